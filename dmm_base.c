@@ -4,6 +4,7 @@
 
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/epoll.h>
 #include <time.h>
@@ -229,8 +230,67 @@ static int dmm_hook_get(dmm_node_p node, enum DMM_HOOK_DIRECTION dir, const char
     return 0;
 }
 
-/* Add dsthook to list of peers in srchook. */
-static int dmm_hook_addpeer(dmm_hook_p hook, dmm_hook_p peerhook)
+static int dmm_sensorrange_cmp(const void *lhs, const void *rhs)
+{
+    const struct dmm_sensorrange *l = lhs, *r = rhs;
+
+    if (l->first != r->first)
+        return (l->first < r->first) ? -1 : 1;
+    return 0;
+}
+
+/*
+ * Copy nmask ranges from mask to dst sorting them and
+ * merging overlapping and adjacent ranges
+ * Returns number of ranges in dst
+ */
+static size_t dmm_sensormask_normalize(struct dmm_sensorrange *dst, const struct dmm_sensorrange *mask, size_t nmask)
+{
+    size_t i, n;
+
+    if (nmask == 0)
+        return 0;
+
+    memcpy(dst, mask, nmask * sizeof(*dst));
+    qsort(dst, nmask, sizeof(*dst), dmm_sensorrange_cmp);
+    for (i = 1, n = 0; i < nmask; ++i) {
+        if (dst[n].last == (dmm_sensorid_t)-1 || dst[i].first <= dst[n].last + 1) {
+            if (dst[i].last > dst[n].last)
+                dst[n].last = dst[i].last;
+        } else {
+            dst[++n] = dst[i];
+        }
+    }
+    return n + 1;
+}
+
+static inline int dmm_sensormask_match(const struct dmm_sensorrange *mask, size_t nmask, dmm_sensorid_t id)
+{
+    size_t lo = 0, hi = nmask, mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (id < mask[mid].first)
+            hi = mid;
+        else if (id > mask[mid].last)
+            lo = mid + 1;
+        else
+            return 1;
+    }
+    return 0;
+}
+
+static inline int dmm_sensormask_equal(const struct dmm_hookpeer *lhs, const struct dmm_hookpeer *rhs)
+{
+    return lhs->hp_nmask == rhs->hp_nmask &&
+           memcmp(lhs->hp_mask, rhs->hp_mask, lhs->hp_nmask * sizeof(lhs->hp_mask[0])) == 0;
+}
+
+/*
+ * Add dsthook to list of peers in srchook.
+ * If nmask > 0 only sensors within mask ranges are passed to peerhook
+ */
+static int dmm_hook_addpeer(dmm_hook_p hook, dmm_hook_p peerhook, const struct dmm_sensorrange *mask, size_t nmask)
 {
     struct dmm_hookpeer *p;
 
@@ -242,11 +302,12 @@ static int dmm_hook_addpeer(dmm_hook_p hook, dmm_hook_p peerhook)
         }
     }
 
-    if ((p = (struct dmm_hookpeer *)DMM_MALLOC(sizeof(*p))) == NULL) {
+    if ((p = (struct dmm_hookpeer *)DMM_MALLOC(sizeof(*p) + nmask * sizeof(p->hp_mask[0]))) == NULL) {
         dmm_debug("No memory%s", "");
         return ENOMEM;
     }
     p->hp_peer = peerhook;
+    p->hp_nmask = dmm_sensormask_normalize(p->hp_mask, mask, nmask);
     LIST_INSERT_HEAD(&(hook->hk_peers), p, hp_peerlist);
     dmm_debug(DMM_PRIPEER ": added", DMM_PEERINFO(hook, peerhook));
     /* Hook holds a reference to its hp_peer */
@@ -393,9 +454,12 @@ int dmm_node_unname(dmm_node_p node)
  * Connect two nodes via given hooks (create if necessary)
  * Connection is made between outhook srchookname of node srcnode to
  *      inhook dsthookname of dstnode
+ * If nmask > 0 only datanodes with sensor ids within mask ranges
+ * are passed via the connection
  * Works only for valid nodes
  * */
-static int dmm_node_connect(dmm_node_p srcnode, const char *srchookname, dmm_node_p dstnode, const char * dsthookname)
+static int dmm_node_connect(dmm_node_p srcnode, const char *srchookname, dmm_node_p dstnode, const char * dsthookname,
+                            const struct dmm_sensorrange *mask, size_t nmask)
 {
     dmm_hook_p srchook, dsthook;
     int err;
@@ -412,9 +476,9 @@ static int dmm_node_connect(dmm_node_p srcnode, const char *srchookname, dmm_nod
         return err;
     }
 
-    err = dmm_hook_addpeer(srchook, dsthook);
+    err = dmm_hook_addpeer(srchook, dsthook, mask, nmask);
     if (err == 0) {
-        err = dmm_hook_addpeer(dsthook, srchook);
+        err = dmm_hook_addpeer(dsthook, srchook, NULL, 0);
         if (err != 0) {
             dmm_hook_rmpeer(srchook, dsthook);
         }
@@ -588,6 +652,89 @@ static int dmm_data_passtohook(dmm_data_p data, dmm_hook_p hook)
     return res;
 }
 
+/*
+ * Implementation of DMM_DATA_SELECT
+ */
+int dmm_data_select(dmm_data_p data, dmm_dnselect_t keep, void *arg, dmm_data_p *resultp)
+{
+    dmm_data_p newdata;
+    dmm_datanode_p dn, run, out;
+    size_t len;
+
+    *resultp = NULL;
+    for (dn = DMM_DATA_NODES(data); !DMM_DN_ISEND(dn); DMM_DN_ADVANCE(dn))
+        if (!keep(dn, arg))
+            break;
+
+    /* Nothing to drop, use data as is */
+    if (DMM_DN_ISEND(dn)) {
+        DMM_DATA_REF(data);
+        *resultp = data;
+        return 0;
+    }
+
+    /*
+     * At least dn is dropped so the rest of data is enough,
+     * it is shrinked later if more datanodes are dropped
+     */
+    newdata = DMM_DATA_CREATE_RAW(0, DMM_DATA_SIZE(data) - DMM_DN_SIZE(dn));
+    if (newdata == NULL)
+        return ENOMEM;
+    len = (char *)dn - (char *)DMM_DATA_NODES(data);
+    memcpy(DMM_DATA_NODES(newdata), DMM_DATA_NODES(data), len);
+    out = (dmm_datanode_p)((char *)DMM_DATA_NODES(newdata) + len);
+
+    /* Copy runs of consecutive kept datanodes at once */
+    run = NULL;
+    for (DMM_DN_ADVANCE(dn); ; DMM_DN_ADVANCE(dn)) {
+        if (!DMM_DN_ISEND(dn) && keep(dn, arg)) {
+            if (run == NULL)
+                run = dn;
+            continue;
+        }
+        if (run != NULL) {
+            len = (char *)dn - (char *)run;
+            memcpy(out, run, len);
+            out = (dmm_datanode_p)((char *)out + len);
+            run = NULL;
+        }
+        if (DMM_DN_ISEND(dn))
+            break;
+    }
+    DMM_DN_MKEND(out);
+
+    len = (char *)out - (char *)DMM_DATA_NODES(newdata);
+    if (len == 0) {
+        DMM_DATA_UNREF(newdata);
+        return 0;
+    }
+    if (len < DMM_DATA_SIZE(newdata))
+        DMM_DATA_RESIZE(newdata, 0, len);
+    *resultp = newdata;
+    return 0;
+}
+
+static int dmm_hookpeer_keep(dmm_datanode_p dn, void *arg)
+{
+    struct dmm_hookpeer *hp = (struct dmm_hookpeer *)arg;
+
+    return dmm_sensormask_match(hp->hp_mask, hp->hp_nmask, dn->dn_sensor);
+}
+
+/*
+ * Return data with only datanodes matching mask of hp (with reference acquired)
+ * If all datanodes match, data itself is returned without copying.
+ * NULL is returned if no datanode matches
+ */
+static dmm_data_p dmm_data_mask(dmm_data_p data, struct dmm_hookpeer *hp)
+{
+    dmm_data_p masked;
+
+    if (dmm_data_select(data, dmm_hookpeer_keep, hp, &masked) != 0)
+        dmm_log(DMM_LOG_CRIT, "Cannot allocate memory for masked data");
+    return masked;
+}
+
 /*
  * Send data via outhook hook.
  * Must be called by node which owns hook via
@@ -595,7 +742,8 @@ static int dmm_data_passtohook(dmm_data_p data, dmm_hook_p hook)
  */
 void dmm_data_send(dmm_data_p data, dmm_hook_p hook)
 {
-    struct dmm_hookpeer *hp;
+    struct dmm_hookpeer *hp, *masked_hp = NULL;
+    dmm_data_p masked = NULL;
 
     assert(hook != NULL);
     assert(DMM_HOOK_ISOUT(hook));
@@ -607,9 +755,25 @@ void dmm_data_send(dmm_data_p data, dmm_hook_p hook)
     DMM_HOOK_REF(hook);
 
     LIST_FOREACH(hp, &(hook->hk_peers), hp_peerlist) {
-        DMM_DATA_REF(data);
-        dmm_data_passtohook(data, hp->hp_peer);
+        if (hp->hp_nmask == 0) {
+            DMM_DATA_REF(data);
+            dmm_data_passtohook(data, hp->hp_peer);
+            continue;
+        }
+        /* Consecutive peers with the same mask share masked data */
+        if (masked_hp == NULL || !dmm_sensormask_equal(masked_hp, hp)) {
+            if (masked != NULL)
+                DMM_DATA_UNREF(masked);
+            masked = dmm_data_mask(data, hp);
+            masked_hp = hp;
+        }
+        if (masked != NULL) {
+            DMM_DATA_REF(masked);
+            dmm_data_passtohook(masked, hp->hp_peer);
+        }
     }
+    if (masked != NULL)
+        DMM_DATA_UNREF(masked);
 
     DMM_HOOK_UNREF(hook);
 }
@@ -718,10 +882,11 @@ static int dmm_msg_process_generic(dmm_node_p node, dmm_msg_p msg)
     }
 
     case DMM_MSG_NODECONNECT: {
-        struct dmm_msg_nodeconnect *connect_data;
+        struct dmm_msg_nodeconnect_masked *connect_data;
         dmm_node_p dstnode;
+        size_t i, nmask;
 
-        assert(msg->cm_len == sizeof(*connect_data));
+        assert(msg->cm_len >= sizeof(connect_data->conn));
 
         resp = dmm_msg_create_resp(0, msg, 0);
         if (resp == NULL) {
@@ -729,10 +894,25 @@ static int dmm_msg_process_generic(dmm_node_p node, dmm_msg_p msg)
             break;
         }
 
-        connect_data = DMM_MSG_DATA(msg, struct dmm_msg_nodeconnect);
-        dstnode = dmm_node_addr2ref(connect_data->dstnode);
+        connect_data = DMM_MSG_DATA(msg, struct dmm_msg_nodeconnect_masked);
+        nmask = (msg->cm_len - sizeof(connect_data->conn)) / sizeof(connect_data->mask[0]);
+        if (sizeof(connect_data->conn) + nmask * sizeof(connect_data->mask[0]) != msg->cm_len) {
+            err = EINVAL;
+            break;
+        }
+        for (i = 0; i < nmask; ++i) {
+            if (connect_data->mask[i].first > connect_data->mask[i].last) {
+                err = EINVAL;
+                break;
+            }
+        }
+        if (err != 0)
+            break;
+
+        dstnode = dmm_node_addr2ref(connect_data->conn.dstnode);
         if (dstnode != NULL) {
-            err = dmm_node_connect(node, connect_data->srchook, dstnode, connect_data->dsthook);
+            err = dmm_node_connect(node, connect_data->conn.srchook, dstnode, connect_data->conn.dsthook,
+                                   connect_data->mask, nmask);
             DMM_NODE_UNREF(dstnode);
         } else {
             err = EINVAL;
@@ -180,9 +180,22 @@ struct dmm_hook {
     dmm_refnum_t hk_refs;
 };
 
+/* Range of sensor ids from first to last inclusive */
+struct dmm_sensorrange {
+    dmm_sensorid_t first;
+    dmm_sensorid_t last;
+};
+
 struct dmm_hookpeer {
     dmm_hook_p hp_peer;
     LIST_ENTRY(dmm_hookpeer) hp_peerlist;
+    /*
+     * Sensor mask of connection: only datanodes with sensor ids
+     * within hp_mask ranges are passed to peer. Ranges are sorted
+     * and do not overlap. hp_nmask == 0 means no mask (pass everything).
+     */
+    size_t hp_nmask;
+    struct dmm_sensorrange hp_mask[];
 };
 
 /* Hook flags bits */
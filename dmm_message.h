@@ -53,6 +53,15 @@ struct dmm_data {
 
 #define DMM_DATA_RESIZE(data, numnodes, datalen)        \
     dmm_data_resize((data), (numnodes), (datalen))
+
+/*
+ * Select datanodes of data for which keep(dn, arg) is nonzero.
+ * *resultp is set to data itself (with reference acquired) if all
+ * datanodes are kept, to new data with kept datanodes if some are
+ * dropped and to NULL if none is kept. Returns ENOMEM on allocation failure
+ */
+#define DMM_DATA_SELECT(data, keep, arg, resultp)       \
+    dmm_data_select((data), (keep), (arg), (resultp))
 #if 0
 #define DMM_DATA_RM(data)   \
     dmm_data_rm(data)
@@ -60,12 +69,18 @@ struct dmm_data {
 
 #define DMM_DATA_REF(data)      dmm_data_ref((data))
 #define DMM_DATA_UNREF(data)    dmm_data_unref((data))
+/*
+ * True if somebody else holds a reference to data.
+ * Data which is not shared after DMM_DATA_SEND returns
+ * may be reused by the sender.
+ */
+#define DMM_DATA_ISSHARED(data) ((data)->da_refs > 1)
 
 #define DMM_DATA_NODES(data)    ((dmm_datanode_p)((data)->da_nodes + 0))
 // Return data length w/o terminating node
 // This value is suitable for passing to
 // DMM_DATA_CREATE_RAW
-#define DMM_DATA_SIZE(data)     ((data)->da_len - sizeof(dmm_datanode))
+#define DMM_DATA_SIZE(data)     ((data)->da_len - sizeof(struct dmm_datanode))
 // Return FULL data length INCLUDING terminating node
 #define DMM_DATA_FULLSIZE(data) ((data)->da_len + 0)
 
@@ -74,6 +89,8 @@ struct dmm_data {
  */
 dmm_data_p dmm_data_create_raw(size_t numnodes, size_t datalen);
 int dmm_data_resize(dmm_data_p data, size_t numnodes, size_t datalen);
+typedef int (*dmm_dnselect_t)(dmm_datanode_p dn, void *arg);
+int dmm_data_select(dmm_data_p data, dmm_dnselect_t keep, void *arg, dmm_data_p *resultp);
 
 static inline void dmm_data_ref(dmm_data_p data)
 {
@@ -192,7 +209,7 @@ enum {
 #define DMM_MSG_COPY(msg)   \
     dmm_msg_copy(msg)
 
-/* Send control message */
+/* Send control message, msg is freed even if it cannot be delivered */
 #define DMM_MSG_SEND_ID(dst, msg)  \
     dmm_msg_send_id((dst), (msg))
 /* Send control message via node name */
@@ -215,16 +232,20 @@ int dmm_msg_send_ref(dmm_node_p node, dmm_msg_p msg);
 static inline int dmm_msg_send_id(dmm_id_t dst, dmm_msg_p msg)
 {
     dmm_node_p node;
-    if ((node = dmm_node_id2ref(dst)) == NULL)
+    if ((node = dmm_node_id2ref(dst)) == NULL) {
+        dmm_msg_free(msg);
         return ENOENT;
+    }
     return dmm_msg_send_ref(node, msg);
 }
 
 static inline int dmm_msg_send_addr(const char * addr, dmm_msg_p msg)
 {
     dmm_node_p node;
-    if ((node = dmm_node_addr2ref(addr)) == NULL)
+    if ((node = dmm_node_addr2ref(addr)) == NULL) {
+        dmm_msg_free(msg);
         return ENOENT;
+    }
     return dmm_msg_send_ref(node, msg);
 }
 
@@ -285,6 +306,16 @@ struct dmm_msg_nodeconnect {
     char dsthook[DMM_HOOKNAMESIZE];
 };
 
+/*
+ * dmm_msg_nodeconnect may be followed by sensor mask ranges,
+ * then only datanodes with sensor ids in the ranges are passed
+ * via the connection. Mask ranges may be unsorted and overlap.
+ */
+struct dmm_msg_nodeconnect_masked {
+    struct dmm_msg_nodeconnect conn;
+    struct dmm_sensorrange     mask[];
+};
+
 /*
  * dmm_msg_nodedisconnect instructs to break connection between
  * out hook srchook of message receiver and
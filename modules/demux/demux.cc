@@ -4,20 +4,185 @@
 
 #include "demux.h"
 
+#include <algorithm>
+#include <arpa/inet.h>
+#include <deque>
 #include <errno.h>
-#include <string>
+#include <netinet/in.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <unordered_map>
+#include <vector>
 
 #include "dmm_base.h"
 #include "dmm_log.h"
 #include "dmm_message.h"
 
+/*
+ * Key bytes which are not owned by the key_view. Used to look up
+ * string keys directly in datanode contents without copying them
+ */
+struct key_view {
+    const char *data;
+    size_t      len;
+};
+
+struct key_view_hash {
+    size_t operator()(const key_view &k) const
+    {
+        // FNV-1a
+        size_t h = 14695981039346656037ULL;
+        for (size_t i = 0; i < k.len; ++i) {
+            h ^= static_cast<unsigned char>(k.data[i]);
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+};
+
+struct key_view_equal {
+    bool operator()(const key_view &lhs, const key_view &rhs) const
+    {
+        return lhs.len == rhs.len && memcmp(lhs.data, rhs.data, lhs.len) == 0;
+    }
+};
+
+/* Output hook data is routed to. Exists even if hook is not connected yet */
+struct target {
+    char       name[DMM_HOOKNAMESIZE];
+    dmm_hook_p hook;
+};
+
+struct range {
+    dmm_sensorid_t first;
+    dmm_sensorid_t last;
+    size_t         target;
+};
+
+static const size_t no_target = static_cast<size_t>(-1);
+
 struct pvt_data {
-    dmm_sensorid_t id; // Sensor id to search in data for demux'ing
-    std::unordered_map<std::string, dmm_hook_p> map;
+    dmm_sensorid_t         id; // Sensor id to search in data for demux'ing
+    enum dmm_demux_keytype keytype;
+    uint32_t               flags;
+    // std::deque does not move elements so names can be referenced by key_views
+    std::deque<target> targets;
+    std::unordered_map<key_view, size_t, key_view_hash, key_view_equal> names;
+    std::unordered_map<uint64_t, size_t> keys;
+    // Sorted by first, ranges do not overlap
+    std::vector<range> ranges;
+
+    // Scratch space for splitting data by ranges, reused between data
+    std::vector<size_t> node_target;
+    std::vector<dmm_size_t> target_len;
+    std::vector<dmm_data_p> target_data;
+    std::vector<dmm_datanode_p> target_pos;
 };
 
+static size_t find_target(struct pvt_data *pvt, const char *name)
+{
+    key_view kv = {name, strnlen(name, DMM_HOOKNAMESIZE - 1)};
+    auto it = pvt->names.find(kv);
+    if (it != pvt->names.end())
+        return it->second;
+
+    pvt->targets.emplace_back();
+    target &t = pvt->targets.back();
+    memcpy(t.name, kv.data, kv.len);
+    t.name[kv.len] = '\0';
+    t.hook = NULL;
+    pvt->names[key_view{t.name, kv.len}] = pvt->targets.size() - 1;
+
+    return pvt->targets.size() - 1;
+}
+
+static size_t find_range_target(struct pvt_data *pvt, dmm_sensorid_t id)
+{
+    auto it = std::upper_bound(pvt->ranges.begin(), pvt->ranges.end(), id,
+                               [](dmm_sensorid_t id, const range &r) { return id < r.first; });
+    if (it == pvt->ranges.begin())
+        return no_target;
+    --it;
+    return (id <= it->last) ? it->target : no_target;
+}
+
+static int add_range(struct pvt_data *pvt, struct dmm_msg_demux_addrange *ar)
+{
+    if (ar->first > ar->last)
+        return EINVAL;
+
+    auto it = std::upper_bound(pvt->ranges.begin(), pvt->ranges.end(), ar->first,
+                               [](dmm_sensorid_t id, const range &r) { return id < r.first; });
+    if (it != pvt->ranges.end() && it->first <= ar->last)
+        return EEXIST;
+    if (it != pvt->ranges.begin() && (it - 1)->last >= ar->first)
+        return EEXIST;
+
+    ar->hook[sizeof(ar->hook) - 1] = '\0';
+    pvt->ranges.insert(it, range{ar->first, ar->last, find_target(pvt, ar->hook)});
+    return 0;
+}
+
+/*
+ * Get numeric key from key datanode contents
+ * Returns false if datanode does not contain a valid key
+ */
+static bool numeric_key(struct pvt_data *pvt, dmm_datanode_p dn, uint64_t *key)
+{
+    switch (pvt->keytype) {
+    case DEMUX_KEY_UINT:
+        switch (DMM_DN_LEN(dn)) {
+        case sizeof(uint8_t):
+            *key = *DMM_DN_DATA(dn, uint8_t);
+            return true;
+        case sizeof(uint16_t): {
+            uint16_t v;
+            memcpy(&v, dn->dn_data, sizeof(v));
+            *key = v;
+            return true;
+        }
+        case sizeof(uint32_t): {
+            uint32_t v;
+            memcpy(&v, dn->dn_data, sizeof(v));
+            *key = v;
+            return true;
+        }
+        case sizeof(uint64_t):
+            memcpy(key, dn->dn_data, sizeof(*key));
+            return true;
+        default:
+            return false;
+        }
+
+    case DEMUX_KEY_INADDR: {
+        sa_family_t family;
+        if (DMM_DN_LEN(dn) < sizeof(family))
+            return false;
+        memcpy(&family, dn->dn_data + offsetof(struct sockaddr, sa_family), sizeof(family));
+        if (family == AF_INET && DMM_DN_LEN(dn) >= sizeof(struct sockaddr_in)) {
+            struct in_addr addr;
+            memcpy(&addr, dn->dn_data + offsetof(struct sockaddr_in, sin_addr), sizeof(addr));
+            *key = ntohl(addr.s_addr);
+            return true;
+        } else if (family == AF_INET6 && DMM_DN_LEN(dn) >= sizeof(struct sockaddr_in6)) {
+            struct in6_addr addr;
+            uint32_t addr4;
+            memcpy(&addr, dn->dn_data + offsetof(struct sockaddr_in6, sin6_addr), sizeof(addr));
+            // XXX Only IPv4-mapped addresses (dual stack sockets) are supported
+            if (!IN6_IS_ADDR_V4MAPPED(&addr))
+                return false;
+            memcpy(&addr4, addr.s6_addr + 12, sizeof(addr4));
+            *key = ntohl(addr4);
+            return true;
+        }
+        return false;
+    }
+
+    default:
+        return false;
+    }
+}
+
 static int ctor(dmm_node_p node)
 {
     struct pvt_data *pvt;
@@ -26,6 +191,8 @@ static int ctor(dmm_node_p node)
         return ENOMEM;
     new(pvt) struct pvt_data;
     pvt->id = 0;
+    pvt->keytype = DEMUX_KEY_STRING;
+    pvt->flags = 0;
     DMM_NODE_SETPRIVATE(node, pvt);
     return 0;
 }
@@ -47,7 +214,7 @@ static int newhook(dmm_hook_p hook)
         else
             return 0;
     }
-    pvt->map[DMM_HOOK_NAME(hook)] = hook;
+    pvt->targets[find_target(pvt, DMM_HOOK_NAME(hook))].hook = hook;
 
     return 0;
 }
@@ -56,59 +223,147 @@ static void rmhook(dmm_hook_p hook)
 {
     struct pvt_data *pvt = (struct pvt_data *)DMM_NODE_PRIVATE(DMM_HOOK_NODE(hook));
     if (DMM_HOOK_ISOUT(hook)) {
-        pvt->map.erase(DMM_HOOK_NAME(hook));
+        pvt->targets[find_target(pvt, DMM_HOOK_NAME(hook))].hook = NULL;
     }
 }
 
-static int rcvdata(dmm_hook_p hook, dmm_data_p data) {
+/* Send data without key datanode dn to hook */
+static int send_stripped(dmm_data_p data, dmm_datanode_p dn, dmm_hook_p hook)
+{
     dmm_data_p newdata;
-    dmm_datanode_p dn, dn_src, dn_tgt;
-    size_t len;
-    int err = 0;
-    struct pvt_data *pvt = (struct pvt_data *)DMM_NODE_PRIVATE(DMM_HOOK_NODE(hook));
-    decltype(pvt->map)::iterator el;
+    size_t prefix_len, suffix_len;
+
+    /*
+     * We subtract additional sizeof(dmm_datanode) to compensate for terminator node size
+     * which is added by DMM_DATA_CREATE_RAW
+     */
+    newdata = DMM_DATA_CREATE_RAW(0, data->da_len - DMM_DN_SIZE(dn) - sizeof(struct dmm_datanode));
+    if (newdata == NULL)
+        return ENOMEM;
+
+    /* Copy everything before and after the key node (including terminator) */
+    prefix_len = (char *)dn - data->da_nodes;
+    suffix_len = data->da_len - prefix_len - DMM_DN_SIZE(dn);
+    memcpy(newdata->da_nodes, data->da_nodes, prefix_len);
+    memcpy(newdata->da_nodes + prefix_len, DMM_DN_NEXT(dn), suffix_len);
 
-    if (pvt->map.empty() || pvt->id == 0)
-        goto finish;
+    DMM_DATA_SEND(newdata, hook);
+    DMM_DATA_UNREF(newdata);
+    return 0;
+}
+
+static int demux_by_key(struct pvt_data *pvt, dmm_data_p data)
+{
+    dmm_datanode_p dn;
+    size_t t;
 
     for (dn = DMM_DATA_NODES(data); !DMM_DN_ISEND(dn); DMM_DN_ADVANCE(dn))
         if (dn->dn_sensor == pvt->id)
             break;
 
     if (DMM_DN_ISEND(dn))
-        goto finish;
+        return 0;
+
+    if (pvt->keytype == DEMUX_KEY_STRING) {
+        auto el = pvt->names.find(key_view{dn->dn_data, strnlen(dn->dn_data, dn->dn_len)});
+        if (el == pvt->names.end())
+            return 0;
+        t = el->second;
+    } else {
+        uint64_t key;
+        if (!numeric_key(pvt, dn, &key))
+            return 0;
+        auto el = pvt->keys.find(key);
+        if (el == pvt->keys.end())
+            return 0;
+        t = el->second;
+    }
 
-    len = strnlen(dn->dn_data, dn->dn_len);
-    el = pvt->map.find(std::string(dn->dn_data, len));
-    if (el == pvt->map.end())
-        goto finish;
+    if (pvt->targets[t].hook == NULL)
+        return 0;
 
-    /*
-     * We subtract additional sizeof(dmm_datanode) to compensate for terminator node size
-     * which is added by DMM_DATA_CREATE_RAW
-     */
-    newdata = DMM_DATA_CREATE_RAW(0, data->da_len - DMM_DN_SIZE(dn) - sizeof(struct dmm_datanode));
-    if (newdata == NULL) {
-        err = ENOMEM;
-        goto finish;
+    if (pvt->flags & DMM_DEMUX_KEEPKEY) {
+        DMM_DATA_SEND(data, pvt->targets[t].hook);
+        return 0;
     }
+    return send_stripped(data, dn, pvt->targets[t].hook);
+}
 
-    dn_tgt = DMM_DATA_NODES(newdata);
-    for (dn_src = DMM_DATA_NODES(data); dn_src != dn; DMM_DN_ADVANCE(dn_src)) {
-        DMM_DN_FILL_ADVANCE(dn_tgt, dn_src->dn_sensor, dn_src->dn_len, dn_src->dn_data);
+static int demux_by_ranges(struct pvt_data *pvt, dmm_data_p data)
+{
+    dmm_datanode_p dn;
+    size_t t, num_targets = pvt->targets.size(), used_targets = 0, last_target = no_target;
+    bool all_routed = true;
+    int err = 0;
+
+    pvt->target_len.assign(num_targets, 0);
+    pvt->node_target.clear();
+    for (dn = DMM_DATA_NODES(data); !DMM_DN_ISEND(dn); DMM_DN_ADVANCE(dn)) {
+        t = find_range_target(pvt, dn->dn_sensor);
+        if (t != no_target && pvt->targets[t].hook == NULL)
+            t = no_target;
+        pvt->node_target.push_back(t);
+        if (t == no_target) {
+            all_routed = false;
+            continue;
+        }
+        if (pvt->target_len[t] == 0) {
+            ++used_targets;
+            last_target = t;
+        }
+        pvt->target_len[t] += DMM_DN_SIZE(dn);
     }
-    /* Skip node on which we do demux'ing */
-    DMM_DN_ADVANCE(dn_src);
-    /* Copy the remainder of the data */
-    for (; !DMM_DN_ISEND(dn_src); DMM_DN_ADVANCE(dn_src)) {
-        DMM_DN_FILL_ADVANCE(dn_tgt, dn_src->dn_sensor, dn_src->dn_len, dn_src->dn_data);
+
+    if (used_targets == 0)
+        return 0;
+
+    /* Whole data goes to single hook, no need to copy it */
+    if (used_targets == 1 && all_routed) {
+        DMM_DATA_SEND(data, pvt->targets[last_target].hook);
+        return 0;
     }
-    DMM_DN_MKEND(dn_tgt);
 
-    DMM_DATA_SEND(newdata, el->second);
-    DMM_DATA_UNREF(newdata);
+    pvt->target_data.assign(num_targets, NULL);
+    pvt->target_pos.resize(num_targets);
+    for (t = 0; t < num_targets; ++t) {
+        if (pvt->target_len[t] == 0)
+            continue;
+        if ((pvt->target_data[t] = DMM_DATA_CREATE_RAW(0, pvt->target_len[t])) == NULL) {
+            err = ENOMEM;
+            continue;
+        }
+        pvt->target_pos[t] = DMM_DATA_NODES(pvt->target_data[t]);
+    }
+
+    size_t i = 0;
+    for (dn = DMM_DATA_NODES(data); !DMM_DN_ISEND(dn); DMM_DN_ADVANCE(dn), ++i) {
+        t = pvt->node_target[i];
+        if (t == no_target || pvt->target_data[t] == NULL)
+            continue;
+        memcpy(pvt->target_pos[t], dn, DMM_DN_SIZE(dn));
+        DMM_DN_ADVANCE(pvt->target_pos[t]);
+    }
+
+    for (t = 0; t < num_targets; ++t) {
+        if (pvt->target_data[t] == NULL)
+            continue;
+        DMM_DN_MKEND(pvt->target_pos[t]);
+        DMM_DATA_SEND(pvt->target_data[t], pvt->targets[t].hook);
+        DMM_DATA_UNREF(pvt->target_data[t]);
+    }
+
+    return err;
+}
+
+static int rcvdata(dmm_hook_p hook, dmm_data_p data) {
+    int err = 0;
+    struct pvt_data *pvt = (struct pvt_data *)DMM_NODE_PRIVATE(DMM_HOOK_NODE(hook));
+
+    if (pvt->id != 0)
+        err = demux_by_key(pvt, data);
+    else if (!pvt->ranges.empty())
+        err = demux_by_ranges(pvt, data);
 
-finish:
     DMM_DATA_UNREF(data);
     return err;
 }
@@ -144,6 +399,47 @@ static int rcvmsg(dmm_node_p node, dmm_msg_p msg)
             break;
         }
 
+        case DMM_MSG_DEMUX_SETKEYTYPE: {
+            struct dmm_msg_demux_setkeytype *kt = DMM_MSG_DATA(msg, struct dmm_msg_demux_setkeytype);
+            if (msg->cm_len != sizeof(*kt) ||
+                kt->type < DEMUX_KEY_MIN || kt->type > DEMUX_KEY_MAX) {
+                err = EINVAL;
+            } else {
+                pvt->keytype = kt->type;
+                pvt->flags = kt->flags;
+            }
+            CREATE_SEND_EMPTY_RESP();
+            break;
+        }
+
+        case DMM_MSG_DEMUX_ADDKEY: {
+            struct dmm_msg_demux_addkey *ak = DMM_MSG_DATA(msg, struct dmm_msg_demux_addkey);
+            if (msg->cm_len != sizeof(*ak)) {
+                err = EINVAL;
+            } else {
+                ak->hook[sizeof(ak->hook) - 1] = '\0';
+                pvt->keys[ak->key] = find_target(pvt, ak->hook);
+            }
+            CREATE_SEND_EMPTY_RESP();
+            break;
+        }
+
+        case DMM_MSG_DEMUX_ADDRANGE: {
+            if (msg->cm_len != sizeof(struct dmm_msg_demux_addrange))
+                err = EINVAL;
+            else
+                err = add_range(pvt, DMM_MSG_DATA(msg, struct dmm_msg_demux_addrange));
+            CREATE_SEND_EMPTY_RESP();
+            break;
+        }
+
+        case DMM_MSG_DEMUX_CLEAR: {
+            pvt->keys.clear();
+            pvt->ranges.clear();
+            CREATE_SEND_EMPTY_RESP();
+            break;
+        }
+
         default:
             err = ENOTSUP;
             break;
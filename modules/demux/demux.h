@@ -5,6 +5,7 @@
 #ifndef DEMUX_H_
 #define DEMUX_H_
 
+#include "dmm_base.h"
 #include "dmm_types.h"
 
 enum {
@@ -14,10 +15,57 @@ enum {
 enum {
     DMM_MSG_DEMUX_SET = 1,
     DMM_MSG_DEMUX_GET,
+    DMM_MSG_DEMUX_SETKEYTYPE,
+    DMM_MSG_DEMUX_ADDKEY,
+    DMM_MSG_DEMUX_ADDRANGE,
+    DMM_MSG_DEMUX_CLEAR,
 };
 
+/*
+ * Set sensor id of key datanode. Data is routed according
+ * to the key datanode contents, see enum dmm_demux_keytype.
+ * If id is 0 data is split by sensor id ranges (DMM_MSG_DEMUX_ADDRANGE)
+ */
 struct dmm_msg_demux_set {
     dmm_id_t id;
 };
 
+enum dmm_demux_keytype {
+    /* Key is a string equal to the name of output hook (default) */
+    DEMUX_KEY_STRING,
+    /* Key is an unsigned integer 1, 2, 4 or 8 bytes long */
+    DEMUX_KEY_UINT,
+    /*
+     * Key is a struct sockaddr (e.g. DMM_SRCHOST), IPv4 address
+     * in host byte order is used as a key
+     */
+    DEMUX_KEY_INADDR,
+
+    DEMUX_KEY_MIN = DEMUX_KEY_STRING,
+    DEMUX_KEY_MAX = DEMUX_KEY_INADDR,
+};
+
+enum {
+    /* Forward data as is, without removing the key datanode (no copying) */
+    DMM_DEMUX_KEEPKEY = 0x00000001,
+};
+
+struct dmm_msg_demux_setkeytype {
+    enum dmm_demux_keytype type;
+    uint32_t               flags;
+};
+
+/* Route data with numeric key to hook (DEMUX_KEY_UINT and DEMUX_KEY_INADDR) */
+struct dmm_msg_demux_addkey {
+    uint64_t key;
+    char     hook[DMM_HOOKNAMESIZE];
+};
+
+/* Send datanodes with sensor id in [first, last] to hook */
+struct dmm_msg_demux_addrange {
+    dmm_sensorid_t first;
+    dmm_sensorid_t last;
+    char           hook[DMM_HOOKNAMESIZE];
+};
+
 #endif /* DEMUX_H_ */
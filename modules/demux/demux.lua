@@ -0,0 +1,91 @@
+-- SPDX-License-Identifier: BSD-2-Clause-Views
+-- Copyright (c) 2013-2023
+--   Research Computing Center Lomonosov Moscow State University
+
+local dmm = require('dmm')
+
+assert(dmm.require_interface('demux', 'll'))
+
+local Demux = dmm.Module:new_type('demux')
+
+--! @brief Set sensor id of key datanode
+--! id == 0 makes demux split data by sensor id ranges (see Demux:addrange)
+function Demux:set(id)
+  local msg, set = dmm.msg_create {
+    payload_type = 'struct dmm_msg_demux_set',
+    type = ffi.C.DMM_MSGTYPE_DEMUX,
+    cmd = ffi.C.DMM_MSG_DEMUX_SET,
+  }
+  set.id = id
+  dmm.msg_send(self.nodeid, msg)
+end
+
+local keytypes = {
+  string = ffi.C.DEMUX_KEY_STRING,
+  uint   = ffi.C.DEMUX_KEY_UINT,
+  inaddr = ffi.C.DEMUX_KEY_INADDR,
+}
+
+--! @brief Set how key datanode is interpreted
+--! @param keytype "string" (default, key is output hook name),
+--!                "uint" or "inaddr" (keys are set by Demux:addkey)
+--! @param keepkey if true data is forwarded without removing key datanode
+function Demux:setkeytype(keytype, keepkey)
+  local msg, kt = dmm.msg_create {
+    payload_type = 'struct dmm_msg_demux_setkeytype',
+    type = ffi.C.DMM_MSGTYPE_DEMUX,
+    cmd = ffi.C.DMM_MSG_DEMUX_SETKEYTYPE,
+  }
+  kt.type = assert(keytypes[keytype], "Unknown key type")
+  kt.flags = keepkey and ffi.C.DMM_DEMUX_KEEPKEY or 0
+  dmm.msg_send(self.nodeid, msg)
+end
+
+--! @brief Route data with numeric key to hook
+--! @param key number or IPv4 address string like "10.0.0.1"
+function Demux:addkey(key, hook)
+  if type(key) == 'string' then
+    local octets = {key:match('^(%d+)%.(%d+)%.(%d+)%.(%d+)$')}
+    assert(#octets == 4, "Invalid IPv4 address " .. key)
+    local addr = 0
+    for _, o in ipairs(octets) do
+      o = tonumber(o)
+      assert(o <= 255, "Invalid IPv4 address " .. key)
+      addr = addr * 256 + o
+    end
+    key = addr
+  end
+  local msg, ak = dmm.msg_create {
+    payload_type = 'struct dmm_msg_demux_addkey',
+    type = ffi.C.DMM_MSGTYPE_DEMUX,
+    cmd = ffi.C.DMM_MSG_DEMUX_ADDKEY,
+  }
+  ak.key = key
+  ak.hook = hook
+  dmm.msg_send(self.nodeid, msg)
+end
+
+--! @brief Send datanodes with sensor ids first..last to hook
+function Demux:addrange(first, last, hook)
+  local msg, ar = dmm.msg_create {
+    payload_type = 'struct dmm_msg_demux_addrange',
+    type = ffi.C.DMM_MSGTYPE_DEMUX,
+    cmd = ffi.C.DMM_MSG_DEMUX_ADDRANGE,
+  }
+  ar.first = first
+  ar.last = last
+  ar.hook = hook
+  dmm.msg_send(self.nodeid, msg)
+end
+
+--! @brief Remove all numeric keys and ranges
+function Demux:clear()
+  local msg = dmm.msg_create {
+    len = 0,
+    type = ffi.C.DMM_MSGTYPE_DEMUX,
+    cmd = ffi.C.DMM_MSG_DEMUX_CLEAR,
+  }
+  dmm.msg_send(self.nodeid, msg)
+end
+
+return Demux
@@ -22,6 +22,8 @@
 struct lastval {
     struct timespec ts;
     size_t vector_size;
+    // Whether ts came from a timestamp datanode or from the local clock
+    bool inband_ts;
     std::unique_ptr<char> values;
 };
 
@@ -41,6 +43,8 @@ struct pvt_data {
     std::unordered_map<dmm_sensorid_t, sensor_data> sensors;
     std::unordered_map<dmm_sensorid_t, lastval> last_values;
     dmm_size_t last_data_size;
+    // Sensor id of timestamp datanodes (struct timespec), 0 if not used
+    dmm_sensorid_t ts_id;
 };
 
 template <typename T>
@@ -115,6 +119,7 @@ static int ctor(dmm_node_p node)
     new(pvt) struct pvt_data;
     pvt->outhook = NULL;
     pvt->last_data_size = 0;
+    pvt->ts_id = 0;
     DMM_NODE_SETPRIVATE(node, pvt);
     return 0;
 }
@@ -156,6 +161,7 @@ static int rcvdata(dmm_hook_p hook, dmm_data_p data)
 {
     int err = 0;
     bool step_back_reported = false;
+    bool inband_ts = false;
     dmm_datanode_p src_dn, dst_dn;
     dmm_data_p dst_data;
     size_t cur_data_size, used_data_size;
@@ -177,12 +183,30 @@ static int rcvdata(dmm_hook_p hook, dmm_data_p data)
 
     clock_gettime(CLOCK_MONOTONIC, &cur_time);
     for (src_dn = DMM_DATA_NODES(data); !DMM_DN_ISEND(src_dn); DMM_DN_ADVANCE(src_dn)) {
+        /*
+         * Timestamp datanode sets the time for all datanodes following it
+         * (till the next timestamp datanode). Datanodes preceding the
+         * first timestamp are processed with the arrival time.
+         */
+        if (pvt->ts_id != 0 && src_dn->dn_sensor == pvt->ts_id) {
+            if (DMM_DN_LEN(src_dn) == sizeof(cur_time)) {
+                memcpy(&cur_time, DMM_DN_DATA(src_dn, char), sizeof(cur_time));
+                inband_ts = true;
+            }
+            continue;
+        }
         auto sd_it = pvt->sensors.find(src_dn->dn_sensor);
         if (sd_it == pvt->sensors.end())
             continue;
         size_t vector_size = DMM_DN_LEN(src_dn) / sd_it->second.elem_size;
         auto lv_it = pvt->last_values.find(src_dn->dn_sensor);
-        if (lv_it != pvt->last_values.end() && lv_it->second.vector_size == vector_size) {
+        /*
+         * Local and in-band timestamps can use different clocks,
+         * so the difference between them is meaningless
+         */
+        if (lv_it != pvt->last_values.end() &&
+            lv_it->second.vector_size == vector_size &&
+            lv_it->second.inband_ts == inband_ts) {
             used_data_size =   reinterpret_cast<char *>(dst_dn)
                              - reinterpret_cast<char *>(DMM_DATA_NODES(dst_data))
                              + sizeof(float) * vector_size
@@ -208,6 +232,10 @@ static int rcvdata(dmm_hook_p hook, dmm_data_p data)
                          );
             }
             double time_delta = TIMESPEC_DIFF(&cur_time, &lv_it->second.ts);
+            if (time_delta == 0.0) {
+                // Same sample received twice (e.g. replayed), nothing to derive
+                continue;
+            }
             if (!step_back_reported && time_delta < 0.0) {
                 dmm_log(DMM_LOG_WARN,
                         "Time steps backward, prev time: %ld.%09ld, cur time: %ld.%09ld, delta: %f",
@@ -245,6 +273,7 @@ static int rcvdata(dmm_hook_p hook, dmm_data_p data)
             pvt->last_values[src_dn->dn_sensor] = {
                 cur_time,
                 vector_size,
+                inband_ts,
                 std::unique_ptr<char>(new char[DMM_DN_LEN(src_dn)]),
             };
         }
@@ -305,6 +334,19 @@ static int rcvmsg(dmm_node_p node, dmm_msg_p msg)
             break;
         }
 
+        case DMM_MSG_DERIVATIVE_SETTIMESTAMP: {
+            if (msg->cm_len != sizeof(struct dmm_msg_derivative_settimestamp)) {
+                err = EINVAL;
+                CREATE_SEND_EMPTY_RESP();
+                break;
+            }
+            pvt->ts_id = DMM_MSG_DATA(msg, struct dmm_msg_derivative_settimestamp)->id;
+            // Previous values may have been recorded using another clock
+            pvt->last_values.clear();
+            CREATE_SEND_EMPTY_RESP();
+            break;
+        }
+
         case DMM_MSG_DERIVATIVE_SET: {
             struct dmm_msg_derivative_set *s = DMM_MSG_DATA(msg, struct dmm_msg_derivative_set);
             dmm_size_t num_descs = (msg->cm_len - sizeof(struct dmm_msg_derivative_set)) / sizeof(struct dmm_derivative_sensor_desc);
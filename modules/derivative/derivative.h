@@ -14,6 +14,7 @@ enum {
 enum {
     DMM_MSG_DERIVATIVE_CLEAR = 1,
     DMM_MSG_DERIVATIVE_SET,
+    DMM_MSG_DERIVATIVE_SETTIMESTAMP,
 };
 
 enum dmm_derivative_sensor_type {
@@ -41,4 +42,12 @@ struct dmm_msg_derivative_set {
     struct dmm_derivative_sensor_desc descs[];
 };
 
+/*
+ * Sensor id of datanodes containing struct timespec sample time
+ * (e.g. DMM_RCVDTIMESTAMP from net/ip/recv), 0 to use arrival time
+ */
+struct dmm_msg_derivative_settimestamp {
+    dmm_sensorid_t id;
+};
+
 #endif /* MODULES_DERIVATIVE_DERIVATIVE_H_ */
@@ -17,6 +17,21 @@ function Derivative:clear()
   dmm.msg_send(self.nodeid, msg)
 end
 
+--! @brief Use time from timestamp datanodes instead of data arrival time
+--!
+--! Datanodes with sensor id ts_id must contain struct timespec,
+--! the time applies to datanodes following the timestamp datanode.
+--! ts_id == 0 returns to arrival time
+function Derivative:settimestamp(ts_id)
+  local msg, set = dmm.msg_create{
+    payload_type = 'struct dmm_msg_derivative_settimestamp',
+    type = ffi.C.DMM_MSGTYPE_DERIVATIVE,
+    cmd = ffi.C.DMM_MSG_DERIVATIVE_SETTIMESTAMP,
+  }
+  set.id = ts_id
+  dmm.msg_send(self.nodeid, msg)
+end
+
 -- Auxiliary table in from [DERIVATIVE_CONST] = "C type string"
 -- Used to fill type_format table which is really used
 local output_type_formats = {
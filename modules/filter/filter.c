@@ -0,0 +1,270 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+/*
+ * Filter passes only datanodes with selected sensor ids.
+ *
+ * Sensor actions are kept in a bitmap (bit set means keep) covering
+ * sensor ids from pvt->base to pvt->base + pvt->nbits - 1, sensors
+ * outside the bitmap get the default action.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "dmm_base.h"
+#include "dmm_log.h"
+#include "dmm_message.h"
+
+#include "filter.h"
+
+#define WORD_BITS   64
+
+struct pvt_data {
+    dmm_hook_p             outhook;
+    enum dmm_filter_action default_action;
+    dmm_sensorid_t         base;  // First sensor id in bitmap, multiple of WORD_BITS
+    size_t                 nbits; // Multiple of WORD_BITS
+    uint64_t              *bitmap;
+};
+
+static inline int keep_sensor(struct pvt_data *pvt, dmm_sensorid_t id)
+{
+    size_t bit;
+
+    bit = (size_t)id - pvt->base;
+    if (id < pvt->base || bit >= pvt->nbits)
+        return pvt->default_action == FILTER_KEEP;
+
+    return (pvt->bitmap[bit / WORD_BITS] >> (bit % WORD_BITS)) & 1;
+}
+
+static void filter_clear(struct pvt_data *pvt)
+{
+    DMM_FREE(pvt->bitmap);
+    pvt->bitmap = NULL;
+    pvt->base = 0;
+    pvt->nbits = 0;
+}
+
+/*
+ * Make bitmap cover sensor ids from first to last,
+ * newly covered sensors get the default action
+ */
+static int bitmap_extend(struct pvt_data *pvt, dmm_sensorid_t first, dmm_sensorid_t last)
+{
+    uint64_t fill, *newbitmap;
+    uint64_t newbase, newend;
+    size_t i, offset, nwords;
+
+    newbase = first - first % WORD_BITS;
+    newend = (uint64_t)last - last % WORD_BITS + WORD_BITS;
+    if (pvt->bitmap != NULL) {
+        if (pvt->base < newbase)
+            newbase = pvt->base;
+        if (pvt->base + pvt->nbits > newend)
+            newend = pvt->base + pvt->nbits;
+        if (newbase == pvt->base && newend == pvt->base + pvt->nbits)
+            return 0;
+    }
+    if (newend - newbase > DMM_FILTER_MAXSPAN)
+        return ERANGE;
+
+    nwords = (newend - newbase) / WORD_BITS;
+    if ((newbitmap = DMM_MALLOC(nwords * sizeof(*newbitmap))) == NULL)
+        return ENOMEM;
+
+    fill = (pvt->default_action == FILTER_KEEP) ? ~(uint64_t)0 : 0;
+    for (i = 0; i < nwords; ++i)
+        newbitmap[i] = fill;
+    if (pvt->bitmap != NULL) {
+        offset = (pvt->base - newbase) / WORD_BITS;
+        memcpy(newbitmap + offset, pvt->bitmap, pvt->nbits / WORD_BITS * sizeof(*newbitmap));
+        DMM_FREE(pvt->bitmap);
+    }
+
+    pvt->bitmap = newbitmap;
+    pvt->base = newbase;
+    pvt->nbits = newend - newbase;
+    return 0;
+}
+
+static int filter_set(struct pvt_data *pvt, struct dmm_filter_range *range)
+{
+    size_t bit, last_bit;
+    int err;
+
+    if (range->first > range->last ||
+        range->action < FILTER_ACTION_MIN || range->action > FILTER_ACTION_MAX)
+        return EINVAL;
+
+    if ((err = bitmap_extend(pvt, range->first, range->last)) != 0)
+        return err;
+
+    last_bit = range->last - pvt->base;
+    for (bit = range->first - pvt->base; bit <= last_bit; ++bit) {
+        if (range->action == FILTER_KEEP)
+            pvt->bitmap[bit / WORD_BITS] |= (uint64_t)1 << (bit % WORD_BITS);
+        else
+            pvt->bitmap[bit / WORD_BITS] &= ~((uint64_t)1 << (bit % WORD_BITS));
+    }
+    return 0;
+}
+
+static int ctor(dmm_node_p node)
+{
+    struct pvt_data *pvt;
+    pvt = (struct pvt_data *)DMM_MALLOC(sizeof(*pvt));
+    if (pvt == NULL)
+        return ENOMEM;
+    pvt->outhook = NULL;
+    pvt->default_action = FILTER_KEEP;
+    pvt->base = 0;
+    pvt->nbits = 0;
+    pvt->bitmap = NULL;
+    DMM_NODE_SETPRIVATE(node, pvt);
+    return 0;
+}
+
+static void dtor(dmm_node_p node)
+{
+    struct pvt_data *pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
+    filter_clear(pvt);
+    DMM_FREE(pvt);
+}
+
+static int newhook(dmm_hook_p hook)
+{
+    struct pvt_data *pvt = (struct pvt_data *)DMM_NODE_PRIVATE(DMM_HOOK_NODE(hook));
+
+    if (DMM_HOOK_ISIN(hook) && strcmp(DMM_HOOK_NAME(hook), "in") != 0)
+        return EINVAL;
+    if (DMM_HOOK_ISOUT(hook) && strcmp(DMM_HOOK_NAME(hook), "out") != 0)
+        return EINVAL;
+
+    if (DMM_HOOK_ISOUT(hook))
+        pvt->outhook = hook;
+
+    return 0;
+}
+
+static void rmhook(dmm_hook_p hook)
+{
+    struct pvt_data *pvt = (struct pvt_data *)DMM_NODE_PRIVATE(DMM_HOOK_NODE(hook));
+    if (DMM_HOOK_ISOUT(hook))
+        pvt->outhook = NULL;
+}
+
+static int keep_datanode(dmm_datanode_p dn, void *arg)
+{
+    return keep_sensor((struct pvt_data *)arg, dn->dn_sensor);
+}
+
+static int rcvdata(dmm_hook_p hook, dmm_data_p data) {
+    dmm_data_p newdata;
+    int err = 0;
+    struct pvt_data *pvt = (struct pvt_data *)DMM_NODE_PRIVATE(DMM_HOOK_NODE(hook));
+
+    if (pvt->outhook == NULL)
+        goto finish;
+
+    if ((err = DMM_DATA_SELECT(data, keep_datanode, pvt, &newdata)) != 0)
+        goto finish;
+    if (newdata != NULL) {
+        DMM_DATA_SEND(newdata, pvt->outhook);
+        DMM_DATA_UNREF(newdata);
+    }
+
+finish:
+    DMM_DATA_UNREF(data);
+    return err;
+}
+
+static int rcvmsg(dmm_node_p node, dmm_msg_p msg)
+{
+    struct pvt_data *pvt;
+    dmm_msg_p resp;
+    int err = 0;
+
+#define CREATE_SEND_EMPTY_RESP()                                    \
+        do {                                                        \
+            resp = DMM_MSG_CREATE_RESP(DMM_NODE_ID(node), msg, 0);  \
+            if (resp != NULL) {                                     \
+                if (err != 0)                                       \
+                    msg->cm_flags |= DMM_MSG_ERR;                   \
+                                                                    \
+                DMM_MSG_SEND_ID(msg->cm_src, resp);                 \
+            } else                                                  \
+                err = (err != 0) ? err : ENOMEM;                    \
+        } while (0)
+
+    if (msg->cm_flags & DMM_MSG_RESP)
+        return 0;
+
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
+    switch (msg->cm_type) {
+    case DMM_MSGTYPE_FILTER:
+        switch (msg->cm_cmd) {
+        case DMM_MSG_FILTER_CLEAR: {
+            filter_clear(pvt);
+            pvt->default_action = FILTER_KEEP;
+            CREATE_SEND_EMPTY_RESP();
+            break;
+        }
+
+        case DMM_MSG_FILTER_SETDEFAULT: {
+            struct dmm_msg_filter_setdefault *sd;
+            sd = DMM_MSG_DATA(msg, struct dmm_msg_filter_setdefault);
+            if (msg->cm_len != sizeof(*sd) ||
+                sd->action < FILTER_ACTION_MIN || sd->action > FILTER_ACTION_MAX) {
+                err = EINVAL;
+            } else {
+                filter_clear(pvt);
+                pvt->default_action = sd->action;
+            }
+            CREATE_SEND_EMPTY_RESP();
+            break;
+        }
+
+        case DMM_MSG_FILTER_SET: {
+            struct dmm_msg_filter_set *s = DMM_MSG_DATA(msg, struct dmm_msg_filter_set);
+            dmm_size_t i, num_ranges;
+            num_ranges = (msg->cm_len - sizeof(struct dmm_msg_filter_set)) / sizeof(struct dmm_filter_range);
+            for (i = 0; i < num_ranges; ++i)
+                if ((err = filter_set(pvt, s->ranges + i)) != 0)
+                    break;
+            CREATE_SEND_EMPTY_RESP();
+            break;
+        }
+
+        default:
+            err = ENOTSUP;
+            break;
+        }
+        break;
+
+    default:
+        err = ENOTSUP;
+        break;
+    }
+
+#undef CREATE_SEND_EMPTY_RESP
+
+    DMM_MSG_FREE(msg);
+    return err;
+}
+
+static struct dmm_type type = {
+    "filter",
+    ctor,
+    dtor,
+    rcvdata,
+    rcvmsg,
+    newhook,
+    rmhook,
+    {},
+};
+
+DMM_MODULE_DECLARE(&type);
@@ -0,0 +1,55 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+#ifndef MODULES_FILTER_FILTER_H_
+#define MODULES_FILTER_FILTER_H_
+
+#include "dmm_types.h"
+
+enum {
+    DMM_MSGTYPE_FILTER = 0x859f962b
+};
+
+enum {
+    DMM_MSG_FILTER_CLEAR = 1,
+    DMM_MSG_FILTER_SETDEFAULT,
+    DMM_MSG_FILTER_SET,
+};
+
+enum dmm_filter_action {
+    FILTER_KEEP,
+    FILTER_DROP,
+
+    FILTER_ACTION_MIN = FILTER_KEEP,
+    FILTER_ACTION_MAX = FILTER_DROP,
+};
+
+/*
+ * Maximum distance between the smallest and the largest
+ * sensor id in filter ranges (filter bitmap size in bits)
+ */
+enum {
+    DMM_FILTER_MAXSPAN = 1 << 20
+};
+
+/*
+ * Set action for sensors not covered by ranges.
+ * All ranges set before are cleared.
+ */
+struct dmm_msg_filter_setdefault {
+    enum dmm_filter_action action;
+};
+
+struct dmm_filter_range {
+    dmm_sensorid_t         first;
+    dmm_sensorid_t         last;
+    enum dmm_filter_action action;
+};
+
+struct dmm_msg_filter_set {
+    char                    dummy;
+    struct dmm_filter_range ranges[];
+};
+
+#endif /* MODULES_FILTER_FILTER_H_ */
@@ -0,0 +1,59 @@
+-- SPDX-License-Identifier: BSD-2-Clause-Views
+-- Copyright (c) 2013-2023
+--   Research Computing Center Lomonosov Moscow State University
+
+local dmm = require('dmm')
+
+assert(dmm.require_interface('filter', 'll'))
+
+local Filter = dmm.Module:new_type('filter')
+
+local actions = {
+  keep = ffi.C.FILTER_KEEP,
+  drop = ffi.C.FILTER_DROP,
+}
+
+--! @brief Remove all ranges, keep all sensors
+function Filter:clear()
+  local msg = dmm.msg_create{
+    len = 0,
+    type = ffi.C.DMM_MSGTYPE_FILTER,
+    cmd = ffi.C.DMM_MSG_FILTER_CLEAR,
+  }
+  dmm.msg_send(self.nodeid, msg)
+end
+
+--! @brief Set action ("keep" or "drop") for sensors not set by
+--! Filter:keep or Filter:drop. Removes all previously set ranges
+function Filter:setdefault(action)
+  local msg, sd = dmm.msg_create{
+    payload_type = 'struct dmm_msg_filter_setdefault',
+    type = ffi.C.DMM_MSGTYPE_FILTER,
+    cmd = ffi.C.DMM_MSG_FILTER_SETDEFAULT,
+  }
+  sd.action = assert(actions[action], "Unknown filter action")
+  dmm.msg_send(self.nodeid, msg)
+end
+
+local function filter_set(self, action, first, last)
+  local msg, set = dmm.msg_create{
+    len = dmm.sfam.struct_sizeof('struct dmm_msg_filter_set', 'ranges', 1),
+    payload_type = 'struct dmm_msg_filter_set',
+    type = ffi.C.DMM_MSGTYPE_FILTER,
+    cmd = ffi.C.DMM_MSG_FILTER_SET,
+  }
+  set.ranges[0] = {first, last or first, action}
+  dmm.msg_send(self.nodeid, msg)
+end
+
+--! @brief Pass sensor first or sensors from first to last
+function Filter:keep(first, last)
+  filter_set(self, ffi.C.FILTER_KEEP, first, last)
+end
+
+--! @brief Drop sensor first or sensors from first to last
+function Filter:drop(first, last)
+  filter_set(self, ffi.C.FILTER_DROP, first, last)
+end
+
+return Filter
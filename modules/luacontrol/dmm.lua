@@ -195,12 +195,27 @@ function dmm.node_rm(id)
   dmm.msg_send(id, msg)
 end
 
-function dmm.node_connect(srcnode, srchook, dstnode, dsthook)
-  local msg, p = dmm.msg_create{
-    payload_type = 'struct dmm_msg_nodeconnect',
+--! @brief connect out hook srchook of srcnode to in hook dsthook of dstnode
+--! @param mask optional sensor mask, only sensors from the mask are passed
+--!             via the connection. Mask is a list of sensor ids
+--!             and {first, last} sensor id ranges, e.g. {500, {520, 564}}
+function dmm.node_connect(srcnode, srchook, dstnode, dsthook, mask)
+  local nmask = mask and #mask or 0
+  local msg, m = dmm.msg_create{
+    len = dmm.sfam.struct_sizeof('struct dmm_msg_nodeconnect_masked', 'mask', nmask),
+    payload_type = 'struct dmm_msg_nodeconnect_masked',
     type = ffi.C.DMM_MSGTYPE_GENERIC,
     cmd = ffi.C.DMM_MSG_NODECONNECT,
   }
+  local p = m.conn
+  for i = 1, nmask do
+    local r = mask[i]
+    if type(r) == 'table' then
+      m.mask[i - 1] = {r[1], r[2]}
+    else
+      m.mask[i - 1] = {r, r}
+    end
+  end
   assert(string.len(srchook) <= ffi.C.DMM_HOOKNAMESIZE - 1)
   assert(string.len(dsthook) <= ffi.C.DMM_HOOKNAMESIZE - 1)
   p.srchook = srchook
@@ -521,8 +536,8 @@ function dmm.Module:rm()
   self.nodeid = nil
 end
 
-function dmm.Module:connect(srchook, dstnode, dsthook)
-  dmm.node_connect(self.nodeid, srchook, nodeid(dstnode), dsthook)
+function dmm.Module:connect(srchook, dstnode, dsthook, mask)
+  dmm.node_connect(self.nodeid, srchook, nodeid(dstnode), dsthook, mask)
 end
 
 function dmm.Module:disconnect(srchook, dstnode, dsthook)
@@ -40,7 +40,7 @@ struct dmm_msg_netiprecv_getflags_resp {
 enum {
     DMM_NETIPRECV_NOCHECKDATA      = 0x00000001,
     DMM_NETIPRECV_PREPENDADDR      = 0x00000002,
-    DMM_NETIPRECV_PREPENDTIMESTAMP = 0x00000002,
+    DMM_NETIPRECV_PREPENDTIMESTAMP = 0x00000004,
     /* Auxiliary flags set by module itself */
     DMM_NETIPRECV_HASSOCK          = 0x80000000,
     DMM_NETIPRECV_BOUND            = 0x40000000,
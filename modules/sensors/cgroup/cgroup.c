@@ -0,0 +1,673 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+/*
+ * cgroup sends per-job resource usage from cgroup v2 hierarchy.
+ *
+ * Jobs are subdirectories of the root directory with names matching
+ * the pattern. The root is watched with inotify, so jobs are added
+ * and removed incrementally on timer ticks, the whole root is rescanned
+ * only at start, on inotify queue overflow or if inotify is unavailable.
+ * Every job keeps its directory and statistics files open, the files
+ * are reread with pread(2).
+ *
+ * Values are sent as vectors with one element per job accompanied
+ * by CGROUP_JOBID vector. CGROUP_NAMES datanode is sent when the set
+ * of jobs changes or a new receiver connects. Missing files (e.g.
+ * controller is not enabled for the cgroup) give zero values.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#include "dmm_base.h"
+#include "dmm_log.h"
+#include "dmm_message.h"
+#include "../sensorfile.h"
+#include "cgroup.h"
+#include "sensors.h"
+
+#define HOOKNAME "out"
+
+#define DEFAULT_ROOT    "/sys/fs/cgroup/system.slice/slurmstepd.scope"
+#define DEFAULT_PATTERN "job_*"
+
+#define INOTIFY_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+                      IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+enum {
+    FILE_CPU_STAT,
+    FILE_MEMORY_CURRENT,
+    FILE_MEMORY_STAT,
+    FILE_IO_STAT,
+    NUM_FILES
+};
+
+static const char *file_names[NUM_FILES] = {
+    "cpu.stat",
+    "memory.current",
+    "memory.stat",
+    "io.stat",
+};
+
+/* Values in the order of sensor ids starting from CGROUP_CPU_USAGE */
+enum {
+    VAL_CPU_USAGE,
+    VAL_CPU_USER,
+    VAL_CPU_SYSTEM,
+    VAL_MEMORY_CURRENT,
+    VAL_MEMORY_ANON,
+    VAL_MEMORY_FILE,
+    VAL_IO_RBYTES,
+    VAL_IO_WBYTES,
+    VAL_IO_RIOS,
+    VAL_IO_WIOS,
+    NUM_VALUES
+};
+
+struct job {
+    int dirfd;
+    uint64_t jobid;
+    struct dmm_cgroup_name name;
+    struct sensorfile files[NUM_FILES];
+    uint64_t vals[NUM_VALUES];
+    /* Found by the current rescan */
+    bool seen;
+};
+
+struct pvt_data {
+    dmm_hook_p hook;
+    char root[DMM_CGROUP_PATHSIZE];
+    char pattern[DMM_CGROUP_NAMESIZE];
+    /* -1 if the root is not opened yet */
+    int rootfd;
+    /* -1 if inotify is unavailable */
+    int infd;
+    int wd;
+    /* Rescan the root at the next tick */
+    bool rescan;
+    /* Set of jobs changed since names were sent last time */
+    bool changed;
+    /* Do not repeat warning about missing root on every tick */
+    bool root_warned;
+    /* Jobs in the order they are sent */
+    struct job **jobs;
+    size_t num_jobs;
+    size_t max_jobs;
+};
+
+static void log_error(const char *what, const char *name, int err)
+{
+    char errbuf[128], *errmsg;
+
+    errmsg = strerror_r(err, errbuf, sizeof(errbuf));
+    dmm_log(DMM_LOG_ERR, "cgroup: %s %s: %s", what, name, errmsg);
+}
+
+static void job_free(struct job *job)
+{
+    int i;
+
+    for (i = 0; i < NUM_FILES; ++i)
+        sensorfile_close(&job->files[i]);
+    close(job->dirfd);
+    DMM_FREE(job);
+}
+
+static size_t find_job(struct pvt_data *pvt, const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < pvt->num_jobs; ++i)
+        if (strcmp(pvt->jobs[i]->name.name, name) == 0)
+            return i;
+    return pvt->num_jobs;
+}
+
+/* Job id is the first number in cgroup name, e.g. 123 in job_123 */
+static uint64_t parse_jobid(const char *name)
+{
+    uint64_t jobid = 0;
+
+    while (*name != '\0' && (unsigned char)(*name - '0') >= 10)
+        name++;
+    sensorfile_u64(name, &jobid);
+    return jobid;
+}
+
+static bool job_name_matches(struct pvt_data *pvt, const char *name)
+{
+    return strlen(name) < DMM_CGROUP_NAMESIZE && fnmatch(pvt->pattern, name, 0) == 0;
+}
+
+/* Add job if it is not known yet, return 0 or errno */
+static int add_job(struct pvt_data *pvt, const char *name)
+{
+    struct job *job, **jobs;
+    size_t i, max_jobs;
+    int err;
+
+    if ((i = find_job(pvt, name)) < pvt->num_jobs) {
+        pvt->jobs[i]->seen = true;
+        return 0;
+    }
+
+    if (pvt->num_jobs == pvt->max_jobs) {
+        max_jobs = pvt->max_jobs > 0 ? pvt->max_jobs * 2 : 16;
+        jobs = (struct job **)DMM_REALLOC(pvt->jobs, max_jobs * sizeof(*jobs));
+        if (jobs == NULL)
+            return ENOMEM;
+        pvt->jobs = jobs;
+        pvt->max_jobs = max_jobs;
+    }
+
+    if ((job = (struct job *)DMM_MALLOC(sizeof(*job))) == NULL)
+        return ENOMEM;
+    job->dirfd = openat(pvt->rootfd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (job->dirfd < 0) {
+        err = errno;
+        DMM_FREE(job);
+        /* Removed before we've got it, not an error */
+        if (err == ENOENT || err == ENOTDIR)
+            return 0;
+        log_error("cannot open", name, err);
+        return err;
+    }
+    job->jobid = parse_jobid(name);
+    memset(&job->name, 0, sizeof(job->name));
+    strcpy(job->name.name, name);
+    for (i = 0; i < NUM_FILES; ++i) {
+        err = sensorfile_openat(&job->files[i], job->dirfd, file_names[i]);
+        if (err == ENOMEM) {
+            while (i-- > 0)
+                sensorfile_close(&job->files[i]);
+            close(job->dirfd);
+            DMM_FREE(job);
+            return ENOMEM;
+        }
+    }
+    job->seen = true;
+
+    pvt->jobs[pvt->num_jobs++] = job;
+    pvt->changed = true;
+    return 0;
+}
+
+/* Remove i-th job preserving the order of the rest */
+static void remove_job(struct pvt_data *pvt, size_t i)
+{
+    job_free(pvt->jobs[i]);
+    memmove(pvt->jobs + i, pvt->jobs + i + 1, (pvt->num_jobs - i - 1) * sizeof(*pvt->jobs));
+    pvt->num_jobs--;
+    pvt->changed = true;
+}
+
+static void remove_all_jobs(struct pvt_data *pvt)
+{
+    while (pvt->num_jobs > 0)
+        remove_job(pvt, pvt->num_jobs - 1);
+}
+
+static void close_root(struct pvt_data *pvt)
+{
+    remove_all_jobs(pvt);
+    if (pvt->wd >= 0)
+        inotify_rm_watch(pvt->infd, pvt->wd);
+    pvt->wd = -1;
+    if (pvt->rootfd >= 0)
+        close(pvt->rootfd);
+    pvt->rootfd = -1;
+}
+
+/*
+ * Open the root and start watching it, the watch is set before
+ * the rescan so no job can be missed between them
+ */
+static int open_root(struct pvt_data *pvt)
+{
+    int err;
+
+    pvt->rootfd = open(pvt->root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (pvt->rootfd < 0) {
+        err = errno;
+        pvt->rootfd = -1;
+        if (!pvt->root_warned)
+            log_error("cannot open root", pvt->root, err);
+        pvt->root_warned = true;
+        return err;
+    }
+    pvt->root_warned = false;
+    if (pvt->infd >= 0) {
+        pvt->wd = inotify_add_watch(pvt->infd, pvt->root, INOTIFY_MASK);
+        if (pvt->wd < 0)
+            log_error("cannot watch", pvt->root, errno);
+    }
+    pvt->rescan = true;
+    return 0;
+}
+
+static int rescan(struct pvt_data *pvt)
+{
+    DIR *dir;
+    struct dirent *de;
+    struct stat st;
+    size_t i;
+    int fd, err = 0;
+
+    if ((fd = openat(pvt->rootfd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+        return errno;
+    if ((dir = fdopendir(fd)) == NULL) {
+        err = errno;
+        close(fd);
+        return err;
+    }
+
+    for (i = 0; i < pvt->num_jobs; ++i)
+        pvt->jobs[i]->seen = false;
+    while ((de = readdir(dir)) != NULL) {
+        if (!job_name_matches(pvt, de->d_name))
+            continue;
+        if (de->d_type == DT_UNKNOWN) {
+            if (fstatat(pvt->rootfd, de->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0 ||
+                !S_ISDIR(st.st_mode))
+                continue;
+        } else if (de->d_type != DT_DIR) {
+            continue;
+        }
+        if ((err = add_job(pvt, de->d_name)) != 0)
+            break;
+    }
+    closedir(dir);
+    if (err != 0)
+        return err;
+
+    for (i = pvt->num_jobs; i-- > 0;)
+        if (!pvt->jobs[i]->seen)
+            remove_job(pvt, i);
+    pvt->rescan = false;
+    return 0;
+}
+
+/* Apply changes of the root directory reported by inotify */
+static int process_events(struct pvt_data *pvt)
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *ev;
+    ssize_t len;
+    size_t i;
+    char *p;
+    int err;
+
+    for (;;) {
+        len = read(pvt->infd, buf, sizeof(buf));
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN)
+                return 0;
+            return errno;
+        }
+        for (p = buf; p < buf + len; p += sizeof(*ev) + ev->len) {
+            ev = (const struct inotify_event *)p;
+            if (ev->mask & IN_Q_OVERFLOW) {
+                pvt->rescan = true;
+                continue;
+            }
+            if (ev->wd != pvt->wd)
+                continue;
+            if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                dmm_log(DMM_LOG_WARN, "cgroup: root %s is removed", pvt->root);
+                /* The kernel removes the watch itself */
+                if (ev->mask & IN_IGNORED)
+                    pvt->wd = -1;
+                close_root(pvt);
+                return 0;
+            }
+            if (!(ev->mask & IN_ISDIR) || ev->len == 0 || !job_name_matches(pvt, ev->name))
+                continue;
+            if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+                if ((err = add_job(pvt, ev->name)) != 0)
+                    return err;
+            } else if ((i = find_job(pvt, ev->name)) < pvt->num_jobs) {
+                remove_job(pvt, i);
+            }
+        }
+    }
+}
+
+/* Bring the set of jobs up to date */
+static int update_jobs(struct pvt_data *pvt)
+{
+    int err;
+
+    if (pvt->rootfd < 0 && open_root(pvt) != 0)
+        return 0;
+    if (pvt->infd >= 0 && pvt->wd >= 0) {
+        if ((err = process_events(pvt)) != 0)
+            return err;
+        if (pvt->rootfd < 0)
+            return 0;
+    } else {
+        pvt->rescan = true;
+    }
+    if (pvt->rescan)
+        return rescan(pvt);
+    return 0;
+}
+
+/* Parse "key value" lines, values of keys not listed are ignored */
+static void parse_keyed(const char *s, const char * const *keys, uint64_t *vals, int num_keys)
+{
+    const char *p;
+    int i;
+
+    for (; *s != '\0'; s = sensorfile_nextline(s))
+        for (i = 0; i < num_keys; ++i)
+            if ((p = sensorfile_match(s, keys[i])) != NULL) {
+                sensorfile_u64(p, &vals[i]);
+                break;
+            }
+}
+
+static void parse_cpu_stat(const char *s, uint64_t *vals)
+{
+    static const char * const keys[] = {
+        "usage_usec ", "user_usec ", "system_usec ",
+    };
+
+    parse_keyed(s, keys, vals + VAL_CPU_USAGE, 3);
+}
+
+static void parse_memory_stat(const char *s, uint64_t *vals)
+{
+    static const char * const keys[] = { "anon ", "file " };
+
+    parse_keyed(s, keys, vals + VAL_MEMORY_ANON, 2);
+}
+
+/* Lines like "8:0 rbytes=1 wbytes=2 rios=3 wios=4 dbytes=0 dios=0" */
+static void parse_io_stat(const char *s, uint64_t *vals)
+{
+    static const char * const keys[] = { "rbytes=", "wbytes=", "rios=", "wios=" };
+    const char *p;
+    uint64_t v;
+    int i;
+
+    for (; *s != '\0'; s = sensorfile_nextline(s)) {
+        /* Skip device number */
+        s = sensorfile_skipfield(s);
+        for (;;) {
+            s = sensorfile_skipblanks(s);
+            if (*s == '\0' || *s == '\n')
+                break;
+            for (i = 0; i < 4; ++i)
+                if ((p = sensorfile_match(s, keys[i])) != NULL) {
+                    if (sensorfile_u64(p, &v) != NULL)
+                        vals[VAL_IO_RBYTES + i] += v;
+                    break;
+                }
+            s = sensorfile_skipfield(s);
+        }
+    }
+}
+
+/* Read values of the job, return 0 or errno */
+static int read_job(struct job *job)
+{
+    struct sensorfile *sf;
+    int i, err;
+
+    memset(job->vals, 0, sizeof(job->vals));
+    for (i = 0; i < NUM_FILES; ++i) {
+        sf = &job->files[i];
+        if (!sensorfile_isopen(sf))
+            continue;
+        if ((err = sensorfile_read(sf)) != 0)
+            return err;
+        switch (i) {
+        case FILE_CPU_STAT:
+            parse_cpu_stat(sf->buf, job->vals);
+            break;
+        case FILE_MEMORY_CURRENT:
+            sensorfile_u64(sf->buf, &job->vals[VAL_MEMORY_CURRENT]);
+            break;
+        case FILE_MEMORY_STAT:
+            parse_memory_stat(sf->buf, job->vals);
+            break;
+        case FILE_IO_STAT:
+            parse_io_stat(sf->buf, job->vals);
+            break;
+        }
+    }
+    return 0;
+}
+
+static int process_timer_msg(struct pvt_data *pvt)
+{
+    dmm_data_p data;
+    dmm_datanode_p dn;
+    uint64_t *vec;
+    size_t i, n, len;
+    int v, err;
+
+    if ((err = update_jobs(pvt)) != 0) {
+        log_error("cannot update jobs in", pvt->root, err);
+        pvt->rescan = true;
+    }
+
+    for (i = pvt->num_jobs; i-- > 0;) {
+        if ((err = read_job(pvt->jobs[i])) != 0) {
+            /*
+             * Reading files of removed cgroup gives ENODEV. Otherwise
+             * the cgroup is still there and inotify won't report it
+             * again, so reopen it with a rescan at the next tick
+             */
+            if (err != ENODEV && err != ENOENT) {
+                log_error("cannot read statistics of", pvt->jobs[i]->name.name, err);
+                pvt->rescan = true;
+            }
+            remove_job(pvt, i);
+        }
+    }
+
+    n = pvt->num_jobs;
+    if (n == 0)
+        return 0;
+
+    len = (NUM_VALUES + 1) * n * sizeof(uint64_t);
+    if (pvt->changed)
+        len += n * sizeof(struct dmm_cgroup_name);
+    if ((data = DMM_DATA_CREATE_RAW(NUM_VALUES + 1 + pvt->changed, len)) == NULL) {
+        dmm_log(DMM_LOG_ERR, "Cannot allocate memory for data");
+        return ENOMEM;
+    }
+    dn = DMM_DATA_NODES(data);
+    DMM_DN_CREATE(dn, CGROUP_JOBID, n * sizeof(uint64_t));
+    vec = DMM_DN_VECTOR(dn, uint64_t);
+    for (i = 0; i < n; ++i)
+        vec[i] = pvt->jobs[i]->jobid;
+    DMM_DN_ADVANCE(dn);
+    for (v = 0; v < NUM_VALUES; ++v) {
+        DMM_DN_CREATE(dn, CGROUP_CPU_USAGE + v, n * sizeof(uint64_t));
+        vec = DMM_DN_VECTOR(dn, uint64_t);
+        for (i = 0; i < n; ++i)
+            vec[i] = pvt->jobs[i]->vals[v];
+        DMM_DN_ADVANCE(dn);
+    }
+    if (pvt->changed) {
+        struct dmm_cgroup_name *names;
+
+        DMM_DN_CREATE(dn, CGROUP_NAMES, n * sizeof(struct dmm_cgroup_name));
+        names = DMM_DN_VECTOR(dn, struct dmm_cgroup_name);
+        for (i = 0; i < n; ++i)
+            names[i] = pvt->jobs[i]->name;
+        DMM_DN_ADVANCE(dn);
+    }
+    DMM_DN_MKEND(dn);
+    DMM_DATA_SEND(data, pvt->hook);
+    DMM_DATA_UNREF(data);
+    pvt->changed = false;
+
+    return 0;
+}
+
+static int set_root(struct pvt_data *pvt, const struct dmm_msg_cgroup_setroot *sr)
+{
+    if (memchr(sr->root, '\0', sizeof(sr->root)) == NULL ||
+        memchr(sr->pattern, '\0', sizeof(sr->pattern)) == NULL ||
+        sr->root[0] == '\0' || sr->pattern[0] == '\0')
+        return EINVAL;
+
+    close_root(pvt);
+    strcpy(pvt->root, sr->root);
+    strcpy(pvt->pattern, sr->pattern);
+    pvt->root_warned = false;
+    /* Missing root is not an error, it's retried on timer ticks */
+    open_root(pvt);
+    return 0;
+}
+
+static int ctor(dmm_node_p node)
+{
+    struct pvt_data *pvt;
+
+    pvt = (struct pvt_data *)DMM_MALLOC(sizeof(*pvt));
+    if (pvt == NULL)
+        return ENOMEM;
+    pvt->hook = NULL;
+    strcpy(pvt->root, DEFAULT_ROOT);
+    strcpy(pvt->pattern, DEFAULT_PATTERN);
+    pvt->rootfd = -1;
+    pvt->infd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (pvt->infd < 0) {
+        char errbuf[128], *errmsg;
+        errmsg = strerror_r(errno, errbuf, sizeof(errbuf));
+        dmm_log(DMM_LOG_WARN, "cgroup: inotify is unavailable, rescan on every tick: %s", errmsg);
+    }
+    pvt->wd = -1;
+    pvt->rescan = true;
+    pvt->changed = true;
+    pvt->root_warned = false;
+    pvt->jobs = NULL;
+    pvt->num_jobs = 0;
+    pvt->max_jobs = 0;
+    DMM_NODE_SETPRIVATE(node, pvt);
+    return 0;
+}
+
+static void dtor(dmm_node_p node)
+{
+    struct pvt_data *pvt;
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
+    close_root(pvt);
+    if (pvt->infd >= 0)
+        close(pvt->infd);
+    DMM_FREE(pvt->jobs);
+    DMM_FREE(pvt);
+}
+
+static int newhook(dmm_hook_p hook)
+{
+    struct pvt_data *pvt;
+
+    if (DMM_HOOK_ISIN(hook))
+        return EINVAL;
+    if (strcmp(HOOKNAME, DMM_HOOK_NAME(hook)) != 0)
+        return EINVAL;
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(DMM_HOOK_NODE(hook));
+    pvt->hook = hook;
+    /* Send names to the new receiver */
+    pvt->changed = true;
+
+    return 0;
+}
+
+static void rmhook(dmm_hook_p hook)
+{
+    struct pvt_data *pvt;
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(DMM_HOOK_NODE(hook));
+    pvt->hook = NULL;
+}
+
+static int rcvmsg(dmm_node_p node, dmm_msg_p msg)
+{
+    struct pvt_data *pvt;
+    dmm_msg_p resp;
+    int err = 0;
+
+#define CREATE_SEND_EMPTY_RESP()                                    \
+        do {                                                        \
+            resp = DMM_MSG_CREATE_RESP(DMM_NODE_ID(node), msg, 0);  \
+            if (resp != NULL) {                                     \
+                if (err != 0)                                       \
+                    msg->cm_flags |= DMM_MSG_ERR;                   \
+                                                                    \
+                DMM_MSG_SEND_ID(msg->cm_src, resp);                 \
+            } else                                                  \
+                err = (err != 0) ? err : ENOMEM;                    \
+        } while (0)
+
+    if (msg->cm_flags & DMM_MSG_RESP)
+        goto err;
+
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
+    switch (msg->cm_type) {
+    case DMM_MSGTYPE_GENERIC:
+        /* Accept only TIMERTRIGGER messages */
+        if (msg->cm_cmd != DMM_MSG_TIMERTRIGGER) {
+            err = ENOTSUP;
+            break;
+        }
+        // Nowhere to send, so why bother?
+        if (pvt->hook != NULL)
+            err = process_timer_msg(pvt);
+        break;
+
+    case DMM_MSGTYPE_CGROUP:
+        switch (msg->cm_cmd) {
+        case DMM_MSG_CGROUP_SETROOT:
+            if (msg->cm_len != sizeof(struct dmm_msg_cgroup_setroot))
+                err = EINVAL;
+            else
+                err = set_root(pvt, DMM_MSG_DATA(msg, struct dmm_msg_cgroup_setroot));
+            CREATE_SEND_EMPTY_RESP();
+            break;
+
+        default:
+            err = ENOTSUP;
+            break;
+        }
+        break;
+
+    default:
+        err = ENOTSUP;
+        break;
+    }
+
+#undef CREATE_SEND_EMPTY_RESP
+
+err:
+    DMM_MSG_FREE(msg);
+    return err;
+}
+
+static struct dmm_type type = {
+    "cgroup",
+    ctor,
+    dtor,
+    NULL,
+    rcvmsg,
+    newhook,
+    rmhook,
+    {},
+};
+
+DMM_MODULE_DECLARE(&type);
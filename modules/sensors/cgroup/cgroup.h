@@ -0,0 +1,37 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+#ifndef MODULES_CGROUP_CGROUP_H_
+#define MODULES_CGROUP_CGROUP_H_
+
+#include "dmm_types.h"
+
+enum {
+    DMM_MSGTYPE_CGROUP = 0x9de70e52
+};
+
+enum {
+    DMM_MSG_CGROUP_SETROOT = 1,
+};
+
+enum { DMM_CGROUP_PATHSIZE = 256 };
+enum { DMM_CGROUP_NAMESIZE = 64 };
+
+/*
+ * Monitor cgroups in directory root with names matching
+ * fnmatch(3) pattern, e.g. root
+ * "/sys/fs/cgroup/system.slice/slurmstepd.scope" and pattern "job_*"
+ * (the default)
+ */
+struct dmm_msg_cgroup_setroot {
+    char root[DMM_CGROUP_PATHSIZE];
+    char pattern[DMM_CGROUP_NAMESIZE];
+};
+
+/* Element of CGROUP_NAMES datanode */
+struct dmm_cgroup_name {
+    char name[DMM_CGROUP_NAMESIZE];
+};
+
+#endif /* MODULES_CGROUP_CGROUP_H_ */
@@ -0,0 +1,28 @@
+-- SPDX-License-Identifier: BSD-2-Clause-Views
+-- Copyright (c) 2013-2023
+--   Research Computing Center Lomonosov Moscow State University
+
+local dmm = require('dmm')
+
+assert(dmm.require_interface('cgroup', 'll'))
+
+local Cgroup = dmm.Module:new_type('cgroup')
+
+--! @brief Set directory with job cgroups
+--! @param root cgroup directory, e.g. '/sys/fs/cgroup/system.slice/slurmstepd.scope'
+--! @param pattern fnmatch(3) pattern of job cgroup names, 'job_*' by default
+function Cgroup:setroot(root, pattern)
+  pattern = pattern or 'job_*'
+  assert(#root < ffi.C.DMM_CGROUP_PATHSIZE, 'root is too long')
+  assert(#pattern < ffi.C.DMM_CGROUP_NAMESIZE, 'pattern is too long')
+  local msg, sr = dmm.msg_create {
+    payload_type = 'struct dmm_msg_cgroup_setroot',
+    type = ffi.C.DMM_MSGTYPE_CGROUP,
+    cmd = ffi.C.DMM_MSG_CGROUP_SETROOT,
+  }
+  sr.root = root
+  sr.pattern = pattern
+  dmm.msg_send(self.nodeid, msg)
+end
+
+return Cgroup
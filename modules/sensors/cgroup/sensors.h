@@ -0,0 +1,28 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+#ifndef MODULES_CGROUP_SENSORS_H_
+#define MODULES_CGROUP_SENSORS_H_
+
+enum {
+    /* uint64_t job ids (first number in cgroup name) for values of other sensors */
+    CGROUP_JOBID = 1000,
+    /* Array of struct dmm_cgroup_name, sent when the set of cgroups changes */
+    CGROUP_NAMES,
+    /* uint64_t counters from cpu.stat, microseconds */
+    CGROUP_CPU_USAGE,
+    CGROUP_CPU_USER,
+    CGROUP_CPU_SYSTEM,
+    /* uint64_t memory.current and memory.stat values, bytes */
+    CGROUP_MEMORY_CURRENT,
+    CGROUP_MEMORY_ANON,
+    CGROUP_MEMORY_FILE,
+    /* uint64_t io.stat counters summed over all devices */
+    CGROUP_IO_RBYTES,
+    CGROUP_IO_WBYTES,
+    CGROUP_IO_RIOS,
+    CGROUP_IO_WIOS
+};
+
+#endif /* MODULES_CGROUP_SENSORS_H_ */
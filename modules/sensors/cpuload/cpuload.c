@@ -2,287 +2,264 @@
 // Copyright (c) 2013-2023
 //   Research Computing Center Lomonosov Moscow State University
 
-#include <ctype.h>
+/*
+ * cpuload sends fraction of time spent by each online CPU in each state
+ * (CPU_USER..CPU_GUEST_NICE) since the previous timer tick. CPUs are
+ * identified by the accompanying CPU_ID datanode which contains CPU
+ * numbers in the same order as values in the state datanodes.
+ *
+ * CPUs may be set offline and online at any time. Previous counter
+ * values are kept in arrays indexed by CPU number, so a change in the
+ * set of online CPUs affects only the CPUs changed: a CPU is reported
+ * starting from the second tick after it comes online.
+ */
+
 #include <errno.h>
 #include <inttypes.h>
 #include <stdbool.h>
-#include <stdio.h>
 #include <string.h>
 
 #include "dmm_base.h"
 #include "dmm_log.h"
 #include "dmm_message.h"
 #include "sensors.h"
+#include "../sensorfile.h"
 
 #define DATAFILE "/proc/stat"
 
-static int num_cores = 0;
-/*
- * Number of system states provided by Linux (depends on Linux version)
- * See /proc/file description in man 5 proc
- */
-static int num_states = 0;
-
 struct pvt_data {
-    FILE *f;
+    struct sensorfile sf;
     dmm_hook_p hook;
+    /*
+     * Number of system states provided by Linux (depends on Linux version)
+     * See /proc/file description in man 5 proc
+     */
+    int num_states;
+    /*
+     * Counter values indexed by CPU number, num_slots * num_states
+     * elements each. prev_valid[cpu] is true if prev_val for cpu
+     * is filled at previous tick
+     */
+    unsigned num_slots;
     uint64_t *prev_val;
-    bool prev_val_filled;
+    uint64_t *cur_val;
+    bool *prev_valid;
+    /* Online CPUs in order of /proc/stat, at current and previous tick */
+    uint32_t *cpus;
+    uint32_t *prev_cpus;
+    unsigned num_cpus;
+    unsigned prev_num_cpus;
 };
 
 /*
- * Count number of cores and number of states
- * provided by kernel in /proc/stat file
- * Is called on first attempt to get values
- * or when number of cores changes.
+ * Count number of states in the aggregate line of /proc/stat:
+ * cpu %d ..(4 to 10 times).. %d\n
  */
-static void count_cores_states(dmm_node_p node)
+static int count_states(const char *buf)
 {
-    struct pvt_data *pvt;
-    FILE *f;
-    /* buf size is 3 (cpu) + (up to 10 states * 2^64 max value (20 chars)) */
-    char buf[256];
-    char *s, *s1;
-    int tmp;
-    int cores, states;
-    const char cpu_prefix[] = "cpu";
+    const char *s;
+    uint64_t tmp;
+    int states;
+
+    if ((s = sensorfile_match(buf, "cpu ")) == NULL)
+        return 0;
+    for (states = 0; (s = sensorfile_u64(s, &tmp)) != NULL; states++)
+        ;
+    return states;
+}
 
-    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
-    f = pvt->f;
-    /* Do not check IO errors. Assume /proc/stat is always readable (except eof) */
-    fflush(f);
-    rewind(f);
-    if (fgets(buf, sizeof (buf), f) != buf)
-        goto err;
-    /*
-     * Check for
-     * cpu %d ..(4 to 10 times).. %d\n
-     */
-    s = buf;
-    if (strncmp(s, cpu_prefix, strlen(cpu_prefix)) != 0)
-        goto err;
-    s += strlen(cpu_prefix);
-    if (!isspace(*s))
-        goto err;
-    for (states = 0; *s != '\n'; states++) {
-        while (*s != '\n' && isspace(*s) && s < buf + sizeof buf)
-            s++;
-        errno = 0;
-        strtoul(s, &s1, 10);
-        if (s1 == s || errno != 0)
-            goto err;
-        s = s1;
+static void free_slots(struct pvt_data *pvt)
+{
+    DMM_FREE(pvt->prev_val);
+    DMM_FREE(pvt->cur_val);
+    DMM_FREE(pvt->prev_valid);
+    DMM_FREE(pvt->cpus);
+    DMM_FREE(pvt->prev_cpus);
+}
+
+/* Make room for CPU numbers up to cpu, doubling the number of slots */
+static int grow_slots(struct pvt_data *pvt, uint32_t cpu)
+{
+    struct pvt_data n = *pvt;
+    size_t vals_size;
+
+    for (n.num_slots = pvt->num_slots ? pvt->num_slots : 64; n.num_slots <= cpu; n.num_slots *= 2)
+        ;
+    vals_size = (size_t)n.num_slots * pvt->num_states * sizeof(*n.prev_val);
+    n.prev_val = (uint64_t *)DMM_MALLOC(vals_size);
+    n.cur_val = (uint64_t *)DMM_MALLOC(vals_size);
+    n.prev_valid = (bool *)DMM_MALLOC(n.num_slots * sizeof(*n.prev_valid));
+    n.cpus = (uint32_t *)DMM_MALLOC(n.num_slots * sizeof(*n.cpus));
+    n.prev_cpus = (uint32_t *)DMM_MALLOC(n.num_slots * sizeof(*n.prev_cpus));
+    if (n.prev_val == NULL || n.cur_val == NULL || n.prev_valid == NULL ||
+        n.cpus == NULL || n.prev_cpus == NULL) {
+        free_slots(&n);
+        dmm_log(DMM_LOG_ERR, "Can't allocate memory for %u CPUs", n.num_slots);
+        return ENOMEM;
     }
-    num_states = states;
-    /*
-     * OK, states are counted, now count cores.
-     * Each core should have a line beginning with
-     * cpu<core num> (no space between "cpu" and number
-     */
-    for (cores = 0;; cores++) {
-        if (fgets(buf, sizeof (buf), f) != buf)
-            goto err;
-        s = buf;
-        if (strncmp(s, cpu_prefix, strlen(cpu_prefix)) != 0)
-            break;
-        s += strlen(cpu_prefix);
-        if (!isdigit(*s))
-            goto err;
-        if (sscanf(s , "%d", &tmp) < 1)
-            goto err;
-/* Seems that this check may cause problems */
-# if 0
-        /* Check that cores are numbered sequentially */
-        if (tmp != cores)
-            goto err;
-#endif
-        while (*s != '\0' && *s != '\n' && s < buf + sizeof buf)
-            s++;
-        if (*s != '\n') {
-            /* Line in files is longer than buf, skip the remainder */
-            while (!feof(f) && fgetc(f) != '\n')
-                ;
-        }
+    memset(n.prev_valid, 0, n.num_slots * sizeof(*n.prev_valid));
+    if (pvt->num_slots > 0) {
+        vals_size = (size_t)pvt->num_slots * pvt->num_states * sizeof(*n.prev_val);
+        memcpy(n.prev_val, pvt->prev_val, vals_size);
+        memcpy(n.cur_val, pvt->cur_val, vals_size);
+        memcpy(n.prev_valid, pvt->prev_valid, pvt->num_slots * sizeof(*n.prev_valid));
+        memcpy(n.cpus, pvt->cpus, pvt->num_cpus * sizeof(*n.cpus));
+        memcpy(n.prev_cpus, pvt->prev_cpus, pvt->prev_num_cpus * sizeof(*n.prev_cpus));
+        free_slots(pvt);
     }
-    num_cores = cores;
-    return;
-
-err:
-    dmm_log(DMM_LOG_ERR, "Can't parse %s", DATAFILE);
-    num_states = 0;
-    num_cores = 0;
+    *pvt = n;
+    return 0;
 }
 
-static int fill_prev(dmm_node_p node, bool numcore_changed)
+/*
+ * Parse per-CPU lines of /proc/stat into cur_val,
+ * fill cpus and num_cpus
+ */
+static int parse_cpus(struct pvt_data *pvt)
 {
-    struct pvt_data *pvt;
-    FILE *f;
-    int core, state;
-    char buf[32];
-    int tmp;
+    const char *s;
+    uint64_t cpu, *val;
+    int state, err;
+
+    pvt->num_cpus = 0;
+    /* Skip first line (aggregate stats), per-CPU lines follow it */
+    for (s = sensorfile_nextline(pvt->sf.buf);
+         (s = sensorfile_match(s, "cpu")) != NULL;
+         s = sensorfile_nextline(s)) {
+        if ((s = sensorfile_u64(s, &cpu)) == NULL || cpu > UINT32_MAX)
+            goto parse_err;
+        if (cpu >= pvt->num_slots && (err = grow_slots(pvt, (uint32_t)cpu)) != 0)
+            return err;
+        val = pvt->cur_val + cpu * pvt->num_states;
+        for (state = 0; state < pvt->num_states; state++)
+            if ((s = sensorfile_u64(s, val + state)) == NULL)
+                goto parse_err;
+        /*
+         * cpus has num_slots entries and every CPU number is below
+         * num_slots, so more lines than that mean a repeated CPU line,
+         * don't write past the end of cpus
+         */
+        if (pvt->num_cpus == pvt->num_slots)
+            goto parse_err;
+        pvt->cpus[pvt->num_cpus++] = (uint32_t)cpu;
+    }
+    return 0;
 
-    assert(num_states > 0);
-    assert(num_cores > 0);
+parse_err:
+    dmm_log(DMM_LOG_ERR, "Can't parse %s", DATAFILE);
+    return EINVAL;
+}
 
-    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
-    f = pvt->f;
-    pvt->prev_val_filled = false;
-    do {
-        if (pvt->prev_val != NULL && numcore_changed) {
-            DMM_FREE(pvt->prev_val);
-            pvt->prev_val = NULL;
-        }
-        if (pvt->prev_val == NULL) {
-            pvt->prev_val = (uint64_t *)DMM_MALLOC(num_cores * num_states * sizeof (*pvt->prev_val));
-        }
-        if (pvt->prev_val == NULL) {
-            dmm_log(DMM_LOG_ERR, "Can't allocate memory for previous values");
-            return ENOMEM;
-        }
-        numcore_changed = false;
-        fflush(f);
-        rewind(f);
-        /* Skip first line (aggregate stats) */
-        assert(fscanf(f, "cpu%*[^\n]%*c") == 0);
-        for (core = 0; core < num_cores; core++) {
-            /* 31 = sizeof(buf) - 1 */
-            assert(fscanf(f, "%31s", buf) == 1);
-            if (strncmp(buf, "cpu", 3) != 0) {
-                /* OOPS, number of cores is now less than it was */
-                count_cores_states(node);
-                numcore_changed = true;
-                continue;
-            }
-            if (sscanf(buf + 3, "%d", &tmp) < 1/* || tmp != core*/) {
-                /* OOPS, it's not "cpu<number> line or <number> != core */
-                count_cores_states(node);
-                numcore_changed = true;
-                continue;
-            }
-            for (state = 0; state < num_states; state++)
-                assert(fscanf(f, "%" SCNu64, &pvt->prev_val[core * num_states + state]) == 1);
-            assert(fscanf(f, "%*1[\n]") == 0);
-        }
-        /* 31 = sizeof(buf) - 1 */
-        assert(fscanf(f, "%31s", buf) == 1);
-        if (strncmp(buf, "cpu", 3) == 0) {
-            /* OOPS, more cores is here now */
-            count_cores_states(node);
-            numcore_changed = true;
-            continue;
-        }
-        pvt->prev_val_filled = true;
-    } while (!pvt->prev_val_filled);
-    return 0;
+/*
+ * Update prev_valid after the set of online CPUs has changed: only
+ * current CPUs will have previous values at the next tick, so CPUs
+ * gone offline start from scratch when they are back
+ */
+static void update_online(struct pvt_data *pvt)
+{
+    unsigned i;
+
+    /* Cheap check for the common case of unchanged CPU set */
+    if (pvt->num_cpus == pvt->prev_num_cpus &&
+        memcmp(pvt->cpus, pvt->prev_cpus, pvt->num_cpus * sizeof(*pvt->cpus)) == 0)
+        return;
+
+    dmm_debug("cpuload: number of online CPUs changed from %u to %u",
+              pvt->prev_num_cpus, pvt->num_cpus);
+    for (i = 0; i < pvt->prev_num_cpus; i++)
+        pvt->prev_valid[pvt->prev_cpus[i]] = false;
+    for (i = 0; i < pvt->num_cpus; i++)
+        pvt->prev_valid[pvt->cpus[i]] = true;
 }
 
 static int process_timer_msg(dmm_node_p node)
 {
     struct pvt_data *pvt;
-    FILE *f;
-    uint64_t cur_val[num_cores * num_states];
-    uint64_t total_jiffies_delta;
-    char buf[32];
-    int core, state;
-    int tmp;
     dmm_datanode_p dn;
     dmm_data_p data;
+    float *fractions[CPU_GUEST_NICE - CPU_USER + 1];
+    uint32_t *cpu_ids;
+    uint64_t *cur_val, *prev_val, *tmp;
+    uint32_t *tmpcpus;
+    uint64_t total_jiffies_delta, delta;
+    unsigned i, num_send;
+    int state;
+    int err;
 
     pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
-    data = NULL;
-    f = pvt->f;
-    fflush(f);
-    rewind(f);
-    /* Skip first line (aggregate stats) */
-    assert(fscanf(f, "cpu%*[^\n]%*c") == 0);
-    if (pvt->prev_val_filled && pvt->hook != NULL) {
-        /* We have previous data, so ready to send */
-        data = DMM_DATA_CREATE(num_states, num_cores * sizeof(float));
-        if (data == NULL) {
+    if ((err = sensorfile_read(&pvt->sf)) != 0) {
+        char errbuf[128], *errmsg;
+        errmsg = strerror_r(err, errbuf, sizeof(errbuf));
+        dmm_log(DMM_LOG_ERR, "Cannot read %s: %s", DATAFILE, errmsg);
+        return err;
+    }
+    if ((err = parse_cpus(pvt)) != 0)
+        return err;
+
+    /* prev_valid is true exactly for CPUs online at previous tick */
+
+    num_send = 0;
+    for (i = 0; i < pvt->num_cpus; i++)
+        if (pvt->prev_valid[pvt->cpus[i]])
+            num_send++;
+
+    if (num_send > 0 && pvt->hook != NULL) {
+        data = DMM_DATA_CREATE(pvt->num_states + 1, num_send * sizeof(float));
+        if (data == NULL)
             return ENOMEM;
-        }
         dn = DMM_DATA_NODES(data);
-        for (state = 0; state < num_states; state++)
-            DMM_DN_CREATE_ADVANCE(dn, CPU_USER + state, num_cores * sizeof(float));
+        for (state = 0; state < pvt->num_states; state++) {
+            DMM_DN_CREATE(dn, CPU_USER + state, num_send * sizeof(float));
+            fractions[state] = DMM_DN_DATA(dn, float);
+            DMM_DN_ADVANCE(dn);
+        }
+        DMM_DN_CREATE(dn, CPU_ID, num_send * sizeof(uint32_t));
+        cpu_ids = DMM_DN_DATA(dn, uint32_t);
+        DMM_DN_ADVANCE(dn);
         DMM_DN_MKEND(dn);
-        /* XXX - if num_cores is changed in another thread, this may be a problem */
-        for (core = 0; core < num_cores; core++) {
-            total_jiffies_delta = 0;
-            /* 31 == sizeof(buf) - 1 */
-            assert(fscanf(f, "%31s", buf) == 1);
-            if (strncmp(buf, "cpu", 3) != 0) {
-                /* OOPS, number of cores is now less than it was */
-                goto numcore_changed;
-            }
-            if (sscanf(buf + 3, "%d", &tmp) < 1) {
-                /* OOPS, it's not "cpu<number> line */
-                goto numcore_changed;
-            }
-
-            for (state = 0; state < num_states; state++) {
-                int64_t cur_val_delta;
-
-                assert(fscanf(f, "%" SCNu64, &cur_val[core * num_states + state]) == 1);
-                cur_val_delta = cur_val[core * num_states + state] - pvt->prev_val[core * num_states + state];
 
+        num_send = 0;
+        for (i = 0; i < pvt->num_cpus; i++) {
+            if (!pvt->prev_valid[pvt->cpus[i]])
+                continue;
+            cur_val = pvt->cur_val + (size_t)pvt->cpus[i] * pvt->num_states;
+            prev_val = pvt->prev_val + (size_t)pvt->cpus[i] * pvt->num_states;
+            total_jiffies_delta = 0;
+            for (state = 0; state < pvt->num_states; state++) {
                 /* proc(5) says that counter for iowait state can decrease, check for it */
-                if (cur_val_delta < 0) {
-                    cur_val_delta = 0;
-                }
-
-                total_jiffies_delta += cur_val_delta;
+                if (cur_val[state] > prev_val[state])
+                    total_jiffies_delta += cur_val[state] - prev_val[state];
             }
             if (total_jiffies_delta == 0) {
                 /* This should not happen, but it does, so check for it */
-                dmm_log(DMM_LOG_ERR, "total_jiffies == 0 for core %d, return 0 for all states (instead of NaN)", core);
-                for (state = 0; state < num_states; state++) {
-                    dmm_log(DMM_LOG_ERR, "state: %d, prev_val: %" PRIu64 ", cur_val: %" PRIu64,
-                            state,
-                            pvt->prev_val[core * num_states + state],
-                            cur_val[core * num_states + state]
-                           );
-                }
+                dmm_log(DMM_LOG_ERR, "total_jiffies == 0 for CPU %" PRIu32 ", return 0 for all states (instead of NaN)",
+                        pvt->cpus[i]);
                 /* As total_jiffies_delta == 0, all counters are equal to their
                  * previous state, so all returned values will be 0 for
                  * any total_jiffies_delta value except 0
                  */
                 total_jiffies_delta = 1;
             }
-            dn = DMM_DATA_NODES(data);
-            for (state = 0; state < num_states; state++) {
-                int64_t cur_val_delta;
-
-                cur_val_delta = cur_val[core * num_states + state] - pvt->prev_val[core * num_states + state];
-                /* proc(5) says that counter for iowait state can decrease, check for it */
-                if (cur_val_delta < 0) {
-                    cur_val_delta = 0;
-                }
-
-                DMM_DN_DATA(dn, float)[core] =
-                    (float)(cur_val_delta) / total_jiffies_delta;
-                DMM_DN_ADVANCE(dn);
-                pvt->prev_val[core * num_states + state] = cur_val[core * num_states + state];
+            for (state = 0; state < pvt->num_states; state++) {
+                delta = cur_val[state] > prev_val[state] ? cur_val[state] - prev_val[state] : 0;
+                fractions[state][num_send] = (float)delta / total_jiffies_delta;
             }
-            assert(fscanf(f, "%*1[\n]") == 0);
-        }
-        /* 31 = sizeof(buf) - 1 */
-        assert(fscanf(f, "%31s", buf) == 1);
-        if (strncmp(buf, "cpu", 3) == 0) {
-            /* OOPS, more cores is here now */
-            goto numcore_changed;
+            cpu_ids[num_send++] = pvt->cpus[i];
         }
         DMM_DATA_SEND(data, pvt->hook);
         DMM_DATA_UNREF(data);
-    } else {
-        /* No previous data, or no hook to send. Just fill prev_val */
-        return fill_prev(node, false);
     }
-    return 0;
 
-numcore_changed:
-    DMM_DATA_UNREF(data);
-    count_cores_states(node);
-    return fill_prev(node, true);
+    /* Current values become previous ones */
+    update_online(pvt);
+    tmp = pvt->prev_val;
+    pvt->prev_val = pvt->cur_val;
+    pvt->cur_val = tmp;
+    tmpcpus = pvt->prev_cpus;
+    pvt->prev_cpus = pvt->cpus;
+    pvt->cpus = tmpcpus;
+    pvt->prev_num_cpus = pvt->num_cpus;
+    return 0;
 }
 
 static int ctor(dmm_node_p node)
@@ -295,27 +272,32 @@ static int ctor(dmm_node_p node)
         return ENOMEM;
     DMM_NODE_SETPRIVATE(node, pvt);
 
-    pvt->f = fopen(DATAFILE, "re");
-    if (pvt->f == NULL) {
+    if ((err = sensorfile_open(&pvt->sf, DATAFILE)) == 0)
+        err = sensorfile_read(&pvt->sf);
+    if (err != 0) {
         char errbuf[128], *errmsg;
-        err = errno;
         errmsg = strerror_r(err, errbuf, sizeof(errbuf));
-        dmm_log(DMM_LOG_ERR, "Cannot open %s for reading: %s", DATAFILE, errmsg);
+        dmm_log(DMM_LOG_ERR, "Cannot read %s: %s", DATAFILE, errmsg);
+        sensorfile_close(&pvt->sf);
         DMM_FREE(pvt);
         return err;
     }
-    // Disable buffering to have fresh data on successive reads
-    setlinebuf(pvt->f);
-    if (num_states == 0)
-        count_cores_states(node);
-    if (num_states == 0) {
-        fclose(pvt->f);
+    pvt->num_states = count_states(pvt->sf.buf);
+    if (pvt->num_states == 0 || pvt->num_states > CPU_GUEST_NICE - CPU_USER + 1) {
+        dmm_log(DMM_LOG_ERR, "Can't parse %s", DATAFILE);
+        sensorfile_close(&pvt->sf);
         DMM_FREE(pvt);
         return EINVAL;
     }
     pvt->hook = NULL;
-    pvt->prev_val_filled = false;
+    pvt->num_slots = 0;
     pvt->prev_val = NULL;
+    pvt->cur_val = NULL;
+    pvt->prev_valid = NULL;
+    pvt->cpus = NULL;
+    pvt->prev_cpus = NULL;
+    pvt->num_cpus = 0;
+    pvt->prev_num_cpus = 0;
     return 0;
 }
 
@@ -323,7 +305,8 @@ static void dtor(dmm_node_p node)
 {
     struct pvt_data *pvt;
     pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
-    fclose(pvt->f);
+    sensorfile_close(&pvt->sf);
+    free_slots(pvt);
     DMM_FREE(pvt);
 }
 
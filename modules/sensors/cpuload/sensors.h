@@ -15,7 +15,9 @@ enum {
     CPU_SOFTIRQ,
     CPU_STEAL,
     CPU_GUEST,
-    CPU_GUEST_NICE
+    CPU_GUEST_NICE,
+    /* uint32_t CPU numbers for values of other sensors */
+    CPU_ID
 };
 
 #endif /* MODULES_CPULOAD_SENSORS_H_ */
@@ -0,0 +1,399 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+/*
+ * diskstats sends block device counters from /proc/diskstats.
+ *
+ * Counters are sent as vectors with one element per selected device
+ * accompanied by DISK_DEV vector of device numbers, so they can be fed
+ * to derivative directly. Devices are selected by name patterns.
+ *
+ * The list of devices in file order with the result of pattern
+ * matching is kept between ticks. While device numbers in the file
+ * are the same, names are neither copied nor matched. When the set
+ * of devices changes the list is rebuilt and DISK_NAMES datanode
+ * with names of selected devices is sent.
+ */
+
+#include <errno.h>
+#include <fnmatch.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/sysmacros.h>
+
+#include "dmm_base.h"
+#include "dmm_log.h"
+#include "dmm_message.h"
+#include "../sensorfile.h"
+#include "diskstats.h"
+#include "sensors.h"
+
+#define HOOKNAME "out"
+
+#define DISKSTATS_PATH "/proc/diskstats"
+
+#define NUM_COUNTERS 5
+
+/*
+ * Columns of counters after device name (1-based): reads completed,
+ * writes completed, sectors read, sectors written, weighted time in queue
+ */
+static const int counter_cols[NUM_COUNTERS] = { 1, 5, 3, 7, 11 };
+
+#define NUM_COLS 11
+
+struct dev {
+    uint64_t dev;
+    bool selected;
+};
+
+struct pvt_data {
+    dmm_hook_p hook;
+    struct sensorfile sf;
+    struct dmm_diskstats_pattern *patterns;
+    size_t num_patterns;
+    /* All devices in file order, arrays have max_devs elements */
+    struct dev *devs;
+    size_t num_devs;
+    size_t max_devs;
+    /* Selected devices */
+    size_t num_sel;
+    uint64_t *devnos;
+    uint64_t *counters[NUM_COUNTERS];
+    struct dmm_diskstats_name *names;
+    /* Set of selected devices changed since names were sent last time */
+    bool changed;
+};
+
+static void free_devs(struct pvt_data *pvt)
+{
+    int i;
+
+    DMM_FREE(pvt->devs);
+    DMM_FREE(pvt->devnos);
+    for (i = 0; i < NUM_COUNTERS; ++i)
+        DMM_FREE(pvt->counters[i]);
+    DMM_FREE(pvt->names);
+}
+
+static int grow_devs(struct pvt_data *pvt)
+{
+    size_t max_devs;
+    void *p;
+    int i;
+
+    max_devs = pvt->max_devs > 0 ? pvt->max_devs * 2 : 32;
+    if ((p = DMM_REALLOC(pvt->devs, max_devs * sizeof(*pvt->devs))) == NULL)
+        return ENOMEM;
+    pvt->devs = (struct dev *)p;
+    if ((p = DMM_REALLOC(pvt->devnos, max_devs * sizeof(*pvt->devnos))) == NULL)
+        return ENOMEM;
+    pvt->devnos = (uint64_t *)p;
+    for (i = 0; i < NUM_COUNTERS; ++i) {
+        if ((p = DMM_REALLOC(pvt->counters[i], max_devs * sizeof(uint64_t))) == NULL)
+            return ENOMEM;
+        pvt->counters[i] = (uint64_t *)p;
+    }
+    if ((p = DMM_REALLOC(pvt->names, max_devs * sizeof(*pvt->names))) == NULL)
+        return ENOMEM;
+    pvt->names = (struct dmm_diskstats_name *)p;
+    pvt->max_devs = max_devs;
+    return 0;
+}
+
+static bool name_selected(struct pvt_data *pvt, const char *name)
+{
+    size_t i;
+
+    if (pvt->num_patterns == 0)
+        return true;
+    for (i = 0; i < pvt->num_patterns; ++i)
+        if (fnmatch(pvt->patterns[i].pattern, name, 0) == 0)
+            return true;
+    return false;
+}
+
+/* Parse device number at the beginning of line, return pointer to name */
+static const char *parse_dev(const char *line, uint64_t *dev)
+{
+    uint64_t major, minor;
+
+    if ((line = sensorfile_u64(line, &major)) == NULL ||
+        (line = sensorfile_u64(line, &minor)) == NULL)
+        return NULL;
+    *dev = makedev(major, minor);
+    return sensorfile_skipblanks(line);
+}
+
+/*
+ * Get counters of selected devices if the set of devices is the same
+ * as in pvt->devs, return false otherwise
+ */
+static bool collect(struct pvt_data *pvt)
+{
+    const char *line, *s;
+    uint64_t dev, vals[NUM_COLS + 1];
+    size_t i, sel;
+    int c;
+
+    i = 0;
+    sel = 0;
+    for (line = pvt->sf.buf; *line != '\0'; line = sensorfile_nextline(line)) {
+        if ((s = parse_dev(line, &dev)) == NULL)
+            continue;
+        if (i == pvt->num_devs || pvt->devs[i].dev != dev)
+            return false;
+        if (pvt->devs[i++].selected) {
+            s = sensorfile_skipfield(s);
+            memset(vals, 0, sizeof(vals));
+            for (c = 1; c <= NUM_COLS; ++c)
+                if ((s = sensorfile_u64(s, &vals[c])) == NULL)
+                    break;
+            for (c = 0; c < NUM_COUNTERS; ++c)
+                pvt->counters[c][sel] = vals[counter_cols[c]];
+            sel++;
+        }
+    }
+    return i == pvt->num_devs;
+}
+
+/* Rebuild the list of devices from the file */
+static int rebuild(struct pvt_data *pvt)
+{
+    const char *line, *name, *end;
+    struct dmm_diskstats_name *dn;
+    uint64_t dev;
+    size_t len;
+    int err;
+
+    pvt->num_devs = 0;
+    pvt->num_sel = 0;
+    for (line = pvt->sf.buf; *line != '\0'; line = sensorfile_nextline(line)) {
+        if ((name = parse_dev(line, &dev)) == NULL)
+            continue;
+        if (pvt->num_devs == pvt->max_devs && (err = grow_devs(pvt)) != 0)
+            return err;
+        pvt->devs[pvt->num_devs].dev = dev;
+        pvt->devs[pvt->num_devs].selected = false;
+        end = sensorfile_skipfield(name);
+        len = (size_t)(end - name);
+        if (len > 0 && len < DMM_DISKSTATS_NAMESIZE) {
+            dn = &pvt->names[pvt->num_sel];
+            memset(dn, 0, sizeof(*dn));
+            memcpy(dn->name, name, len);
+            if (name_selected(pvt, dn->name)) {
+                dn->dev = dev;
+                pvt->devnos[pvt->num_sel++] = dev;
+                pvt->devs[pvt->num_devs].selected = true;
+            }
+        }
+        pvt->num_devs++;
+    }
+    pvt->changed = true;
+    return 0;
+}
+
+static int process_timer_msg(struct pvt_data *pvt)
+{
+    dmm_data_p data;
+    dmm_datanode_p dn;
+    size_t n, len;
+    int i, err;
+
+    if ((err = sensorfile_read(&pvt->sf)) != 0 ||
+        (!collect(pvt) && ((err = rebuild(pvt)) != 0 || !collect(pvt)))) {
+        char errbuf[128], *errmsg;
+        err = (err != 0) ? err : EIO;
+        errmsg = strerror_r(err, errbuf, sizeof(errbuf));
+        dmm_log(DMM_LOG_ERR, "Cannot get disk statistics: %s", errmsg);
+        /* Rebuild the list when it works again */
+        pvt->num_devs = 0;
+        return err;
+    }
+    n = pvt->num_sel;
+    if (n == 0)
+        return 0;
+
+    len = (NUM_COUNTERS + 1) * n * sizeof(uint64_t);
+    if (pvt->changed)
+        len += n * sizeof(struct dmm_diskstats_name);
+    if ((data = DMM_DATA_CREATE_RAW(NUM_COUNTERS + 1 + pvt->changed, len)) == NULL) {
+        dmm_log(DMM_LOG_ERR, "Cannot allocate memory for data");
+        return ENOMEM;
+    }
+    dn = DMM_DATA_NODES(data);
+    for (i = 0; i < NUM_COUNTERS; ++i)
+        DMM_DN_FILL_ADVANCE(dn, DISK_READS + i, n * sizeof(uint64_t), pvt->counters[i]);
+    DMM_DN_FILL_ADVANCE(dn, DISK_DEV, n * sizeof(uint64_t), pvt->devnos);
+    if (pvt->changed)
+        DMM_DN_FILL_ADVANCE(dn, DISK_NAMES, n * sizeof(struct dmm_diskstats_name), pvt->names);
+    DMM_DN_MKEND(dn);
+    DMM_DATA_SEND(data, pvt->hook);
+    DMM_DATA_UNREF(data);
+    pvt->changed = false;
+
+    return 0;
+}
+
+static int set_patterns(struct pvt_data *pvt, const struct dmm_diskstats_pattern *patterns, size_t n)
+{
+    struct dmm_diskstats_pattern *p = NULL;
+    size_t i;
+
+    for (i = 0; i < n; ++i)
+        if (memchr(patterns[i].pattern, '\0', sizeof(patterns[i].pattern)) == NULL)
+            return EINVAL;
+    if (n > 0) {
+        if ((p = DMM_MALLOC(n * sizeof(*p))) == NULL)
+            return ENOMEM;
+        memcpy(p, patterns, n * sizeof(*p));
+    }
+    DMM_FREE(pvt->patterns);
+    pvt->patterns = p;
+    pvt->num_patterns = n;
+    /* Match names again on the next tick */
+    pvt->num_devs = 0;
+    return 0;
+}
+
+static int ctor(dmm_node_p node)
+{
+    struct pvt_data *pvt;
+    int err, i;
+
+    pvt = (struct pvt_data *)DMM_MALLOC(sizeof(*pvt));
+    if (pvt == NULL)
+        return ENOMEM;
+    if ((err = sensorfile_open(&pvt->sf, DISKSTATS_PATH)) != 0) {
+        char errbuf[128], *errmsg;
+        errmsg = strerror_r(err, errbuf, sizeof(errbuf));
+        dmm_log(DMM_LOG_ERR, "Cannot open %s: %s", DISKSTATS_PATH, errmsg);
+        DMM_FREE(pvt);
+        return err;
+    }
+    pvt->hook = NULL;
+    pvt->patterns = NULL;
+    pvt->num_patterns = 0;
+    pvt->devs = NULL;
+    pvt->num_devs = 0;
+    pvt->max_devs = 0;
+    pvt->num_sel = 0;
+    pvt->devnos = NULL;
+    for (i = 0; i < NUM_COUNTERS; ++i)
+        pvt->counters[i] = NULL;
+    pvt->names = NULL;
+    pvt->changed = true;
+    DMM_NODE_SETPRIVATE(node, pvt);
+    return 0;
+}
+
+static void dtor(dmm_node_p node)
+{
+    struct pvt_data *pvt;
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
+    sensorfile_close(&pvt->sf);
+    DMM_FREE(pvt->patterns);
+    free_devs(pvt);
+    DMM_FREE(pvt);
+}
+
+static int newhook(dmm_hook_p hook)
+{
+    struct pvt_data *pvt;
+
+    if (DMM_HOOK_ISIN(hook))
+        return EINVAL;
+    if (strcmp(HOOKNAME, DMM_HOOK_NAME(hook)) != 0)
+        return EINVAL;
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(DMM_HOOK_NODE(hook));
+    pvt->hook = hook;
+    /* Send names to the new receiver */
+    pvt->changed = true;
+
+    return 0;
+}
+
+static void rmhook(dmm_hook_p hook)
+{
+    struct pvt_data *pvt;
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(DMM_HOOK_NODE(hook));
+    pvt->hook = NULL;
+}
+
+static int rcvmsg(dmm_node_p node, dmm_msg_p msg)
+{
+    struct pvt_data *pvt;
+    dmm_msg_p resp;
+    int err = 0;
+
+#define CREATE_SEND_EMPTY_RESP()                                    \
+        do {                                                        \
+            resp = DMM_MSG_CREATE_RESP(DMM_NODE_ID(node), msg, 0);  \
+            if (resp != NULL) {                                     \
+                if (err != 0)                                       \
+                    msg->cm_flags |= DMM_MSG_ERR;                   \
+                                                                    \
+                DMM_MSG_SEND_ID(msg->cm_src, resp);                 \
+            } else                                                  \
+                err = (err != 0) ? err : ENOMEM;                    \
+        } while (0)
+
+    if (msg->cm_flags & DMM_MSG_RESP)
+        goto err;
+
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
+    switch (msg->cm_type) {
+    case DMM_MSGTYPE_GENERIC:
+        /* Accept only TIMERTRIGGER messages */
+        if (msg->cm_cmd != DMM_MSG_TIMERTRIGGER) {
+            err = ENOTSUP;
+            break;
+        }
+        // Nowhere to send, so why bother?
+        if (pvt->hook != NULL)
+            err = process_timer_msg(pvt);
+        break;
+
+    case DMM_MSGTYPE_DISKSTATS:
+        switch (msg->cm_cmd) {
+        case DMM_MSG_DISKSTATS_SET: {
+            struct dmm_msg_diskstats_set *set = DMM_MSG_DATA(msg, struct dmm_msg_diskstats_set);
+            dmm_size_t num_patterns;
+
+            num_patterns = (msg->cm_len - sizeof(struct dmm_msg_diskstats_set)) / sizeof(struct dmm_diskstats_pattern);
+            err = set_patterns(pvt, set->patterns, num_patterns);
+            CREATE_SEND_EMPTY_RESP();
+            break;
+        }
+
+        default:
+            err = ENOTSUP;
+            break;
+        }
+        break;
+
+    default:
+        err = ENOTSUP;
+        break;
+    }
+
+#undef CREATE_SEND_EMPTY_RESP
+
+err:
+    DMM_MSG_FREE(msg);
+    return err;
+}
+
+static struct dmm_type type = {
+    "diskstats",
+    ctor,
+    dtor,
+    NULL,
+    rcvmsg,
+    newhook,
+    rmhook,
+    {},
+};
+
+DMM_MODULE_DECLARE(&type);
@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+#ifndef MODULES_DISKSTATS_DISKSTATS_H_
+#define MODULES_DISKSTATS_DISKSTATS_H_
+
+#include "dmm_types.h"
+
+enum {
+    DMM_MSGTYPE_DISKSTATS = 0x14c7da06
+};
+
+enum {
+    DMM_MSG_DISKSTATS_SET = 1,
+};
+
+enum { DMM_DISKSTATS_NAMESIZE = 32 };
+
+/* fnmatch(3) pattern of device names, e.g. "sd[a-z]" or "nvme*n1" */
+struct dmm_diskstats_pattern {
+    char pattern[DMM_DISKSTATS_NAMESIZE];
+};
+
+/*
+ * Send only devices with names matching any of the patterns,
+ * empty list selects all devices (the default)
+ */
+struct dmm_msg_diskstats_set {
+    char                         dummy;
+    struct dmm_diskstats_pattern patterns[];
+};
+
+/* Element of DISK_NAMES datanode */
+struct dmm_diskstats_name {
+    uint64_t dev;
+    char     name[DMM_DISKSTATS_NAMESIZE];
+};
+
+#endif /* MODULES_DISKSTATS_DISKSTATS_H_ */
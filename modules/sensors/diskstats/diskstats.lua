@@ -0,0 +1,29 @@
+-- SPDX-License-Identifier: BSD-2-Clause-Views
+-- Copyright (c) 2013-2023
+--   Research Computing Center Lomonosov Moscow State University
+
+local dmm = require('dmm')
+
+assert(dmm.require_interface('diskstats', 'll'))
+
+local Diskstats = dmm.Module:new_type('diskstats')
+
+--! @brief Select devices to send
+--! @param patterns 'all' or list of fnmatch(3) patterns of device names,
+--! e.g. {'sd[a-z]', 'nvme*n1'}
+function Diskstats:set(patterns)
+  local n = (patterns == 'all') and 0 or #patterns
+  local msg, set = dmm.msg_create {
+    len = dmm.sfam.struct_sizeof('struct dmm_msg_diskstats_set', 'patterns', n),
+    payload_type = 'struct dmm_msg_diskstats_set',
+    type = ffi.C.DMM_MSGTYPE_DISKSTATS,
+    cmd = ffi.C.DMM_MSG_DISKSTATS_SET,
+  }
+  for i = 1, n do
+    assert(#patterns[i] < ffi.C.DMM_DISKSTATS_NAMESIZE, 'pattern is too long')
+    set.patterns[i - 1].pattern = patterns[i]
+  end
+  dmm.msg_send(self.nodeid, msg)
+end
+
+return Diskstats
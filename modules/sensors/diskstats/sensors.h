@@ -0,0 +1,22 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+#ifndef MODULES_DISKSTATS_SENSORS_H_
+#define MODULES_DISKSTATS_SENSORS_H_
+
+enum {
+    /* uint64_t counters, one element per device */
+    DISK_READS = 1200,
+    DISK_WRITES,
+    DISK_SECTORS_READ,
+    DISK_SECTORS_WRITTEN,
+    /* Weighted time spent doing I/O, milliseconds */
+    DISK_TIME_IN_QUEUE,
+    /* uint64_t device numbers (makedev(major, minor)) for counter vectors */
+    DISK_DEV,
+    /* Array of struct dmm_diskstats_name, sent when the set of devices changes */
+    DISK_NAMES
+};
+
+#endif /* MODULES_DISKSTATS_SENSORS_H_ */
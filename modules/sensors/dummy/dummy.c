@@ -3,36 +3,196 @@
 //   Research Computing Center Lomonosov Moscow State University
 
 /*
- * This is dummy sensor which sends empty data on each timer trigger message
+ * This is dummy sensor which sends empty data on each timer trigger message.
+ *
+ * With DMM_MSG_DUMMY_SET it becomes a load generator for benchmarks:
+ * a fixed number of vectors of the given type and length filled with
+ * a reproducible value pattern (see dummy.h). Values are kept in
+ * a state array updated once per data object, so the cost of the sensor
+ * itself is close to that of a real one copying its counters.
  */
 
 #include <errno.h>
+#include <stdint.h>
 #include <string.h>
 
 #include "dmm_base.h"
 #include "dmm_log.h"
 #include "dmm_message.h"
+#include "dummy.h"
+
+#define DEFAULT_SEED 1
+
+union value {
+    uint64_t u;
+    double   d;
+};
 
 struct pvt_data {
     dmm_hook_p hook;
+    struct dmm_msg_dummy_set set;
+    /* Element size of set.type */
+    size_t elsize;
+    /* num_sensors * len current values */
+    union value *vals;
+    /* xorshift64 state */
+    uint64_t rnd;
 };
 
+static inline uint64_t next_random(struct pvt_data *pvt)
+{
+    uint64_t x = pvt->rnd;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return pvt->rnd = x;
+}
+
+static void reset_values(struct pvt_data *pvt)
+{
+    size_t i, n;
+    uint64_t start;
+
+    n = (size_t)pvt->set.num_sensors * pvt->set.len;
+    for (i = 0; i < n; ++i) {
+        start = (pvt->set.pattern == DMM_DUMMY_RANDOMWALK) ? 0 : i % pvt->set.len;
+        if (pvt->set.type == DMM_DUMMY_DOUBLE)
+            pvt->vals[i].d = (double)start;
+        else
+            pvt->vals[i].u = start;
+    }
+    /* xorshift state must not be 0 */
+    pvt->rnd = (uint64_t)pvt->set.seed * 0x9e3779b97f4a7c15ULL + 1;
+}
+
+/* Replace generator parameters, the old ones are kept on error */
+static int set_params(struct pvt_data *pvt, const struct dmm_msg_dummy_set *set)
+{
+    union value *vals;
+    size_t elsize, n;
+
+    switch (set->type) {
+    case DMM_DUMMY_UINT32:
+        elsize = sizeof(uint32_t);
+        break;
+    case DMM_DUMMY_UINT64:
+        elsize = sizeof(uint64_t);
+        break;
+    case DMM_DUMMY_DOUBLE:
+        elsize = sizeof(double);
+        break;
+    default:
+        return EINVAL;
+    }
+    if (set->pattern != DMM_DUMMY_CONSTANT && set->pattern != DMM_DUMMY_COUNTER &&
+        set->pattern != DMM_DUMMY_RANDOMWALK)
+        return EINVAL;
+    if (set->num_sensors > 0 &&
+        (set->first == 0 || set->first - 1 > UINT32_MAX - set->num_sensors))
+        return EINVAL;
+    if (((uint64_t)set->len * elsize + sizeof(struct dmm_datanode)) *
+        set->num_sensors > DMM_DUMMY_MAXDATASIZE)
+        return EFBIG;
+
+    n = (size_t)set->num_sensors * set->len;
+    vals = NULL;
+    if (n > 0 && (vals = (union value *)DMM_MALLOC(n * sizeof(*vals))) == NULL)
+        return ENOMEM;
+    DMM_FREE(pvt->vals);
+    pvt->vals = vals;
+    pvt->set = *set;
+    pvt->elsize = elsize;
+    reset_values(pvt);
+    return 0;
+}
+
+/* Advance values to the next data object */
+static void update_values(struct pvt_data *pvt)
+{
+    union value *v, *end;
+    uint64_t r;
+
+    end = pvt->vals + (size_t)pvt->set.num_sensors * pvt->set.len;
+    switch (pvt->set.pattern) {
+    case DMM_DUMMY_COUNTER:
+        if (pvt->set.type == DMM_DUMMY_DOUBLE)
+            for (v = pvt->vals; v < end; ++v)
+                v->d += 1.0;
+        else
+            for (v = pvt->vals; v < end; ++v)
+                v->u++;
+        break;
+
+    case DMM_DUMMY_RANDOMWALK:
+        if (pvt->set.type == DMM_DUMMY_DOUBLE) {
+            for (v = pvt->vals; v < end; ++v)
+                v->d += (double)(next_random(pvt) >> 11) * 0x1.0p-52 - 1.0;
+        } else {
+            for (v = pvt->vals; v < end; ++v) {
+                r = next_random(pvt);
+                if ((r & 1) || v->u == 0)
+                    v->u++;
+                else
+                    v->u--;
+            }
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+static dmm_data_p create_data(struct pvt_data *pvt)
+{
+    dmm_data_p data;
+    dmm_datanode_p dn;
+    const union value *v;
+    size_t veclen;
+    uint32_t i, j;
+
+    veclen = pvt->set.len * pvt->elsize;
+    if ((data = DMM_DATA_CREATE(pvt->set.num_sensors, veclen)) == NULL)
+        return NULL;
+
+    update_values(pvt);
+    dn = DMM_DATA_NODES(data);
+    v = pvt->vals;
+    for (i = 0; i < pvt->set.num_sensors; ++i) {
+        DMM_DN_CREATE(dn, pvt->set.first + i, veclen);
+        if (pvt->set.type == DMM_DUMMY_UINT32) {
+            for (j = 0; j < pvt->set.len; ++j)
+                DMM_DN_VECTOR(dn, uint32_t)[j] = (uint32_t)v[j].u;
+        } else {
+            /* uint64_t and double are stored as is */
+            memcpy(dn->dn_data, v, veclen);
+        }
+        v += pvt->set.len;
+        DMM_DN_ADVANCE(dn);
+    }
+    DMM_DN_MKEND(dn);
+    return data;
+}
+
 static int process_timer_msg(dmm_node_p node)
 {
     struct pvt_data *pvt;
     dmm_hook_p hook;
     dmm_data_p data;
-    dmm_datanode_p dn;
+    uint32_t i;
 
     pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
     hook = pvt->hook;
     if (hook != NULL) {
-        data = DMM_DATA_CREATE(0, 0);
-
-        dn = DMM_DATA_NODES(data);
-        DMM_DN_MKEND(dn);
-        DMM_DATA_SEND(data, hook);
-        DMM_DATA_UNREF(data);
+        for (i = 0; i < pvt->set.num_objects; ++i) {
+            if ((data = create_data(pvt)) == NULL) {
+                dmm_log(DMM_LOG_ERR, "Cannot allocate memory for data");
+                return ENOMEM;
+            }
+            DMM_DATA_SEND(data, hook);
+            DMM_DATA_UNREF(data);
+        }
     }
 
     return 0;
@@ -47,6 +207,14 @@ static int ctor(dmm_node_p node)
         return ENOMEM;
     DMM_NODE_SETPRIVATE(node, pvt);
     pvt->hook = NULL;
+    memset(&pvt->set, 0, sizeof(pvt->set));
+    pvt->set.type = DMM_DUMMY_UINT64;
+    pvt->set.pattern = DMM_DUMMY_CONSTANT;
+    pvt->set.num_objects = 1;
+    pvt->set.seed = DEFAULT_SEED;
+    pvt->elsize = sizeof(uint64_t);
+    pvt->vals = NULL;
+    reset_values(pvt);
 
     return 0;
 }
@@ -55,6 +223,7 @@ static void dtor(dmm_node_p node)
 {
     struct pvt_data *pvt;
     pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
+    DMM_FREE(pvt->vals);
     DMM_FREE(pvt);
 }
 
@@ -83,19 +252,58 @@ static void rmhook(dmm_hook_p hook)
 
 static int rcvmsg(dmm_node_p node, dmm_msg_p msg)
 {
+    struct pvt_data *pvt;
+    dmm_msg_p resp;
     int err = 0;
 
-    /* Accept only generic messages */
-    if (msg->cm_type != DMM_MSGTYPE_GENERIC) {
-        err = ENOTSUP;
+#define CREATE_SEND_EMPTY_RESP()                                    \
+        do {                                                        \
+            resp = DMM_MSG_CREATE_RESP(DMM_NODE_ID(node), msg, 0);  \
+            if (resp != NULL) {                                     \
+                if (err != 0)                                       \
+                    msg->cm_flags |= DMM_MSG_ERR;                   \
+                                                                    \
+                DMM_MSG_SEND_ID(msg->cm_src, resp);                 \
+            } else                                                  \
+                err = (err != 0) ? err : ENOMEM;                    \
+        } while (0)
+
+    if (msg->cm_flags & DMM_MSG_RESP)
         goto err;
-    }
-    /* Accept only TIMERTRIGGER messages */
-    if (msg->cm_cmd != DMM_MSG_TIMERTRIGGER) {
+
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
+    switch (msg->cm_type) {
+    case DMM_MSGTYPE_GENERIC:
+        /* Accept only TIMERTRIGGER messages */
+        if (msg->cm_cmd != DMM_MSG_TIMERTRIGGER) {
+            err = ENOTSUP;
+            break;
+        }
+        err = process_timer_msg(node);
+        break;
+
+    case DMM_MSGTYPE_DUMMY:
+        switch (msg->cm_cmd) {
+        case DMM_MSG_DUMMY_SET:
+            if (msg->cm_len != sizeof(struct dmm_msg_dummy_set))
+                err = EINVAL;
+            else
+                err = set_params(pvt, DMM_MSG_DATA(msg, struct dmm_msg_dummy_set));
+            CREATE_SEND_EMPTY_RESP();
+            break;
+
+        default:
+            err = ENOTSUP;
+            break;
+        }
+        break;
+
+    default:
         err = ENOTSUP;
-        goto err;
+        break;
     }
-    err = process_timer_msg(node);
+
+#undef CREATE_SEND_EMPTY_RESP
 
 err:
     DMM_MSG_FREE(msg);
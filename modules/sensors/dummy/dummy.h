@@ -0,0 +1,57 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+#ifndef MODULES_DUMMY_DUMMY_H_
+#define MODULES_DUMMY_DUMMY_H_
+
+#include "dmm_types.h"
+
+enum {
+    DMM_MSGTYPE_DUMMY = 0x2769311c
+};
+
+enum {
+    DMM_MSG_DUMMY_SET = 1,
+};
+
+/* Element types */
+enum {
+    DMM_DUMMY_UINT32,
+    DMM_DUMMY_UINT64,
+    DMM_DUMMY_DOUBLE
+};
+
+/* Value patterns */
+enum {
+    /* Element j of every vector is j */
+    DMM_DUMMY_CONSTANT,
+    /* Element j starts from j and grows by 1 with every data object */
+    DMM_DUMMY_COUNTER,
+    /*
+     * Every element starts from 0 and makes a random step of 1
+     * (uniform in [-1, 1] for doubles) with every data object,
+     * integers do not go below 0. Sequence depends on the seed only.
+     */
+    DMM_DUMMY_RANDOMWALK
+};
+
+/* Upper bound of the data object size */
+enum { DMM_DUMMY_MAXDATASIZE = 1 << 30 };
+
+/*
+ * Send num_objects data objects on every timer trigger, each with
+ * num_sensors datanodes of ids first, first + 1, ... holding vectors
+ * of len elements. num_sensors 0 (the default) sends empty data.
+ */
+struct dmm_msg_dummy_set {
+    dmm_sensorid_t first;
+    uint32_t       num_sensors;
+    uint32_t       len;
+    uint32_t       type;
+    uint32_t       pattern;
+    uint32_t       num_objects;
+    uint32_t       seed;
+};
+
+#endif /* MODULES_DUMMY_DUMMY_H_ */
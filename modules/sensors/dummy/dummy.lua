@@ -0,0 +1,48 @@
+-- SPDX-License-Identifier: BSD-2-Clause-Views
+-- Copyright (c) 2013-2023
+--   Research Computing Center Lomonosov Moscow State University
+
+local dmm = require('dmm')
+
+assert(dmm.require_interface('dummy', 'll'))
+
+local Dummy = dmm.Module:new_type('dummy')
+
+local types = {
+  uint32_t = ffi.C.DMM_DUMMY_UINT32,
+  uint64_t = ffi.C.DMM_DUMMY_UINT64,
+  double = ffi.C.DMM_DUMMY_DOUBLE,
+}
+
+local patterns = {
+  constant = ffi.C.DMM_DUMMY_CONSTANT,
+  counter = ffi.C.DMM_DUMMY_COUNTER,
+  randomwalk = ffi.C.DMM_DUMMY_RANDOMWALK,
+}
+
+--! @brief Set generated load, see dummy.h
+--! @param params table with fields (defaults in parentheses)
+--! first: id of the first sensor,
+--! sensors: number of sensors (0, send empty data),
+--! len: number of vector elements (1),
+--! type: 'uint32_t', 'uint64_t' or 'double' ('uint64_t'),
+--! pattern: 'constant', 'counter' or 'randomwalk' ('constant'),
+--! objects: data objects per timer trigger (1),
+--! seed: random walk seed (1)
+function Dummy:set(params)
+  local msg, set = dmm.msg_create {
+    payload_type = 'struct dmm_msg_dummy_set',
+    type = ffi.C.DMM_MSGTYPE_DUMMY,
+    cmd = ffi.C.DMM_MSG_DUMMY_SET,
+  }
+  set.first = params.first or 0
+  set.num_sensors = params.sensors or 0
+  set.len = params.len or 1
+  set.type = assert(types[params.type or 'uint64_t'], 'unknown type')
+  set.pattern = assert(patterns[params.pattern or 'constant'], 'unknown pattern')
+  set.num_objects = params.objects or 1
+  set.seed = params.seed or 1
+  dmm.msg_send(self.nodeid, msg)
+end
+
+return Dummy
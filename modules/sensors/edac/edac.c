@@ -4,65 +4,385 @@
 
 /*
  * This is edac sensor which sends {memory controllers count, corrected
- * errors, uncorrected errors, pci parity errors} on each timer trigger 
- * message
+ * errors, uncorrected errors, pci parity errors} totals and corrected
+ * and uncorrected error vectors per memory controller and per DIMM
+ * on each timer trigger message.
+ *
+ * root/devices/system/edac/mc is enumerated once, counter files of all
+ * controllers and DIMMs are kept open and reread with pread(2). The tree
+ * is enumerated again only when the link count of the mc directory,
+ * which is the number of its subdirectories on sysfs, changes.
  */
 
+#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-
-#include <edac.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "dmm_base.h"
 #include "dmm_log.h"
 #include "dmm_message.h"
+#include "../sensorfile.h"
+#include "edac.h"
 #include "sensors.h"
 
-typedef uint64_t sensor_type;
-const int num_sensors = 4;
+#define DEFAULT_ROOT "/sys"
+
+#define EDAC_DIR "devices/system/edac"
+
+struct counters {
+    int ce_fd;
+    int ue_fd;
+};
+
+struct mc {
+    uint32_t id;
+    struct counters cnt;
+};
+
+struct dimm {
+    struct dmm_edac_dimm id;
+    struct counters cnt;
+};
 
 struct pvt_data {
     dmm_hook_p hook;
-    edac_handle *edac;
+    char root[DMM_EDAC_PATHSIZE];
+    bool scanned;
+    /* Scan failure is already reported */
+    bool warned;
+    int mcdir_fd;
+    nlink_t mcdir_nlink;
+    int pci_fd;
+    /* Sorted by controller number */
+    struct mc *mcs;
+    size_t num_mcs;
+    uint64_t *mc_ce;
+    uint64_t *mc_ue;
+    uint32_t *mc_ids;
+    /* Sorted by controller and directory name */
+    struct dimm *dimms;
+    size_t num_dimms;
+    uint64_t *dimm_ce;
+    uint64_t *dimm_ue;
+    struct dmm_edac_dimm *dimm_ids;
+    /* DIMMs changed since EDAC_DIMMS was sent last time */
+    bool changed;
 };
 
-static int process_timer_msg(dmm_node_p node)
+static void close_counters(struct counters *cnt)
+{
+    if (cnt->ce_fd >= 0)
+        close(cnt->ce_fd);
+    if (cnt->ue_fd >= 0)
+        close(cnt->ue_fd);
+}
+
+static void close_all(struct pvt_data *pvt)
+{
+    size_t i;
+
+    for (i = 0; i < pvt->num_mcs; ++i)
+        close_counters(&pvt->mcs[i].cnt);
+    for (i = 0; i < pvt->num_dimms; ++i)
+        close_counters(&pvt->dimms[i].cnt);
+    if (pvt->mcdir_fd >= 0)
+        close(pvt->mcdir_fd);
+    if (pvt->pci_fd >= 0)
+        close(pvt->pci_fd);
+    DMM_FREE(pvt->mcs);
+    DMM_FREE(pvt->mc_ce);
+    DMM_FREE(pvt->mc_ue);
+    DMM_FREE(pvt->mc_ids);
+    DMM_FREE(pvt->dimms);
+    DMM_FREE(pvt->dimm_ce);
+    DMM_FREE(pvt->dimm_ue);
+    DMM_FREE(pvt->dimm_ids);
+    pvt->mcdir_fd = -1;
+    pvt->pci_fd = -1;
+    pvt->mcs = NULL;
+    pvt->num_mcs = 0;
+    pvt->mc_ce = NULL;
+    pvt->mc_ue = NULL;
+    pvt->mc_ids = NULL;
+    pvt->dimms = NULL;
+    pvt->num_dimms = 0;
+    pvt->dimm_ce = NULL;
+    pvt->dimm_ue = NULL;
+    pvt->dimm_ids = NULL;
+    pvt->scanned = false;
+    pvt->changed = true;
+}
+
+/* Open counter files in dirfd, return true if both are opened */
+static bool open_counters(int dirfd, const char *ce, const char *ue, struct counters *cnt)
+{
+    cnt->ce_fd = openat(dirfd, ce, O_RDONLY | O_CLOEXEC);
+    cnt->ue_fd = openat(dirfd, ue, O_RDONLY | O_CLOEXEC);
+    if (cnt->ce_fd >= 0 && cnt->ue_fd >= 0)
+        return true;
+    close_counters(cnt);
+    return false;
+}
+
+static int mc_cmp(const void *a, const void *b)
+{
+    uint32_t na = ((const struct mc *)a)->id, nb = ((const struct mc *)b)->id;
+    return na < nb ? -1 : na > nb;
+}
+
+static int dimm_cmp(const void *a, const void *b)
+{
+    const struct dmm_edac_dimm *da = &((const struct dimm *)a)->id;
+    const struct dmm_edac_dimm *db = &((const struct dimm *)b)->id;
+    size_t la, lb;
+
+    if (da->mc != db->mc)
+        return da->mc < db->mc ? -1 : 1;
+    /* dimm2 before dimm10 */
+    la = strlen(da->name);
+    lb = strlen(db->name);
+    if (la != lb)
+        return la < lb ? -1 : 1;
+    return strcmp(da->name, db->name);
+}
+
+/*
+ * Open DIMM counters of controller mc. Drivers with per-DIMM or per-rank
+ * information have dimmN or rankN directories, older ones have csrowN
+ * only, which are used as a fallback
+ */
+static int scan_dimms(struct pvt_data *pvt, int mcfd, uint32_t mc, size_t *max)
+{
+    struct dirent *de;
+    struct dimm *d;
+    size_t found;
+    uint32_t num;
+    bool csrow, ok;
+    DIR *dir;
+    int fd, err = 0;
+
+    if ((fd = dup(mcfd)) < 0 || (dir = fdopendir(fd)) == NULL) {
+        err = errno;
+        if (fd >= 0)
+            close(fd);
+        return err;
+    }
+    found = 0;
+    for (csrow = false; ; csrow = true) {
+        while ((de = readdir(dir)) != NULL) {
+            if (csrow ? !sensorfile_numbered(de->d_name, "csrow", &num) :
+                        !sensorfile_numbered(de->d_name, "dimm", &num) &&
+                        !sensorfile_numbered(de->d_name, "rank", &num))
+                continue;
+            if (strlen(de->d_name) >= DMM_EDAC_NAMESIZE)
+                continue;
+            if ((fd = openat(dirfd(dir), de->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+                continue;
+            if (pvt->num_dimms == *max) {
+                *max = *max > 0 ? *max * 2 : 16;
+                if ((d = (struct dimm *)DMM_REALLOC(pvt->dimms, *max * sizeof(*d))) == NULL) {
+                    close(fd);
+                    err = ENOMEM;
+                    break;
+                }
+                pvt->dimms = d;
+            }
+            d = &pvt->dimms[pvt->num_dimms];
+            memset(&d->id, 0, sizeof(d->id));
+            d->id.mc = mc;
+            strcpy(d->id.name, de->d_name);
+            if (csrow) {
+                sensorfile_readline(fd, "ch0_dimm_label", d->id.label, sizeof(d->id.label));
+                ok = open_counters(fd, "ce_count", "ue_count", &d->cnt);
+            } else {
+                sensorfile_readline(fd, "dimm_label", d->id.label, sizeof(d->id.label));
+                ok = open_counters(fd, "dimm_ce_count", "dimm_ue_count", &d->cnt);
+            }
+            close(fd);
+            if (ok) {
+                pvt->num_dimms++;
+                found++;
+            }
+        }
+        if (err != 0 || found > 0 || csrow)
+            break;
+        rewinddir(dir);
+    }
+    closedir(dir);
+    return err;
+}
+
+/* Open counters of all controllers and DIMMs, return 0 or errno */
+static int scan(struct pvt_data *pvt)
+{
+    char path[PATH_MAX];
+    struct dirent *de;
+    struct stat st;
+    size_t i, max_mcs = 0, max_dimms = 0;
+    uint32_t num;
+    DIR *dir;
+    int fd, err = 0;
+
+    snprintf(path, sizeof(path), "%s/" EDAC_DIR "/mc", pvt->root);
+    if ((pvt->mcdir_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+        return errno;
+    if (fstat(pvt->mcdir_fd, &st) != 0)
+        return errno;
+    pvt->mcdir_nlink = st.st_nlink;
+    snprintf(path, sizeof(path), "%s/" EDAC_DIR "/pci/pci_parity_count", pvt->root);
+    pvt->pci_fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if ((fd = dup(pvt->mcdir_fd)) < 0 || (dir = fdopendir(fd)) == NULL) {
+        err = errno;
+        if (fd >= 0)
+            close(fd);
+        return err;
+    }
+    while ((de = readdir(dir)) != NULL) {
+        struct mc *m;
+
+        if (!sensorfile_numbered(de->d_name, "mc", &num))
+            continue;
+        if ((fd = openat(dirfd(dir), de->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+            continue;
+        if (pvt->num_mcs == max_mcs) {
+            max_mcs = max_mcs > 0 ? max_mcs * 2 : 4;
+            if ((m = (struct mc *)DMM_REALLOC(pvt->mcs, max_mcs * sizeof(*m))) == NULL) {
+                close(fd);
+                err = ENOMEM;
+                break;
+            }
+            pvt->mcs = m;
+        }
+        m = &pvt->mcs[pvt->num_mcs];
+        m->id = num;
+        if (open_counters(fd, "ce_count", "ue_count", &m->cnt)) {
+            pvt->num_mcs++;
+            err = scan_dimms(pvt, fd, num, &max_dimms);
+        }
+        close(fd);
+        if (err != 0)
+            break;
+    }
+    closedir(dir);
+    if (err != 0)
+        return err;
+
+    qsort(pvt->mcs, pvt->num_mcs, sizeof(*pvt->mcs), mc_cmp);
+    qsort(pvt->dimms, pvt->num_dimms, sizeof(*pvt->dimms), dimm_cmp);
+    /* Allocate at least one element, so that NULL means no memory */
+    pvt->mc_ce = (uint64_t *)DMM_MALLOC((pvt->num_mcs + 1) * sizeof(*pvt->mc_ce));
+    pvt->mc_ue = (uint64_t *)DMM_MALLOC((pvt->num_mcs + 1) * sizeof(*pvt->mc_ue));
+    pvt->mc_ids = (uint32_t *)DMM_MALLOC((pvt->num_mcs + 1) * sizeof(*pvt->mc_ids));
+    pvt->dimm_ce = (uint64_t *)DMM_MALLOC((pvt->num_dimms + 1) * sizeof(*pvt->dimm_ce));
+    pvt->dimm_ue = (uint64_t *)DMM_MALLOC((pvt->num_dimms + 1) * sizeof(*pvt->dimm_ue));
+    pvt->dimm_ids = (struct dmm_edac_dimm *)DMM_MALLOC((pvt->num_dimms + 1) * sizeof(*pvt->dimm_ids));
+    if (pvt->mc_ce == NULL || pvt->mc_ue == NULL || pvt->mc_ids == NULL ||
+        pvt->dimm_ce == NULL || pvt->dimm_ue == NULL || pvt->dimm_ids == NULL)
+        return ENOMEM;
+    for (i = 0; i < pvt->num_mcs; ++i)
+        pvt->mc_ids[i] = pvt->mcs[i].id;
+    for (i = 0; i < pvt->num_dimms; ++i)
+        pvt->dimm_ids[i] = pvt->dimms[i].id;
+    pvt->scanned = true;
+    pvt->changed = true;
+    return 0;
+}
+
+/* Is the set of controllers the same as at the last scan? */
+static bool mcdir_unchanged(struct pvt_data *pvt)
+{
+    struct stat st;
+
+    return fstat(pvt->mcdir_fd, &st) == 0 && st.st_nlink == pvt->mcdir_nlink;
+}
+
+/* Counters of removed devices read as 0 until the next scan */
+static void read_counters(const struct counters *cnt, uint64_t *ce, uint64_t *ue)
+{
+    if (sensorfile_pread_u64(cnt->ce_fd, ce) != 0)
+        *ce = 0;
+    if (sensorfile_pread_u64(cnt->ue_fd, ue) != 0)
+        *ue = 0;
+}
+
+static int process_timer_msg(struct pvt_data *pvt)
 {
-    struct pvt_data *pvt;
-    dmm_hook_p hook;
     dmm_data_p data;
     dmm_datanode_p dn;
-    struct edac_totals totals;
-    edac_handle *edac;
-    unsigned int mc_count = 0;
+    uint64_t totals[4];
+    size_t i, nm, nd, numnodes, len;
+    int err;
 
-    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
-    hook = pvt->hook;
-    edac = pvt->edac;
-    if (hook != NULL) 
-    {
-        data = DMM_DATA_CREATE(num_sensors, sizeof (sensor_type));
-        if (data == NULL)
-    	    return ENOMEM;
-	mc_count = edac_mc_count (edac);
-	edac_error_totals (edac, &totals);
-        dn = DMM_DATA_NODES(data);
-        DMM_DN_CREATE (dn, EDAC_MC_COUNT, sizeof (sensor_type));
-        *DMM_DN_DATA (dn, sensor_type) = mc_count;
-        DMM_DN_ADVANCE (dn);
-        DMM_DN_CREATE (dn, EDAC_CORRECTED, sizeof (sensor_type));
-        *DMM_DN_DATA (dn, sensor_type) = totals.ce_total;
-        DMM_DN_ADVANCE (dn);
-        DMM_DN_CREATE (dn, EDAC_UNCORRECTED, sizeof (sensor_type));
-        *DMM_DN_DATA (dn, sensor_type) = totals.ue_total;
-        DMM_DN_ADVANCE (dn);
-        DMM_DN_CREATE (dn, EDAC_PCI_PARITY, sizeof (sensor_type));
-        *DMM_DN_DATA (dn, sensor_type) = totals.pci_parity_total;
-        DMM_DN_ADVANCE (dn);
-        DMM_DN_MKEND(dn);
-        DMM_DATA_SEND(data, hook);
-        DMM_DATA_UNREF(data);
+    if (pvt->scanned && !mcdir_unchanged(pvt))
+        close_all(pvt);
+    if (!pvt->scanned && (err = scan(pvt)) != 0) {
+        close_all(pvt);
+        if (!pvt->warned) {
+            char errbuf[128], *errmsg;
+            errmsg = strerror_r(err, errbuf, sizeof(errbuf));
+            dmm_log(DMM_LOG_ERR, "edac: cannot scan %s/" EDAC_DIR ": %s", pvt->root, errmsg);
+            pvt->warned = true;
+        }
+        return err;
+    }
+    pvt->warned = false;
+
+    nm = pvt->num_mcs;
+    nd = pvt->num_dimms;
+    totals[0] = nm;
+    totals[1] = totals[2] = totals[3] = 0;
+    for (i = 0; i < nm; ++i) {
+        read_counters(&pvt->mcs[i].cnt, &pvt->mc_ce[i], &pvt->mc_ue[i]);
+        totals[1] += pvt->mc_ce[i];
+        totals[2] += pvt->mc_ue[i];
     }
+    for (i = 0; i < nd; ++i)
+        read_counters(&pvt->dimms[i].cnt, &pvt->dimm_ce[i], &pvt->dimm_ue[i]);
+    if (pvt->pci_fd >= 0)
+        sensorfile_pread_u64(pvt->pci_fd, &totals[3]);
+
+    numnodes = 4;
+    len = sizeof(totals);
+    if (nm > 0) {
+        numnodes += 3;
+        len += nm * (2 * sizeof(uint64_t) + sizeof(uint32_t));
+    }
+    if (nd > 0) {
+        numnodes += 2 + pvt->changed;
+        len += nd * 2 * sizeof(uint64_t);
+        if (pvt->changed)
+            len += nd * sizeof(struct dmm_edac_dimm);
+    }
+    if ((data = DMM_DATA_CREATE_RAW(numnodes, len)) == NULL) {
+        dmm_log(DMM_LOG_ERR, "Cannot allocate memory for data");
+        return ENOMEM;
+    }
+    dn = DMM_DATA_NODES(data);
+    for (i = 0; i < 4; ++i)
+        DMM_DN_FILL_ADVANCE(dn, EDAC_MC_COUNT + i, sizeof(uint64_t), &totals[i]);
+    if (nm > 0) {
+        DMM_DN_FILL_ADVANCE(dn, EDAC_MC_CE, nm * sizeof(uint64_t), pvt->mc_ce);
+        DMM_DN_FILL_ADVANCE(dn, EDAC_MC_UE, nm * sizeof(uint64_t), pvt->mc_ue);
+        DMM_DN_FILL_ADVANCE(dn, EDAC_MC_ID, nm * sizeof(uint32_t), pvt->mc_ids);
+    }
+    if (nd > 0) {
+        DMM_DN_FILL_ADVANCE(dn, EDAC_DIMM_CE, nd * sizeof(uint64_t), pvt->dimm_ce);
+        DMM_DN_FILL_ADVANCE(dn, EDAC_DIMM_UE, nd * sizeof(uint64_t), pvt->dimm_ue);
+        if (pvt->changed)
+            DMM_DN_FILL_ADVANCE(dn, EDAC_DIMMS, nd * sizeof(struct dmm_edac_dimm), pvt->dimm_ids);
+    }
+    DMM_DN_MKEND(dn);
+    DMM_DATA_SEND(data, pvt->hook);
+    DMM_DATA_UNREF(data);
+    pvt->changed = false;
 
     return 0;
 }
@@ -70,27 +390,30 @@ static int process_timer_msg(dmm_node_p node)
 static int ctor(dmm_node_p node)
 {
     struct pvt_data *pvt;
-    edac_handle *edac;
+
     pvt = (struct pvt_data *)DMM_MALLOC(sizeof(*pvt));
     if (pvt == NULL)
         return ENOMEM;
+    pvt->hook = NULL;
+    strcpy(pvt->root, DEFAULT_ROOT);
+    pvt->warned = false;
+    pvt->mcdir_fd = -1;
+    pvt->pci_fd = -1;
+    pvt->mcs = NULL;
+    pvt->num_mcs = 0;
+    pvt->mc_ce = NULL;
+    pvt->mc_ue = NULL;
+    pvt->mc_ids = NULL;
+    pvt->dimms = NULL;
+    pvt->num_dimms = 0;
+    pvt->dimm_ce = NULL;
+    pvt->dimm_ue = NULL;
+    pvt->dimm_ids = NULL;
     DMM_NODE_SETPRIVATE(node, pvt);
 
-    if (!(edac = edac_handle_create ())) 
-    {
-	dmm_log (DMM_LOG_ERR, "edac_handle_create: Out of memory!");
-	DMM_FREE (pvt);
-    	return -1;
-    }
-    if (edac_handle_init (edac) < 0) 
-    {
-	dmm_log (DMM_LOG_ERR, "Unable to get EDAC data: %s", edac_strerror (edac));
-	DMM_FREE (pvt);
-    	return -1;
-    }
-
-    pvt->hook = NULL;
-    pvt->edac = edac;
+    /* Enumerate now, so that the first tick only reads counters */
+    if (scan(pvt) != 0)
+        close_all(pvt);
     return 0;
 }
 
@@ -98,7 +421,7 @@ static void dtor(dmm_node_p node)
 {
     struct pvt_data *pvt;
     pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
-    edac_handle_destroy (pvt->edac);
+    close_all(pvt);
     DMM_FREE(pvt);
 }
 
@@ -114,6 +437,8 @@ static int newhook(dmm_hook_p hook)
         return EEXIST;
 
     pvt->hook = hook;
+    /* Send DIMMs to the new receiver */
+    pvt->changed = true;
 
     return 0;
 }
@@ -127,19 +452,68 @@ static void rmhook(dmm_hook_p hook)
 
 static int rcvmsg(dmm_node_p node, dmm_msg_p msg)
 {
+    struct pvt_data *pvt;
+    dmm_msg_p resp;
     int err = 0;
 
-    /* Accept only generic messages */
-    if (msg->cm_type != DMM_MSGTYPE_GENERIC) {
-        err = ENOTSUP;
+#define CREATE_SEND_EMPTY_RESP()                                    \
+        do {                                                        \
+            resp = DMM_MSG_CREATE_RESP(DMM_NODE_ID(node), msg, 0);  \
+            if (resp != NULL) {                                     \
+                if (err != 0)                                       \
+                    msg->cm_flags |= DMM_MSG_ERR;                   \
+                                                                    \
+                DMM_MSG_SEND_ID(msg->cm_src, resp);                 \
+            } else                                                  \
+                err = (err != 0) ? err : ENOMEM;                    \
+        } while (0)
+
+    if (msg->cm_flags & DMM_MSG_RESP)
         goto err;
-    }
-    /* Accept only TIMERTRIGGER messages */
-    if (msg->cm_cmd != DMM_MSG_TIMERTRIGGER) {
+
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
+    switch (msg->cm_type) {
+    case DMM_MSGTYPE_GENERIC:
+        /* Accept only TIMERTRIGGER messages */
+        if (msg->cm_cmd != DMM_MSG_TIMERTRIGGER) {
+            err = ENOTSUP;
+            break;
+        }
+        // Nowhere to send, so why bother?
+        if (pvt->hook != NULL)
+            err = process_timer_msg(pvt);
+        break;
+
+    case DMM_MSGTYPE_EDAC:
+        switch (msg->cm_cmd) {
+        case DMM_MSG_EDAC_SETROOT: {
+            struct dmm_msg_edac_setroot *sr;
+
+            sr = DMM_MSG_DATA(msg, struct dmm_msg_edac_setroot);
+            if (msg->cm_len != sizeof(*sr) ||
+                memchr(sr->root, '\0', sizeof(sr->root)) == NULL || sr->root[0] == '\0') {
+                err = EINVAL;
+            } else {
+                close_all(pvt);
+                strcpy(pvt->root, sr->root);
+                pvt->warned = false;
+            }
+            CREATE_SEND_EMPTY_RESP();
+            break;
+        }
+
+        default:
+            err = ENOTSUP;
+            break;
+        }
+        break;
+
+    default:
         err = ENOTSUP;
-        goto err;
+        break;
     }
-    err = process_timer_msg(node);
+
+#undef CREATE_SEND_EMPTY_RESP
 
 err:
     DMM_MSG_FREE(msg);
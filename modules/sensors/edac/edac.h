@@ -0,0 +1,37 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+#ifndef MODULES_EDAC_EDAC_H_
+#define MODULES_EDAC_EDAC_H_
+
+#include "dmm_types.h"
+
+enum {
+    DMM_MSGTYPE_EDAC = 0xf113ef75
+};
+
+enum {
+    DMM_MSG_EDAC_SETROOT = 1,
+};
+
+enum { DMM_EDAC_PATHSIZE = 256 };
+enum { DMM_EDAC_NAMESIZE = 16 };
+enum { DMM_EDAC_LABELSIZE = 32 };
+
+/* Read root/devices/system/edac, root is /sys by default */
+struct dmm_msg_edac_setroot {
+    char root[DMM_EDAC_PATHSIZE];
+};
+
+/* Element of EDAC_DIMMS datanode */
+struct dmm_edac_dimm {
+    /* N of mcN */
+    uint32_t mc;
+    /* Directory in mcN, e.g. dimm0, rank3 or csrow1 */
+    char     name[DMM_EDAC_NAMESIZE];
+    /* dimm_label or ch0_dimm_label of csrow, may be empty */
+    char     label[DMM_EDAC_LABELSIZE];
+};
+
+#endif /* MODULES_EDAC_EDAC_H_ */
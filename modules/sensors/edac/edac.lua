@@ -0,0 +1,24 @@
+-- SPDX-License-Identifier: BSD-2-Clause-Views
+-- Copyright (c) 2013-2023
+--   Research Computing Center Lomonosov Moscow State University
+
+local dmm = require('dmm')
+
+assert(dmm.require_interface('edac', 'll'))
+
+local Edac = dmm.Module:new_type('edac')
+
+--! @brief Set sysfs root
+--! @param root '/sys' by default, e.g. a fixture tree for tests
+function Edac:setroot(root)
+  assert(#root < ffi.C.DMM_EDAC_PATHSIZE, 'root is too long')
+  local msg, sr = dmm.msg_create {
+    payload_type = 'struct dmm_msg_edac_setroot',
+    type = ffi.C.DMM_MSGTYPE_EDAC,
+    cmd = ffi.C.DMM_MSG_EDAC_SETROOT,
+  }
+  sr.root = root
+  dmm.msg_send(self.nodeid, msg)
+end
+
+return Edac
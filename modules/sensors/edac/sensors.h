@@ -6,10 +6,19 @@
 #define MODULES_EDAC_SENSORS_H_
 
 enum {
+    /* Totals over all memory controllers, uint64_t */
     EDAC_MC_COUNT = 200,
     EDAC_CORRECTED,
     EDAC_UNCORRECTED,
-    EDAC_PCI_PARITY
+    EDAC_PCI_PARITY,
+    /* Per memory controller, in the order of EDAC_MC_ID */
+    EDAC_MC_CE,             /* uint64_t */
+    EDAC_MC_UE,             /* uint64_t */
+    EDAC_MC_ID,             /* uint32_t, N of mcN */
+    /* Per DIMM (rank or csrow on older drivers), in the order of EDAC_DIMMS */
+    EDAC_DIMM_CE,           /* uint64_t */
+    EDAC_DIMM_UE,           /* uint64_t */
+    EDAC_DIMMS              /* struct dmm_edac_dimm, sent when changed */
 };
 
 #endif /* MODULES_EDAC_SENSORS_H_ */
@@ -0,0 +1,541 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+/*
+ * fileparse sends values of procfs and sysfs files described by a spec
+ * (see fileparse.h), so simple metrics need no module of their own.
+ *
+ * Every file added is compiled into a parse plan: its fields sorted by
+ * line and column, so a tick makes a single pass over the file without
+ * looking at keys. Keys of "key: value" files are resolved to line numbers
+ * on the first read and trusted while the line still starts with the key,
+ * otherwise the file is resolved again. Files are opened once and reread
+ * with pread, single value files without allocating a buffer.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "dmm_base.h"
+#include "dmm_log.h"
+#include "dmm_message.h"
+#include "../sensorfile.h"
+#include "fileparse.h"
+
+#define HOOKNAME "out"
+
+/* Enough for any number */
+#define SINGLE_BUFSIZE 64
+
+union value {
+    uint64_t u;
+    int64_t  i;
+    double   d;
+};
+
+enum {
+    FIELD_UNRESOLVED,
+    FIELD_MISSING,
+    FIELD_RESOLVED
+};
+
+struct field {
+    dmm_sensorid_t id;
+    int type;
+    char key[DMM_FILEPARSE_KEYSIZE];
+    size_t keylen;
+    unsigned line;
+    unsigned col;
+    int state;
+    /* Parsed on the current tick */
+    bool valid;
+    /* Parse error has been reported */
+    bool warned;
+    union value val;
+};
+
+struct file {
+    char path[DMM_FILEPARSE_PATHSIZE];
+    int format;
+    /* buf is not allocated for DMM_FILEPARSE_SINGLE */
+    struct sensorfile sf;
+    /* File cannot be opened, do not retry */
+    bool failed;
+    /* Read error has been reported */
+    bool warned;
+    /* Sorted by line and column */
+    struct field *fields;
+    size_t num_fields;
+};
+
+struct pvt_data {
+    dmm_hook_p hook;
+    struct file *files;
+    size_t num_files;
+};
+
+static int field_cmp(const void *a, const void *b)
+{
+    const struct field *fa = (const struct field *)a;
+    const struct field *fb = (const struct field *)b;
+
+    /* Missing fields go last */
+    if ((fa->state == FIELD_MISSING) != (fb->state == FIELD_MISSING))
+        return fa->state == FIELD_MISSING ? 1 : -1;
+    if (fa->line != fb->line)
+        return fa->line < fb->line ? -1 : 1;
+    if (fa->col != fb->col)
+        return fa->col < fb->col ? -1 : 1;
+    /* qsort is not stable, keep the order of duplicates fixed */
+    if (fa->id != fb->id)
+        return fa->id < fb->id ? -1 : 1;
+    return 0;
+}
+
+/* Check field spec and fill field from it, return 0 or EINVAL */
+static int compile_field(int format, const struct dmm_fileparse_field *ff, struct field *f)
+{
+    if (ff->type != DMM_FILEPARSE_UINT64 && ff->type != DMM_FILEPARSE_INT64 &&
+        ff->type != DMM_FILEPARSE_DOUBLE)
+        return EINVAL;
+
+    f->id = ff->id;
+    f->type = (int)ff->type;
+    f->key[0] = '\0';
+    f->keylen = 0;
+    f->line = 0;
+    f->col = 0;
+    f->state = FIELD_RESOLVED;
+    f->valid = false;
+    f->warned = false;
+    f->val.u = 0;
+
+    switch (format) {
+    case DMM_FILEPARSE_SINGLE:
+        break;
+
+    case DMM_FILEPARSE_KEYVALUE:
+        if (memchr(ff->key, '\0', sizeof(ff->key)) == NULL || ff->key[0] == '\0')
+            return EINVAL;
+        if (strpbrk(ff->key, " \t\n:") != NULL)
+            return EINVAL;
+        strcpy(f->key, ff->key);
+        f->keylen = strlen(f->key);
+        f->col = ff->col;
+        f->state = FIELD_UNRESOLVED;
+        break;
+
+    case DMM_FILEPARSE_COLUMNS:
+        f->line = ff->line;
+        f->col = ff->col;
+        break;
+
+    default:
+        return EINVAL;
+    }
+    return 0;
+}
+
+/* Compile file spec and append it to the list of files */
+static int add_file(struct pvt_data *pvt, const struct dmm_msg_fileparse_add *add, size_t n)
+{
+    struct file *files, *file;
+    struct field *fields;
+    size_t i;
+    int err;
+
+    if (memchr(add->path, '\0', sizeof(add->path)) == NULL || add->path[0] == '\0') {
+        dmm_log(DMM_LOG_ERR, "fileparse: invalid path");
+        return EINVAL;
+    }
+    if (n == 0 || (add->format == DMM_FILEPARSE_SINGLE && n != 1)) {
+        dmm_log(DMM_LOG_ERR, "fileparse: %s: invalid number of fields %zu", add->path, n);
+        return EINVAL;
+    }
+    if ((fields = (struct field *)DMM_MALLOC(n * sizeof(*fields))) == NULL)
+        return ENOMEM;
+    for (i = 0; i < n; ++i)
+        if ((err = compile_field((int)add->format, add->fields + i, fields + i)) != 0) {
+            dmm_log(DMM_LOG_ERR, "fileparse: %s: invalid spec of field %u",
+                    add->path, (unsigned)add->fields[i].id);
+            DMM_FREE(fields);
+            return err;
+        }
+    qsort(fields, n, sizeof(*fields), field_cmp);
+
+    files = (struct file *)DMM_REALLOC(pvt->files, (pvt->num_files + 1) * sizeof(*files));
+    if (files == NULL) {
+        DMM_FREE(fields);
+        return ENOMEM;
+    }
+    pvt->files = files;
+    file = &pvt->files[pvt->num_files++];
+    strcpy(file->path, add->path);
+    file->format = (int)add->format;
+    sensorfile_init(&file->sf);
+    file->failed = false;
+    file->warned = false;
+    file->fields = fields;
+    file->num_fields = n;
+    return 0;
+}
+
+static void clear_files(struct pvt_data *pvt)
+{
+    size_t i;
+
+    for (i = 0; i < pvt->num_files; ++i) {
+        sensorfile_close(&pvt->files[i].sf);
+        DMM_FREE(pvt->files[i].fields);
+    }
+    DMM_FREE(pvt->files);
+    pvt->files = NULL;
+    pvt->num_files = 0;
+}
+
+/* Parse value of the field type, return pointer past it or NULL */
+static const char *parse_value(const char *s, int type, union value *val)
+{
+    char *end;
+
+    switch (type) {
+    case DMM_FILEPARSE_UINT64:
+        return sensorfile_u64(s, &val->u);
+    case DMM_FILEPARSE_INT64:
+        return sensorfile_i64(s, &val->i);
+    default:
+        s = sensorfile_skipblanks(s);
+        if (*s == '\n' || *s == '\0')
+            return NULL;
+        val->d = strtod(s, &end);
+        return end != s ? end : NULL;
+    }
+}
+
+/* If line starts with the field key return pointer past it and ':', NULL otherwise */
+static const char *match_key(const char *line, const struct field *f)
+{
+    const char *s;
+
+    s = sensorfile_skipblanks(line);
+    if (strncmp(s, f->key, f->keylen) != 0)
+        return NULL;
+    s += f->keylen;
+    if (*s == ':')
+        return s + 1;
+    if (*s == ' ' || *s == '\t' || *s == '\n' || *s == '\0')
+        return s;
+    return NULL;
+}
+
+/* Find lines of unresolved keys */
+static void resolve(struct file *file)
+{
+    struct field *f, *end;
+    const char *line;
+    unsigned lineno;
+
+    end = file->fields + file->num_fields;
+    for (f = file->fields; f < end; ++f)
+        f->state = FIELD_UNRESOLVED;
+    line = file->sf.buf;
+    for (lineno = 0; *line != '\0'; line = sensorfile_nextline(line), ++lineno)
+        for (f = file->fields; f < end; ++f)
+            if (f->state == FIELD_UNRESOLVED && match_key(line, f) != NULL) {
+                f->line = lineno;
+                f->state = FIELD_RESOLVED;
+            }
+    for (f = file->fields; f < end; ++f)
+        if (f->state == FIELD_UNRESOLVED) {
+            dmm_log(DMM_LOG_WARN, "fileparse: key %s is not found in %s",
+                    f->key, file->path);
+            f->state = FIELD_MISSING;
+        }
+    qsort(file->fields, file->num_fields, sizeof(*file->fields), field_cmp);
+}
+
+/*
+ * Parse fields in one pass over the file contents,
+ * return false if a key has moved to another line
+ */
+static bool parse_fields(struct file *file)
+{
+    const char *line, *s;
+    struct field *f, *end;
+    unsigned lineno, col;
+    bool moved = false;
+
+    line = file->sf.buf;
+    lineno = 0;
+    s = NULL;
+    col = 0;
+    end = file->fields + file->num_fields;
+    for (f = file->fields; f < end && f->state == FIELD_RESOLVED; ++f) {
+        f->valid = false;
+        if (s == NULL || lineno != f->line) {
+            for (; lineno < f->line && *line != '\0'; ++lineno)
+                line = sensorfile_nextline(line);
+            if (*line == '\0')
+                s = NULL;
+            else if (file->format == DMM_FILEPARSE_KEYVALUE)
+                s = match_key(line, f);
+            else
+                s = line;
+            if (s == NULL) {
+                /* Keys are resolved again, columns are not there */
+                moved = moved || file->format == DMM_FILEPARSE_KEYVALUE;
+                continue;
+            }
+            col = 0;
+        } else if (file->format == DMM_FILEPARSE_KEYVALUE && match_key(line, f) == NULL) {
+            /* Another key resolved to the same line */
+            moved = true;
+            continue;
+        }
+        /* Fields sharing a column parse the same value */
+        for (; col < f->col; ++col)
+            s = sensorfile_skipfield(s);
+        f->valid = parse_value(s, f->type, &f->val) != NULL;
+    }
+    for (; f < end; ++f)
+        f->valid = false;
+    return !moved;
+}
+
+/* Read a single value file with a stack buffer */
+static int read_single(struct file *file)
+{
+    char buf[SINGLE_BUFSIZE];
+    ssize_t n;
+
+    while ((n = pread(file->sf.fd, buf, sizeof(buf) - 1, 0)) < 0)
+        if (errno != EINTR)
+            return errno;
+    buf[n] = '\0';
+    file->fields[0].valid = parse_value(buf, file->fields[0].type, &file->fields[0].val) != NULL;
+    return 0;
+}
+
+static int open_file(struct file *file)
+{
+    if (file->format != DMM_FILEPARSE_SINGLE)
+        return sensorfile_open(&file->sf, file->path);
+    if ((file->sf.fd = open(file->path, O_RDONLY | O_CLOEXEC)) < 0) {
+        file->sf.fd = -1;
+        return errno;
+    }
+    return 0;
+}
+
+/* Read the file and parse its fields, fields of unreadable file are not valid */
+static void read_file(struct file *file)
+{
+    struct field *f;
+    size_t i;
+    int err;
+
+    for (i = 0; i < file->num_fields; ++i)
+        file->fields[i].valid = false;
+    if (file->failed)
+        return;
+    if (!sensorfile_isopen(&file->sf) && (err = open_file(file)) != 0) {
+        char errbuf[128], *errmsg;
+        errmsg = strerror_r(err, errbuf, sizeof(errbuf));
+        dmm_log(DMM_LOG_WARN, "fileparse: cannot open %s, its fields are not sent: %s",
+                file->path, errmsg);
+        file->failed = true;
+        return;
+    }
+
+    if (file->format == DMM_FILEPARSE_SINGLE)
+        err = read_single(file);
+    else if ((err = sensorfile_read(&file->sf)) == 0 &&
+             (file->fields[0].state == FIELD_UNRESOLVED || !parse_fields(file))) {
+        resolve(file);
+        parse_fields(file);
+    }
+    if (err != 0) {
+        /* Some sysfs attributes fail to read at times, report once */
+        if (!file->warned) {
+            char errbuf[128], *errmsg;
+            errmsg = strerror_r(err, errbuf, sizeof(errbuf));
+            dmm_log(DMM_LOG_WARN, "fileparse: cannot read %s: %s", file->path, errmsg);
+            file->warned = true;
+        }
+        return;
+    }
+
+    for (f = file->fields; f < file->fields + file->num_fields; ++f)
+        if (!f->valid && f->state != FIELD_MISSING && !f->warned) {
+            dmm_log(DMM_LOG_WARN, "fileparse: cannot parse field %u of %s",
+                    (unsigned)f->id, file->path);
+            f->warned = true;
+        }
+}
+
+static int process_timer_msg(struct pvt_data *pvt)
+{
+    dmm_data_p data;
+    dmm_datanode_p dn;
+    struct file *file;
+    struct field *f;
+    size_t i, n;
+
+    n = 0;
+    for (file = pvt->files; file < pvt->files + pvt->num_files; ++file) {
+        read_file(file);
+        for (i = 0; i < file->num_fields; ++i)
+            n += file->fields[i].valid;
+    }
+    if (n == 0)
+        return 0;
+
+    if ((data = DMM_DATA_CREATE(n, sizeof(union value))) == NULL) {
+        dmm_log(DMM_LOG_ERR, "Cannot allocate memory for data");
+        return ENOMEM;
+    }
+    dn = DMM_DATA_NODES(data);
+    for (file = pvt->files; file < pvt->files + pvt->num_files; ++file)
+        for (f = file->fields; f < file->fields + file->num_fields; ++f)
+            if (f->valid)
+                DMM_DN_FILL_ADVANCE(dn, f->id, sizeof(f->val), &f->val);
+    DMM_DN_MKEND(dn);
+    DMM_DATA_SEND(data, pvt->hook);
+    DMM_DATA_UNREF(data);
+
+    return 0;
+}
+
+static int ctor(dmm_node_p node)
+{
+    struct pvt_data *pvt;
+
+    pvt = (struct pvt_data *)DMM_MALLOC(sizeof(*pvt));
+    if (pvt == NULL)
+        return ENOMEM;
+    pvt->hook = NULL;
+    pvt->files = NULL;
+    pvt->num_files = 0;
+    DMM_NODE_SETPRIVATE(node, pvt);
+    return 0;
+}
+
+static void dtor(dmm_node_p node)
+{
+    struct pvt_data *pvt;
+
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
+    clear_files(pvt);
+    DMM_FREE(pvt);
+}
+
+static int newhook(dmm_hook_p hook)
+{
+    struct pvt_data *pvt;
+
+    if (DMM_HOOK_ISIN(hook))
+        return EINVAL;
+    if (strcmp(HOOKNAME, DMM_HOOK_NAME(hook)) != 0)
+        return EINVAL;
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(DMM_HOOK_NODE(hook));
+    pvt->hook = hook;
+
+    return 0;
+}
+
+static void rmhook(dmm_hook_p hook)
+{
+    struct pvt_data *pvt;
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(DMM_HOOK_NODE(hook));
+    pvt->hook = NULL;
+}
+
+static int rcvmsg(dmm_node_p node, dmm_msg_p msg)
+{
+    struct pvt_data *pvt;
+    dmm_msg_p resp;
+    int err = 0;
+
+#define CREATE_SEND_EMPTY_RESP()                                    \
+        do {                                                        \
+            resp = DMM_MSG_CREATE_RESP(DMM_NODE_ID(node), msg, 0);  \
+            if (resp != NULL) {                                     \
+                if (err != 0)                                       \
+                    msg->cm_flags |= DMM_MSG_ERR;                   \
+                                                                    \
+                DMM_MSG_SEND_ID(msg->cm_src, resp);                 \
+            } else                                                  \
+                err = (err != 0) ? err : ENOMEM;                    \
+        } while (0)
+
+    if (msg->cm_flags & DMM_MSG_RESP)
+        goto err;
+
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
+    switch (msg->cm_type) {
+    case DMM_MSGTYPE_GENERIC:
+        /* Accept only TIMERTRIGGER messages */
+        if (msg->cm_cmd != DMM_MSG_TIMERTRIGGER) {
+            err = ENOTSUP;
+            break;
+        }
+        // Nowhere to send, so why bother?
+        if (pvt->hook != NULL)
+            err = process_timer_msg(pvt);
+        break;
+
+    case DMM_MSGTYPE_FILEPARSE:
+        switch (msg->cm_cmd) {
+        case DMM_MSG_FILEPARSE_ADD: {
+            struct dmm_msg_fileparse_add *add = DMM_MSG_DATA(msg, struct dmm_msg_fileparse_add);
+            dmm_size_t num_fields;
+
+            if (msg->cm_len < sizeof(struct dmm_msg_fileparse_add)) {
+                err = EINVAL;
+            } else {
+                num_fields = (msg->cm_len - sizeof(struct dmm_msg_fileparse_add)) / sizeof(struct dmm_fileparse_field);
+                err = add_file(pvt, add, num_fields);
+            }
+            CREATE_SEND_EMPTY_RESP();
+            break;
+        }
+
+        case DMM_MSG_FILEPARSE_CLEAR:
+            clear_files(pvt);
+            CREATE_SEND_EMPTY_RESP();
+            break;
+
+        default:
+            err = ENOTSUP;
+            break;
+        }
+        break;
+
+    default:
+        err = ENOTSUP;
+        break;
+    }
+
+#undef CREATE_SEND_EMPTY_RESP
+
+err:
+    DMM_MSG_FREE(msg);
+    return err;
+}
+
+static struct dmm_type type = {
+    "fileparse",
+    ctor,
+    dtor,
+    NULL,
+    rcvmsg,
+    newhook,
+    rmhook,
+    {},
+};
+
+DMM_MODULE_DECLARE(&type);
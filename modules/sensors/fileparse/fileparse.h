@@ -0,0 +1,72 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+#ifndef MODULES_FILEPARSE_FILEPARSE_H_
+#define MODULES_FILEPARSE_FILEPARSE_H_
+
+#include "dmm_types.h"
+
+enum {
+    DMM_MSGTYPE_FILEPARSE = 0xe80109b8
+};
+
+enum {
+    DMM_MSG_FILEPARSE_ADD = 1,
+    DMM_MSG_FILEPARSE_CLEAR,
+};
+
+enum {
+    DMM_FILEPARSE_PATHSIZE = 256,
+    DMM_FILEPARSE_KEYSIZE = 64
+};
+
+/* File formats */
+enum {
+    /* The whole file is a single value, e.g. sysfs attribute */
+    DMM_FILEPARSE_SINGLE,
+    /*
+     * Lines start with a key followed by ':' or blanks, e.g. /proc/meminfo,
+     * /proc/vmstat, the field is selected by the key and the column
+     * after it, 0 for the first value
+     */
+    DMM_FILEPARSE_KEYVALUE,
+    /*
+     * Blank-separated columns, e.g. /proc/loadavg, the field is selected
+     * by line and column numbers starting from 0
+     */
+    DMM_FILEPARSE_COLUMNS
+};
+
+/* Value types, all values are sent as 8 bytes */
+enum {
+    DMM_FILEPARSE_UINT64,
+    DMM_FILEPARSE_INT64,
+    DMM_FILEPARSE_DOUBLE
+};
+
+struct dmm_fileparse_field {
+    dmm_sensorid_t id;
+    uint32_t       type;
+    /* Used by DMM_FILEPARSE_COLUMNS only */
+    uint32_t       line;
+    /* Not used by DMM_FILEPARSE_SINGLE */
+    uint32_t       col;
+    /* Used by DMM_FILEPARSE_KEYVALUE only */
+    char           key[DMM_FILEPARSE_KEYSIZE];
+};
+
+/*
+ * Add a file and its fields. Fields are checked and compiled into
+ * a parse plan when the message is received, a malformed spec is
+ * rejected as a whole. DMM_FILEPARSE_SINGLE takes exactly one field.
+ * Files are opened on the first tick, fields missing in the file are
+ * reported once and not sent.
+ */
+struct dmm_msg_fileparse_add {
+    char                       path[DMM_FILEPARSE_PATHSIZE];
+    uint32_t                   format;
+    struct dmm_fileparse_field fields[];
+};
+
+#endif /* MODULES_FILEPARSE_FILEPARSE_H_ */
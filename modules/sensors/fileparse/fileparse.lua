@@ -0,0 +1,66 @@
+-- SPDX-License-Identifier: BSD-2-Clause-Views
+-- Copyright (c) 2013-2023
+--   Research Computing Center Lomonosov Moscow State University
+
+local dmm = require('dmm')
+
+assert(dmm.require_interface('fileparse', 'll'))
+
+local Fileparse = dmm.Module:new_type('fileparse')
+
+local formats = {
+  single = ffi.C.DMM_FILEPARSE_SINGLE,
+  keyvalue = ffi.C.DMM_FILEPARSE_KEYVALUE,
+  columns = ffi.C.DMM_FILEPARSE_COLUMNS,
+}
+
+local types = {
+  uint64_t = ffi.C.DMM_FILEPARSE_UINT64,
+  int64_t = ffi.C.DMM_FILEPARSE_INT64,
+  double = ffi.C.DMM_FILEPARSE_DOUBLE,
+}
+
+--! @brief Add file to parse on every tick
+--! @param path file name
+--! @param format 'single', 'keyvalue' or 'columns', see fileparse.h
+--! @param fields list of {id = sensor_id, key = name, line = n, col = n,
+--! type = 'uint64_t' | 'int64_t' | 'double'}, type is 'uint64_t' by default,
+--! line and col count from 0, e.g.
+--! p:add('/proc/meminfo', 'keyvalue', {{id = 3000, key = 'Dirty'}})
+--! p:add('/proc/loadavg', 'columns', {{id = 3001, col = 0, type = 'double'}})
+--! p:add('/sys/class/thermal/thermal_zone0/temp', 'single', {{id = 3002}})
+function Fileparse:add(path, format, fields)
+  assert(#path < ffi.C.DMM_FILEPARSE_PATHSIZE, 'path is too long')
+  assert(formats[format], 'unknown format')
+  local msg, add = dmm.msg_create {
+    len = dmm.sfam.struct_sizeof('struct dmm_msg_fileparse_add', 'fields', #fields),
+    payload_type = 'struct dmm_msg_fileparse_add',
+    type = ffi.C.DMM_MSGTYPE_FILEPARSE,
+    cmd = ffi.C.DMM_MSG_FILEPARSE_ADD,
+  }
+  add.path = path
+  add.format = formats[format]
+  for i, f in ipairs(fields) do
+    local key = f.key or ''
+    assert(types[f.type or 'uint64_t'], 'unknown type')
+    assert(#key < ffi.C.DMM_FILEPARSE_KEYSIZE, 'key is too long')
+    add.fields[i - 1].id = f.id
+    add.fields[i - 1].type = types[f.type or 'uint64_t']
+    add.fields[i - 1].line = f.line or 0
+    add.fields[i - 1].col = f.col or 0
+    add.fields[i - 1].key = key
+  end
+  dmm.msg_send(self.nodeid, msg)
+end
+
+--! @brief Remove all files
+function Fileparse:clear()
+  local msg = dmm.msg_create {
+    len = 0,
+    type = ffi.C.DMM_MSGTYPE_FILEPARSE,
+    cmd = ffi.C.DMM_MSG_FILEPARSE_CLEAR,
+  }
+  dmm.msg_send(self.nodeid, msg)
+end
+
+return Fileparse
@@ -0,0 +1,411 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+/*
+ * ibcounters sends InfiniBand/Omni-Path port counters from
+ * /sys/class/infiniband/<device>/ports/<port>/counters.
+ *
+ * All counter files of all ports are opened once when ports are
+ * scanned and reread with pread(2) on every tick. Every counter
+ * is sent as a vector with one element per port, ports are sorted
+ * by device name and port number, IB_PORTS datanode describing them
+ * is sent when the set of ports changes or a new receiver connects.
+ * Ports are scanned again if a counter file disappears or while
+ * no ports are found. Counters missing for a port are sent as zeroes.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dmm_base.h"
+#include "dmm_log.h"
+#include "dmm_message.h"
+#include "../sensorfile.h"
+#include "ibcounters.h"
+#include "sensors.h"
+
+#define HOOKNAME "out"
+
+#define DEFAULT_ROOT "/sys/class/infiniband"
+
+/* In the order of sensor ids starting from IB_PORT_XMIT_DATA */
+static const char *counter_names[] = {
+    "port_xmit_data",
+    "port_rcv_data",
+    "port_xmit_packets",
+    "port_rcv_packets",
+    "symbol_error",
+    "port_rcv_errors",
+    "link_downed",
+    "link_error_recovery",
+    "port_xmit_discards",
+    "port_xmit_wait",
+    "port_rcv_remote_physical_errors",
+    "local_link_integrity_errors",
+    "excessive_buffer_overrun_errors",
+    "VL15_dropped",
+};
+
+#define NUM_COUNTERS ((int)(sizeof(counter_names) / sizeof(counter_names[0])))
+
+struct port {
+    struct dmm_ibcounters_port id;
+    /* -1 for missing counters */
+    int fds[NUM_COUNTERS];
+};
+
+struct pvt_data {
+    dmm_hook_p hook;
+    char root[DMM_IBCOUNTERS_PATHSIZE];
+    struct port *ports;
+    size_t num_ports;
+    size_t max_ports;
+    /* NUM_COUNTERS vectors of num_ports values */
+    uint64_t *vals;
+    struct dmm_ibcounters_port *ids;
+    /* Scan ports at the next tick */
+    bool rescan;
+    /* Set of ports changed since IB_PORTS was sent last time */
+    bool changed;
+    /* Do not repeat warning about missing root on every tick */
+    bool root_warned;
+};
+
+static void close_ports(struct pvt_data *pvt)
+{
+    size_t i;
+    int c;
+
+    for (i = 0; i < pvt->num_ports; ++i)
+        for (c = 0; c < NUM_COUNTERS; ++c)
+            if (pvt->ports[i].fds[c] >= 0)
+                close(pvt->ports[i].fds[c]);
+    if (pvt->num_ports > 0)
+        pvt->changed = true;
+    pvt->num_ports = 0;
+}
+
+static int port_cmp(const void *a, const void *b)
+{
+    const struct port *pa = (const struct port *)a;
+    const struct port *pb = (const struct port *)b;
+    int r;
+
+    if ((r = strcmp(pa->id.dev, pb->id.dev)) != 0)
+        return r;
+    if (pa->id.port != pb->id.port)
+        return pa->id.port < pb->id.port ? -1 : 1;
+    return 0;
+}
+
+/* Open counters of the port of device, return 0 or errno */
+static int add_port(struct pvt_data *pvt, int portsfd, const char *dev, const char *port)
+{
+    struct port *p;
+    uint64_t num;
+    const char *end;
+    int fd, c;
+
+    if ((end = sensorfile_u64(port, &num)) == NULL || *end != '\0')
+        return 0;
+    if ((fd = openat(portsfd, port, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+        return 0;
+    if ((c = openat(fd, "counters", O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0) {
+        close(fd);
+        return 0;
+    }
+    close(fd);
+    fd = c;
+
+    if (pvt->num_ports == pvt->max_ports) {
+        size_t max_ports = pvt->max_ports > 0 ? pvt->max_ports * 2 : 4;
+        p = (struct port *)DMM_REALLOC(pvt->ports, max_ports * sizeof(*p));
+        if (p == NULL) {
+            close(fd);
+            return ENOMEM;
+        }
+        pvt->ports = p;
+        pvt->max_ports = max_ports;
+    }
+    p = &pvt->ports[pvt->num_ports++];
+    memset(&p->id, 0, sizeof(p->id));
+    strcpy(p->id.dev, dev);
+    p->id.port = (uint32_t)num;
+    for (c = 0; c < NUM_COUNTERS; ++c)
+        p->fds[c] = openat(fd, counter_names[c], O_RDONLY | O_CLOEXEC);
+    close(fd);
+    return 0;
+}
+
+/* Find all ports and open their counters */
+static int scan(struct pvt_data *pvt)
+{
+    DIR *rootdir, *portsdir;
+    struct dirent *dev, *port;
+    char path[DMM_IBCOUNTERS_DEVSIZE + sizeof("/ports")];
+    void *p;
+    int fd, err = 0;
+
+    close_ports(pvt);
+    if ((rootdir = opendir(pvt->root)) == NULL) {
+        err = errno;
+        if (!pvt->root_warned) {
+            char errbuf[128], *errmsg;
+            errmsg = strerror_r(err, errbuf, sizeof(errbuf));
+            dmm_log(DMM_LOG_WARN, "ibcounters: cannot open %s: %s", pvt->root, errmsg);
+        }
+        pvt->root_warned = true;
+        return 0;
+    }
+    pvt->root_warned = false;
+
+    while (err == 0 && (dev = readdir(rootdir)) != NULL) {
+        if (dev->d_name[0] == '.' || strlen(dev->d_name) >= DMM_IBCOUNTERS_DEVSIZE)
+            continue;
+        strcpy(path, dev->d_name);
+        strcat(path, "/ports");
+        if ((fd = openat(dirfd(rootdir), path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+            continue;
+        if ((portsdir = fdopendir(fd)) == NULL) {
+            close(fd);
+            continue;
+        }
+        while (err == 0 && (port = readdir(portsdir)) != NULL)
+            err = add_port(pvt, dirfd(portsdir), dev->d_name, port->d_name);
+        closedir(portsdir);
+    }
+    closedir(rootdir);
+    if (err != 0)
+        return err;
+
+    qsort(pvt->ports, pvt->num_ports, sizeof(*pvt->ports), port_cmp);
+    if (pvt->num_ports > 0) {
+        size_t i;
+
+        p = DMM_REALLOC(pvt->vals, NUM_COUNTERS * pvt->num_ports * sizeof(*pvt->vals));
+        if (p == NULL)
+            return ENOMEM;
+        pvt->vals = (uint64_t *)p;
+        p = DMM_REALLOC(pvt->ids, pvt->num_ports * sizeof(*pvt->ids));
+        if (p == NULL)
+            return ENOMEM;
+        pvt->ids = (struct dmm_ibcounters_port *)p;
+        for (i = 0; i < pvt->num_ports; ++i)
+            pvt->ids[i] = pvt->ports[i].id;
+        pvt->changed = true;
+    }
+    pvt->rescan = false;
+    return 0;
+}
+
+/* Read all counters, return 0 or errno */
+static int read_counters(struct pvt_data *pvt)
+{
+    size_t i, n;
+    int c, err;
+
+    n = pvt->num_ports;
+    for (i = 0; i < n; ++i)
+        for (c = 0; c < NUM_COUNTERS; ++c) {
+            uint64_t *val = &pvt->vals[c * n + i];
+
+            *val = 0;
+            if (pvt->ports[i].fds[c] < 0)
+                continue;
+            if ((err = sensorfile_pread_u64(pvt->ports[i].fds[c], val)) != 0)
+                return err;
+        }
+    return 0;
+}
+
+static int process_timer_msg(struct pvt_data *pvt)
+{
+    dmm_data_p data;
+    dmm_datanode_p dn;
+    size_t n, len;
+    int c, err;
+
+    if ((pvt->rescan || pvt->num_ports == 0) && (err = scan(pvt)) != 0)
+        goto err;
+    n = pvt->num_ports;
+    if (n == 0)
+        return 0;
+    if ((err = read_counters(pvt)) != 0) {
+        /* Device is gone, find ports again */
+        pvt->rescan = true;
+        if (err == ENODEV || err == ENOENT)
+            return 0;
+        goto err;
+    }
+
+    len = NUM_COUNTERS * n * sizeof(uint64_t);
+    if (pvt->changed)
+        len += n * sizeof(struct dmm_ibcounters_port);
+    if ((data = DMM_DATA_CREATE_RAW(NUM_COUNTERS + pvt->changed, len)) == NULL) {
+        dmm_log(DMM_LOG_ERR, "Cannot allocate memory for data");
+        return ENOMEM;
+    }
+    dn = DMM_DATA_NODES(data);
+    for (c = 0; c < NUM_COUNTERS; ++c)
+        DMM_DN_FILL_ADVANCE(dn, IB_PORT_XMIT_DATA + c, n * sizeof(uint64_t), pvt->vals + c * n);
+    if (pvt->changed)
+        DMM_DN_FILL_ADVANCE(dn, IB_PORTS, n * sizeof(struct dmm_ibcounters_port), pvt->ids);
+    DMM_DN_MKEND(dn);
+    DMM_DATA_SEND(data, pvt->hook);
+    DMM_DATA_UNREF(data);
+    pvt->changed = false;
+    return 0;
+
+err:
+    {
+        char errbuf[128], *errmsg;
+        errmsg = strerror_r(err, errbuf, sizeof(errbuf));
+        dmm_log(DMM_LOG_ERR, "Cannot get InfiniBand counters: %s", errmsg);
+    }
+    return err;
+}
+
+static int ctor(dmm_node_p node)
+{
+    struct pvt_data *pvt;
+
+    pvt = (struct pvt_data *)DMM_MALLOC(sizeof(*pvt));
+    if (pvt == NULL)
+        return ENOMEM;
+    pvt->hook = NULL;
+    strcpy(pvt->root, DEFAULT_ROOT);
+    pvt->ports = NULL;
+    pvt->num_ports = 0;
+    pvt->max_ports = 0;
+    pvt->vals = NULL;
+    pvt->ids = NULL;
+    pvt->rescan = true;
+    pvt->changed = true;
+    pvt->root_warned = false;
+    DMM_NODE_SETPRIVATE(node, pvt);
+    return 0;
+}
+
+static void dtor(dmm_node_p node)
+{
+    struct pvt_data *pvt;
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
+    close_ports(pvt);
+    DMM_FREE(pvt->ports);
+    DMM_FREE(pvt->vals);
+    DMM_FREE(pvt->ids);
+    DMM_FREE(pvt);
+}
+
+static int newhook(dmm_hook_p hook)
+{
+    struct pvt_data *pvt;
+
+    if (DMM_HOOK_ISIN(hook))
+        return EINVAL;
+    if (strcmp(HOOKNAME, DMM_HOOK_NAME(hook)) != 0)
+        return EINVAL;
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(DMM_HOOK_NODE(hook));
+    pvt->hook = hook;
+    /* Send ports to the new receiver */
+    pvt->changed = true;
+
+    return 0;
+}
+
+static void rmhook(dmm_hook_p hook)
+{
+    struct pvt_data *pvt;
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(DMM_HOOK_NODE(hook));
+    pvt->hook = NULL;
+}
+
+static int rcvmsg(dmm_node_p node, dmm_msg_p msg)
+{
+    struct pvt_data *pvt;
+    dmm_msg_p resp;
+    int err = 0;
+
+#define CREATE_SEND_EMPTY_RESP()                                    \
+        do {                                                        \
+            resp = DMM_MSG_CREATE_RESP(DMM_NODE_ID(node), msg, 0);  \
+            if (resp != NULL) {                                     \
+                if (err != 0)                                       \
+                    msg->cm_flags |= DMM_MSG_ERR;                   \
+                                                                    \
+                DMM_MSG_SEND_ID(msg->cm_src, resp);                 \
+            } else                                                  \
+                err = (err != 0) ? err : ENOMEM;                    \
+        } while (0)
+
+    if (msg->cm_flags & DMM_MSG_RESP)
+        goto err;
+
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
+    switch (msg->cm_type) {
+    case DMM_MSGTYPE_GENERIC:
+        /* Accept only TIMERTRIGGER messages */
+        if (msg->cm_cmd != DMM_MSG_TIMERTRIGGER) {
+            err = ENOTSUP;
+            break;
+        }
+        // Nowhere to send, so why bother?
+        if (pvt->hook != NULL)
+            err = process_timer_msg(pvt);
+        break;
+
+    case DMM_MSGTYPE_IBCOUNTERS:
+        switch (msg->cm_cmd) {
+        case DMM_MSG_IBCOUNTERS_SETROOT: {
+            struct dmm_msg_ibcounters_setroot *sr;
+
+            sr = DMM_MSG_DATA(msg, struct dmm_msg_ibcounters_setroot);
+            if (msg->cm_len != sizeof(*sr) ||
+                memchr(sr->root, '\0', sizeof(sr->root)) == NULL || sr->root[0] == '\0') {
+                err = EINVAL;
+            } else {
+                close_ports(pvt);
+                strcpy(pvt->root, sr->root);
+                pvt->rescan = true;
+                pvt->root_warned = false;
+            }
+            CREATE_SEND_EMPTY_RESP();
+            break;
+        }
+
+        default:
+            err = ENOTSUP;
+            break;
+        }
+        break;
+
+    default:
+        err = ENOTSUP;
+        break;
+    }
+
+#undef CREATE_SEND_EMPTY_RESP
+
+err:
+    DMM_MSG_FREE(msg);
+    return err;
+}
+
+static struct dmm_type type = {
+    "ibcounters",
+    ctor,
+    dtor,
+    NULL,
+    rcvmsg,
+    newhook,
+    rmhook,
+    {},
+};
+
+DMM_MODULE_DECLARE(&type);
@@ -0,0 +1,35 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+#ifndef MODULES_IBCOUNTERS_IBCOUNTERS_H_
+#define MODULES_IBCOUNTERS_IBCOUNTERS_H_
+
+#include "dmm_types.h"
+
+enum {
+    DMM_MSGTYPE_IBCOUNTERS = 0x4c212ea9
+};
+
+enum {
+    DMM_MSG_IBCOUNTERS_SETROOT = 1,
+};
+
+enum { DMM_IBCOUNTERS_PATHSIZE = 256 };
+enum { DMM_IBCOUNTERS_DEVSIZE = 64 };
+
+/*
+ * Read counters from root/<device>/ports/<port>/counters,
+ * root is /sys/class/infiniband by default
+ */
+struct dmm_msg_ibcounters_setroot {
+    char root[DMM_IBCOUNTERS_PATHSIZE];
+};
+
+/* Element of IB_PORTS datanode */
+struct dmm_ibcounters_port {
+    char     dev[DMM_IBCOUNTERS_DEVSIZE];
+    uint32_t port;
+};
+
+#endif /* MODULES_IBCOUNTERS_IBCOUNTERS_H_ */
@@ -0,0 +1,24 @@
+-- SPDX-License-Identifier: BSD-2-Clause-Views
+-- Copyright (c) 2013-2023
+--   Research Computing Center Lomonosov Moscow State University
+
+local dmm = require('dmm')
+
+assert(dmm.require_interface('ibcounters', 'll'))
+
+local Ibcounters = dmm.Module:new_type('ibcounters')
+
+--! @brief Set directory with InfiniBand devices
+--! @param root '/sys/class/infiniband' by default, e.g. a fixture tree for tests
+function Ibcounters:setroot(root)
+  assert(#root < ffi.C.DMM_IBCOUNTERS_PATHSIZE, 'root is too long')
+  local msg, sr = dmm.msg_create {
+    payload_type = 'struct dmm_msg_ibcounters_setroot',
+    type = ffi.C.DMM_MSGTYPE_IBCOUNTERS,
+    cmd = ffi.C.DMM_MSG_IBCOUNTERS_SETROOT,
+  }
+  sr.root = root
+  dmm.msg_send(self.nodeid, msg)
+end
+
+return Ibcounters
@@ -0,0 +1,31 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+#ifndef MODULES_IBCOUNTERS_SENSORS_H_
+#define MODULES_IBCOUNTERS_SENSORS_H_
+
+/*
+ * uint64_t vectors with one element per port, in the order
+ * of IB_PORTS datanode. Data counters are in 4 octet units.
+ */
+enum {
+    IB_PORT_XMIT_DATA = 1300,
+    IB_PORT_RCV_DATA,
+    IB_PORT_XMIT_PACKETS,
+    IB_PORT_RCV_PACKETS,
+    IB_SYMBOL_ERROR,
+    IB_PORT_RCV_ERRORS,
+    IB_LINK_DOWNED,
+    IB_LINK_ERROR_RECOVERY,
+    IB_PORT_XMIT_DISCARDS,
+    IB_PORT_XMIT_WAIT,
+    IB_PORT_RCV_REMOTE_PHYSICAL_ERRORS,
+    IB_LOCAL_LINK_INTEGRITY_ERRORS,
+    IB_EXCESSIVE_BUFFER_OVERRUN_ERRORS,
+    IB_VL15_DROPPED,
+    /* Array of struct dmm_ibcounters_port, sent when the set of ports changes */
+    IB_PORTS
+};
+
+#endif /* MODULES_IBCOUNTERS_SENSORS_H_ */
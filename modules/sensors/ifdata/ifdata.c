@@ -2,87 +2,360 @@
 // Copyright (c) 2013-2023
 //   Research Computing Center Lomonosov Moscow State University
 
+/*
+ * ifdata sends network interface counters got from the kernel
+ * with a single netlink dump per timer tick: RTM_GETSTATS with
+ * 64-bit link stats only, or RTM_GETLINK on kernels without
+ * RTM_GETSTATS (before 4.7).
+ *
+ * Counters are sent as vectors accompanied by IFINDEX vector
+ * of interface indexes. When the set of interfaces changes (or on the
+ * first tick) IFNAMES datanode with names of all interfaces is sent too.
+ * Interface renames without changing the set are not tracked.
+ */
+
 #include <errno.h>
-#include <stdio.h>
+#include <stdbool.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/if_link.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
 
 #include "dmm_base.h"
 #include "dmm_log.h"
 #include "dmm_message.h"
+#include "sensors.h"
 
-#define DATAFILE "/proc/net/dev"
 #define HOOKNAME "out"
 
-static int num_interfaces = 0;
+typedef uint64_t ifcounter_t;
+
+#define NUM_COUNTERS 4
+
+/*
+ * Kernel fits dump messages to the receive buffer size,
+ * but not more than 32K, so it's rarely exceeded
+ */
+#define RECVBUF_SIZE 32768
+
 struct pvt_data {
-    FILE *f;
     dmm_hook_p hook;
+    int nlfd;
+    uint32_t seq;
+    char *buf;
+    size_t bufsize;
+    /* False after kernel refused RTM_GETSTATS */
+    bool use_getstats;
+    /* Interfaces found at the current tick, arrays have max_ifs elements */
+    size_t num_ifs;
+    size_t max_ifs;
+    uint32_t *ifindex;
+    ifcounter_t *counters[NUM_COUNTERS];
+    struct dmm_ifdata_ifname *names;
+    /* Expected position of the next name in RTM_GETLINK dump */
+    size_t names_next;
+    /* Interface indexes at previous tick */
+    uint32_t *prev_ifindex;
+    size_t prev_num_ifs;
 };
-typedef uint64_t ifcounter_t;
-#define SCNifcounter SCNu64
 
-#define NUM_SENSORS 4
+typedef int (*nlmsg_handler_t)(struct pvt_data *pvt, struct nlmsghdr *nlh);
 
-enum {
-    IFBYTESIN = 100,
-    IFPACKETSIN,
-    IFBYTESOUT,
-    IFPACKETSOUT
-};
+static void free_ifs(struct pvt_data *pvt)
+{
+    int i;
 
-/*
- * Try to open data file to ensure it exists and readable
- * Count interfaces
- */
-static int init()
+    DMM_FREE(pvt->ifindex);
+    for (i = 0; i < NUM_COUNTERS; ++i)
+        DMM_FREE(pvt->counters[i]);
+    DMM_FREE(pvt->names);
+    DMM_FREE(pvt->prev_ifindex);
+}
+
+static int grow_ifs(struct pvt_data *pvt)
+{
+    size_t max_ifs;
+    void *p;
+    int i;
+
+    max_ifs = pvt->max_ifs ? pvt->max_ifs * 2 : 64;
+#define GROW_ARRAY(arr)                                             \
+    do {                                                            \
+        if ((p = DMM_REALLOC((arr), max_ifs * sizeof(*(arr)))) == NULL) \
+            goto enomem;                                            \
+        (arr) = p;                                                  \
+    } while (0)
+
+    GROW_ARRAY(pvt->ifindex);
+    for (i = 0; i < NUM_COUNTERS; ++i)
+        GROW_ARRAY(pvt->counters[i]);
+    GROW_ARRAY(pvt->names);
+    GROW_ARRAY(pvt->prev_ifindex);
+#undef GROW_ARRAY
+    pvt->max_ifs = max_ifs;
+    return 0;
+
+enomem:
+    dmm_log(DMM_LOG_ERR, "Cannot allocate memory for %zu interfaces", max_ifs);
+    return ENOMEM;
+}
+
+/* Position of interface in the current list, or num_ifs if it's not there */
+static size_t find_if(struct pvt_data *pvt, uint32_t ifindex, size_t hint)
 {
-    FILE *f;
+    size_t i;
+
+    if (hint < pvt->num_ifs && pvt->ifindex[hint] == ifindex)
+        return hint;
+    for (i = 0; i < pvt->num_ifs; ++i)
+        if (pvt->ifindex[i] == ifindex)
+            break;
+    return i;
+}
+
+static int add_if(struct pvt_data *pvt, uint32_t ifindex, const struct rtnl_link_stats64 *st)
+{
+    size_t i;
     int err;
-    char errbuf[128], *errmsg;
-    int c, i;
-    char tempc;
 
-    f = fopen(DATAFILE, "re");
-    if (f == NULL) {
-        err = errno;
-        errmsg = strerror_r(err, errbuf, sizeof(errbuf));
-        dmm_log(DMM_LOG_ERR, "Cannot open %s for reading: %s", DATAFILE, errmsg);
+    if (pvt->num_ifs == pvt->max_ifs && (err = grow_ifs(pvt)) != 0)
+        return err;
+    i = pvt->num_ifs++;
+    pvt->ifindex[i] = ifindex;
+    pvt->counters[0][i] = st->rx_bytes;
+    pvt->counters[1][i] = st->rx_packets;
+    pvt->counters[2][i] = st->tx_bytes;
+    pvt->counters[3][i] = st->tx_packets;
+    return 0;
+}
+
+static void set_name(struct pvt_data *pvt, size_t i, const struct rtattr *rta)
+{
+    size_t len;
+
+    len = RTA_PAYLOAD(rta);
+    if (len > sizeof(pvt->names[i].name) - 1)
+        len = sizeof(pvt->names[i].name) - 1;
+    pvt->names[i].ifindex = pvt->ifindex[i];
+    memset(pvt->names[i].name, 0, sizeof(pvt->names[i].name));
+    memcpy(pvt->names[i].name, RTA_DATA(rta), len);
+}
+
+static int handle_newstats(struct pvt_data *pvt, struct nlmsghdr *nlh)
+{
+    struct if_stats_msg *ifsm;
+    struct rtnl_link_stats64 st;
+    struct rtattr *rta;
+    int len;
+
+    if (nlh->nlmsg_type != RTM_NEWSTATS)
+        return 0;
+    ifsm = (struct if_stats_msg *)NLMSG_DATA(nlh);
+    len = nlh->nlmsg_len - NLMSG_LENGTH(sizeof(*ifsm));
+    for (rta = (struct rtattr *)((char *)ifsm + NLMSG_ALIGN(sizeof(*ifsm)));
+         RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+        if (rta->rta_type == IFLA_STATS_LINK_64 && RTA_PAYLOAD(rta) >= sizeof(st)) {
+            /* Attribute data is only 4 bytes aligned */
+            memcpy(&st, RTA_DATA(rta), sizeof(st));
+            return add_if(pvt, ifsm->ifindex, &st);
+        }
+    }
+    return 0;
+}
+
+/* Stats and names for kernels without RTM_GETSTATS */
+static int handle_newlink(struct pvt_data *pvt, struct nlmsghdr *nlh)
+{
+    struct ifinfomsg *ifi;
+    struct rtnl_link_stats64 st;
+    struct rtattr *rta, *name = NULL;
+    bool have_stats = false;
+    int len, err;
+
+    if (nlh->nlmsg_type != RTM_NEWLINK)
+        return 0;
+    ifi = (struct ifinfomsg *)NLMSG_DATA(nlh);
+    len = nlh->nlmsg_len - NLMSG_LENGTH(sizeof(*ifi));
+    for (rta = IFLA_RTA(ifi); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+        if (rta->rta_type == IFLA_STATS64 && RTA_PAYLOAD(rta) >= sizeof(st)) {
+            memcpy(&st, RTA_DATA(rta), sizeof(st));
+            have_stats = true;
+        } else if (rta->rta_type == IFLA_IFNAME) {
+            name = rta;
+        }
+    }
+    if (!have_stats)
+        return 0;
+    if ((err = add_if(pvt, ifi->ifi_index, &st)) != 0)
         return err;
+    if (name != NULL)
+        set_name(pvt, pvt->num_ifs - 1, name);
+    return 0;
+}
+
+/* Names of interfaces already found by RTM_GETSTATS dump */
+static int handle_newlink_name(struct pvt_data *pvt, struct nlmsghdr *nlh)
+{
+    struct ifinfomsg *ifi;
+    struct rtattr *rta;
+    size_t i;
+    int len;
+
+    if (nlh->nlmsg_type != RTM_NEWLINK)
+        return 0;
+    ifi = (struct ifinfomsg *)NLMSG_DATA(nlh);
+    len = nlh->nlmsg_len - NLMSG_LENGTH(sizeof(*ifi));
+    for (rta = IFLA_RTA(ifi); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+        if (rta->rta_type != IFLA_IFNAME)
+            continue;
+        /* Links are dumped in the same order as stats, so guess position */
+        i = find_if(pvt, ifi->ifi_index, pvt->names_next);
+        if (i < pvt->num_ifs) {
+            set_name(pvt, i, rta);
+            pvt->names_next = i + 1;
+        }
+        break;
     }
-    // Skip first two lines (header)
-    for (i = 0; i < 2; ++i) {
-        while ((c = fgetc(f)) != '\n' && c != EOF)
-            ;
+    return 0;
+}
+
+/* Dump all interfaces with request type, pass every reply to handler */
+static int nl_dump(struct pvt_data *pvt, uint16_t type, nlmsg_handler_t handler)
+{
+    struct {
+        struct nlmsghdr nlh;
+        union {
+            struct if_stats_msg ifsm;
+            struct ifinfomsg    ifi;
+        };
+    } req;
+    struct nlmsghdr *nlh;
+    ssize_t n;
+    char *newbuf;
+    int len, err;
+
+    memset(&req, 0, sizeof(req));
+    if (type == RTM_GETSTATS) {
+        req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(req.ifsm));
+        req.ifsm.family = AF_UNSPEC;
+        req.ifsm.filter_mask = IFLA_STATS_FILTER_BIT(IFLA_STATS_LINK_64);
+    } else {
+        req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(req.ifi));
+        req.ifi.ifi_family = AF_UNSPEC;
     }
-    while (fscanf(f, "%*[^:]%c", &tempc) > 0) {
-        num_interfaces++;
-        while ((c = fgetc(f)) != '\n' && c != EOF)
-            ;
+    req.nlh.nlmsg_type = type;
+    req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.nlh.nlmsg_seq = ++pvt->seq;
+    if (send(pvt->nlfd, &req, req.nlh.nlmsg_len, 0) < 0)
+        return errno;
+
+    for (;;) {
+        n = recv(pvt->nlfd, pvt->buf, pvt->bufsize, MSG_TRUNC);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return errno;
+        }
+        if ((size_t)n > pvt->bufsize) {
+            /*
+             * Rest of the dump is lost. Make buffer large enough for next
+             * time, stale replies are then skipped by sequence number
+             */
+            if ((newbuf = (char *)DMM_REALLOC(pvt->buf, n)) != NULL) {
+                pvt->buf = newbuf;
+                pvt->bufsize = n;
+            }
+            return EMSGSIZE;
+        }
+        len = (int)n;
+        for (nlh = (struct nlmsghdr *)pvt->buf; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+            if (nlh->nlmsg_seq != pvt->seq)
+                continue;
+            if (nlh->nlmsg_type == NLMSG_DONE)
+                return 0;
+            if (nlh->nlmsg_type == NLMSG_ERROR) {
+                struct nlmsgerr *e = (struct nlmsgerr *)NLMSG_DATA(nlh);
+                return e->error < 0 ? -e->error : EINVAL;
+            }
+            if ((err = handler(pvt, nlh)) != 0)
+                return err;
+        }
     }
-    dmm_debug("ifdatda: found %d interfaces", num_interfaces);
+}
+
+/* Get counters of all interfaces, set changed if the set of interfaces changed */
+static int collect(struct pvt_data *pvt, bool *changed)
+{
+    int err;
 
-    fclose(f);
+    pvt->num_ifs = 0;
+    if (pvt->use_getstats) {
+        err = nl_dump(pvt, RTM_GETSTATS, handle_newstats);
+        if (err == EOPNOTSUPP || err == EINVAL) {
+            dmm_log(DMM_LOG_INFO, "ifdata: RTM_GETSTATS is not supported, use RTM_GETLINK");
+            pvt->use_getstats = false;
+        } else if (err != 0) {
+            return err;
+        }
+    }
+    if (!pvt->use_getstats) {
+        pvt->num_ifs = 0;
+        if ((err = nl_dump(pvt, RTM_GETLINK, handle_newlink)) != 0)
+            return err;
+    }
+
+    *changed = pvt->num_ifs != pvt->prev_num_ifs ||
+               memcmp(pvt->ifindex, pvt->prev_ifindex, pvt->num_ifs * sizeof(*pvt->ifindex)) != 0;
+    if (*changed && pvt->use_getstats) {
+        size_t i;
+
+        for (i = 0; i < pvt->num_ifs; ++i) {
+            pvt->names[i].ifindex = pvt->ifindex[i];
+            memset(pvt->names[i].name, 0, sizeof(pvt->names[i].name));
+        }
+        pvt->names_next = 0;
+        if ((err = nl_dump(pvt, RTM_GETLINK, handle_newlink_name)) != 0)
+            return err;
+    }
     return 0;
 }
 
 static int ctor(dmm_node_p node)
 {
     struct pvt_data *pvt;
+    int err, i;
 
     pvt = (struct pvt_data *)DMM_MALLOC(sizeof(*pvt));
     if (pvt == NULL)
         return ENOMEM;
-    pvt->f = fopen(DATAFILE, "re");
-    if (pvt->f == NULL) {
-        int err;
+    pvt->nlfd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (pvt->nlfd < 0) {
         char errbuf[128], *errmsg;
         err = errno;
         errmsg = strerror_r(err, errbuf, sizeof(errbuf));
-        dmm_log(DMM_LOG_ERR, "Cannot open %s for reading: %s", DATAFILE, errmsg);
+        dmm_log(DMM_LOG_ERR, "Cannot open netlink socket: %s", errmsg);
+        DMM_FREE(pvt);
         return err;
     }
-    // Disable buffering to have fresh data on successive reads
-    setlinebuf(pvt->f);
+    if ((pvt->buf = (char *)DMM_MALLOC(RECVBUF_SIZE)) == NULL) {
+        close(pvt->nlfd);
+        DMM_FREE(pvt);
+        return ENOMEM;
+    }
+    pvt->bufsize = RECVBUF_SIZE;
+    pvt->seq = 0;
+    pvt->use_getstats = true;
+    pvt->num_ifs = 0;
+    pvt->max_ifs = 0;
+    pvt->ifindex = NULL;
+    for (i = 0; i < NUM_COUNTERS; ++i)
+        pvt->counters[i] = NULL;
+    pvt->names = NULL;
+    pvt->names_next = 0;
+    pvt->prev_ifindex = NULL;
+    pvt->prev_num_ifs = 0;
     pvt->hook = NULL;
     DMM_NODE_SETPRIVATE(node, pvt);
     return 0;
@@ -92,7 +365,9 @@ static void dtor(dmm_node_p node)
 {
     struct pvt_data *pvt;
     pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
-    fclose(pvt->f);
+    close(pvt->nlfd);
+    DMM_FREE(pvt->buf);
+    free_ifs(pvt);
     DMM_FREE(pvt);
 }
 
@@ -106,16 +381,17 @@ static int newhook(dmm_hook_p hook)
         return EINVAL;
     pvt = (struct pvt_data *)DMM_NODE_PRIVATE(DMM_HOOK_NODE(hook));
     pvt->hook = hook;
+    /* Send names to the new receiver */
+    pvt->prev_num_ifs = 0;
 
     return 0;
 }
 
 static void rmhook(dmm_hook_p hook)
 {
-    (void)hook;
     struct pvt_data *pvt;
     pvt = (struct pvt_data *)DMM_NODE_PRIVATE(DMM_HOOK_NODE(hook));
-    pvt->hook = hook;
+    pvt->hook = NULL;
 }
 
 static int rcvmsg(dmm_node_p node, dmm_msg_p msg)
@@ -123,12 +399,10 @@ static int rcvmsg(dmm_node_p node, dmm_msg_p msg)
     dmm_data_p data;
     dmm_datanode_p dn;
     struct pvt_data *pvt;
-    int i, c;
-    FILE *f;
-    ifcounter_t bytes_in[num_interfaces],
-                packets_in[num_interfaces],
-                bytes_out[num_interfaces],
-                packets_out[num_interfaces];
+    uint32_t *tmp;
+    size_t n, len;
+    bool changed;
+    int i, err;
 
     // We believe all messages are timer messages, so ignore
     DMM_MSG_FREE(msg);
@@ -138,63 +412,41 @@ static int rcvmsg(dmm_node_p node, dmm_msg_p msg)
     if (pvt->hook == NULL)
         return 0;
 
-    f = pvt->f;
-    if ((data = DMM_DATA_CREATE(NUM_SENSORS * num_interfaces, sizeof(ifcounter_t))) == NULL) {
+    if ((err = collect(pvt, &changed)) != 0) {
+        char errbuf[128], *errmsg;
+        errmsg = strerror_r(err, errbuf, sizeof(errbuf));
+        dmm_log(DMM_LOG_ERR, "Cannot get interface statistics: %s", errmsg);
+        /* Resend names when it works again */
+        pvt->prev_num_ifs = 0;
+        return err;
+    }
+    n = pvt->num_ifs;
+    if (n == 0)
+        return 0;
+
+    len = NUM_COUNTERS * n * sizeof(ifcounter_t) + n * sizeof(uint32_t);
+    if (changed)
+        len += n * sizeof(struct dmm_ifdata_ifname);
+    if ((data = DMM_DATA_CREATE_RAW(NUM_COUNTERS + 1 + changed, len)) == NULL) {
         dmm_log(DMM_LOG_ERR, "Cannot allocate memory for data");
         return ENOMEM;
     }
-    rewind(f);
-    fflush(f);
-
-    // Skip first two lines (header)
-    for (i = 0; i < 2; ++i) {
-        while ((c = fgetc(f)) != '\n')
-            if (c == EOF)
-                goto errexit;
-    }
-
     dn = DMM_DATA_NODES(data);
-    for (i = 0; i < num_interfaces; ++i) {
-// Silence scanf format warnings
-#pragma GCC diagnostic ignored "-Wformat"
-        if (fscanf(f,
-                "%*[^:]:"
-                "%" SCNifcounter
-                "%" SCNifcounter
-                "%*" SCNifcounter
-                "%*" SCNifcounter
-                "%*" SCNifcounter
-                "%*" SCNifcounter
-                "%*" SCNifcounter
-                "%*" SCNifcounter
-                "%" SCNifcounter
-                "%" SCNifcounter
-                "%*" SCNifcounter
-                "%*" SCNifcounter
-                "%*" SCNifcounter
-                "%*" SCNifcounter
-                "%*" SCNifcounter
-                "%*" SCNifcounter,
-                bytes_in + i, packets_in + i, bytes_out + i, packets_out + i
-            ) < 4
-           ) {
-            goto errexit;
-        }
-#pragma GCC diagnostic error "-Wformat"
-    }
-    DMM_DN_FILL_ADVANCE(dn, IFBYTESIN, sizeof(bytes_in), bytes_in);
-    DMM_DN_FILL_ADVANCE(dn, IFPACKETSIN, sizeof(packets_in), packets_in);
-    DMM_DN_FILL_ADVANCE(dn, IFBYTESOUT, sizeof(bytes_out), bytes_out);
-    DMM_DN_FILL_ADVANCE(dn, IFPACKETSOUT, sizeof(packets_out), packets_out);
+    for (i = 0; i < NUM_COUNTERS; ++i)
+        DMM_DN_FILL_ADVANCE(dn, IFBYTESIN + i, n * sizeof(ifcounter_t), pvt->counters[i]);
+    DMM_DN_FILL_ADVANCE(dn, IFINDEX, n * sizeof(uint32_t), pvt->ifindex);
+    if (changed)
+        DMM_DN_FILL_ADVANCE(dn, IFNAMES, n * sizeof(struct dmm_ifdata_ifname), pvt->names);
     DMM_DN_MKEND(dn);
     DMM_DATA_SEND(data, pvt->hook);
     DMM_DATA_UNREF(data);
 
-    return 0;
+    tmp = pvt->prev_ifindex;
+    pvt->prev_ifindex = pvt->ifindex;
+    pvt->ifindex = tmp;
+    pvt->prev_num_ifs = n;
 
-errexit:
-    DMM_FREE(data);
-    return EINVAL;
+    return 0;
 }
 
 static struct dmm_type type = {
@@ -209,4 +461,3 @@ static struct dmm_type type = {
 };
 
 DMM_MODULE_DECLARE(&type);
-DMM_MODULEINIT_DECLARE(init);
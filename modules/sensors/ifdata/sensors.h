@@ -0,0 +1,28 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+#ifndef MODULES_IFDATA_SENSORS_H_
+#define MODULES_IFDATA_SENSORS_H_
+
+#include <stdint.h>
+
+enum {
+    IFBYTESIN = 100,
+    IFPACKETSIN,
+    IFBYTESOUT,
+    IFPACKETSOUT,
+    /* uint32_t interface indexes for values of the sensors above */
+    IFINDEX,
+    /* Array of struct dmm_ifdata_ifname, sent when interfaces change */
+    IFNAMES
+};
+
+#define DMM_IFDATA_IFNAMSIZ 16
+
+struct dmm_ifdata_ifname {
+    uint32_t ifindex;
+    char     name[DMM_IFDATA_IFNAMSIZ];
+};
+
+#endif /* MODULES_IFDATA_SENSORS_H_ */
@@ -0,0 +1,555 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+/*
+ * interrupts sends per-CPU interrupt totals from /proc/interrupts,
+ * per-CPU sums of selected IRQ rows and per-CPU /proc/softirqs rows.
+ *
+ * Both files are matrices with a CPU per column. They are parsed
+ * row by row in a single pass: counters of a row are parsed into
+ * a row buffer and added to per-CPU column sums, so the cost is linear
+ * in the file size. IRQ rows are matched against selection patterns
+ * only when the label or the description of the row at the same
+ * position changes (an IRQ number may be reassigned to another device),
+ * matching results are cached as a bit mask per row.
+ */
+
+#include <errno.h>
+#include <fnmatch.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "dmm_base.h"
+#include "dmm_log.h"
+#include "dmm_message.h"
+#include "../sensorfile.h"
+#include "interrupts.h"
+#include "sensors.h"
+
+#define HOOKNAME "out"
+
+#define INTERRUPTS_PATH "/proc/interrupts"
+#define SOFTIRQS_PATH   "/proc/softirqs"
+
+#define NUM_SOFTIRQS 10
+
+static const char *softirq_names[NUM_SOFTIRQS] = {
+    "HI", "TIMER", "NET_TX", "NET_RX", "BLOCK",
+    "IRQ_POLL", "TASKLET", "SCHED", "HRTIMER", "RCU",
+};
+
+#define ROW_KEYSIZE 16
+
+/* Matching results for the row of /proc/interrupts */
+struct row {
+    char key[ROW_KEYSIZE];
+    /* Hash of the description after counters */
+    uint64_t desc_hash;
+    uint64_t mask;
+};
+
+/* CPU columns of a file */
+struct cpus {
+    size_t num;
+    size_t max;
+    uint32_t *ids;
+};
+
+struct pvt_data {
+    dmm_hook_p hook;
+    struct sensorfile intr_sf;
+    struct sensorfile soft_sf;
+    struct cpus intr_cpus;
+    struct cpus soft_cpus;
+    /* Arrays of intr_cpus.max elements */
+    uint64_t *totals;
+    uint64_t *rowvals;
+    /* num_irqs vectors of intr_cpus.max elements */
+    uint64_t *irqvals;
+    /* NUM_SOFTIRQS vectors of soft_cpus.max elements */
+    uint64_t *softvals;
+    struct dmm_interrupts_irq irqs[DMM_INTERRUPTS_MAXIRQS];
+    size_t num_irqs;
+    struct row *rows;
+    size_t num_rows;
+    size_t max_rows;
+};
+
+/*
+ * Parse header line "CPU0 CPU1 ..." into cpus,
+ * return pointer to the next line and set changed if CPUs changed
+ */
+static const char *parse_header(const char *s, struct cpus *cpus, bool *changed, int *err)
+{
+    const char *p;
+    uint64_t id;
+    uint32_t *ids;
+    size_t n = 0;
+
+    *changed = false;
+    *err = 0;
+    for (;;) {
+        s = sensorfile_skipblanks(s);
+        if ((p = sensorfile_match(s, "CPU")) == NULL || (p = sensorfile_u64(p, &id)) == NULL)
+            break;
+        if (n == cpus->max) {
+            size_t max = cpus->max > 0 ? cpus->max * 2 : 64;
+            if ((ids = (uint32_t *)DMM_REALLOC(cpus->ids, max * sizeof(*ids))) == NULL) {
+                *err = ENOMEM;
+                return s;
+            }
+            cpus->ids = ids;
+            cpus->max = max;
+            *changed = true;
+        }
+        if (n >= cpus->num || cpus->ids[n] != (uint32_t)id)
+            *changed = true;
+        cpus->ids[n++] = (uint32_t)id;
+        s = p;
+    }
+    if (n != cpus->num)
+        *changed = true;
+    cpus->num = n;
+    return sensorfile_nextline(s);
+}
+
+/* Parse "LABEL:" at the beginning of row, return pointer past ':' or NULL */
+static const char *parse_label(const char *s, const char **label, size_t *len)
+{
+    const char *p;
+
+    s = sensorfile_skipblanks(s);
+    for (p = s; *p != ':' && *p != ' ' && *p != '\n' && *p != '\0'; p++)
+        ;
+    if (*p != ':')
+        return NULL;
+    *label = s;
+    *len = (size_t)(p - s);
+    return p + 1;
+}
+
+/* Parse up to n counters into vals, return the number parsed and set *end */
+static size_t parse_counters(const char *s, uint64_t *vals, size_t n, const char **end)
+{
+    const char *p;
+    size_t i;
+
+    for (i = 0; i < n; ++i) {
+        if ((p = sensorfile_u64(s, &vals[i])) == NULL)
+            break;
+        s = p;
+    }
+    *end = s;
+    return i;
+}
+
+static int grow_rows(struct pvt_data *pvt)
+{
+    struct row *rows;
+    size_t max;
+
+    max = pvt->max_rows > 0 ? pvt->max_rows * 2 : 64;
+    if ((rows = (struct row *)DMM_REALLOC(pvt->rows, max * sizeof(*rows))) == NULL)
+        return ENOMEM;
+    pvt->rows = rows;
+    pvt->max_rows = max;
+    return 0;
+}
+
+/* Match the row against selected IRQ patterns */
+static uint64_t match_row(struct pvt_data *pvt, const char *key, const char *desc)
+{
+    uint64_t mask = 0;
+    size_t i;
+
+    for (i = 0; i < pvt->num_irqs; ++i)
+        if (fnmatch(pvt->irqs[i].pattern, key, 0) == 0 ||
+            fnmatch(pvt->irqs[i].pattern, desc, 0) == 0)
+            mask |= (uint64_t)1 << i;
+    return mask;
+}
+
+/* FNV-1a hash of the rest of the line */
+static uint64_t line_hash(const char *s)
+{
+    uint64_t h = 14695981039346656037ull;
+
+    for (; *s != '\n' && *s != '\0'; ++s) {
+        h ^= (unsigned char)*s;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+/*
+ * Cached selection mask of the r-th row, updated if the label
+ * or the description changed
+ */
+static int row_mask(struct pvt_data *pvt, size_t r, const char *label, size_t len,
+                    const char *rest, uint64_t *mask)
+{
+    char key[ROW_KEYSIZE], desc[256];
+    struct row *row;
+    uint64_t hash;
+    size_t dlen;
+    int err;
+
+    if (len >= ROW_KEYSIZE)
+        len = ROW_KEYSIZE - 1;
+    rest = sensorfile_skipblanks(rest);
+    hash = line_hash(rest);
+    if (r < pvt->num_rows && memcmp(pvt->rows[r].key, label, len) == 0 &&
+        pvt->rows[r].key[len] == '\0' && pvt->rows[r].desc_hash == hash) {
+        *mask = pvt->rows[r].mask;
+        return 0;
+    }
+    while (r >= pvt->max_rows)
+        if ((err = grow_rows(pvt)) != 0)
+            return err;
+    pvt->num_rows = r + 1;
+    row = &pvt->rows[r];
+    memcpy(key, label, len);
+    key[len] = '\0';
+    dlen = strcspn(rest, "\n");
+    if (dlen >= sizeof(desc))
+        dlen = sizeof(desc) - 1;
+    memcpy(desc, rest, dlen);
+    desc[dlen] = '\0';
+    memcpy(row->key, key, len + 1);
+    row->desc_hash = hash;
+    row->mask = match_row(pvt, key, desc);
+    *mask = row->mask;
+    return 0;
+}
+
+static int resize_intr(struct pvt_data *pvt)
+{
+    size_t max = pvt->intr_cpus.max;
+    void *p;
+
+    if ((p = DMM_REALLOC(pvt->totals, max * sizeof(uint64_t))) == NULL)
+        return ENOMEM;
+    pvt->totals = (uint64_t *)p;
+    if ((p = DMM_REALLOC(pvt->rowvals, max * sizeof(uint64_t))) == NULL)
+        return ENOMEM;
+    pvt->rowvals = (uint64_t *)p;
+    if ((p = DMM_REALLOC(pvt->irqvals, DMM_INTERRUPTS_MAXIRQS * max * sizeof(uint64_t))) == NULL)
+        return ENOMEM;
+    pvt->irqvals = (uint64_t *)p;
+    return 0;
+}
+
+static int parse_interrupts(struct pvt_data *pvt)
+{
+    const char *line, *s, *label, *end;
+    size_t i, j, n, r, len;
+    uint64_t mask, *vals;
+    bool changed;
+    int err;
+
+    if ((err = sensorfile_read(&pvt->intr_sf)) != 0)
+        return err;
+    line = parse_header(pvt->intr_sf.buf, &pvt->intr_cpus, &changed, &err);
+    if (err != 0)
+        return err;
+    n = pvt->intr_cpus.num;
+    if (changed) {
+        if ((err = resize_intr(pvt)) != 0) {
+            pvt->intr_cpus.num = 0;
+            return err;
+        }
+        pvt->num_rows = 0;
+    }
+    if (n == 0)
+        return 0;
+
+    memset(pvt->totals, 0, n * sizeof(uint64_t));
+    memset(pvt->irqvals, 0, pvt->num_irqs * n * sizeof(uint64_t));
+    for (r = 0; *line != '\0'; line = sensorfile_nextline(line)) {
+        if ((s = parse_label(line, &label, &len)) == NULL)
+            continue;
+        /* Global error counters have a single value */
+        if ((len == 3 && memcmp(label, "ERR", 3) == 0) ||
+            (len == 3 && memcmp(label, "MIS", 3) == 0))
+            continue;
+        if (parse_counters(s, pvt->rowvals, n, &end) != n)
+            continue;
+        for (i = 0; i < n; ++i)
+            pvt->totals[i] += pvt->rowvals[i];
+        if (pvt->num_irqs > 0) {
+            if ((err = row_mask(pvt, r, label, len, end, &mask)) != 0)
+                return err;
+            for (j = 0; mask != 0; ++j, mask >>= 1) {
+                if (!(mask & 1))
+                    continue;
+                vals = pvt->irqvals + j * n;
+                for (i = 0; i < n; ++i)
+                    vals[i] += pvt->rowvals[i];
+            }
+        }
+        r++;
+    }
+    return 0;
+}
+
+static int parse_softirqs(struct pvt_data *pvt)
+{
+    const char *line, *s, *label, *end;
+    size_t m, len;
+    int t, err;
+    bool changed;
+
+    if ((err = sensorfile_read(&pvt->soft_sf)) != 0)
+        return err;
+    line = parse_header(pvt->soft_sf.buf, &pvt->soft_cpus, &changed, &err);
+    if (err != 0)
+        return err;
+    m = pvt->soft_cpus.num;
+    if (changed) {
+        uint64_t *p = (uint64_t *)DMM_REALLOC(pvt->softvals, NUM_SOFTIRQS * pvt->soft_cpus.max * sizeof(uint64_t));
+        if (p == NULL) {
+            pvt->soft_cpus.num = 0;
+            return ENOMEM;
+        }
+        pvt->softvals = p;
+    }
+    if (m == 0)
+        return 0;
+
+    memset(pvt->softvals, 0, NUM_SOFTIRQS * m * sizeof(uint64_t));
+    for (t = 0; *line != '\0'; line = sensorfile_nextline(line)) {
+        if ((s = parse_label(line, &label, &len)) == NULL)
+            continue;
+        /* Rows are expected in softirq_names order, look up otherwise */
+        if (t >= NUM_SOFTIRQS || strncmp(softirq_names[t], label, len) != 0 ||
+            softirq_names[t][len] != '\0')
+            for (t = 0; t < NUM_SOFTIRQS; ++t)
+                if (strncmp(softirq_names[t], label, len) == 0 && softirq_names[t][len] == '\0')
+                    break;
+        if (t == NUM_SOFTIRQS)
+            continue;
+        parse_counters(s, pvt->softvals + t * m, m, &end);
+        t++;
+    }
+    return 0;
+}
+
+static int process_timer_msg(struct pvt_data *pvt)
+{
+    dmm_data_p data;
+    dmm_datanode_p dn;
+    size_t i, n, m, len, numnodes;
+    int t, err;
+
+    if ((err = parse_interrupts(pvt)) != 0 || (err = parse_softirqs(pvt)) != 0) {
+        char errbuf[128], *errmsg;
+        errmsg = strerror_r(err, errbuf, sizeof(errbuf));
+        dmm_log(DMM_LOG_ERR, "Cannot get interrupt statistics: %s", errmsg);
+        return err;
+    }
+    n = pvt->intr_cpus.num;
+    m = pvt->soft_cpus.num;
+
+    numnodes = 0;
+    len = 0;
+    if (n > 0) {
+        numnodes += 2 + pvt->num_irqs;
+        len += (1 + pvt->num_irqs) * n * sizeof(uint64_t) + n * sizeof(uint32_t);
+    }
+    if (m > 0) {
+        numnodes += NUM_SOFTIRQS + 1;
+        len += NUM_SOFTIRQS * m * sizeof(uint64_t) + m * sizeof(uint32_t);
+    }
+    if (numnodes == 0)
+        return 0;
+
+    if ((data = DMM_DATA_CREATE_RAW(numnodes, len)) == NULL) {
+        dmm_log(DMM_LOG_ERR, "Cannot allocate memory for data");
+        return ENOMEM;
+    }
+    dn = DMM_DATA_NODES(data);
+    if (n > 0) {
+        DMM_DN_FILL_ADVANCE(dn, INTR_CPU_TOTAL, n * sizeof(uint64_t), pvt->totals);
+        DMM_DN_FILL_ADVANCE(dn, INTR_CPU_ID, n * sizeof(uint32_t), pvt->intr_cpus.ids);
+        for (i = 0; i < pvt->num_irqs; ++i)
+            DMM_DN_FILL_ADVANCE(dn, pvt->irqs[i].id, n * sizeof(uint64_t), pvt->irqvals + i * n);
+    }
+    if (m > 0) {
+        for (t = 0; t < NUM_SOFTIRQS; ++t)
+            DMM_DN_FILL_ADVANCE(dn, SOFTIRQ_HI + t, m * sizeof(uint64_t), pvt->softvals + t * m);
+        DMM_DN_FILL_ADVANCE(dn, SOFTIRQ_CPU_ID, m * sizeof(uint32_t), pvt->soft_cpus.ids);
+    }
+    DMM_DN_MKEND(dn);
+    DMM_DATA_SEND(data, pvt->hook);
+    DMM_DATA_UNREF(data);
+
+    return 0;
+}
+
+static int set_irqs(struct pvt_data *pvt, const struct dmm_interrupts_irq *irqs, size_t n)
+{
+    size_t i;
+
+    if (n > DMM_INTERRUPTS_MAXIRQS)
+        return E2BIG;
+    for (i = 0; i < n; ++i)
+        if (memchr(irqs[i].pattern, '\0', sizeof(irqs[i].pattern)) == NULL)
+            return EINVAL;
+    memcpy(pvt->irqs, irqs, n * sizeof(*irqs));
+    pvt->num_irqs = n;
+    /* Match rows again */
+    pvt->num_rows = 0;
+    return 0;
+}
+
+static int ctor(dmm_node_p node)
+{
+    struct pvt_data *pvt;
+    int err;
+
+    pvt = (struct pvt_data *)DMM_MALLOC(sizeof(*pvt));
+    if (pvt == NULL)
+        return ENOMEM;
+    if ((err = sensorfile_open(&pvt->intr_sf, INTERRUPTS_PATH)) != 0 ||
+        (err = sensorfile_open(&pvt->soft_sf, SOFTIRQS_PATH)) != 0) {
+        char errbuf[128], *errmsg;
+        errmsg = strerror_r(err, errbuf, sizeof(errbuf));
+        dmm_log(DMM_LOG_ERR, "Cannot open %s: %s",
+                sensorfile_isopen(&pvt->intr_sf) ? SOFTIRQS_PATH : INTERRUPTS_PATH, errmsg);
+        sensorfile_close(&pvt->intr_sf);
+        DMM_FREE(pvt);
+        return err;
+    }
+    pvt->hook = NULL;
+    pvt->intr_cpus.num = 0;
+    pvt->intr_cpus.max = 0;
+    pvt->intr_cpus.ids = NULL;
+    pvt->soft_cpus.num = 0;
+    pvt->soft_cpus.max = 0;
+    pvt->soft_cpus.ids = NULL;
+    pvt->totals = NULL;
+    pvt->rowvals = NULL;
+    pvt->irqvals = NULL;
+    pvt->softvals = NULL;
+    pvt->num_irqs = 0;
+    pvt->rows = NULL;
+    pvt->num_rows = 0;
+    pvt->max_rows = 0;
+    DMM_NODE_SETPRIVATE(node, pvt);
+    return 0;
+}
+
+static void dtor(dmm_node_p node)
+{
+    struct pvt_data *pvt;
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
+    sensorfile_close(&pvt->intr_sf);
+    sensorfile_close(&pvt->soft_sf);
+    DMM_FREE(pvt->intr_cpus.ids);
+    DMM_FREE(pvt->soft_cpus.ids);
+    DMM_FREE(pvt->totals);
+    DMM_FREE(pvt->rowvals);
+    DMM_FREE(pvt->irqvals);
+    DMM_FREE(pvt->softvals);
+    DMM_FREE(pvt->rows);
+    DMM_FREE(pvt);
+}
+
+static int newhook(dmm_hook_p hook)
+{
+    struct pvt_data *pvt;
+
+    if (DMM_HOOK_ISIN(hook))
+        return EINVAL;
+    if (strcmp(HOOKNAME, DMM_HOOK_NAME(hook)) != 0)
+        return EINVAL;
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(DMM_HOOK_NODE(hook));
+    pvt->hook = hook;
+
+    return 0;
+}
+
+static void rmhook(dmm_hook_p hook)
+{
+    struct pvt_data *pvt;
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(DMM_HOOK_NODE(hook));
+    pvt->hook = NULL;
+}
+
+static int rcvmsg(dmm_node_p node, dmm_msg_p msg)
+{
+    struct pvt_data *pvt;
+    dmm_msg_p resp;
+    int err = 0;
+
+#define CREATE_SEND_EMPTY_RESP()                                    \
+        do {                                                        \
+            resp = DMM_MSG_CREATE_RESP(DMM_NODE_ID(node), msg, 0);  \
+            if (resp != NULL) {                                     \
+                if (err != 0)                                       \
+                    msg->cm_flags |= DMM_MSG_ERR;                   \
+                                                                    \
+                DMM_MSG_SEND_ID(msg->cm_src, resp);                 \
+            } else                                                  \
+                err = (err != 0) ? err : ENOMEM;                    \
+        } while (0)
+
+    if (msg->cm_flags & DMM_MSG_RESP)
+        goto err;
+
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
+    switch (msg->cm_type) {
+    case DMM_MSGTYPE_GENERIC:
+        /* Accept only TIMERTRIGGER messages */
+        if (msg->cm_cmd != DMM_MSG_TIMERTRIGGER) {
+            err = ENOTSUP;
+            break;
+        }
+        // Nowhere to send, so why bother?
+        if (pvt->hook != NULL)
+            err = process_timer_msg(pvt);
+        break;
+
+    case DMM_MSGTYPE_INTERRUPTS:
+        switch (msg->cm_cmd) {
+        case DMM_MSG_INTERRUPTS_SET: {
+            struct dmm_msg_interrupts_set *set = DMM_MSG_DATA(msg, struct dmm_msg_interrupts_set);
+            dmm_size_t num_irqs;
+
+            num_irqs = (msg->cm_len - sizeof(struct dmm_msg_interrupts_set)) / sizeof(struct dmm_interrupts_irq);
+            err = set_irqs(pvt, set->irqs, num_irqs);
+            CREATE_SEND_EMPTY_RESP();
+            break;
+        }
+
+        default:
+            err = ENOTSUP;
+            break;
+        }
+        break;
+
+    default:
+        err = ENOTSUP;
+        break;
+    }
+
+#undef CREATE_SEND_EMPTY_RESP
+
+err:
+    DMM_MSG_FREE(msg);
+    return err;
+}
+
+static struct dmm_type type = {
+    "interrupts",
+    ctor,
+    dtor,
+    NULL,
+    rcvmsg,
+    newhook,
+    rmhook,
+    {},
+};
+
+DMM_MODULE_DECLARE(&type);
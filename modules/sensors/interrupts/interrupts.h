@@ -0,0 +1,41 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+#ifndef MODULES_INTERRUPTS_INTERRUPTS_H_
+#define MODULES_INTERRUPTS_INTERRUPTS_H_
+
+#include "dmm_types.h"
+
+enum {
+    DMM_MSGTYPE_INTERRUPTS = 0x09274fe3
+};
+
+enum {
+    DMM_MSG_INTERRUPTS_SET = 1,
+};
+
+enum { DMM_INTERRUPTS_PATTERNSIZE = 64 };
+enum { DMM_INTERRUPTS_MAXIRQS = 64 };
+
+/*
+ * Send per-CPU sums of /proc/interrupts rows matching fnmatch(3) pattern
+ * as uint64_t vector with sensor id. Pattern is matched against the row
+ * label (e.g. "LOC" or "24") and against the rest of the row after
+ * counters (e.g. "IR-PCI-MSI 524288-edge mlx5_comp0@pci:0000:01:00.0")
+ */
+struct dmm_interrupts_irq {
+    dmm_sensorid_t id;
+    char           pattern[DMM_INTERRUPTS_PATTERNSIZE];
+};
+
+/*
+ * Replace the set of selected IRQs, at most DMM_INTERRUPTS_MAXIRQS,
+ * empty list sends CPU totals and softirqs only (the default)
+ */
+struct dmm_msg_interrupts_set {
+    char                      dummy;
+    struct dmm_interrupts_irq irqs[];
+};
+
+#endif /* MODULES_INTERRUPTS_INTERRUPTS_H_ */
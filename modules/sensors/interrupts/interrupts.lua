@@ -0,0 +1,33 @@
+-- SPDX-License-Identifier: BSD-2-Clause-Views
+-- Copyright (c) 2013-2023
+--   Research Computing Center Lomonosov Moscow State University
+
+local dmm = require('dmm')
+
+assert(dmm.require_interface('interrupts', 'll'))
+
+local Interrupts = dmm.Module:new_type('interrupts')
+
+--! @brief Select IRQs to send as per-CPU vectors
+--! @param irqs list of {sensor_id, pattern} pairs, e.g.
+--! {{2200, 'LOC'}, {2201, '*mlx5_comp*'}}, rows matching a pattern
+--! are summed, see interrupts.h. Empty list sends totals only
+function Interrupts:set(irqs)
+  local n = #irqs
+  assert(n <= ffi.C.DMM_INTERRUPTS_MAXIRQS, 'too many IRQs')
+  local msg, set = dmm.msg_create {
+    len = dmm.sfam.struct_sizeof('struct dmm_msg_interrupts_set', 'irqs', n),
+    payload_type = 'struct dmm_msg_interrupts_set',
+    type = ffi.C.DMM_MSGTYPE_INTERRUPTS,
+    cmd = ffi.C.DMM_MSG_INTERRUPTS_SET,
+  }
+  for i = 1, n do
+    local id, pattern = irqs[i][1], irqs[i][2]
+    assert(#pattern < ffi.C.DMM_INTERRUPTS_PATTERNSIZE, 'pattern is too long')
+    set.irqs[i - 1].id = id
+    set.irqs[i - 1].pattern = pattern
+  end
+  dmm.msg_send(self.nodeid, msg)
+end
+
+return Interrupts
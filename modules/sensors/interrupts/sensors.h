@@ -0,0 +1,28 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+#ifndef MODULES_INTERRUPTS_SENSORS_H_
+#define MODULES_INTERRUPTS_SENSORS_H_
+
+enum {
+    /* uint64_t sums of all /proc/interrupts rows, one element per online CPU */
+    INTR_CPU_TOTAL = 1600,
+    /* uint32_t CPU numbers for INTR_CPU_TOTAL and selected IRQ vectors */
+    INTR_CPU_ID,
+    /* uint64_t /proc/softirqs rows, one element per possible CPU */
+    SOFTIRQ_HI,
+    SOFTIRQ_TIMER,
+    SOFTIRQ_NET_TX,
+    SOFTIRQ_NET_RX,
+    SOFTIRQ_BLOCK,
+    SOFTIRQ_IRQ_POLL,
+    SOFTIRQ_TASKLET,
+    SOFTIRQ_SCHED,
+    SOFTIRQ_HRTIMER,
+    SOFTIRQ_RCU,
+    /* uint32_t CPU numbers for SOFTIRQ_* */
+    SOFTIRQ_CPU_ID
+};
+
+#endif /* MODULES_INTERRUPTS_SENSORS_H_ */
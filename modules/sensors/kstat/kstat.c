@@ -0,0 +1,549 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+/*
+ * kstat sends selected fields of /proc/vmstat, /proc/pressure/{cpu,memory,io}
+ * (pressure stall information) and /proc/schedstat.
+ *
+ * Fields are selected by name (see kstat.h). The first parse of a file
+ * resolves every field to the number of its line, fields are kept sorted
+ * by file and line, so later ticks walk each file once jumping from line
+ * to line and only check that the key ends where it is expected instead
+ * of comparing names. If the check fails the file is resolved again.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "dmm_base.h"
+#include "dmm_log.h"
+#include "dmm_message.h"
+#include "../sensorfile.h"
+#include "kstat.h"
+#include "sensors.h"
+
+#define HOOKNAME "out"
+
+enum {
+    SRC_VMSTAT,
+    SRC_PSI_CPU,
+    SRC_PSI_MEMORY,
+    SRC_PSI_IO,
+    SRC_SCHEDSTAT,
+    NUM_SOURCES
+};
+
+static const char *source_paths[NUM_SOURCES] = {
+    "/proc/vmstat",
+    "/proc/pressure/cpu",
+    "/proc/pressure/memory",
+    "/proc/pressure/io",
+    "/proc/schedstat",
+};
+
+/* Number of per-CPU counters in /proc/schedstat cpu lines (version 15) */
+#define SCHEDSTAT_NUM_COLS 9
+
+enum {
+    /* Plain decimal number */
+    KIND_U64,
+    /* Number after '=' in PSI "name=value" pairs */
+    KIND_PSI_TOTAL,
+    /* Same with two decimal places, sent in hundredths */
+    KIND_PSI_AVG,
+};
+
+/* Line numbers of unresolved and missing fields */
+#define LINE_UNRESOLVED ((ssize_t)-1)
+#define LINE_MISSING    ((ssize_t)-2)
+
+struct field {
+    dmm_sensorid_t id;
+    int source;
+    int kind;
+    /* Beginning of the line: vmstat field name, "some" or "full" */
+    char key[DMM_KSTAT_NAMESIZE];
+    size_t keylen;
+    /* Number of the value among fields after the key */
+    unsigned col;
+    /* Line number in the source file, or LINE_* */
+    ssize_t line;
+    uint64_t val;
+    /* For error messages */
+    char name[DMM_KSTAT_NAMESIZE];
+};
+
+struct pvt_data {
+    dmm_hook_p hook;
+    /* Sorted by source and line */
+    struct field *fields;
+    size_t num_fields;
+    struct sensorfile files[NUM_SOURCES];
+    /* Source cannot be opened, do not retry */
+    bool failed[NUM_SOURCES];
+};
+
+static const struct dmm_kstat_field default_fields[] = {
+    { KSTAT_PSI_CPU_SOME_TOTAL,    "pressure.cpu.some.total" },
+    { KSTAT_PSI_CPU_FULL_TOTAL,    "pressure.cpu.full.total" },
+    { KSTAT_PSI_MEMORY_SOME_TOTAL, "pressure.memory.some.total" },
+    { KSTAT_PSI_MEMORY_FULL_TOTAL, "pressure.memory.full.total" },
+    { KSTAT_PSI_IO_SOME_TOTAL,     "pressure.io.some.total" },
+    { KSTAT_PSI_IO_FULL_TOTAL,     "pressure.io.full.total" },
+    { KSTAT_PSI_CPU_SOME_AVG10,    "pressure.cpu.some.avg10" },
+    { KSTAT_PSI_CPU_FULL_AVG10,    "pressure.cpu.full.avg10" },
+    { KSTAT_PSI_MEMORY_SOME_AVG10, "pressure.memory.some.avg10" },
+    { KSTAT_PSI_MEMORY_FULL_AVG10, "pressure.memory.full.avg10" },
+    { KSTAT_PSI_IO_SOME_AVG10,     "pressure.io.some.avg10" },
+    { KSTAT_PSI_IO_FULL_AVG10,     "pressure.io.full.avg10" },
+    { KSTAT_SCHED_RUN_TIME,        "schedstat.run_time" },
+    { KSTAT_SCHED_WAIT_TIME,       "schedstat.wait_time" },
+    { KSTAT_SCHED_TIMESLICES,      "schedstat.timeslices" },
+    { KSTAT_VM_PGFAULT,            "vmstat.pgfault" },
+    { KSTAT_VM_PGMAJFAULT,         "vmstat.pgmajfault" },
+    { KSTAT_VM_PSWPIN,             "vmstat.pswpin" },
+    { KSTAT_VM_PSWPOUT,            "vmstat.pswpout" },
+    { KSTAT_VM_OOM_KILL,           "vmstat.oom_kill" },
+};
+
+#define NUM_DEFAULT_FIELDS (sizeof(default_fields) / sizeof(default_fields[0]))
+
+/* Return index of s in NULL-terminated list or -1 */
+static int lookup(const char *s, const char * const *list)
+{
+    int i;
+
+    for (i = 0; list[i] != NULL; ++i)
+        if (strcmp(s, list[i]) == 0)
+            return i;
+    return -1;
+}
+
+/* Fill field from its name, return 0 or EINVAL */
+static int parse_name(const struct dmm_kstat_field *kf, struct field *f)
+{
+    static const char * const psi_sources[] = { "cpu.", "memory.", "io.", NULL };
+    static const char * const psi_values[] = { "avg10", "avg60", "avg300", "total", NULL };
+    static const char * const sched_values[] = { "run_time", "wait_time", "timeslices", NULL };
+    const char *s, *p;
+    int i;
+
+    if (memchr(kf->name, '\0', sizeof(kf->name)) == NULL)
+        return EINVAL;
+
+    f->id = kf->id;
+    strcpy(f->name, kf->name);
+    f->key[0] = '\0';
+    f->col = 0;
+    f->kind = KIND_U64;
+    f->line = LINE_UNRESOLVED;
+    f->val = 0;
+
+    if ((s = sensorfile_match(kf->name, "vmstat.")) != NULL) {
+        if (*s == '\0' || strpbrk(s, " \t\n") != NULL)
+            return EINVAL;
+        f->source = SRC_VMSTAT;
+        strcpy(f->key, s);
+    } else if ((s = sensorfile_match(kf->name, "pressure.")) != NULL) {
+        for (i = 0; psi_sources[i] != NULL; ++i)
+            if ((p = sensorfile_match(s, psi_sources[i])) != NULL)
+                break;
+        if (psi_sources[i] == NULL)
+            return EINVAL;
+        f->source = SRC_PSI_CPU + i;
+        if ((s = sensorfile_match(p, "some.")) != NULL)
+            strcpy(f->key, "some");
+        else if ((s = sensorfile_match(p, "full.")) != NULL)
+            strcpy(f->key, "full");
+        else
+            return EINVAL;
+        if ((i = lookup(s, psi_values)) < 0)
+            return EINVAL;
+        f->col = (unsigned)i;
+        f->kind = (strcmp(s, "total") == 0) ? KIND_PSI_TOTAL : KIND_PSI_AVG;
+    } else if ((s = sensorfile_match(kf->name, "schedstat.")) != NULL) {
+        /* rq_cpu_time, run_delay and pcount are the last 3 counters */
+        if ((i = lookup(s, sched_values)) < 0)
+            return EINVAL;
+        f->source = SRC_SCHEDSTAT;
+        f->col = (unsigned)(SCHEDSTAT_NUM_COLS - 3 + i);
+    } else {
+        return EINVAL;
+    }
+    f->keylen = strlen(f->key);
+    return 0;
+}
+
+static int field_cmp(const void *a, const void *b)
+{
+    const struct field *fa = (const struct field *)a;
+    const struct field *fb = (const struct field *)b;
+
+    if (fa->source != fb->source)
+        return fa->source < fb->source ? -1 : 1;
+    if (fa->line != fb->line)
+        return fa->line < fb->line ? -1 : 1;
+    /* qsort is not stable, keep the order of values from one line fixed */
+    if (fa->id != fb->id)
+        return fa->id < fb->id ? -1 : 1;
+    return 0;
+}
+
+/* Replace fields, the old set is kept on error */
+static int set_fields(struct pvt_data *pvt, const struct dmm_kstat_field *kf, size_t n)
+{
+    struct field *fields;
+    size_t i;
+    int err;
+
+    if (n == 0) {
+        kf = default_fields;
+        n = NUM_DEFAULT_FIELDS;
+    }
+    if ((fields = (struct field *)DMM_MALLOC(n * sizeof(*fields))) == NULL)
+        return ENOMEM;
+    for (i = 0; i < n; ++i)
+        if ((err = parse_name(kf + i, fields + i)) != 0) {
+            dmm_log(DMM_LOG_ERR, "kstat: invalid field name \"%.*s\"",
+                    (int)sizeof(kf[i].name), kf[i].name);
+            DMM_FREE(fields);
+            return err;
+        }
+    qsort(fields, n, sizeof(*fields), field_cmp);
+
+    DMM_FREE(pvt->fields);
+    pvt->fields = fields;
+    pvt->num_fields = n;
+    return 0;
+}
+
+/* Does line begin with the field key followed by a blank? */
+static inline bool key_matches(const char *line, const struct field *f)
+{
+    return strncmp(line, f->key, f->keylen) == 0 &&
+           (line[f->keylen] == ' ' || line[f->keylen] == '\t');
+}
+
+/* Find line numbers of fields of the source from first to last - 1 */
+static void resolve(struct pvt_data *pvt, struct field *first, struct field *last)
+{
+    const char *line;
+    struct field *f;
+    ssize_t lineno;
+
+    for (f = first; f < last; ++f)
+        f->line = LINE_UNRESOLVED;
+    line = pvt->files[first->source].buf;
+    for (lineno = 0; *line != '\0'; line = sensorfile_nextline(line), ++lineno)
+        for (f = first; f < last; ++f)
+            if (f->line == LINE_UNRESOLVED && key_matches(line, f))
+                f->line = lineno;
+    for (f = first; f < last; ++f)
+        if (f->line == LINE_UNRESOLVED) {
+            dmm_log(DMM_LOG_WARN, "kstat: field %s is not found in %s",
+                    f->name, source_paths[f->source]);
+            f->line = LINE_MISSING;
+        }
+    qsort(first, (size_t)(last - first), sizeof(*first), field_cmp);
+}
+
+/* Parse value of resolved field from line, return false on mismatch */
+static bool parse_value(const char *line, struct field *f)
+{
+    const char *s;
+    uint64_t frac;
+    unsigned i;
+
+    if (!key_matches(line, f))
+        return false;
+    s = line + f->keylen;
+    for (i = 0; i < f->col; ++i)
+        s = sensorfile_skipfield(s);
+    s = sensorfile_skipblanks(s);
+    if (f->kind != KIND_U64) {
+        while (*s != '=' && *s != ' ' && *s != '\n' && *s != '\0')
+            s++;
+        if (*s != '=')
+            return false;
+        s++;
+    }
+    if ((s = sensorfile_u64(s, &f->val)) == NULL)
+        return false;
+    if (f->kind == KIND_PSI_AVG) {
+        frac = 0;
+        if (*s == '.') {
+            s++;
+            for (i = 0; i < 2; ++i) {
+                frac *= 10;
+                if ((unsigned char)(*s - '0') < 10)
+                    frac += (uint64_t)(*s++ - '0');
+            }
+        }
+        f->val = f->val * 100 + frac;
+    }
+    return true;
+}
+
+/* Parse resolved fields from first to last - 1, return false on mismatch */
+static bool parse_lines(struct pvt_data *pvt, struct field *first, struct field *last)
+{
+    const char *line;
+    struct field *f;
+    ssize_t lineno;
+
+    line = pvt->files[first->source].buf;
+    lineno = 0;
+    for (f = first; f < last; ++f) {
+        if (f->line < 0)
+            continue;
+        for (; lineno < f->line && *line != '\0'; ++lineno)
+            line = sensorfile_nextline(line);
+        if (*line == '\0' || !parse_value(line, f))
+            return false;
+    }
+    return true;
+}
+
+/* Sum counters of cpu lines, other lines are domain statistics */
+static void parse_schedstat(struct pvt_data *pvt, struct field *first, struct field *last)
+{
+    uint64_t sums[SCHEDSTAT_NUM_COLS], v;
+    const char *line, *s;
+    struct field *f;
+    int i;
+
+    memset(sums, 0, sizeof(sums));
+    line = pvt->files[SRC_SCHEDSTAT].buf;
+    for (; *line != '\0'; line = sensorfile_nextline(line)) {
+        if ((s = sensorfile_match(line, "cpu")) == NULL)
+            continue;
+        s = sensorfile_skipfield(s);
+        for (i = 0; i < SCHEDSTAT_NUM_COLS; ++i) {
+            if ((s = sensorfile_u64(s, &v)) == NULL)
+                break;
+            sums[i] += v;
+        }
+    }
+    for (f = first; f < last; ++f) {
+        f->val = sums[f->col];
+        f->line = 0;
+    }
+}
+
+/* Read the source and parse values of its fields from first to last - 1 */
+static int read_source(struct pvt_data *pvt, struct field *first, struct field *last)
+{
+    struct sensorfile *sf;
+    struct field *f;
+    int src, err;
+
+    src = first->source;
+    sf = &pvt->files[src];
+    if (pvt->failed[src])
+        return 0;
+    if (!sensorfile_isopen(sf) && (err = sensorfile_open(sf, source_paths[src])) != 0) {
+        char errbuf[128], *errmsg;
+        errmsg = strerror_r(err, errbuf, sizeof(errbuf));
+        dmm_log(DMM_LOG_WARN, "kstat: cannot open %s, its fields are not sent: %s",
+                source_paths[src], errmsg);
+        pvt->failed[src] = true;
+        for (f = first; f < last; ++f)
+            f->line = LINE_MISSING;
+        return 0;
+    }
+    if ((err = sensorfile_read(sf)) != 0)
+        return err;
+
+    if (src == SRC_SCHEDSTAT) {
+        parse_schedstat(pvt, first, last);
+        return 0;
+    }
+    if (first->line == LINE_UNRESOLVED || !parse_lines(pvt, first, last)) {
+        resolve(pvt, first, last);
+        if (!parse_lines(pvt, first, last)) {
+            /* Should never happen, do not send garbage */
+            for (f = first; f < last; ++f)
+                f->line = LINE_MISSING;
+        }
+    }
+    return 0;
+}
+
+static int process_timer_msg(struct pvt_data *pvt)
+{
+    dmm_data_p data;
+    dmm_datanode_p dn;
+    struct field *first, *last, *end;
+    size_t n;
+    int err;
+
+    end = pvt->fields + pvt->num_fields;
+    for (first = pvt->fields; first < end; first = last) {
+        for (last = first; last < end && last->source == first->source; ++last)
+            ;
+        if ((err = read_source(pvt, first, last)) != 0) {
+            char errbuf[128], *errmsg;
+            errmsg = strerror_r(err, errbuf, sizeof(errbuf));
+            dmm_log(DMM_LOG_ERR, "kstat: cannot read %s: %s",
+                    source_paths[first->source], errmsg);
+            return err;
+        }
+    }
+
+    n = 0;
+    for (first = pvt->fields; first < end; ++first)
+        n += first->line >= 0;
+    if (n == 0)
+        return 0;
+
+    if ((data = DMM_DATA_CREATE(n, sizeof(uint64_t))) == NULL) {
+        dmm_log(DMM_LOG_ERR, "Cannot allocate memory for data");
+        return ENOMEM;
+    }
+    dn = DMM_DATA_NODES(data);
+    for (first = pvt->fields; first < end; ++first)
+        if (first->line >= 0)
+            DMM_DN_FILL_ADVANCE(dn, first->id, sizeof(uint64_t), &first->val);
+    DMM_DN_MKEND(dn);
+    DMM_DATA_SEND(data, pvt->hook);
+    DMM_DATA_UNREF(data);
+
+    return 0;
+}
+
+static int ctor(dmm_node_p node)
+{
+    struct pvt_data *pvt;
+    int i, err;
+
+    pvt = (struct pvt_data *)DMM_MALLOC(sizeof(*pvt));
+    if (pvt == NULL)
+        return ENOMEM;
+    pvt->hook = NULL;
+    pvt->fields = NULL;
+    pvt->num_fields = 0;
+    for (i = 0; i < NUM_SOURCES; ++i) {
+        sensorfile_init(&pvt->files[i]);
+        pvt->failed[i] = false;
+    }
+    if ((err = set_fields(pvt, NULL, 0)) != 0) {
+        DMM_FREE(pvt);
+        return err;
+    }
+    DMM_NODE_SETPRIVATE(node, pvt);
+    return 0;
+}
+
+static void dtor(dmm_node_p node)
+{
+    struct pvt_data *pvt;
+    int i;
+
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
+    for (i = 0; i < NUM_SOURCES; ++i)
+        sensorfile_close(&pvt->files[i]);
+    DMM_FREE(pvt->fields);
+    DMM_FREE(pvt);
+}
+
+static int newhook(dmm_hook_p hook)
+{
+    struct pvt_data *pvt;
+
+    if (DMM_HOOK_ISIN(hook))
+        return EINVAL;
+    if (strcmp(HOOKNAME, DMM_HOOK_NAME(hook)) != 0)
+        return EINVAL;
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(DMM_HOOK_NODE(hook));
+    pvt->hook = hook;
+
+    return 0;
+}
+
+static void rmhook(dmm_hook_p hook)
+{
+    struct pvt_data *pvt;
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(DMM_HOOK_NODE(hook));
+    pvt->hook = NULL;
+}
+
+static int rcvmsg(dmm_node_p node, dmm_msg_p msg)
+{
+    struct pvt_data *pvt;
+    dmm_msg_p resp;
+    int err = 0;
+
+#define CREATE_SEND_EMPTY_RESP()                                    \
+        do {                                                        \
+            resp = DMM_MSG_CREATE_RESP(DMM_NODE_ID(node), msg, 0);  \
+            if (resp != NULL) {                                     \
+                if (err != 0)                                       \
+                    msg->cm_flags |= DMM_MSG_ERR;                   \
+                                                                    \
+                DMM_MSG_SEND_ID(msg->cm_src, resp);                 \
+            } else                                                  \
+                err = (err != 0) ? err : ENOMEM;                    \
+        } while (0)
+
+    if (msg->cm_flags & DMM_MSG_RESP)
+        goto err;
+
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
+    switch (msg->cm_type) {
+    case DMM_MSGTYPE_GENERIC:
+        /* Accept only TIMERTRIGGER messages */
+        if (msg->cm_cmd != DMM_MSG_TIMERTRIGGER) {
+            err = ENOTSUP;
+            break;
+        }
+        // Nowhere to send, so why bother?
+        if (pvt->hook != NULL)
+            err = process_timer_msg(pvt);
+        break;
+
+    case DMM_MSGTYPE_KSTAT:
+        switch (msg->cm_cmd) {
+        case DMM_MSG_KSTAT_SET: {
+            struct dmm_msg_kstat_set *set = DMM_MSG_DATA(msg, struct dmm_msg_kstat_set);
+            dmm_size_t num_fields;
+
+            num_fields = (msg->cm_len - sizeof(struct dmm_msg_kstat_set)) / sizeof(struct dmm_kstat_field);
+            err = set_fields(pvt, set->fields, num_fields);
+            CREATE_SEND_EMPTY_RESP();
+            break;
+        }
+
+        default:
+            err = ENOTSUP;
+            break;
+        }
+        break;
+
+    default:
+        err = ENOTSUP;
+        break;
+    }
+
+#undef CREATE_SEND_EMPTY_RESP
+
+err:
+    DMM_MSG_FREE(msg);
+    return err;
+}
+
+static struct dmm_type type = {
+    "kstat",
+    ctor,
+    dtor,
+    NULL,
+    rcvmsg,
+    newhook,
+    rmhook,
+    {},
+};
+
+DMM_MODULE_DECLARE(&type);
@@ -0,0 +1,42 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+#ifndef MODULES_KSTAT_KSTAT_H_
+#define MODULES_KSTAT_KSTAT_H_
+
+#include "dmm_types.h"
+
+enum {
+    DMM_MSGTYPE_KSTAT = 0x4613c96e
+};
+
+enum {
+    DMM_MSG_KSTAT_SET = 1,
+};
+
+enum { DMM_KSTAT_NAMESIZE = 64 };
+
+/*
+ * Field name is one of
+ *   vmstat.<name>, where <name> is a /proc/vmstat field;
+ *   pressure.<cpu|memory|io>.<some|full>.<avg10|avg60|avg300|total>,
+ *     averages are in hundredths of percent, total is in microseconds;
+ *   schedstat.<run_time|wait_time|timeslices>, summed over all CPUs.
+ */
+struct dmm_kstat_field {
+    dmm_sensorid_t id;
+    char           name[DMM_KSTAT_NAMESIZE];
+};
+
+/*
+ * Replace the set of fields to send, empty list selects the default
+ * set (see sensors.h). Unknown field names are rejected, fields missing
+ * in the running kernel are reported once and not sent.
+ */
+struct dmm_msg_kstat_set {
+    char                   dummy;
+    struct dmm_kstat_field fields[];
+};
+
+#endif /* MODULES_KSTAT_KSTAT_H_ */
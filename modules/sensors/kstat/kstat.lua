@@ -0,0 +1,32 @@
+-- SPDX-License-Identifier: BSD-2-Clause-Views
+-- Copyright (c) 2013-2023
+--   Research Computing Center Lomonosov Moscow State University
+
+local dmm = require('dmm')
+
+assert(dmm.require_interface('kstat', 'll'))
+
+local Kstat = dmm.Module:new_type('kstat')
+
+--! @brief Select fields to send
+--! @param fields 'default' or list of {sensor_id, name} pairs, e.g.
+--! {{2100, 'vmstat.pgfault'}, {2101, 'pressure.io.full.avg60'}},
+--! see kstat.h for field names
+function Kstat:set(fields)
+  local n = (fields == 'default') and 0 or #fields
+  local msg, set = dmm.msg_create {
+    len = dmm.sfam.struct_sizeof('struct dmm_msg_kstat_set', 'fields', n),
+    payload_type = 'struct dmm_msg_kstat_set',
+    type = ffi.C.DMM_MSGTYPE_KSTAT,
+    cmd = ffi.C.DMM_MSG_KSTAT_SET,
+  }
+  for i = 1, n do
+    local id, name = fields[i][1], fields[i][2]
+    assert(#name < ffi.C.DMM_KSTAT_NAMESIZE, 'field name is too long')
+    set.fields[i - 1].id = id
+    set.fields[i - 1].name = name
+  end
+  dmm.msg_send(self.nodeid, msg)
+end
+
+return Kstat
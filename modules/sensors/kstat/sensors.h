@@ -0,0 +1,39 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+#ifndef MODULES_KSTAT_SENSORS_H_
+#define MODULES_KSTAT_SENSORS_H_
+
+/*
+ * Sensor ids of the default field set, all values are uint64_t.
+ * Fields selected with DMM_MSG_KSTAT_SET get ids given in the message.
+ */
+enum {
+    /* pressure.{cpu,memory,io}.{some,full}.total, microseconds */
+    KSTAT_PSI_CPU_SOME_TOTAL = 1100,
+    KSTAT_PSI_CPU_FULL_TOTAL,
+    KSTAT_PSI_MEMORY_SOME_TOTAL,
+    KSTAT_PSI_MEMORY_FULL_TOTAL,
+    KSTAT_PSI_IO_SOME_TOTAL,
+    KSTAT_PSI_IO_FULL_TOTAL,
+    /* pressure.{cpu,memory,io}.{some,full}.avg10, hundredths of percent */
+    KSTAT_PSI_CPU_SOME_AVG10,
+    KSTAT_PSI_CPU_FULL_AVG10,
+    KSTAT_PSI_MEMORY_SOME_AVG10,
+    KSTAT_PSI_MEMORY_FULL_AVG10,
+    KSTAT_PSI_IO_SOME_AVG10,
+    KSTAT_PSI_IO_FULL_AVG10,
+    /* schedstat.{run_time,wait_time,timeslices} summed over CPUs */
+    KSTAT_SCHED_RUN_TIME,
+    KSTAT_SCHED_WAIT_TIME,
+    KSTAT_SCHED_TIMESLICES,
+    /* vmstat.{pgfault,pgmajfault,pswpin,pswpout,oom_kill} */
+    KSTAT_VM_PGFAULT,
+    KSTAT_VM_PGMAJFAULT,
+    KSTAT_VM_PSWPIN,
+    KSTAT_VM_PSWPOUT,
+    KSTAT_VM_OOM_KILL
+};
+
+#endif /* MODULES_KSTAT_SENSORS_H_ */
@@ -0,0 +1,503 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+/*
+ * lustre sends Lustre client statistics from llite/<mount>/stats
+ * (per mount) and osc/<target>/stats (per OST) under the root
+ * directory, /proc/fs/lustre by default.
+ *
+ * Stats files look like
+ *   snapshot_time             1690000000.123456 secs.usecs
+ *   read_bytes                12 samples [bytes] 4096 1048576 12582912
+ *   open                      100 samples [reqs]
+ * and may be large on big clients, so every file is parsed in one pass
+ * over a reused buffer, lines are recognized by the name length and
+ * the name itself, nothing is allocated while parsing.
+ *
+ * Stats files stay open, directories are rescanned every RESCAN_TICKS
+ * ticks, when reading fails or while nothing is found. Values of each
+ * group are sent as vectors with one element per mount or OST, names
+ * are sent when the set changes or a new receiver connects.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dmm_base.h"
+#include "dmm_log.h"
+#include "dmm_message.h"
+#include "../sensorfile.h"
+#include "lustre.h"
+#include "sensors.h"
+
+#define HOOKNAME "out"
+
+#define DEFAULT_ROOT "/proc/fs/lustre"
+
+#define RESCAN_TICKS 60
+
+/* Values in the order of sensor ids of a group */
+enum {
+    VAL_READ_BYTES,
+    VAL_WRITE_BYTES,
+    VAL_READ_OPS,
+    VAL_WRITE_OPS,
+    VAL_META_OPS,
+    NUM_VALUES
+};
+
+enum {
+    GROUP_LLITE,
+    GROUP_OSC,
+    NUM_GROUPS
+};
+
+static const struct {
+    const char *dir;
+    dmm_sensorid_t first;
+    int num_values;
+    dmm_sensorid_t names;
+} groups[NUM_GROUPS] = {
+    { "llite", LUSTRE_READ_BYTES,     NUM_VALUES,   LUSTRE_MOUNTS },
+    { "osc",   LUSTRE_OSC_READ_BYTES, VAL_META_OPS, LUSTRE_OSCS },
+};
+
+/* Stats lines we are interested in */
+enum {
+    LINE_READ_BYTES,
+    LINE_WRITE_BYTES,
+    LINE_META,
+};
+
+#define STAT(name, kind) { name, sizeof(name) - 1, kind }
+
+static const struct stat_line {
+    const char *name;
+    size_t len;
+    int kind;
+} stat_lines[] = {
+    STAT("read_bytes", LINE_READ_BYTES),
+    STAT("write_bytes", LINE_WRITE_BYTES),
+    STAT("open", LINE_META),
+    STAT("close", LINE_META),
+    STAT("getattr", LINE_META),
+    STAT("setattr", LINE_META),
+    STAT("truncate", LINE_META),
+    STAT("statfs", LINE_META),
+    STAT("create", LINE_META),
+    STAT("link", LINE_META),
+    STAT("unlink", LINE_META),
+    STAT("symlink", LINE_META),
+    STAT("mkdir", LINE_META),
+    STAT("rmdir", LINE_META),
+    STAT("mknod", LINE_META),
+    STAT("rename", LINE_META),
+    STAT("getxattr", LINE_META),
+    STAT("setxattr", LINE_META),
+    STAT("listxattr", LINE_META),
+    STAT("removexattr", LINE_META),
+};
+
+#undef STAT
+
+#define NUM_STAT_LINES (sizeof(stat_lines) / sizeof(stat_lines[0]))
+
+struct entry {
+    struct dmm_lustre_name name;
+    struct sensorfile sf;
+    uint64_t vals[NUM_VALUES];
+    /* Found by the current rescan */
+    bool seen;
+};
+
+struct group {
+    /* Sorted by name */
+    struct entry **entries;
+    size_t num;
+    size_t max;
+    /* Set changed since names were sent last time */
+    bool changed;
+};
+
+struct pvt_data {
+    dmm_hook_p hook;
+    char root[DMM_LUSTRE_PATHSIZE];
+    struct group groups[NUM_GROUPS];
+    /* Ticks till the next rescan */
+    unsigned rescan_ticks;
+    /* Do not repeat warning about missing root on every tick */
+    bool root_warned;
+};
+
+static const struct stat_line *find_stat_line(const char *name, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < NUM_STAT_LINES; ++i)
+        if (stat_lines[i].len == len && memcmp(stat_lines[i].name, name, len) == 0)
+            return &stat_lines[i];
+    return NULL;
+}
+
+/* Parse stats file contents into vals in one pass */
+static void parse_stats(const char *s, uint64_t *vals)
+{
+    const struct stat_line *sl;
+    const char *end;
+    uint64_t samples, v;
+    int i;
+
+    memset(vals, 0, NUM_VALUES * sizeof(*vals));
+    for (; *s != '\0'; s = sensorfile_nextline(s)) {
+        end = sensorfile_skipfield(s);
+        if ((sl = find_stat_line(s, (size_t)(end - s))) == NULL)
+            continue;
+        if ((end = sensorfile_u64(end, &samples)) == NULL)
+            continue;
+        if (sl->kind == LINE_META) {
+            vals[VAL_META_OPS] += samples;
+            continue;
+        }
+        /* "samples [bytes] min max sum" */
+        end = sensorfile_skipfield(sensorfile_skipfield(end));
+        for (i = 0; i < 3 && end != NULL; ++i)
+            end = sensorfile_u64(end, &v);
+        if (end == NULL)
+            v = 0;
+        if (sl->kind == LINE_READ_BYTES) {
+            vals[VAL_READ_OPS] = samples;
+            vals[VAL_READ_BYTES] = v;
+        } else {
+            vals[VAL_WRITE_OPS] = samples;
+            vals[VAL_WRITE_BYTES] = v;
+        }
+    }
+}
+
+static void remove_entry(struct group *g, size_t i)
+{
+    sensorfile_close(&g->entries[i]->sf);
+    DMM_FREE(g->entries[i]);
+    memmove(g->entries + i, g->entries + i + 1, (g->num - i - 1) * sizeof(*g->entries));
+    g->num--;
+    g->changed = true;
+}
+
+static void clear_groups(struct pvt_data *pvt)
+{
+    int gi;
+
+    for (gi = 0; gi < NUM_GROUPS; ++gi)
+        while (pvt->groups[gi].num > 0)
+            remove_entry(&pvt->groups[gi], pvt->groups[gi].num - 1);
+}
+
+static int entry_cmp(const void *a, const void *b)
+{
+    return strcmp((*(struct entry * const *)a)->name.name,
+                  (*(struct entry * const *)b)->name.name);
+}
+
+/* Add entry if it is not known, return 0 or errno */
+static int add_entry(struct pvt_data *pvt, int gi, const char *name)
+{
+    struct group *g = &pvt->groups[gi];
+    struct entry *e, **entries;
+    char path[PATH_MAX];
+    size_t i, max;
+
+    for (i = 0; i < g->num; ++i)
+        if (strcmp(g->entries[i]->name.name, name) == 0) {
+            g->entries[i]->seen = true;
+            return 0;
+        }
+    if (strlen(name) >= DMM_LUSTRE_NAMESIZE)
+        return 0;
+    if ((size_t)snprintf(path, sizeof(path), "%s/%s/%s/stats", pvt->root, groups[gi].dir, name) >= sizeof(path))
+        return 0;
+
+    if (g->num == g->max) {
+        max = g->max > 0 ? g->max * 2 : 8;
+        if ((entries = (struct entry **)DMM_REALLOC(g->entries, max * sizeof(*entries))) == NULL)
+            return ENOMEM;
+        g->entries = entries;
+        g->max = max;
+    }
+    if ((e = (struct entry *)DMM_MALLOC(sizeof(*e))) == NULL)
+        return ENOMEM;
+    /* Not every directory entry has stats, e.g. osc/num_refs */
+    if (sensorfile_open(&e->sf, path) != 0) {
+        DMM_FREE(e);
+        return 0;
+    }
+    memset(&e->name, 0, sizeof(e->name));
+    strcpy(e->name.name, name);
+    e->seen = true;
+    g->entries[g->num++] = e;
+    g->changed = true;
+    return 0;
+}
+
+static int rescan(struct pvt_data *pvt)
+{
+    char path[PATH_MAX];
+    struct dirent *de;
+    struct group *g;
+    DIR *dir;
+    size_t i, num;
+    int gi, err = 0;
+    bool found = false;
+
+    for (gi = 0; gi < NUM_GROUPS && err == 0; ++gi) {
+        g = &pvt->groups[gi];
+        for (i = 0; i < g->num; ++i)
+            g->entries[i]->seen = false;
+        num = g->num;
+        snprintf(path, sizeof(path), "%s/%s", pvt->root, groups[gi].dir);
+        if ((dir = opendir(path)) != NULL) {
+            found = true;
+            while ((de = readdir(dir)) != NULL)
+                if (de->d_name[0] != '.' && (err = add_entry(pvt, gi, de->d_name)) != 0)
+                    break;
+            closedir(dir);
+        }
+        for (i = num; i-- > 0;)
+            if (!g->entries[i]->seen)
+                remove_entry(g, i);
+        if (g->changed)
+            qsort(g->entries, g->num, sizeof(*g->entries), entry_cmp);
+    }
+
+    if (!found && !pvt->root_warned)
+        dmm_log(DMM_LOG_WARN, "lustre: no llite or osc directories in %s", pvt->root);
+    pvt->root_warned = !found;
+    pvt->rescan_ticks = RESCAN_TICKS;
+    return err;
+}
+
+static int process_timer_msg(struct pvt_data *pvt)
+{
+    dmm_data_p data;
+    dmm_datanode_p dn;
+    struct group *g;
+    size_t i, n, len, numnodes;
+    uint64_t *vec;
+    int gi, v, err;
+
+    if (pvt->rescan_ticks == 0 ||
+        (pvt->groups[GROUP_LLITE].num == 0 && pvt->groups[GROUP_OSC].num == 0)) {
+        if ((err = rescan(pvt)) != 0) {
+            char errbuf[128], *errmsg;
+            errmsg = strerror_r(err, errbuf, sizeof(errbuf));
+            dmm_log(DMM_LOG_ERR, "lustre: cannot scan %s: %s", pvt->root, errmsg);
+            return err;
+        }
+    }
+    pvt->rescan_ticks--;
+
+    numnodes = 0;
+    len = 0;
+    for (gi = 0; gi < NUM_GROUPS; ++gi) {
+        g = &pvt->groups[gi];
+        for (i = g->num; i-- > 0;) {
+            if (sensorfile_read(&g->entries[i]->sf) != 0) {
+                /* Unmounted, find out what is left on the next tick */
+                remove_entry(g, i);
+                pvt->rescan_ticks = 0;
+                continue;
+            }
+            parse_stats(g->entries[i]->sf.buf, g->entries[i]->vals);
+        }
+        if (g->num == 0)
+            continue;
+        numnodes += (size_t)groups[gi].num_values + g->changed;
+        len += (size_t)groups[gi].num_values * g->num * sizeof(uint64_t);
+        if (g->changed)
+            len += g->num * sizeof(struct dmm_lustre_name);
+    }
+    if (numnodes == 0)
+        return 0;
+
+    if ((data = DMM_DATA_CREATE_RAW(numnodes, len)) == NULL) {
+        dmm_log(DMM_LOG_ERR, "Cannot allocate memory for data");
+        return ENOMEM;
+    }
+    dn = DMM_DATA_NODES(data);
+    for (gi = 0; gi < NUM_GROUPS; ++gi) {
+        g = &pvt->groups[gi];
+        n = g->num;
+        if (n == 0)
+            continue;
+        for (v = 0; v < groups[gi].num_values; ++v) {
+            DMM_DN_CREATE(dn, groups[gi].first + v, n * sizeof(uint64_t));
+            vec = DMM_DN_VECTOR(dn, uint64_t);
+            for (i = 0; i < n; ++i)
+                vec[i] = g->entries[i]->vals[v];
+            DMM_DN_ADVANCE(dn);
+        }
+        if (g->changed) {
+            struct dmm_lustre_name *names;
+
+            DMM_DN_CREATE(dn, groups[gi].names, n * sizeof(struct dmm_lustre_name));
+            names = DMM_DN_VECTOR(dn, struct dmm_lustre_name);
+            for (i = 0; i < n; ++i)
+                names[i] = g->entries[i]->name;
+            DMM_DN_ADVANCE(dn);
+            g->changed = false;
+        }
+    }
+    DMM_DN_MKEND(dn);
+    DMM_DATA_SEND(data, pvt->hook);
+    DMM_DATA_UNREF(data);
+
+    return 0;
+}
+
+static int ctor(dmm_node_p node)
+{
+    struct pvt_data *pvt;
+    int gi;
+
+    pvt = (struct pvt_data *)DMM_MALLOC(sizeof(*pvt));
+    if (pvt == NULL)
+        return ENOMEM;
+    pvt->hook = NULL;
+    strcpy(pvt->root, DEFAULT_ROOT);
+    for (gi = 0; gi < NUM_GROUPS; ++gi) {
+        pvt->groups[gi].entries = NULL;
+        pvt->groups[gi].num = 0;
+        pvt->groups[gi].max = 0;
+        pvt->groups[gi].changed = true;
+    }
+    pvt->rescan_ticks = 0;
+    pvt->root_warned = false;
+    DMM_NODE_SETPRIVATE(node, pvt);
+    return 0;
+}
+
+static void dtor(dmm_node_p node)
+{
+    struct pvt_data *pvt;
+    int gi;
+
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
+    clear_groups(pvt);
+    for (gi = 0; gi < NUM_GROUPS; ++gi)
+        DMM_FREE(pvt->groups[gi].entries);
+    DMM_FREE(pvt);
+}
+
+static int newhook(dmm_hook_p hook)
+{
+    struct pvt_data *pvt;
+    int gi;
+
+    if (DMM_HOOK_ISIN(hook))
+        return EINVAL;
+    if (strcmp(HOOKNAME, DMM_HOOK_NAME(hook)) != 0)
+        return EINVAL;
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(DMM_HOOK_NODE(hook));
+    pvt->hook = hook;
+    /* Send names to the new receiver */
+    for (gi = 0; gi < NUM_GROUPS; ++gi)
+        pvt->groups[gi].changed = true;
+
+    return 0;
+}
+
+static void rmhook(dmm_hook_p hook)
+{
+    struct pvt_data *pvt;
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(DMM_HOOK_NODE(hook));
+    pvt->hook = NULL;
+}
+
+static int rcvmsg(dmm_node_p node, dmm_msg_p msg)
+{
+    struct pvt_data *pvt;
+    dmm_msg_p resp;
+    int err = 0;
+
+#define CREATE_SEND_EMPTY_RESP()                                    \
+        do {                                                        \
+            resp = DMM_MSG_CREATE_RESP(DMM_NODE_ID(node), msg, 0);  \
+            if (resp != NULL) {                                     \
+                if (err != 0)                                       \
+                    msg->cm_flags |= DMM_MSG_ERR;                   \
+                                                                    \
+                DMM_MSG_SEND_ID(msg->cm_src, resp);                 \
+            } else                                                  \
+                err = (err != 0) ? err : ENOMEM;                    \
+        } while (0)
+
+    if (msg->cm_flags & DMM_MSG_RESP)
+        goto err;
+
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
+    switch (msg->cm_type) {
+    case DMM_MSGTYPE_GENERIC:
+        /* Accept only TIMERTRIGGER messages */
+        if (msg->cm_cmd != DMM_MSG_TIMERTRIGGER) {
+            err = ENOTSUP;
+            break;
+        }
+        // Nowhere to send, so why bother?
+        if (pvt->hook != NULL)
+            err = process_timer_msg(pvt);
+        break;
+
+    case DMM_MSGTYPE_LUSTRE:
+        switch (msg->cm_cmd) {
+        case DMM_MSG_LUSTRE_SETROOT: {
+            struct dmm_msg_lustre_setroot *sr;
+
+            sr = DMM_MSG_DATA(msg, struct dmm_msg_lustre_setroot);
+            if (msg->cm_len != sizeof(*sr) ||
+                memchr(sr->root, '\0', sizeof(sr->root)) == NULL || sr->root[0] == '\0') {
+                err = EINVAL;
+            } else {
+                clear_groups(pvt);
+                strcpy(pvt->root, sr->root);
+                pvt->rescan_ticks = 0;
+                pvt->root_warned = false;
+            }
+            CREATE_SEND_EMPTY_RESP();
+            break;
+        }
+
+        default:
+            err = ENOTSUP;
+            break;
+        }
+        break;
+
+    default:
+        err = ENOTSUP;
+        break;
+    }
+
+#undef CREATE_SEND_EMPTY_RESP
+
+err:
+    DMM_MSG_FREE(msg);
+    return err;
+}
+
+static struct dmm_type type = {
+    "lustre",
+    ctor,
+    dtor,
+    NULL,
+    rcvmsg,
+    newhook,
+    rmhook,
+    {},
+};
+
+DMM_MODULE_DECLARE(&type);
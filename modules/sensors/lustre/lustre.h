@@ -0,0 +1,35 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+#ifndef MODULES_LUSTRE_LUSTRE_H_
+#define MODULES_LUSTRE_LUSTRE_H_
+
+#include "dmm_types.h"
+
+enum {
+    DMM_MSGTYPE_LUSTRE = 0x8c7400e6
+};
+
+enum {
+    DMM_MSG_LUSTRE_SETROOT = 1,
+};
+
+enum { DMM_LUSTRE_PATHSIZE = 256 };
+enum { DMM_LUSTRE_NAMESIZE = 64 };
+
+/*
+ * Read root/llite/<mount>/stats and root/osc/<target>/stats,
+ * root is /proc/fs/lustre by default (/sys/kernel/debug/lustre
+ * on newer Lustre versions)
+ */
+struct dmm_msg_lustre_setroot {
+    char root[DMM_LUSTRE_PATHSIZE];
+};
+
+/* Element of LUSTRE_MOUNTS and LUSTRE_OSCS datanodes */
+struct dmm_lustre_name {
+    char name[DMM_LUSTRE_NAMESIZE];
+};
+
+#endif /* MODULES_LUSTRE_LUSTRE_H_ */
@@ -0,0 +1,25 @@
+-- SPDX-License-Identifier: BSD-2-Clause-Views
+-- Copyright (c) 2013-2023
+--   Research Computing Center Lomonosov Moscow State University
+
+local dmm = require('dmm')
+
+assert(dmm.require_interface('lustre', 'll'))
+
+local Lustre = dmm.Module:new_type('lustre')
+
+--! @brief Set Lustre statistics directory
+--! @param root '/proc/fs/lustre' by default, '/sys/kernel/debug/lustre'
+--! on newer Lustre versions or a directory with captured files for tests
+function Lustre:setroot(root)
+  assert(#root < ffi.C.DMM_LUSTRE_PATHSIZE, 'root is too long')
+  local msg, sr = dmm.msg_create {
+    payload_type = 'struct dmm_msg_lustre_setroot',
+    type = ffi.C.DMM_MSGTYPE_LUSTRE,
+    cmd = ffi.C.DMM_MSG_LUSTRE_SETROOT,
+  }
+  sr.root = root
+  dmm.msg_send(self.nodeid, msg)
+end
+
+return Lustre
@@ -0,0 +1,27 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+#ifndef MODULES_LUSTRE_SENSORS_H_
+#define MODULES_LUSTRE_SENSORS_H_
+
+enum {
+    /* uint64_t vectors from llite/<mount>/stats, one element per mount */
+    LUSTRE_READ_BYTES = 1400,
+    LUSTRE_WRITE_BYTES,
+    LUSTRE_READ_OPS,
+    LUSTRE_WRITE_OPS,
+    /* Sum of open, close, getattr, create, unlink and other metadata ops */
+    LUSTRE_META_OPS,
+    /* Array of struct dmm_lustre_name, sent when the set of mounts changes */
+    LUSTRE_MOUNTS,
+    /* uint64_t vectors from osc/<target>/stats, one element per OST */
+    LUSTRE_OSC_READ_BYTES,
+    LUSTRE_OSC_WRITE_BYTES,
+    LUSTRE_OSC_READ_OPS,
+    LUSTRE_OSC_WRITE_OPS,
+    /* Array of struct dmm_lustre_name, sent when the set of OSTs changes */
+    LUSTRE_OSCS
+};
+
+#endif /* MODULES_LUSTRE_SENSORS_H_ */
@@ -2,98 +2,186 @@
 // Copyright (c) 2013-2023
 //   Research Computing Center Lomonosov Moscow State University
 
+/*
+ * memory sends selected fields of /proc/meminfo (see DMM_MSG_MEMORY_SET).
+ *
+ * Field names are looked up with a perfect hash: every known field
+ * name falls into its own slot of hash_table, so a line is matched
+ * with one hash computation and one memcmp.
+ */
+
+#include <assert.h>
+#include <errno.h>
 #include <stdbool.h>
-#include <stdio.h>
+#include <string.h>
 
 #include "dmm_base.h"
 #include "dmm_log.h"
 #include "dmm_message.h"
 #include "sensors.h"
+#include "memory.h"
+#include "../sensorfile.h"
 
 #define DATAFILE "/proc/meminfo"
 
+#define NUM_FIELDS (MEMORY_DIRECTMAP2M - MEMORY_MEMTOTAL + 1)
+
 struct pvt_data {
-    FILE *f;
+    struct sensorfile sf;
     dmm_hook_p hook;
+    bool selected[NUM_FIELDS];
+    int num_selected;
 };
 
-struct search_item_t {
+struct field {
     const char *header;
-    dmm_id_t    sensor_id;
+    size_t      len;
     bool        convert_from_k;
-} search_list[] = {
-    { "MemTotal",           MEMORY_MEMTOTAL,            true },
-    { "MemFree",            MEMORY_MEMFREE,             true },
-    { "MemAvailable",       MEMORY_MEMAVAILABLE,        true },
-    { "Buffers",            MEMORY_BUFFERS,             true },
-    { "Cached",             MEMORY_CACHED,              true },
-//    { "SwapCached",         MEMORY_SWAPCACHED,          true },
-    { "Active",             MEMORY_ACTIVE,              true },
-    { "Inactive",           MEMORY_INACTIVE,            true },
-//    { "Active(anon)",       MEMORY_ACTIVE_ANON,         true },
-//    { "Inactive(anon)",     MEMORY_INACTIVE_ANON,       true },
-//    { "Active(file)",       MEMORY_ACTIVE_FILE,         true },
-//    { "Inactive(file)",     MEMORY_INACTIVE_FILE,       true },
-//    { "Unevictable",        MEMORY_UNEVICTABLE,         true },
-    { "Mlocked",            MEMORY_MLOCKED,             true },
-//    { "SwapTotal",          MEMORY_SWAPTOTAL,           true },
-//    { "SwapFree",           MEMORY_SWAPFREE,            true },
-//    { "Dirty",              MEMORY_DIRTY,               true },
-//    { "Writeback",          MEMORY_WRITEBACK,           true },
-    { "AnonPages",          MEMORY_ANONPAGES,           true },
-    { "Mapped",             MEMORY_MAPPED,              true },
-    { "Shmem",              MEMORY_SHMEM,               true },
-//    { "Slab",               MEMORY_SLAB,                true },
-//    { "SReclaimable",       MEMORY_SRECLAIMABLE,        true },
-//    { "SUnreclaim",         MEMORY_SUNRECLAIM,          true },
-//    { "KernelStack",        MEMORY_KERNELSTACK,         true },
-//    { "PageTables",         MEMORY_PAGETABLES,          true },
-//    { "NFS_Unstable",       MEMORY_NFS_UNSTABLE,        true },
-//    { "Bounce",             MEMORY_BOUNCE,              true },
-//    { "WritebackTmp",       MEMORY_WRITEBACKTMP,        true },
-//    { "CommitLimit",        MEMORY_COMMITLIMIT,         true },
-//    { "Committed_AS",       MEMORY_COMMITTED_AS,        true },
-//    { "VmallocTotal",       MEMORY_VMALLOCTOTAL,        true },
-//    { "VmallocUsed",        MEMORY_VMALLOCUSED,         true },
-//    { "VmallocChunk",       MEMORY_VMALLOCCHUNK,        true },
-//    { "HardwareCorrupted",  MEMORY_HARDWARECORRUPTED,   true },
-//    { "AnonHugePages",      MEMORY_ANONHUGEPAGES,       true },
-//    { "CmaTotal",           MEMORY_CMATOTAL,            true },
-//    { "CmaFree",            MEMORY_CMAFREE,             true },
-//    { "HugePages_Total",    MEMORY_HUGEPAGES_TOTAL,     false },
-//    { "HugePages_Free",     MEMORY_HUGEPAGES_FREE,      false },
-//    { "HugePages_Rsvd",     MEMORY_HUGEPAGES_RSVD,      false },
-//    { "HugePages_Surp",     MEMORY_HUGEPAGES_SURP,      false },
-//    { "Hugepagesize",       MEMORY_HUGEPAGESIZE,        true },
-//    { "DirectMap",          MEMORY_DIRECTMAP4K,         true },
-//    { "DirectMap",          MEMORY_DIRECTMAP2M,         true },
-    { NULL,                 0,                          false }
 };
 
-const int num_sensors = sizeof(search_list) / sizeof(*search_list) - 1;
+#define FIELD(id, header, convert_from_k) \
+    [(id) - MEMORY_MEMTOTAL] = { (header), sizeof(header) - 1, (convert_from_k) }
+
+/* Indexed by sensor id - MEMORY_MEMTOTAL */
+static const struct field fields[NUM_FIELDS] = {
+    FIELD(MEMORY_MEMTOTAL,          "MemTotal",             true),
+    FIELD(MEMORY_MEMFREE,           "MemFree",              true),
+    FIELD(MEMORY_MEMAVAILABLE,      "MemAvailable",         true),
+    FIELD(MEMORY_BUFFERS,           "Buffers",              true),
+    FIELD(MEMORY_CACHED,            "Cached",               true),
+    FIELD(MEMORY_SWAPCACHED,        "SwapCached",           true),
+    FIELD(MEMORY_ACTIVE,            "Active",               true),
+    FIELD(MEMORY_INACTIVE,          "Inactive",             true),
+    FIELD(MEMORY_ACTIVE_ANON,       "Active(anon)",         true),
+    FIELD(MEMORY_INACTIVE_ANON,     "Inactive(anon)",       true),
+    FIELD(MEMORY_ACTIVE_FILE,       "Active(file)",         true),
+    FIELD(MEMORY_INACTIVE_FILE,     "Inactive(file)",       true),
+    FIELD(MEMORY_UNEVICTABLE,       "Unevictable",          true),
+    FIELD(MEMORY_MLOCKED,           "Mlocked",              true),
+    FIELD(MEMORY_SWAPTOTAL,         "SwapTotal",            true),
+    FIELD(MEMORY_SWAPFREE,          "SwapFree",             true),
+    FIELD(MEMORY_DIRTY,             "Dirty",                true),
+    FIELD(MEMORY_WRITEBACK,         "Writeback",            true),
+    FIELD(MEMORY_ANONPAGES,         "AnonPages",            true),
+    FIELD(MEMORY_MAPPED,            "Mapped",               true),
+    FIELD(MEMORY_SHMEM,             "Shmem",                true),
+    FIELD(MEMORY_SLAB,              "Slab",                 true),
+    FIELD(MEMORY_SRECLAIMABLE,      "SReclaimable",         true),
+    FIELD(MEMORY_SUNRECLAIM,        "SUnreclaim",           true),
+    FIELD(MEMORY_KERNELSTACK,       "KernelStack",          true),
+    FIELD(MEMORY_PAGETABLES,        "PageTables",           true),
+    FIELD(MEMORY_NFS_UNSTABLE,      "NFS_Unstable",         true),
+    FIELD(MEMORY_BOUNCE,            "Bounce",               true),
+    FIELD(MEMORY_WRITEBACKTMP,      "WritebackTmp",         true),
+    FIELD(MEMORY_COMMITLIMIT,       "CommitLimit",          true),
+    FIELD(MEMORY_COMMITTED_AS,      "Committed_AS",         true),
+    FIELD(MEMORY_VMALLOCTOTAL,      "VmallocTotal",         true),
+    FIELD(MEMORY_VMALLOCUSED,       "VmallocUsed",          true),
+    FIELD(MEMORY_VMALLOCCHUNK,      "VmallocChunk",         true),
+    FIELD(MEMORY_HARDWARECORRUPTED, "HardwareCorrupted",    true),
+    FIELD(MEMORY_ANONHUGEPAGES,     "AnonHugePages",        true),
+    FIELD(MEMORY_CMATOTAL,          "CmaTotal",             true),
+    FIELD(MEMORY_CMAFREE,           "CmaFree",              true),
+    FIELD(MEMORY_HUGEPAGES_TOTAL,   "HugePages_Total",      false),
+    FIELD(MEMORY_HUGEPAGES_FREE,    "HugePages_Free",       false),
+    FIELD(MEMORY_HUGEPAGES_RSVD,    "HugePages_Rsvd",       false),
+    FIELD(MEMORY_HUGEPAGES_SURP,    "HugePages_Surp",       false),
+    FIELD(MEMORY_HUGEPAGESIZE,      "Hugepagesize",         true),
+    FIELD(MEMORY_DIRECTMAP4K,       "DirectMap4k",          true),
+    FIELD(MEMORY_DIRECTMAP2M,       "DirectMap2M",          true),
+};
+
+/* Fields sent until DMM_MSG_MEMORY_SET is received */
+static const dmm_sensorid_t default_fields[] = {
+    MEMORY_MEMTOTAL,
+    MEMORY_MEMFREE,
+    MEMORY_MEMAVAILABLE,
+    MEMORY_BUFFERS,
+    MEMORY_CACHED,
+    MEMORY_ACTIVE,
+    MEMORY_INACTIVE,
+    MEMORY_MLOCKED,
+    MEMORY_ANONPAGES,
+    MEMORY_MAPPED,
+    MEMORY_SHMEM,
+};
+
+/*
+ * FNV-1a with a seed, top HASH_BITS bits are used. HASH_SEED is found
+ * offline by trying seeds until all field names get different slots.
+ * If fields are added, a new seed must be found and hash_table
+ * refilled, ctor checks the table in debug builds.
+ */
+#define HASH_SEED   0x15a3
+#define HASH_BITS   7
+
+static inline unsigned field_hash(const char *s, size_t len)
+{
+    uint32_t h = HASH_SEED;
+
+    while (len-- > 0)
+        h = (h ^ (unsigned char)*s++) * 0x01000193;
+    return h >> (32 - HASH_BITS);
+}
+
+/* Field index + 1 for every hash value, 0 for no field */
+static const uint8_t hash_table[1 << HASH_BITS] = {
+     0, 44,  0,  0, 45,  0,  8,  6, 34,  0, 29,  0,  0,  0,  0,  0,
+    23, 22,  0,  0,  0, 15,  0,  0,  0, 35, 32,  0, 12, 10,  0,  0,
+     0, 13,  0,  0,  0, 20,  0,  0,  1,  0,  0,  0,  0,  0, 36,  0,
+     0,  0,  0,  0, 21,  3, 14,  0, 30, 33,  0,  0, 43,  0,  0,  0,
+     0,  0,  0,  0, 18,  0, 26,  0, 24,  0, 11, 16,  0,  0,  0,  4,
+     0,  0,  5,  0,  0,  0,  0,  0, 19, 37, 42, 28,  9, 39,  0,  0,
+     0,  0,  0,  0,  0, 41,  0, 25,  0, 31,  2,  0,  0,  0,  0,  0,
+     0,  0,  0,  0, 17, 38,  0,  7, 40,  0,  0, 27,  0,  0,  0,  0,
+};
+
+/* Return field index for name of length len or -1 if it is not known */
+static inline int field_lookup(const char *name, size_t len)
+{
+    const struct field *f;
+    int idx;
+
+    if ((idx = hash_table[field_hash(name, len)] - 1) < 0)
+        return -1;
+    f = &fields[idx];
+    if (f->len != len || memcmp(f->header, name, len) != 0)
+        return -1;
+    return idx;
+}
+
+static void select_field(struct pvt_data *pvt, dmm_sensorid_t id)
+{
+    if (id < MEMORY_MEMTOTAL || id > MEMORY_DIRECTMAP2M || pvt->selected[id - MEMORY_MEMTOTAL])
+        return;
+    pvt->selected[id - MEMORY_MEMTOTAL] = true;
+    pvt->num_selected++;
+}
 
 typedef uint64_t sensor_type;
-#define SCNsensor SCNu64
 
 static int process_timer_msg(dmm_node_p node)
 {
     struct pvt_data *pvt;
-    FILE *f;
-    char buf[64];
+    const char *line, *colon;
     dmm_datanode_p dn;
     dmm_data_p data;
     int sensors_found;
+    int err;
 
     pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
     data = NULL;
-    if (pvt->hook == NULL)
+    if (pvt->hook == NULL || pvt->num_selected == 0)
         goto out;
 
-    f = pvt->f;
-    fflush(f);
-    rewind(f);
+    if ((err = sensorfile_read(&pvt->sf)) != 0) {
+        char errbuf[128], *errmsg;
+        errmsg = strerror_r(err, errbuf, sizeof(errbuf));
+        dmm_log(DMM_LOG_ERR, "Cannot read %s: %s", DATAFILE, errmsg);
+        return err;
+    }
 
-    data = DMM_DATA_CREATE(num_sensors, sizeof(sensor_type));
+    data = DMM_DATA_CREATE(pvt->num_selected, sizeof(sensor_type));
     if (data == NULL) {
         return ENOMEM;
     }
@@ -101,24 +189,20 @@ static int process_timer_msg(dmm_node_p node)
 
     sensors_found = 0;
 
-    while ((sensors_found < num_sensors) && !feof(f)) {
-        int retval;
+    /* Lines look like "MemTotal:       16318480 kB", stop when all selected are found */
+    for (line = pvt->sf.buf; sensors_found < pvt->num_selected; line = sensorfile_nextline(colon)) {
         sensor_type value;
-        struct search_item_t *s;
+        int idx;
 
-        retval = fscanf(f, "%60[^:]: %" SCNsensor "%*[^\n]%*c", buf, &value);
-        if (retval < 2 || retval == EOF) {
-            assert(fscanf(f, "%*[^\n]%*c") == 0);
+        if ((colon = strchr(line, ':')) == NULL)
             break;
-        }
-        for (s = search_list; s->header != NULL; ++s) {
-            if (strncmp(buf, s->header, sizeof(buf)) == 0)
-                break;
-        }
-        if (s->header == NULL)
+        idx = field_lookup(line, colon - line);
+        if (idx < 0 || !pvt->selected[idx])
+            continue;
+        if (sensorfile_u64(colon + 1, &value) == NULL)
             continue;
-        DMM_DN_CREATE(dn, s->sensor_id, sizeof(sensor_type));
-        *DMM_DN_DATA(dn, sensor_type) = value * (s->convert_from_k ? 1024 : 1);
+        DMM_DN_CREATE(dn, MEMORY_MEMTOTAL + idx, sizeof(sensor_type));
+        *DMM_DN_DATA(dn, sensor_type) = value * (fields[idx].convert_from_k ? 1024 : 1);
         DMM_DN_ADVANCE(dn);
         ++sensors_found;
     }
@@ -136,25 +220,31 @@ out:
 static int ctor(dmm_node_p node)
 {
     struct pvt_data *pvt;
+    size_t i;
     int err;
 
+#ifdef DEBUG
+    for (i = 0; i < NUM_FIELDS; ++i)
+        assert(field_lookup(fields[i].header, fields[i].len) == (int)i);
+#endif
+
     pvt = (struct pvt_data *)DMM_MALLOC(sizeof(*pvt));
     if (pvt == NULL)
         return ENOMEM;
     DMM_NODE_SETPRIVATE(node, pvt);
 
-    pvt->f = fopen(DATAFILE, "re");
-    if (pvt->f == NULL) {
+    if ((err = sensorfile_open(&pvt->sf, DATAFILE)) != 0) {
         char errbuf[128], *errmsg;
-        err = errno;
         errmsg = strerror_r(err, errbuf, sizeof(errbuf));
         dmm_log(DMM_LOG_ERR, "Cannot open %s for reading: %s", DATAFILE, errmsg);
         DMM_FREE(pvt);
         return err;
     }
-    // Disable buffering to have fresh data on successive reads
-    setlinebuf(pvt->f);
     pvt->hook = NULL;
+    memset(pvt->selected, 0, sizeof(pvt->selected));
+    pvt->num_selected = 0;
+    for (i = 0; i < sizeof(default_fields) / sizeof(*default_fields); ++i)
+        select_field(pvt, default_fields[i]);
     return 0;
 }
 
@@ -162,7 +252,7 @@ static void dtor(dmm_node_p node)
 {
     struct pvt_data *pvt;
     pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
-    fclose(pvt->f);
+    sensorfile_close(&pvt->sf);
     DMM_FREE(pvt);
 }
 
@@ -189,25 +279,80 @@ static void rmhook(dmm_hook_p hook)
 
 static int rcvmsg(dmm_node_p node, dmm_msg_p msg)
 {
+    struct pvt_data *pvt;
+    dmm_msg_p resp;
     int err = 0;
 
-    /* Accept only generic messages */
-    if (msg->cm_type != DMM_MSGTYPE_GENERIC) {
-        err = ENOTSUP;
+#define CREATE_SEND_EMPTY_RESP()                                    \
+        do {                                                        \
+            resp = DMM_MSG_CREATE_RESP(DMM_NODE_ID(node), msg, 0);  \
+            if (resp != NULL) {                                     \
+                if (err != 0)                                       \
+                    msg->cm_flags |= DMM_MSG_ERR;                   \
+                                                                    \
+                DMM_MSG_SEND_ID(msg->cm_src, resp);                 \
+            } else                                                  \
+                err = (err != 0) ? err : ENOMEM;                    \
+        } while (0)
+
+    if (msg->cm_flags & DMM_MSG_RESP)
         goto err;
-    }
-    /* Accept only TIMERTRIGGER messages */
-    if (msg->cm_cmd != DMM_MSG_TIMERTRIGGER) {
+
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
+    switch (msg->cm_type) {
+    case DMM_MSGTYPE_GENERIC:
+        /* Accept only TIMERTRIGGER messages */
+        if (msg->cm_cmd != DMM_MSG_TIMERTRIGGER) {
+            err = ENOTSUP;
+            break;
+        }
+        err = process_timer_msg(node);
+        break;
+
+    case DMM_MSGTYPE_MEMORY:
+        switch (msg->cm_cmd) {
+        case DMM_MSG_MEMORY_SET: {
+            struct dmm_msg_memory_set *set = DMM_MSG_DATA(msg, struct dmm_msg_memory_set);
+            dmm_size_t i, num_ranges;
+            dmm_sensorid_t id;
+
+            num_ranges = (msg->cm_len - sizeof(struct dmm_msg_memory_set)) / sizeof(struct dmm_sensorrange);
+            for (i = 0; i < num_ranges; ++i)
+                if (set->sensors[i].first > set->sensors[i].last)
+                    err = EINVAL;
+            if (err == 0) {
+                memset(pvt->selected, 0, sizeof(pvt->selected));
+                pvt->num_selected = 0;
+                for (i = 0; i < num_ranges; ++i)
+                    for (id = MEMORY_MEMTOTAL; id <= MEMORY_DIRECTMAP2M; ++id)
+                        if (id >= set->sensors[i].first && id <= set->sensors[i].last)
+                            select_field(pvt, id);
+                if (num_ranges == 0)
+                    for (id = MEMORY_MEMTOTAL; id <= MEMORY_DIRECTMAP2M; ++id)
+                        select_field(pvt, id);
+            }
+            CREATE_SEND_EMPTY_RESP();
+            break;
+        }
+
+        default:
+            err = ENOTSUP;
+            break;
+        }
+        break;
+
+    default:
         err = ENOTSUP;
-        goto err;
+        break;
     }
-    err = process_timer_msg(node);
+
+#undef CREATE_SEND_EMPTY_RESP
 
 err:
     DMM_MSG_FREE(msg);
     return err;
-
 }
+
 static struct dmm_type type = {
     "memory",
     ctor,
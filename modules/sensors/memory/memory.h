@@ -0,0 +1,31 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+#ifndef MODULES_MEMORY_MEMORY_H_
+#define MODULES_MEMORY_MEMORY_H_
+
+#include "dmm_base.h"
+#include "dmm_types.h"
+
+enum {
+    DMM_MSGTYPE_MEMORY = 0x47b395f0
+};
+
+enum {
+    DMM_MSG_MEMORY_SET = 1,
+};
+
+/*
+ * Select /proc/meminfo fields to send by their sensor ids
+ * (MEMORY_MEMTOTAL..MEMORY_DIRECTMAP2M, see sensors.h).
+ * Ids in ranges which do not correspond to any field are ignored,
+ * empty list of ranges selects all fields.
+ * Fields are sent in /proc/meminfo order
+ */
+struct dmm_msg_memory_set {
+    char                   dummy;
+    struct dmm_sensorrange sensors[];
+};
+
+#endif /* MODULES_MEMORY_MEMORY_H_ */
@@ -0,0 +1,33 @@
+-- SPDX-License-Identifier: BSD-2-Clause-Views
+-- Copyright (c) 2013-2023
+--   Research Computing Center Lomonosov Moscow State University
+
+local dmm = require('dmm')
+
+assert(dmm.require_interface('memory', 'll'))
+
+local Memory = dmm.Module:new_type('memory')
+
+--! @brief Select /proc/meminfo fields to send
+--! @param sensors 'all' or list of sensor ids and {first, last} id ranges,
+--! see sensor_ids.txt
+function Memory:set(sensors)
+  local n = (sensors == 'all') and 0 or #sensors
+  local msg, set = dmm.msg_create{
+    len = dmm.sfam.struct_sizeof('struct dmm_msg_memory_set', 'sensors', n),
+    payload_type = 'struct dmm_msg_memory_set',
+    type = ffi.C.DMM_MSGTYPE_MEMORY,
+    cmd = ffi.C.DMM_MSG_MEMORY_SET,
+  }
+  for i = 1, n do
+    local r = sensors[i]
+    if type(r) == 'table' then
+      set.sensors[i - 1] = {r[1], r[2]}
+    else
+      set.sensors[i - 1] = {r, r}
+    end
+  end
+  dmm.msg_send(self.nodeid, msg)
+end
+
+return Memory
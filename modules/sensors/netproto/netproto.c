@@ -0,0 +1,483 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+/*
+ * netproto sends selected protocol counters of /proc/net/snmp and
+ * /proc/net/netstat.
+ *
+ * Both files consist of line pairs: a header line with counter names
+ * and a line with their values, both starting with the group name.
+ * The first parse resolves every field to the number of its value line
+ * and the column in it, fields are kept sorted by file, line and column,
+ * so later ticks make a single pass over the values without looking at
+ * names. Columns are trusted as long as the group name matches and
+ * the length of the header line stays the same, otherwise the file
+ * is resolved again (e.g. IcmpMsg grows when new message types are seen).
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "dmm_base.h"
+#include "dmm_log.h"
+#include "dmm_message.h"
+#include "../sensorfile.h"
+#include "netproto.h"
+#include "sensors.h"
+
+#define HOOKNAME "out"
+
+enum {
+    SRC_SNMP,
+    SRC_NETSTAT,
+    NUM_SOURCES
+};
+
+static const char *source_paths[NUM_SOURCES] = {
+    "/proc/net/snmp",
+    "/proc/net/netstat",
+};
+
+/* Line numbers of unresolved and missing fields */
+#define LINE_UNRESOLVED ((ssize_t)-1)
+#define LINE_MISSING    ((ssize_t)-2)
+
+struct field {
+    dmm_sensorid_t id;
+    int source;
+    /* Group name without ':' and counter name */
+    char group[DMM_NETPROTO_NAMESIZE];
+    size_t grouplen;
+    char key[DMM_NETPROTO_NAMESIZE];
+    /* Number of the value among fields after the group name */
+    unsigned col;
+    /* Value line number in the source file, or LINE_* */
+    ssize_t line;
+    /* Length of the header line the column was found in */
+    size_t hdrlen;
+    uint64_t val;
+    /* For error messages */
+    char name[DMM_NETPROTO_NAMESIZE];
+};
+
+struct pvt_data {
+    dmm_hook_p hook;
+    /* Sorted by source, line and column */
+    struct field *fields;
+    size_t num_fields;
+    struct sensorfile files[NUM_SOURCES];
+    /* Source cannot be opened, do not retry */
+    bool failed[NUM_SOURCES];
+};
+
+static const struct dmm_netproto_field default_fields[] = {
+    { NETPROTO_TCP_IN_SEGS,             "Tcp.InSegs" },
+    { NETPROTO_TCP_OUT_SEGS,            "Tcp.OutSegs" },
+    { NETPROTO_TCP_RETRANS_SEGS,        "Tcp.RetransSegs" },
+    { NETPROTO_TCP_IN_ERRS,             "Tcp.InErrs" },
+    { NETPROTO_TCP_ESTAB_RESETS,        "Tcp.EstabResets" },
+    { NETPROTO_TCP_CURR_ESTAB,          "Tcp.CurrEstab" },
+    { NETPROTO_UDP_IN_DATAGRAMS,        "Udp.InDatagrams" },
+    { NETPROTO_UDP_OUT_DATAGRAMS,       "Udp.OutDatagrams" },
+    { NETPROTO_UDP_IN_ERRORS,           "Udp.InErrors" },
+    { NETPROTO_UDP_RCVBUF_ERRORS,       "Udp.RcvbufErrors" },
+    { NETPROTO_UDP_SNDBUF_ERRORS,       "Udp.SndbufErrors" },
+    { NETPROTO_IP_IN_DISCARDS,          "Ip.InDiscards" },
+    { NETPROTO_IP_REASM_FAILS,          "Ip.ReasmFails" },
+    { NETPROTO_TCPEXT_LISTEN_OVERFLOWS, "TcpExt.ListenOverflows" },
+    { NETPROTO_TCPEXT_LISTEN_DROPS,     "TcpExt.ListenDrops" },
+    { NETPROTO_TCPEXT_TCP_TIMEOUTS,     "TcpExt.TCPTimeouts" },
+};
+
+#define NUM_DEFAULT_FIELDS (sizeof(default_fields) / sizeof(default_fields[0]))
+
+/* Fill field from its name, return 0 or EINVAL */
+static int parse_name(const struct dmm_netproto_field *nf, struct field *f)
+{
+    const char *dot;
+
+    if (memchr(nf->name, '\0', sizeof(nf->name)) == NULL)
+        return EINVAL;
+    if (strpbrk(nf->name, " \t\n:") != NULL)
+        return EINVAL;
+    if ((dot = strchr(nf->name, '.')) == NULL || dot == nf->name || dot[1] == '\0')
+        return EINVAL;
+
+    f->id = nf->id;
+    strcpy(f->name, nf->name);
+    f->grouplen = (size_t)(dot - nf->name);
+    memcpy(f->group, nf->name, f->grouplen);
+    f->group[f->grouplen] = '\0';
+    strcpy(f->key, dot + 1);
+    f->source = (f->grouplen > 3 && strcmp(f->group + f->grouplen - 3, "Ext") == 0) ?
+                SRC_NETSTAT : SRC_SNMP;
+    f->col = 0;
+    f->line = LINE_UNRESOLVED;
+    f->hdrlen = 0;
+    f->val = 0;
+    return 0;
+}
+
+static int field_cmp(const void *a, const void *b)
+{
+    const struct field *fa = (const struct field *)a;
+    const struct field *fb = (const struct field *)b;
+
+    if (fa->source != fb->source)
+        return fa->source < fb->source ? -1 : 1;
+    if (fa->line != fb->line)
+        return fa->line < fb->line ? -1 : 1;
+    if (fa->col != fb->col)
+        return fa->col < fb->col ? -1 : 1;
+    /* qsort is not stable, keep the order of duplicates fixed */
+    if (fa->id != fb->id)
+        return fa->id < fb->id ? -1 : 1;
+    return 0;
+}
+
+/* Replace fields, the old set is kept on error */
+static int set_fields(struct pvt_data *pvt, const struct dmm_netproto_field *nf, size_t n)
+{
+    struct field *fields;
+    size_t i;
+    int err;
+
+    if (n == 0) {
+        nf = default_fields;
+        n = NUM_DEFAULT_FIELDS;
+    }
+    if ((fields = (struct field *)DMM_MALLOC(n * sizeof(*fields))) == NULL)
+        return ENOMEM;
+    for (i = 0; i < n; ++i)
+        if ((err = parse_name(nf + i, fields + i)) != 0) {
+            dmm_log(DMM_LOG_ERR, "netproto: invalid field name \"%.*s\"",
+                    (int)sizeof(nf[i].name), nf[i].name);
+            DMM_FREE(fields);
+            return err;
+        }
+    qsort(fields, n, sizeof(*fields), field_cmp);
+
+    DMM_FREE(pvt->fields);
+    pvt->fields = fields;
+    pvt->num_fields = n;
+    return 0;
+}
+
+/* Does line begin with the field group followed by ':'? */
+static inline bool group_matches(const char *line, const struct field *f)
+{
+    return strncmp(line, f->group, f->grouplen) == 0 && line[f->grouplen] == ':';
+}
+
+/* Find column of the field key in header line, return false if there is none */
+static bool find_column(const char *hdr, struct field *f)
+{
+    const char *s, *end;
+    size_t keylen;
+    unsigned col;
+
+    keylen = strlen(f->key);
+    s = hdr + f->grouplen + 1;
+    for (col = 0; ; ++col) {
+        s = sensorfile_skipblanks(s);
+        if (*s == '\n' || *s == '\0')
+            return false;
+        end = sensorfile_skipfield(s);
+        if ((size_t)(end - s) == keylen && memcmp(s, f->key, keylen) == 0) {
+            f->col = col;
+            return true;
+        }
+        s = end;
+    }
+}
+
+/* Find value lines and columns of fields of the source from first to last - 1 */
+static void resolve(struct pvt_data *pvt, struct field *first, struct field *last)
+{
+    const char *hdr, *vals, *next;
+    struct field *f;
+    ssize_t lineno;
+
+    for (f = first; f < last; ++f)
+        f->line = LINE_UNRESOLVED;
+    hdr = pvt->files[first->source].buf;
+    for (lineno = 0; *hdr != '\0'; hdr = next, lineno += 2) {
+        vals = sensorfile_nextline(hdr);
+        if (*vals == '\0')
+            break;
+        next = sensorfile_nextline(vals);
+        for (f = first; f < last; ++f)
+            if (f->line == LINE_UNRESOLVED && group_matches(hdr, f) &&
+                group_matches(vals, f) && find_column(hdr, f)) {
+                f->line = lineno + 1;
+                f->hdrlen = (size_t)(vals - hdr);
+            }
+    }
+    for (f = first; f < last; ++f)
+        if (f->line == LINE_UNRESOLVED) {
+            dmm_log(DMM_LOG_WARN, "netproto: field %s is not found in %s",
+                    f->name, source_paths[f->source]);
+            f->line = LINE_MISSING;
+        }
+    qsort(first, (size_t)(last - first), sizeof(*first), field_cmp);
+}
+
+/*
+ * Parse resolved fields from first to last - 1 in one pass,
+ * return false on mismatch
+ */
+static bool parse_lines(struct pvt_data *pvt, struct field *first, struct field *last)
+{
+    const char *line, *prev, *s;
+    struct field *f;
+    ssize_t lineno;
+    unsigned col;
+    int64_t v;
+
+    line = pvt->files[first->source].buf;
+    prev = NULL;
+    lineno = 0;
+    s = NULL;
+    col = 0;
+    for (f = first; f < last; ++f) {
+        if (f->line < 0)
+            continue;
+        if (s == NULL || lineno != f->line) {
+            for (; lineno < f->line && *line != '\0'; ++lineno) {
+                prev = line;
+                line = sensorfile_nextline(line);
+            }
+            if (*line == '\0' || prev == NULL || (size_t)(line - prev) != f->hdrlen ||
+                !group_matches(line, f))
+                return false;
+            s = line + f->grouplen + 1;
+            col = 0;
+        }
+        /* Fields sharing a column parse the same value */
+        for (; col < f->col; ++col)
+            s = sensorfile_skipfield(s);
+        s = sensorfile_skipblanks(s);
+        if (*s == '-') {
+            if (sensorfile_i64(s, &v) == NULL)
+                return false;
+            f->val = (uint64_t)v;
+        } else if (sensorfile_u64(s, &f->val) == NULL) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Read the source and parse values of its fields from first to last - 1 */
+static int read_source(struct pvt_data *pvt, struct field *first, struct field *last)
+{
+    struct sensorfile *sf;
+    struct field *f;
+    int src, err;
+
+    src = first->source;
+    sf = &pvt->files[src];
+    if (pvt->failed[src])
+        return 0;
+    if (!sensorfile_isopen(sf) && (err = sensorfile_open(sf, source_paths[src])) != 0) {
+        char errbuf[128], *errmsg;
+        errmsg = strerror_r(err, errbuf, sizeof(errbuf));
+        dmm_log(DMM_LOG_WARN, "netproto: cannot open %s, its fields are not sent: %s",
+                source_paths[src], errmsg);
+        pvt->failed[src] = true;
+        for (f = first; f < last; ++f)
+            f->line = LINE_MISSING;
+        return 0;
+    }
+    if ((err = sensorfile_read(sf)) != 0)
+        return err;
+
+    if (first->line == LINE_UNRESOLVED || !parse_lines(pvt, first, last)) {
+        resolve(pvt, first, last);
+        if (!parse_lines(pvt, first, last)) {
+            /* Should never happen, do not send garbage */
+            for (f = first; f < last; ++f)
+                f->line = LINE_MISSING;
+        }
+    }
+    return 0;
+}
+
+static int process_timer_msg(struct pvt_data *pvt)
+{
+    dmm_data_p data;
+    dmm_datanode_p dn;
+    struct field *first, *last, *end;
+    size_t n;
+    int err;
+
+    end = pvt->fields + pvt->num_fields;
+    for (first = pvt->fields; first < end; first = last) {
+        for (last = first; last < end && last->source == first->source; ++last)
+            ;
+        if ((err = read_source(pvt, first, last)) != 0) {
+            char errbuf[128], *errmsg;
+            errmsg = strerror_r(err, errbuf, sizeof(errbuf));
+            dmm_log(DMM_LOG_ERR, "netproto: cannot read %s: %s",
+                    source_paths[first->source], errmsg);
+            return err;
+        }
+    }
+
+    n = 0;
+    for (first = pvt->fields; first < end; ++first)
+        n += first->line >= 0;
+    if (n == 0)
+        return 0;
+
+    if ((data = DMM_DATA_CREATE(n, sizeof(uint64_t))) == NULL) {
+        dmm_log(DMM_LOG_ERR, "Cannot allocate memory for data");
+        return ENOMEM;
+    }
+    dn = DMM_DATA_NODES(data);
+    for (first = pvt->fields; first < end; ++first)
+        if (first->line >= 0)
+            DMM_DN_FILL_ADVANCE(dn, first->id, sizeof(uint64_t), &first->val);
+    DMM_DN_MKEND(dn);
+    DMM_DATA_SEND(data, pvt->hook);
+    DMM_DATA_UNREF(data);
+
+    return 0;
+}
+
+static int ctor(dmm_node_p node)
+{
+    struct pvt_data *pvt;
+    int i, err;
+
+    pvt = (struct pvt_data *)DMM_MALLOC(sizeof(*pvt));
+    if (pvt == NULL)
+        return ENOMEM;
+    pvt->hook = NULL;
+    pvt->fields = NULL;
+    pvt->num_fields = 0;
+    for (i = 0; i < NUM_SOURCES; ++i) {
+        sensorfile_init(&pvt->files[i]);
+        pvt->failed[i] = false;
+    }
+    if ((err = set_fields(pvt, NULL, 0)) != 0) {
+        DMM_FREE(pvt);
+        return err;
+    }
+    DMM_NODE_SETPRIVATE(node, pvt);
+    return 0;
+}
+
+static void dtor(dmm_node_p node)
+{
+    struct pvt_data *pvt;
+    int i;
+
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
+    for (i = 0; i < NUM_SOURCES; ++i)
+        sensorfile_close(&pvt->files[i]);
+    DMM_FREE(pvt->fields);
+    DMM_FREE(pvt);
+}
+
+static int newhook(dmm_hook_p hook)
+{
+    struct pvt_data *pvt;
+
+    if (DMM_HOOK_ISIN(hook))
+        return EINVAL;
+    if (strcmp(HOOKNAME, DMM_HOOK_NAME(hook)) != 0)
+        return EINVAL;
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(DMM_HOOK_NODE(hook));
+    pvt->hook = hook;
+
+    return 0;
+}
+
+static void rmhook(dmm_hook_p hook)
+{
+    struct pvt_data *pvt;
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(DMM_HOOK_NODE(hook));
+    pvt->hook = NULL;
+}
+
+static int rcvmsg(dmm_node_p node, dmm_msg_p msg)
+{
+    struct pvt_data *pvt;
+    dmm_msg_p resp;
+    int err = 0;
+
+#define CREATE_SEND_EMPTY_RESP()                                    \
+        do {                                                        \
+            resp = DMM_MSG_CREATE_RESP(DMM_NODE_ID(node), msg, 0);  \
+            if (resp != NULL) {                                     \
+                if (err != 0)                                       \
+                    msg->cm_flags |= DMM_MSG_ERR;                   \
+                                                                    \
+                DMM_MSG_SEND_ID(msg->cm_src, resp);                 \
+            } else                                                  \
+                err = (err != 0) ? err : ENOMEM;                    \
+        } while (0)
+
+    if (msg->cm_flags & DMM_MSG_RESP)
+        goto err;
+
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
+    switch (msg->cm_type) {
+    case DMM_MSGTYPE_GENERIC:
+        /* Accept only TIMERTRIGGER messages */
+        if (msg->cm_cmd != DMM_MSG_TIMERTRIGGER) {
+            err = ENOTSUP;
+            break;
+        }
+        // Nowhere to send, so why bother?
+        if (pvt->hook != NULL)
+            err = process_timer_msg(pvt);
+        break;
+
+    case DMM_MSGTYPE_NETPROTO:
+        switch (msg->cm_cmd) {
+        case DMM_MSG_NETPROTO_SET: {
+            struct dmm_msg_netproto_set *set = DMM_MSG_DATA(msg, struct dmm_msg_netproto_set);
+            dmm_size_t num_fields;
+
+            num_fields = (msg->cm_len - sizeof(struct dmm_msg_netproto_set)) / sizeof(struct dmm_netproto_field);
+            err = set_fields(pvt, set->fields, num_fields);
+            CREATE_SEND_EMPTY_RESP();
+            break;
+        }
+
+        default:
+            err = ENOTSUP;
+            break;
+        }
+        break;
+
+    default:
+        err = ENOTSUP;
+        break;
+    }
+
+#undef CREATE_SEND_EMPTY_RESP
+
+err:
+    DMM_MSG_FREE(msg);
+    return err;
+}
+
+static struct dmm_type type = {
+    "netproto",
+    ctor,
+    dtor,
+    NULL,
+    rcvmsg,
+    newhook,
+    rmhook,
+    {},
+};
+
+DMM_MODULE_DECLARE(&type);
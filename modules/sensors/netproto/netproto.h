@@ -0,0 +1,41 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+#ifndef MODULES_NETPROTO_NETPROTO_H_
+#define MODULES_NETPROTO_NETPROTO_H_
+
+#include "dmm_types.h"
+
+enum {
+    DMM_MSGTYPE_NETPROTO = 0x25e48e9e
+};
+
+enum {
+    DMM_MSG_NETPROTO_SET = 1,
+};
+
+enum { DMM_NETPROTO_NAMESIZE = 64 };
+
+/*
+ * Field name is <group>.<counter> as in header lines of /proc/net/snmp
+ * and /proc/net/netstat, e.g. Tcp.RetransSegs or TcpExt.ListenDrops.
+ * Groups ending in "Ext" are looked up in netstat, others in snmp.
+ * Negative values (Tcp.MaxConn) are sent as two's complement.
+ */
+struct dmm_netproto_field {
+    dmm_sensorid_t id;
+    char           name[DMM_NETPROTO_NAMESIZE];
+};
+
+/*
+ * Replace the set of fields to send, empty list selects the default
+ * set (see sensors.h). Malformed field names are rejected, fields missing
+ * in the running kernel are reported once and not sent.
+ */
+struct dmm_msg_netproto_set {
+    char                      dummy;
+    struct dmm_netproto_field fields[];
+};
+
+#endif /* MODULES_NETPROTO_NETPROTO_H_ */
@@ -0,0 +1,32 @@
+-- SPDX-License-Identifier: BSD-2-Clause-Views
+-- Copyright (c) 2013-2023
+--   Research Computing Center Lomonosov Moscow State University
+
+local dmm = require('dmm')
+
+assert(dmm.require_interface('netproto', 'll'))
+
+local Netproto = dmm.Module:new_type('netproto')
+
+--! @brief Select fields to send
+--! @param fields 'default' or list of {sensor_id, name} pairs, e.g.
+--! {{2300, 'Udp.InCsumErrors'}, {2301, 'TcpExt.TCPLostRetransmit'}},
+--! see netproto.h for field names
+function Netproto:set(fields)
+  local n = (fields == 'default') and 0 or #fields
+  local msg, set = dmm.msg_create {
+    len = dmm.sfam.struct_sizeof('struct dmm_msg_netproto_set', 'fields', n),
+    payload_type = 'struct dmm_msg_netproto_set',
+    type = ffi.C.DMM_MSGTYPE_NETPROTO,
+    cmd = ffi.C.DMM_MSG_NETPROTO_SET,
+  }
+  for i = 1, n do
+    local id, name = fields[i][1], fields[i][2]
+    assert(#name < ffi.C.DMM_NETPROTO_NAMESIZE, 'field name is too long')
+    set.fields[i - 1].id = id
+    set.fields[i - 1].name = name
+  end
+  dmm.msg_send(self.nodeid, msg)
+end
+
+return Netproto
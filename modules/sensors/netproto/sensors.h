@@ -0,0 +1,35 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+#ifndef MODULES_NETPROTO_SENSORS_H_
+#define MODULES_NETPROTO_SENSORS_H_
+
+/*
+ * Sensor ids of the default field set, all values are uint64_t.
+ * Fields selected with DMM_MSG_NETPROTO_SET get ids given in the message.
+ */
+enum {
+    /* Tcp.{InSegs,OutSegs,RetransSegs,InErrs,EstabResets,CurrEstab} */
+    NETPROTO_TCP_IN_SEGS = 1700,
+    NETPROTO_TCP_OUT_SEGS,
+    NETPROTO_TCP_RETRANS_SEGS,
+    NETPROTO_TCP_IN_ERRS,
+    NETPROTO_TCP_ESTAB_RESETS,
+    NETPROTO_TCP_CURR_ESTAB,
+    /* Udp.{InDatagrams,OutDatagrams,InErrors,RcvbufErrors,SndbufErrors} */
+    NETPROTO_UDP_IN_DATAGRAMS,
+    NETPROTO_UDP_OUT_DATAGRAMS,
+    NETPROTO_UDP_IN_ERRORS,
+    NETPROTO_UDP_RCVBUF_ERRORS,
+    NETPROTO_UDP_SNDBUF_ERRORS,
+    /* Ip.{InDiscards,ReasmFails} */
+    NETPROTO_IP_IN_DISCARDS,
+    NETPROTO_IP_REASM_FAILS,
+    /* TcpExt.{ListenOverflows,ListenDrops,TCPTimeouts} */
+    NETPROTO_TCPEXT_LISTEN_OVERFLOWS,
+    NETPROTO_TCPEXT_LISTEN_DROPS,
+    NETPROTO_TCPEXT_TCP_TIMEOUTS
+};
+
+#endif /* MODULES_NETPROTO_SENSORS_H_ */
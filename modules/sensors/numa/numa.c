@@ -0,0 +1,575 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+/*
+ * numa sends per-node vectors of selected fields of
+ * root/devices/system/node/node<N>/meminfo and numastat.
+ *
+ * Files of all nodes are opened once and reread with sensorfile.
+ * All nodes share the same file layout, so the first parse resolves the
+ * field of every line by name, and later ticks only check that the line
+ * still carries the expected name. If it does not, the layout is
+ * resolved again from the file at hand.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dmm_base.h"
+#include "dmm_log.h"
+#include "dmm_message.h"
+#include "../sensorfile.h"
+#include "numa.h"
+#include "sensors.h"
+
+#define HOOKNAME "out"
+
+#define DEFAULT_ROOT "/sys"
+
+#define NODE_DIR "devices/system/node"
+
+#define NUM_FIELDS (NUMA_OTHER_NODE - NUMA_MEMTOTAL + 1)
+
+enum {
+    SRC_MEMINFO,
+    SRC_NUMASTAT,
+    NUM_SOURCES
+};
+
+static const char *source_files[NUM_SOURCES] = {
+    "meminfo",
+    "numastat",
+};
+
+struct field {
+    const char *header;
+    size_t      len;
+    int         source;
+    bool        convert_from_k;
+};
+
+#define FIELD(id, header, source, convert_from_k) \
+    [(id) - NUMA_MEMTOTAL] = { (header), sizeof(header) - 1, (source), (convert_from_k) }
+
+#define MEMINFO(id, header, convert_from_k) FIELD(id, header, SRC_MEMINFO, convert_from_k)
+#define NUMASTAT(id, header) FIELD(id, header, SRC_NUMASTAT, false)
+
+/* Indexed by sensor id - NUMA_MEMTOTAL, names as in /proc/meminfo and numastat */
+static const struct field fields[NUM_FIELDS] = {
+    MEMINFO(NUMA_MEMTOTAL,          "MemTotal",             true),
+    MEMINFO(NUMA_MEMFREE,           "MemFree",              true),
+    MEMINFO(NUMA_MEMAVAILABLE,      "MemAvailable",         true),
+    MEMINFO(NUMA_BUFFERS,           "Buffers",              true),
+    MEMINFO(NUMA_CACHED,            "Cached",               true),
+    MEMINFO(NUMA_SWAPCACHED,        "SwapCached",           true),
+    MEMINFO(NUMA_ACTIVE,            "Active",               true),
+    MEMINFO(NUMA_INACTIVE,          "Inactive",             true),
+    MEMINFO(NUMA_ACTIVE_ANON,       "Active(anon)",         true),
+    MEMINFO(NUMA_INACTIVE_ANON,     "Inactive(anon)",       true),
+    MEMINFO(NUMA_ACTIVE_FILE,       "Active(file)",         true),
+    MEMINFO(NUMA_INACTIVE_FILE,     "Inactive(file)",       true),
+    MEMINFO(NUMA_UNEVICTABLE,       "Unevictable",          true),
+    MEMINFO(NUMA_MLOCKED,           "Mlocked",              true),
+    MEMINFO(NUMA_SWAPTOTAL,         "SwapTotal",            true),
+    MEMINFO(NUMA_SWAPFREE,          "SwapFree",             true),
+    MEMINFO(NUMA_DIRTY,             "Dirty",                true),
+    MEMINFO(NUMA_WRITEBACK,         "Writeback",            true),
+    MEMINFO(NUMA_ANONPAGES,         "AnonPages",            true),
+    MEMINFO(NUMA_MAPPED,            "Mapped",               true),
+    MEMINFO(NUMA_SHMEM,             "Shmem",                true),
+    MEMINFO(NUMA_SLAB,              "Slab",                 true),
+    MEMINFO(NUMA_SRECLAIMABLE,      "SReclaimable",         true),
+    MEMINFO(NUMA_SUNRECLAIM,        "SUnreclaim",           true),
+    MEMINFO(NUMA_KERNELSTACK,       "KernelStack",          true),
+    MEMINFO(NUMA_PAGETABLES,        "PageTables",           true),
+    MEMINFO(NUMA_NFS_UNSTABLE,      "NFS_Unstable",         true),
+    MEMINFO(NUMA_BOUNCE,            "Bounce",               true),
+    MEMINFO(NUMA_WRITEBACKTMP,      "WritebackTmp",         true),
+    MEMINFO(NUMA_COMMITLIMIT,       "CommitLimit",          true),
+    MEMINFO(NUMA_COMMITTED_AS,      "Committed_AS",         true),
+    MEMINFO(NUMA_VMALLOCTOTAL,      "VmallocTotal",         true),
+    MEMINFO(NUMA_VMALLOCUSED,       "VmallocUsed",          true),
+    MEMINFO(NUMA_VMALLOCCHUNK,      "VmallocChunk",         true),
+    MEMINFO(NUMA_HARDWARECORRUPTED, "HardwareCorrupted",    true),
+    MEMINFO(NUMA_ANONHUGEPAGES,     "AnonHugePages",        true),
+    MEMINFO(NUMA_CMATOTAL,          "CmaTotal",             true),
+    MEMINFO(NUMA_CMAFREE,           "CmaFree",              true),
+    MEMINFO(NUMA_HUGEPAGES_TOTAL,   "HugePages_Total",      false),
+    MEMINFO(NUMA_HUGEPAGES_FREE,    "HugePages_Free",       false),
+    MEMINFO(NUMA_HUGEPAGES_RSVD,    "HugePages_Rsvd",       false),
+    MEMINFO(NUMA_HUGEPAGES_SURP,    "HugePages_Surp",       false),
+    MEMINFO(NUMA_HUGEPAGESIZE,      "Hugepagesize",         true),
+    MEMINFO(NUMA_DIRECTMAP4K,       "DirectMap4k",          true),
+    MEMINFO(NUMA_DIRECTMAP2M,       "DirectMap2M",          true),
+    MEMINFO(NUMA_MEMUSED,           "MemUsed",              true),
+    MEMINFO(NUMA_FILEPAGES,         "FilePages",            true),
+    NUMASTAT(NUMA_NUMA_HIT,         "numa_hit"),
+    NUMASTAT(NUMA_NUMA_MISS,        "numa_miss"),
+    NUMASTAT(NUMA_NUMA_FOREIGN,     "numa_foreign"),
+    NUMASTAT(NUMA_INTERLEAVE_HIT,   "interleave_hit"),
+    NUMASTAT(NUMA_LOCAL_NODE,       "local_node"),
+    NUMASTAT(NUMA_OTHER_NODE,       "other_node"),
+};
+
+/* Fields sent until DMM_MSG_NUMA_SET is received */
+static const dmm_sensorid_t default_fields[] = {
+    NUMA_MEMTOTAL,
+    NUMA_MEMFREE,
+    NUMA_MEMUSED,
+    NUMA_ACTIVE,
+    NUMA_INACTIVE,
+    NUMA_ANONPAGES,
+    NUMA_FILEPAGES,
+    NUMA_SHMEM,
+    NUMA_NUMA_HIT,
+    NUMA_NUMA_MISS,
+    NUMA_NUMA_FOREIGN,
+    NUMA_INTERLEAVE_HIT,
+    NUMA_LOCAL_NODE,
+    NUMA_OTHER_NODE,
+};
+
+struct node {
+    uint32_t id;
+    struct sensorfile files[NUM_SOURCES];
+};
+
+/* Field index of every line of a source file or -1 */
+struct layout {
+    int *line_field;
+    size_t num_lines;
+};
+
+struct pvt_data {
+    dmm_hook_p hook;
+    char root[DMM_NUMA_PATHSIZE];
+    bool scanned;
+    /* Sorted by node number */
+    struct node *nodes;
+    size_t num_nodes;
+    uint32_t *node_ids;
+    struct layout layouts[NUM_SOURCES];
+    bool selected[NUM_FIELDS];
+    /* Field is found in the layout */
+    bool present[NUM_FIELDS];
+    /* NUM_FIELDS vectors of num_nodes values */
+    uint64_t *values;
+};
+
+/* Return field name of the line and store its length, NULL if there is none */
+static const char *line_key(int src, const char *line, size_t *len)
+{
+    const char *s, *e;
+
+    s = line;
+    /* "Node 0 MemTotal:       16318480 kB" */
+    if (src == SRC_MEMINFO) {
+        s = sensorfile_skipblanks(sensorfile_skipfield(sensorfile_skipfield(s)));
+        for (e = s; *e != ':' && *e != '\n' && *e != '\0'; ++e)
+            ;
+        if (*e != ':')
+            return NULL;
+    } else {
+        for (e = s; *e != ' ' && *e != '\n' && *e != '\0'; ++e)
+            ;
+    }
+    if (e == s)
+        return NULL;
+    *len = (size_t)(e - s);
+    return s;
+}
+
+/* Resolve fields of lines of src from buf, return 0 or ENOMEM */
+static int resolve(struct pvt_data *pvt, int src, const char *buf)
+{
+    struct layout *l = &pvt->layouts[src];
+    const char *line, *key;
+    size_t n, len;
+    int i, *lf;
+
+    for (n = 0, line = buf; *line != '\0'; line = sensorfile_nextline(line))
+        n++;
+    if ((lf = (int *)DMM_MALLOC((n + 1) * sizeof(*lf))) == NULL)
+        return ENOMEM;
+    DMM_FREE(l->line_field);
+    l->line_field = lf;
+    l->num_lines = n;
+
+    for (i = 0; i < NUM_FIELDS; ++i)
+        if (fields[i].source == src)
+            pvt->present[i] = false;
+    for (n = 0, line = buf; *line != '\0'; line = sensorfile_nextline(line), ++n) {
+        lf[n] = -1;
+        if ((key = line_key(src, line, &len)) == NULL)
+            continue;
+        for (i = 0; i < NUM_FIELDS; ++i)
+            if (fields[i].source == src && fields[i].len == len &&
+                memcmp(fields[i].header, key, len) == 0) {
+                lf[n] = i;
+                pvt->present[i] = true;
+                break;
+            }
+    }
+    return 0;
+}
+
+/*
+ * Parse values of selected fields of node k from buf,
+ * return false if the layout does not match
+ */
+static bool parse(struct pvt_data *pvt, int src, size_t k, const char *buf)
+{
+    const struct layout *l = &pvt->layouts[src];
+    const struct field *f;
+    const char *line, *key;
+    uint64_t value;
+    size_t n, len;
+    int idx;
+
+    for (n = 0, line = buf; *line != '\0'; line = sensorfile_nextline(line), ++n) {
+        if (n >= l->num_lines)
+            return false;
+        if ((idx = l->line_field[n]) < 0 || !pvt->selected[idx])
+            continue;
+        f = &fields[idx];
+        if ((key = line_key(src, line, &len)) == NULL ||
+            len != f->len || memcmp(key, f->header, len) != 0)
+            return false;
+        /* Skip ':' of meminfo */
+        if (sensorfile_u64(key + len + (src == SRC_MEMINFO), &value) == NULL)
+            value = 0;
+        pvt->values[(size_t)idx * pvt->num_nodes + k] = value * (f->convert_from_k ? 1024 : 1);
+    }
+    return n == l->num_lines;
+}
+
+static void close_all(struct pvt_data *pvt)
+{
+    size_t i;
+    int src;
+
+    for (i = 0; i < pvt->num_nodes; ++i)
+        for (src = 0; src < NUM_SOURCES; ++src)
+            sensorfile_close(&pvt->nodes[i].files[src]);
+    for (src = 0; src < NUM_SOURCES; ++src) {
+        DMM_FREE(pvt->layouts[src].line_field);
+        pvt->layouts[src].line_field = NULL;
+        pvt->layouts[src].num_lines = 0;
+    }
+    DMM_FREE(pvt->nodes);
+    DMM_FREE(pvt->node_ids);
+    DMM_FREE(pvt->values);
+    pvt->nodes = NULL;
+    pvt->node_ids = NULL;
+    pvt->values = NULL;
+    pvt->num_nodes = 0;
+    pvt->scanned = false;
+}
+
+static int node_cmp(const void *a, const void *b)
+{
+    uint32_t na = ((const struct node *)a)->id;
+    uint32_t nb = ((const struct node *)b)->id;
+
+    return (na > nb) - (na < nb);
+}
+
+/* Open files of all nodes, return 0 or errno */
+static int scan(struct pvt_data *pvt)
+{
+    char path[PATH_MAX];
+    struct dirent *de;
+    struct node *nd;
+    size_t i, max = 0;
+    uint32_t num;
+    DIR *dir;
+    int src, err = 0;
+
+    snprintf(path, sizeof(path), "%s/" NODE_DIR, pvt->root);
+    if ((dir = opendir(path)) == NULL)
+        return errno;
+    while ((de = readdir(dir)) != NULL) {
+        if (!sensorfile_numbered(de->d_name, "node", &num))
+            continue;
+        if (pvt->num_nodes == max) {
+            max = max > 0 ? max * 2 : 8;
+            if ((nd = (struct node *)DMM_REALLOC(pvt->nodes, max * sizeof(*nd))) == NULL) {
+                err = ENOMEM;
+                break;
+            }
+            pvt->nodes = nd;
+        }
+        nd = &pvt->nodes[pvt->num_nodes];
+        nd->id = num;
+        for (src = 0; src < NUM_SOURCES; ++src) {
+            sensorfile_init(&nd->files[src]);
+            snprintf(path, sizeof(path), "%s/%s", de->d_name, source_files[src]);
+            if ((err = sensorfile_openat(&nd->files[src], dirfd(dir), path)) != 0)
+                break;
+        }
+        if (err != 0) {
+            for (src = 0; src < NUM_SOURCES; ++src)
+                sensorfile_close(&nd->files[src]);
+            /* numastat is missing on some architectures, skip such node */
+            err = 0;
+            continue;
+        }
+        pvt->num_nodes++;
+    }
+    closedir(dir);
+    if (err != 0)
+        return err;
+    if (pvt->num_nodes == 0)
+        return ENOENT;
+
+    qsort(pvt->nodes, pvt->num_nodes, sizeof(*pvt->nodes), node_cmp);
+    pvt->node_ids = (uint32_t *)DMM_MALLOC(pvt->num_nodes * sizeof(*pvt->node_ids));
+    pvt->values = (uint64_t *)DMM_MALLOC(NUM_FIELDS * pvt->num_nodes * sizeof(*pvt->values));
+    if (pvt->node_ids == NULL || pvt->values == NULL)
+        return ENOMEM;
+    for (i = 0; i < pvt->num_nodes; ++i)
+        pvt->node_ids[i] = pvt->nodes[i].id;
+    memset(pvt->values, 0, NUM_FIELDS * pvt->num_nodes * sizeof(*pvt->values));
+    pvt->scanned = true;
+    return 0;
+}
+
+/* Read and parse files of all nodes, return 0 or errno */
+static int read_nodes(struct pvt_data *pvt)
+{
+    struct sensorfile *sf;
+    size_t k;
+    int src, err;
+
+    for (k = 0; k < pvt->num_nodes; ++k)
+        for (src = 0; src < NUM_SOURCES; ++src) {
+            sf = &pvt->nodes[k].files[src];
+            if ((err = sensorfile_read(sf)) != 0)
+                return err;
+            if (pvt->layouts[src].line_field != NULL && parse(pvt, src, k, sf->buf))
+                continue;
+            if ((err = resolve(pvt, src, sf->buf)) != 0)
+                return err;
+            parse(pvt, src, k, sf->buf);
+        }
+    return 0;
+}
+
+static int process_timer_msg(struct pvt_data *pvt)
+{
+    dmm_data_p data;
+    dmm_datanode_p dn;
+    size_t i, n, nn;
+    int err;
+
+    if (!pvt->scanned && (err = scan(pvt)) != 0) {
+        char errbuf[128], *errmsg;
+        close_all(pvt);
+        errmsg = strerror_r(err, errbuf, sizeof(errbuf));
+        dmm_log(DMM_LOG_ERR, "numa: cannot scan %s/" NODE_DIR ": %s", pvt->root, errmsg);
+        return err;
+    }
+    if ((err = read_nodes(pvt)) != 0) {
+        char errbuf[128], *errmsg;
+        errmsg = strerror_r(err, errbuf, sizeof(errbuf));
+        /* Node went offline, rescan at the next tick */
+        dmm_log(DMM_LOG_WARN, "numa: cannot read node statistics: %s", errmsg);
+        close_all(pvt);
+        return 0;
+    }
+
+    nn = pvt->num_nodes;
+    n = 0;
+    for (i = 0; i < NUM_FIELDS; ++i)
+        n += pvt->selected[i] && pvt->present[i];
+    if ((data = DMM_DATA_CREATE_RAW(n + 1, nn * (n * sizeof(uint64_t) + sizeof(uint32_t)))) == NULL) {
+        dmm_log(DMM_LOG_ERR, "Cannot allocate memory for data");
+        return ENOMEM;
+    }
+    dn = DMM_DATA_NODES(data);
+    for (i = 0; i < NUM_FIELDS; ++i)
+        if (pvt->selected[i] && pvt->present[i])
+            DMM_DN_FILL_ADVANCE(dn, NUMA_MEMTOTAL + i, nn * sizeof(uint64_t), pvt->values + i * nn);
+    DMM_DN_FILL_ADVANCE(dn, NUMA_NODE_ID, nn * sizeof(uint32_t), pvt->node_ids);
+    DMM_DN_MKEND(dn);
+    DMM_DATA_SEND(data, pvt->hook);
+    DMM_DATA_UNREF(data);
+
+    return 0;
+}
+
+static void select_field(struct pvt_data *pvt, dmm_sensorid_t id)
+{
+    if (id >= NUMA_MEMTOTAL && id <= NUMA_OTHER_NODE)
+        pvt->selected[id - NUMA_MEMTOTAL] = true;
+}
+
+static int ctor(dmm_node_p node)
+{
+    struct pvt_data *pvt;
+    size_t i;
+    int src;
+
+    pvt = (struct pvt_data *)DMM_MALLOC(sizeof(*pvt));
+    if (pvt == NULL)
+        return ENOMEM;
+    pvt->hook = NULL;
+    strcpy(pvt->root, DEFAULT_ROOT);
+    pvt->scanned = false;
+    pvt->nodes = NULL;
+    pvt->num_nodes = 0;
+    pvt->node_ids = NULL;
+    pvt->values = NULL;
+    for (src = 0; src < NUM_SOURCES; ++src) {
+        pvt->layouts[src].line_field = NULL;
+        pvt->layouts[src].num_lines = 0;
+    }
+    memset(pvt->selected, 0, sizeof(pvt->selected));
+    memset(pvt->present, 0, sizeof(pvt->present));
+    for (i = 0; i < sizeof(default_fields) / sizeof(*default_fields); ++i)
+        select_field(pvt, default_fields[i]);
+    DMM_NODE_SETPRIVATE(node, pvt);
+    return 0;
+}
+
+static void dtor(dmm_node_p node)
+{
+    struct pvt_data *pvt;
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
+    close_all(pvt);
+    DMM_FREE(pvt);
+}
+
+static int newhook(dmm_hook_p hook)
+{
+    struct pvt_data *pvt;
+
+    if (DMM_HOOK_ISIN(hook))
+        return EINVAL;
+    if (strcmp(HOOKNAME, DMM_HOOK_NAME(hook)) != 0)
+        return EINVAL;
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(DMM_HOOK_NODE(hook));
+    pvt->hook = hook;
+
+    return 0;
+}
+
+static void rmhook(dmm_hook_p hook)
+{
+    struct pvt_data *pvt;
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(DMM_HOOK_NODE(hook));
+    pvt->hook = NULL;
+}
+
+static int rcvmsg(dmm_node_p node, dmm_msg_p msg)
+{
+    struct pvt_data *pvt;
+    dmm_msg_p resp;
+    int err = 0;
+
+#define CREATE_SEND_EMPTY_RESP()                                    \
+        do {                                                        \
+            resp = DMM_MSG_CREATE_RESP(DMM_NODE_ID(node), msg, 0);  \
+            if (resp != NULL) {                                     \
+                if (err != 0)                                       \
+                    msg->cm_flags |= DMM_MSG_ERR;                   \
+                                                                    \
+                DMM_MSG_SEND_ID(msg->cm_src, resp);                 \
+            } else                                                  \
+                err = (err != 0) ? err : ENOMEM;                    \
+        } while (0)
+
+    if (msg->cm_flags & DMM_MSG_RESP)
+        goto err;
+
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
+    switch (msg->cm_type) {
+    case DMM_MSGTYPE_GENERIC:
+        /* Accept only TIMERTRIGGER messages */
+        if (msg->cm_cmd != DMM_MSG_TIMERTRIGGER) {
+            err = ENOTSUP;
+            break;
+        }
+        // Nowhere to send, so why bother?
+        if (pvt->hook != NULL)
+            err = process_timer_msg(pvt);
+        break;
+
+    case DMM_MSGTYPE_NUMA:
+        switch (msg->cm_cmd) {
+        case DMM_MSG_NUMA_SET: {
+            struct dmm_msg_numa_set *set = DMM_MSG_DATA(msg, struct dmm_msg_numa_set);
+            dmm_size_t i, num_ranges;
+            dmm_sensorid_t id;
+
+            num_ranges = (msg->cm_len - sizeof(struct dmm_msg_numa_set)) / sizeof(struct dmm_sensorrange);
+            for (i = 0; i < num_ranges; ++i)
+                if (set->sensors[i].first > set->sensors[i].last)
+                    err = EINVAL;
+            if (err == 0) {
+                memset(pvt->selected, 0, sizeof(pvt->selected));
+                for (i = 0; i < num_ranges; ++i)
+                    for (id = NUMA_MEMTOTAL; id <= NUMA_OTHER_NODE; ++id)
+                        if (id >= set->sensors[i].first && id <= set->sensors[i].last)
+                            select_field(pvt, id);
+                if (num_ranges == 0)
+                    for (id = NUMA_MEMTOTAL; id <= NUMA_OTHER_NODE; ++id)
+                        select_field(pvt, id);
+            }
+            CREATE_SEND_EMPTY_RESP();
+            break;
+        }
+
+        case DMM_MSG_NUMA_SETROOT: {
+            struct dmm_msg_numa_setroot *sr;
+
+            sr = DMM_MSG_DATA(msg, struct dmm_msg_numa_setroot);
+            if (msg->cm_len != sizeof(*sr) ||
+                memchr(sr->root, '\0', sizeof(sr->root)) == NULL || sr->root[0] == '\0') {
+                err = EINVAL;
+            } else {
+                close_all(pvt);
+                strcpy(pvt->root, sr->root);
+            }
+            CREATE_SEND_EMPTY_RESP();
+            break;
+        }
+
+        default:
+            err = ENOTSUP;
+            break;
+        }
+        break;
+
+    default:
+        err = ENOTSUP;
+        break;
+    }
+
+#undef CREATE_SEND_EMPTY_RESP
+
+err:
+    DMM_MSG_FREE(msg);
+    return err;
+}
+
+static struct dmm_type type = {
+    "numa",
+    ctor,
+    dtor,
+    NULL,
+    rcvmsg,
+    newhook,
+    rmhook,
+    {},
+};
+
+DMM_MODULE_DECLARE(&type);
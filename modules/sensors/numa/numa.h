@@ -0,0 +1,38 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+#ifndef MODULES_NUMA_NUMA_H_
+#define MODULES_NUMA_NUMA_H_
+
+#include "dmm_base.h"
+#include "dmm_types.h"
+
+enum {
+    DMM_MSGTYPE_NUMA = 0x55d503aa
+};
+
+enum {
+    DMM_MSG_NUMA_SET = 1,
+    DMM_MSG_NUMA_SETROOT,
+};
+
+enum { DMM_NUMA_PATHSIZE = 256 };
+
+/*
+ * Select fields to send by their sensor ids
+ * (NUMA_MEMTOTAL..NUMA_OTHER_NODE, see sensors.h), same as
+ * DMM_MSG_MEMORY_SET. Empty list of ranges selects all fields.
+ * NUMA_NODE_ID is always sent
+ */
+struct dmm_msg_numa_set {
+    char                   dummy;
+    struct dmm_sensorrange sensors[];
+};
+
+/* Read root/devices/system/node/node*, root is /sys by default */
+struct dmm_msg_numa_setroot {
+    char root[DMM_NUMA_PATHSIZE];
+};
+
+#endif /* MODULES_NUMA_NUMA_H_ */
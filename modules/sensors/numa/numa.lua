@@ -0,0 +1,46 @@
+-- SPDX-License-Identifier: BSD-2-Clause-Views
+-- Copyright (c) 2013-2023
+--   Research Computing Center Lomonosov Moscow State University
+
+local dmm = require('dmm')
+
+assert(dmm.require_interface('numa', 'll'))
+
+local Numa = dmm.Module:new_type('numa')
+
+--! @brief Select per-node fields to send
+--! @param sensors 'all' or list of sensor ids and {first, last} id ranges,
+--! see sensor_ids.txt
+function Numa:set(sensors)
+  local n = (sensors == 'all') and 0 or #sensors
+  local msg, set = dmm.msg_create{
+    len = dmm.sfam.struct_sizeof('struct dmm_msg_numa_set', 'sensors', n),
+    payload_type = 'struct dmm_msg_numa_set',
+    type = ffi.C.DMM_MSGTYPE_NUMA,
+    cmd = ffi.C.DMM_MSG_NUMA_SET,
+  }
+  for i = 1, n do
+    local r = sensors[i]
+    if type(r) == 'table' then
+      set.sensors[i - 1] = {r[1], r[2]}
+    else
+      set.sensors[i - 1] = {r, r}
+    end
+  end
+  dmm.msg_send(self.nodeid, msg)
+end
+
+--! @brief Set sysfs root
+--! @param root '/sys' by default, e.g. a fixture tree for tests
+function Numa:setroot(root)
+  assert(#root < ffi.C.DMM_NUMA_PATHSIZE, 'root is too long')
+  local msg, sr = dmm.msg_create {
+    payload_type = 'struct dmm_msg_numa_setroot',
+    type = ffi.C.DMM_MSGTYPE_NUMA,
+    cmd = ffi.C.DMM_MSG_NUMA_SETROOT,
+  }
+  sr.root = root
+  dmm.msg_send(self.nodeid, msg)
+end
+
+return Numa
@@ -0,0 +1,75 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+#ifndef MODULES_NUMA_SENSORS_H_
+#define MODULES_NUMA_SENSORS_H_
+
+/*
+ * All sensors are vectors with one element per NUMA node in the order
+ * of NUMA_NODE_ID. Memory sensors follow the layout of memory sensor
+ * ids (NUMA_X = NUMA_MEMTOTAL + MEMORY_X - MEMORY_MEMTOTAL) and are
+ * uint64_t in bytes, except HugePages_* which are in pages.
+ * Fields missing in node meminfo (e.g. MemAvailable) are never sent.
+ */
+enum {
+    NUMA_MEMTOTAL = 1900,
+    NUMA_MEMFREE,
+    NUMA_MEMAVAILABLE,
+    NUMA_BUFFERS,
+    NUMA_CACHED,
+    NUMA_SWAPCACHED,
+    NUMA_ACTIVE,
+    NUMA_INACTIVE,
+    NUMA_ACTIVE_ANON,
+    NUMA_INACTIVE_ANON,
+    NUMA_ACTIVE_FILE,
+    NUMA_INACTIVE_FILE,
+    NUMA_UNEVICTABLE,
+    NUMA_MLOCKED,
+    NUMA_SWAPTOTAL,
+    NUMA_SWAPFREE,
+    NUMA_DIRTY,
+    NUMA_WRITEBACK,
+    NUMA_ANONPAGES,
+    NUMA_MAPPED,
+    NUMA_SHMEM,
+    NUMA_SLAB,
+    NUMA_SRECLAIMABLE,
+    NUMA_SUNRECLAIM,
+    NUMA_KERNELSTACK,
+    NUMA_PAGETABLES,
+    NUMA_NFS_UNSTABLE,
+    NUMA_BOUNCE,
+    NUMA_WRITEBACKTMP,
+    NUMA_COMMITLIMIT,
+    NUMA_COMMITTED_AS,
+    NUMA_VMALLOCTOTAL,
+    NUMA_VMALLOCUSED,
+    NUMA_VMALLOCCHUNK,
+    NUMA_HARDWARECORRUPTED,
+    NUMA_ANONHUGEPAGES,
+    NUMA_CMATOTAL,
+    NUMA_CMAFREE,
+    NUMA_HUGEPAGES_TOTAL,
+    NUMA_HUGEPAGES_FREE,
+    NUMA_HUGEPAGES_RSVD,
+    NUMA_HUGEPAGES_SURP,
+    NUMA_HUGEPAGESIZE,
+    NUMA_DIRECTMAP4K,
+    NUMA_DIRECTMAP2M,
+    /* Node meminfo only */
+    NUMA_MEMUSED,
+    NUMA_FILEPAGES,
+    /* numastat, pages */
+    NUMA_NUMA_HIT,
+    NUMA_NUMA_MISS,
+    NUMA_NUMA_FOREIGN,
+    NUMA_INTERLEAVE_HIT,
+    NUMA_LOCAL_NODE,
+    NUMA_OTHER_NODE,
+    /* uint32_t, node numbers */
+    NUMA_NODE_ID
+};
+
+#endif /* MODULES_NUMA_SENSORS_H_ */
@@ -0,0 +1,370 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+/*
+ * perfsw sends per-CPU counts of context switches, page faults and
+ * CPU migrations, and of cycles, instructions and cache misses where
+ * the hardware PMU is available.
+ *
+ * Events are opened with perf_event_open(2) for every CPU online at
+ * creation in two groups per CPU, software and hardware, so that PMU
+ * contention or multiplexing never stops software counters. Every
+ * group is read with a single read(2) (PERF_FORMAT_GROUP) into a buffer
+ * in pvt_data. Events which cannot be opened are reported once and
+ * skipped, counting system-wide requires perf_event_paranoid <= 0
+ * or CAP_PERFMON.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <linux/perf_event.h>
+
+#include "dmm_base.h"
+#include "dmm_log.h"
+#include "dmm_message.h"
+#include "../sensorfile.h"
+#include "sensors.h"
+
+#define HOOKNAME "out"
+
+#define ONLINE_FILE "/sys/devices/system/cpu/online"
+
+enum {
+    GROUP_SW,
+    GROUP_HW,
+    NUM_GROUPS
+};
+
+/* Indexed by sensor id - PERFSW_CONTEXT_SWITCHES */
+static const struct event {
+    int group;
+    uint32_t type;
+    uint64_t config;
+    const char *name;
+} events[] = {
+    { GROUP_SW, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, "context-switches" },
+    { GROUP_SW, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS,      "page-faults" },
+    { GROUP_SW, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS,   "cpu-migrations" },
+    { GROUP_HW, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES,       "cycles" },
+    { GROUP_HW, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,     "instructions" },
+    { GROUP_HW, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES,     "cache-misses" },
+};
+
+#define NUM_EVENTS (sizeof(events) / sizeof(events[0]))
+
+struct group {
+    /* Group leader or -1 if no event of the group is opened */
+    int leader;
+    /* Events in the order of values in read buffer */
+    unsigned events[NUM_EVENTS];
+    unsigned num_events;
+};
+
+struct cpu {
+    uint32_t id;
+    int fds[NUM_EVENTS];
+    struct group groups[NUM_GROUPS];
+};
+
+/* Layout of read(2) with PERF_FORMAT_GROUP and both TOTAL_TIME flags */
+struct group_read {
+    uint64_t nr;
+    uint64_t time_enabled;
+    uint64_t time_running;
+    uint64_t values[NUM_EVENTS];
+};
+
+struct pvt_data {
+    dmm_hook_p hook;
+    struct cpu *cpus;
+    unsigned num_cpus;
+    uint32_t *cpu_ids;
+    /* Event is opened on some CPU */
+    bool available[NUM_EVENTS];
+    unsigned num_available;
+    /* NUM_EVENTS vectors of num_cpus values */
+    uint64_t *values;
+    struct group_read buf;
+};
+
+static int perf_event_open(struct perf_event_attr *attr, int cpu, int group_fd)
+{
+    return (int)syscall(SYS_perf_event_open, attr, -1, cpu, group_fd, PERF_FLAG_FD_CLOEXEC);
+}
+
+/*
+ * Parse CPU list like "0-3,8,10-11" into cpus, return number of CPUs
+ * or -1 if there are more than max
+ */
+static int parse_cpulist(const char *s, uint32_t *cpus, unsigned max)
+{
+    uint64_t first, last, c;
+    unsigned n = 0;
+
+    while ((s = sensorfile_u64(s, &first)) != NULL) {
+        last = first;
+        if (*s == '-' && (s = sensorfile_u64(s + 1, &last)) == NULL)
+            break;
+        for (c = first; c <= last; ++c) {
+            if (n == max)
+                return -1;
+            cpus[n++] = (uint32_t)c;
+        }
+        if (*s != ',')
+            break;
+        s++;
+    }
+    return (int)n;
+}
+
+/* Open events of all CPUs, errors are reported once per event */
+static void open_events(struct pvt_data *pvt)
+{
+    struct perf_event_attr attr;
+    int errs[NUM_EVENTS];
+    struct group *g;
+    struct cpu *c;
+    unsigned i, e;
+    int fd;
+
+    for (e = 0; e < NUM_EVENTS; ++e)
+        errs[e] = 0;
+    for (i = 0; i < pvt->num_cpus; ++i) {
+        c = &pvt->cpus[i];
+        for (e = 0; e < NUM_EVENTS; ++e) {
+            g = &c->groups[events[e].group];
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = events[e].type;
+            attr.config = events[e].config;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                               PERF_FORMAT_TOTAL_TIME_RUNNING;
+            if ((fd = perf_event_open(&attr, (int)c->id, g->leader)) < 0) {
+                errs[e] = errno;
+                continue;
+            }
+            c->fds[e] = fd;
+            if (g->leader < 0)
+                g->leader = fd;
+            g->events[g->num_events++] = e;
+            if (!pvt->available[e]) {
+                pvt->available[e] = true;
+                pvt->num_available++;
+            }
+        }
+    }
+    for (e = 0; e < NUM_EVENTS; ++e)
+        if (!pvt->available[e] && errs[e] != 0) {
+            char errbuf[128], *errmsg;
+            errmsg = strerror_r(errs[e], errbuf, sizeof(errbuf));
+            dmm_log(DMM_LOG_WARN, "perfsw: event %s is not available: %s",
+                    events[e].name, errmsg);
+        }
+}
+
+static void close_events(struct pvt_data *pvt)
+{
+    unsigned i, e;
+
+    for (i = 0; i < pvt->num_cpus; ++i)
+        for (e = 0; e < NUM_EVENTS; ++e)
+            if (pvt->cpus[i].fds[e] >= 0)
+                close(pvt->cpus[i].fds[e]);
+}
+
+/* Read group of CPU k into values, keep old values if it did not run */
+static void read_group(struct pvt_data *pvt, unsigned k, const struct group *g)
+{
+    struct group_read *r = &pvt->buf;
+    ssize_t len;
+    uint64_t v;
+    unsigned i;
+
+    len = read(g->leader, r, sizeof(*r));
+    if (len < (ssize_t)(3 + g->num_events) * (ssize_t)sizeof(uint64_t) ||
+        r->nr != g->num_events || r->time_running == 0)
+        return;
+    for (i = 0; i < g->num_events; ++i) {
+        v = r->values[i];
+        /* Estimate the full count of multiplexed events */
+        if (r->time_running < r->time_enabled)
+            v = (uint64_t)((double)v * r->time_enabled / r->time_running);
+        pvt->values[g->events[i] * pvt->num_cpus + k] = v;
+    }
+}
+
+static int process_timer_msg(dmm_node_p node)
+{
+    struct pvt_data *pvt;
+    dmm_data_p data;
+    dmm_datanode_p dn;
+    unsigned i, e, nc;
+
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
+    if (pvt->hook == NULL || pvt->num_available == 0)
+        return 0;
+
+    nc = pvt->num_cpus;
+    for (i = 0; i < nc; ++i)
+        for (e = 0; e < NUM_GROUPS; ++e)
+            if (pvt->cpus[i].groups[e].leader >= 0)
+                read_group(pvt, i, &pvt->cpus[i].groups[e]);
+
+    data = DMM_DATA_CREATE_RAW(pvt->num_available + 1,
+                               nc * (pvt->num_available * sizeof(uint64_t) + sizeof(uint32_t)));
+    if (data == NULL) {
+        dmm_log(DMM_LOG_ERR, "Cannot allocate memory for data");
+        return ENOMEM;
+    }
+    dn = DMM_DATA_NODES(data);
+    for (e = 0; e < NUM_EVENTS; ++e)
+        if (pvt->available[e])
+            DMM_DN_FILL_ADVANCE(dn, PERFSW_CONTEXT_SWITCHES + e, nc * sizeof(uint64_t),
+                                pvt->values + e * nc);
+    DMM_DN_FILL_ADVANCE(dn, PERFSW_CPU_ID, nc * sizeof(uint32_t), pvt->cpu_ids);
+    DMM_DN_MKEND(dn);
+    DMM_DATA_SEND(data, pvt->hook);
+    DMM_DATA_UNREF(data);
+
+    return 0;
+}
+
+static int ctor(dmm_node_p node)
+{
+    struct pvt_data *pvt;
+    struct sensorfile sf;
+    unsigned i, e;
+    long max_cpus;
+    int n, err;
+
+    pvt = (struct pvt_data *)DMM_MALLOC(sizeof(*pvt));
+    if (pvt == NULL)
+        return ENOMEM;
+    pvt->hook = NULL;
+    pvt->num_available = 0;
+    for (e = 0; e < NUM_EVENTS; ++e)
+        pvt->available[e] = false;
+
+    sensorfile_init(&sf);
+    if ((err = sensorfile_open(&sf, ONLINE_FILE)) != 0 || (err = sensorfile_read(&sf)) != 0) {
+        char errbuf[128], *errmsg;
+        errmsg = strerror_r(err, errbuf, sizeof(errbuf));
+        dmm_log(DMM_LOG_ERR, "perfsw: cannot read %s: %s", ONLINE_FILE, errmsg);
+        sensorfile_close(&sf);
+        DMM_FREE(pvt);
+        return err;
+    }
+    if ((max_cpus = sysconf(_SC_NPROCESSORS_CONF)) < 1)
+        max_cpus = 1;
+    pvt->cpu_ids = (uint32_t *)DMM_MALLOC(max_cpus * sizeof(*pvt->cpu_ids));
+    if (pvt->cpu_ids == NULL) {
+        sensorfile_close(&sf);
+        DMM_FREE(pvt);
+        return ENOMEM;
+    }
+    n = parse_cpulist(sf.buf, pvt->cpu_ids, (unsigned)max_cpus);
+    sensorfile_close(&sf);
+    if (n <= 0) {
+        dmm_log(DMM_LOG_ERR, "perfsw: cannot parse %s", ONLINE_FILE);
+        DMM_FREE(pvt->cpu_ids);
+        DMM_FREE(pvt);
+        return EINVAL;
+    }
+    pvt->num_cpus = (unsigned)n;
+
+    pvt->cpus = (struct cpu *)DMM_MALLOC(pvt->num_cpus * sizeof(*pvt->cpus));
+    pvt->values = (uint64_t *)DMM_MALLOC(NUM_EVENTS * pvt->num_cpus * sizeof(*pvt->values));
+    if (pvt->cpus == NULL || pvt->values == NULL) {
+        DMM_FREE(pvt->cpus);
+        DMM_FREE(pvt->values);
+        DMM_FREE(pvt->cpu_ids);
+        DMM_FREE(pvt);
+        return ENOMEM;
+    }
+    memset(pvt->values, 0, NUM_EVENTS * pvt->num_cpus * sizeof(*pvt->values));
+    for (i = 0; i < pvt->num_cpus; ++i) {
+        pvt->cpus[i].id = pvt->cpu_ids[i];
+        for (e = 0; e < NUM_EVENTS; ++e)
+            pvt->cpus[i].fds[e] = -1;
+        for (e = 0; e < NUM_GROUPS; ++e) {
+            pvt->cpus[i].groups[e].leader = -1;
+            pvt->cpus[i].groups[e].num_events = 0;
+        }
+    }
+    open_events(pvt);
+    DMM_NODE_SETPRIVATE(node, pvt);
+    return 0;
+}
+
+static void dtor(dmm_node_p node)
+{
+    struct pvt_data *pvt;
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
+    close_events(pvt);
+    DMM_FREE(pvt->cpus);
+    DMM_FREE(pvt->values);
+    DMM_FREE(pvt->cpu_ids);
+    DMM_FREE(pvt);
+}
+
+static int newhook(dmm_hook_p hook)
+{
+    struct pvt_data *pvt;
+
+    if (DMM_HOOK_ISIN(hook))
+        return EINVAL;
+    if (strcmp(HOOKNAME, DMM_HOOK_NAME(hook)) != 0)
+        return EINVAL;
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(DMM_HOOK_NODE(hook));
+    pvt->hook = hook;
+
+    return 0;
+}
+
+static void rmhook(dmm_hook_p hook)
+{
+    struct pvt_data *pvt;
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(DMM_HOOK_NODE(hook));
+    pvt->hook = NULL;
+}
+
+static int rcvmsg(dmm_node_p node, dmm_msg_p msg)
+{
+    int err = 0;
+
+    /* Accept only generic messages */
+    if (msg->cm_type != DMM_MSGTYPE_GENERIC) {
+        err = ENOTSUP;
+        goto err;
+    }
+    /* Accept only TIMERTRIGGER messages */
+    if (msg->cm_cmd != DMM_MSG_TIMERTRIGGER) {
+        err = ENOTSUP;
+        goto err;
+    }
+    err = process_timer_msg(node);
+
+err:
+    DMM_MSG_FREE(msg);
+    return err;
+}
+
+static struct dmm_type type = {
+    "perfsw",
+    ctor,
+    dtor,
+    NULL,
+    rcvmsg,
+    newhook,
+    rmhook,
+    {},
+};
+
+DMM_MODULE_DECLARE(&type);
@@ -0,0 +1,25 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+#ifndef MODULES_PERFSW_SENSORS_H_
+#define MODULES_PERFSW_SENSORS_H_
+
+/*
+ * Counters are uint64_t vectors with one element per CPU in the order
+ * of PERFSW_CPU_ID, they count from module creation and are scaled
+ * for multiplexing. Events which cannot be opened on any CPU
+ * (e.g. hardware events in VMs) are not sent.
+ */
+enum {
+    PERFSW_CONTEXT_SWITCHES = 2000,
+    PERFSW_PAGE_FAULTS,
+    PERFSW_CPU_MIGRATIONS,
+    PERFSW_CPU_CYCLES,
+    PERFSW_INSTRUCTIONS,
+    PERFSW_CACHE_MISSES,
+    /* uint32_t */
+    PERFSW_CPU_ID
+};
+
+#endif /* MODULES_PERFSW_SENSORS_H_ */
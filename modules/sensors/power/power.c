@@ -0,0 +1,463 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+/*
+ * power sends RAPL package energy from powercap
+ * (/sys/class/powercap/intel-rapl:N/energy_uj) and current CPU
+ * frequencies from cpufreq (/sys/devices/system/cpu/cpuN/cpufreq/
+ * scaling_cur_freq).
+ *
+ * Files are found and opened at the first tick (or after the root
+ * is changed), looked for again on every tick while none is found,
+ * and reread with pread(2). RAPL counters wrap around
+ * at max_energy_range_uj, the sensor accumulates differences between
+ * ticks, so sent energy values only grow (provided ticks are more
+ * frequent than wraparounds, which take minutes at full load).
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dmm_base.h"
+#include "dmm_log.h"
+#include "dmm_message.h"
+#include "../sensorfile.h"
+#include "power.h"
+#include "sensors.h"
+
+#define HOOKNAME "out"
+
+#define DEFAULT_ROOT "/sys"
+
+#define POWERCAP_DIR "class/powercap"
+#define CPU_DIR      "devices/system/cpu"
+
+struct zone {
+    struct dmm_power_zone id;
+    int fd;
+    uint64_t max_range;
+    /* Last raw counter value */
+    uint64_t prev;
+    bool prev_valid;
+};
+
+struct cpu {
+    uint32_t id;
+    int fd;
+};
+
+struct pvt_data {
+    dmm_hook_p hook;
+    char root[DMM_POWER_PATHSIZE];
+    bool scanned;
+    /* Sorted by zone number */
+    struct zone *zones;
+    size_t num_zones;
+    /* Accumulated energy and zone descriptions, num_zones elements */
+    uint64_t *energy;
+    struct dmm_power_zone *zone_ids;
+    /* Zones changed since POWER_ZONES was sent last time */
+    bool changed;
+    /* Sorted by CPU number */
+    struct cpu *cpus;
+    size_t num_cpus;
+    uint64_t *freqs;
+    uint32_t *cpu_ids;
+    /* Do not repeat warning about missing RAPL and cpufreq on every tick */
+    bool warned;
+};
+
+static void close_all(struct pvt_data *pvt)
+{
+    size_t i;
+
+    for (i = 0; i < pvt->num_zones; ++i)
+        close(pvt->zones[i].fd);
+    for (i = 0; i < pvt->num_cpus; ++i)
+        close(pvt->cpus[i].fd);
+    DMM_FREE(pvt->zones);
+    DMM_FREE(pvt->energy);
+    DMM_FREE(pvt->zone_ids);
+    DMM_FREE(pvt->cpus);
+    DMM_FREE(pvt->freqs);
+    DMM_FREE(pvt->cpu_ids);
+    pvt->zones = NULL;
+    pvt->energy = NULL;
+    pvt->zone_ids = NULL;
+    pvt->num_zones = 0;
+    pvt->cpus = NULL;
+    pvt->freqs = NULL;
+    pvt->cpu_ids = NULL;
+    pvt->num_cpus = 0;
+    pvt->scanned = false;
+    pvt->changed = true;
+}
+
+static int zone_cmp(const void *a, const void *b)
+{
+    uint32_t na = 0, nb = 0;
+
+    sensorfile_numbered(((const struct zone *)a)->id.zone, "intel-rapl:", &na);
+    sensorfile_numbered(((const struct zone *)b)->id.zone, "intel-rapl:", &nb);
+    return na < nb ? -1 : na > nb;
+}
+
+static int cpu_cmp(const void *a, const void *b)
+{
+    uint32_t na = ((const struct cpu *)a)->id, nb = ((const struct cpu *)b)->id;
+    return na < nb ? -1 : na > nb;
+}
+
+/* Open energy counters of RAPL packages (top level zones) */
+static int scan_zones(struct pvt_data *pvt)
+{
+    char path[PATH_MAX];
+    struct dirent *de;
+    struct zone *z;
+    size_t max = 0;
+    uint32_t num;
+    DIR *dir;
+    int fd, err = 0;
+
+    snprintf(path, sizeof(path), "%s/" POWERCAP_DIR, pvt->root);
+    if ((dir = opendir(path)) == NULL)
+        return 0;
+    while ((de = readdir(dir)) != NULL) {
+        if (!sensorfile_numbered(de->d_name, "intel-rapl:", &num) ||
+            strlen(de->d_name) >= DMM_POWER_NAMESIZE)
+            continue;
+        if ((fd = openat(dirfd(dir), de->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+            continue;
+        if (pvt->num_zones == max) {
+            max = max > 0 ? max * 2 : 4;
+            if ((z = (struct zone *)DMM_REALLOC(pvt->zones, max * sizeof(*z))) == NULL) {
+                close(fd);
+                err = ENOMEM;
+                break;
+            }
+            pvt->zones = z;
+        }
+        z = &pvt->zones[pvt->num_zones];
+        memset(&z->id, 0, sizeof(z->id));
+        strcpy(z->id.zone, de->d_name);
+        sensorfile_readline(fd, "name", z->id.name, sizeof(z->id.name));
+        z->prev_valid = false;
+        z->max_range = 0;
+        z->fd = openat(fd, "max_energy_range_uj", O_RDONLY | O_CLOEXEC);
+        if (z->fd >= 0) {
+            sensorfile_pread_u64(z->fd, &z->max_range);
+            close(z->fd);
+        }
+        /* energy_uj is readable only by root on recent kernels */
+        if ((z->fd = openat(fd, "energy_uj", O_RDONLY | O_CLOEXEC)) < 0) {
+            char errbuf[128], *errmsg;
+            errmsg = strerror_r(errno, errbuf, sizeof(errbuf));
+            dmm_log(DMM_LOG_WARN, "power: cannot open %s/%s/energy_uj: %s", path, de->d_name, errmsg);
+        } else {
+            pvt->num_zones++;
+        }
+        close(fd);
+    }
+    closedir(dir);
+    if (err != 0 || pvt->num_zones == 0)
+        return err;
+
+    qsort(pvt->zones, pvt->num_zones, sizeof(*pvt->zones), zone_cmp);
+    pvt->energy = (uint64_t *)DMM_MALLOC(pvt->num_zones * sizeof(*pvt->energy));
+    pvt->zone_ids = (struct dmm_power_zone *)DMM_MALLOC(pvt->num_zones * sizeof(*pvt->zone_ids));
+    if (pvt->energy == NULL || pvt->zone_ids == NULL)
+        return ENOMEM;
+    for (max = 0; max < pvt->num_zones; ++max) {
+        pvt->energy[max] = 0;
+        pvt->zone_ids[max] = pvt->zones[max].id;
+    }
+    return 0;
+}
+
+/* Open current frequency files of all CPUs with cpufreq */
+static int scan_cpus(struct pvt_data *pvt)
+{
+    char path[PATH_MAX];
+    struct dirent *de;
+    struct cpu *c;
+    size_t i, max = 0;
+    uint32_t num;
+    DIR *dir;
+    int fd, err = 0;
+
+    snprintf(path, sizeof(path), "%s/" CPU_DIR, pvt->root);
+    if ((dir = opendir(path)) == NULL)
+        return 0;
+    while ((de = readdir(dir)) != NULL) {
+        if (!sensorfile_numbered(de->d_name, "cpu", &num))
+            continue;
+        snprintf(path, sizeof(path), "%s/cpufreq/scaling_cur_freq", de->d_name);
+        if ((fd = openat(dirfd(dir), path, O_RDONLY | O_CLOEXEC)) < 0)
+            continue;
+        if (pvt->num_cpus == max) {
+            max = max > 0 ? max * 2 : 64;
+            if ((c = (struct cpu *)DMM_REALLOC(pvt->cpus, max * sizeof(*c))) == NULL) {
+                close(fd);
+                err = ENOMEM;
+                break;
+            }
+            pvt->cpus = c;
+        }
+        pvt->cpus[pvt->num_cpus].id = num;
+        pvt->cpus[pvt->num_cpus++].fd = fd;
+    }
+    closedir(dir);
+    if (err != 0 || pvt->num_cpus == 0)
+        return err;
+
+    qsort(pvt->cpus, pvt->num_cpus, sizeof(*pvt->cpus), cpu_cmp);
+    pvt->freqs = (uint64_t *)DMM_MALLOC(pvt->num_cpus * sizeof(*pvt->freqs));
+    pvt->cpu_ids = (uint32_t *)DMM_MALLOC(pvt->num_cpus * sizeof(*pvt->cpu_ids));
+    if (pvt->freqs == NULL || pvt->cpu_ids == NULL)
+        return ENOMEM;
+    for (i = 0; i < pvt->num_cpus; ++i)
+        pvt->cpu_ids[i] = pvt->cpus[i].id;
+    return 0;
+}
+
+static int scan(struct pvt_data *pvt)
+{
+    int err;
+
+    /* Zones without readable energy_uj may be left by the previous scan */
+    close_all(pvt);
+    if ((err = scan_zones(pvt)) != 0 || (err = scan_cpus(pvt)) != 0) {
+        close_all(pvt);
+        return err;
+    }
+    /* Look again at the next tick while nothing is found */
+    pvt->scanned = pvt->num_zones > 0 || pvt->num_cpus > 0;
+    if (!pvt->scanned && !pvt->warned)
+        dmm_log(DMM_LOG_WARN, "power: neither RAPL nor cpufreq is found in %s", pvt->root);
+    pvt->warned = !pvt->scanned;
+    return 0;
+}
+
+static void read_energy(struct zone *z, uint64_t *energy)
+{
+    uint64_t raw;
+
+    if (sensorfile_pread_u64(z->fd, &raw) != 0)
+        return;
+    if (!z->prev_valid) {
+        *energy = raw;
+    } else if (raw >= z->prev) {
+        *energy += raw - z->prev;
+    } else {
+        /* Wrapped around */
+        *energy += (z->max_range > z->prev ? z->max_range - z->prev : 0) + raw;
+    }
+    z->prev = raw;
+    z->prev_valid = true;
+}
+
+static int process_timer_msg(struct pvt_data *pvt)
+{
+    dmm_data_p data;
+    dmm_datanode_p dn;
+    size_t i, nz, nc, len, numnodes;
+    int err;
+
+    if (!pvt->scanned && (err = scan(pvt)) != 0) {
+        char errbuf[128], *errmsg;
+        errmsg = strerror_r(err, errbuf, sizeof(errbuf));
+        dmm_log(DMM_LOG_ERR, "power: cannot scan %s: %s", pvt->root, errmsg);
+        return err;
+    }
+
+    nz = pvt->num_zones;
+    nc = pvt->num_cpus;
+    for (i = 0; i < nz; ++i)
+        read_energy(&pvt->zones[i], &pvt->energy[i]);
+    /* Frequency of CPU going offline is not available */
+    for (i = 0; i < nc; ++i)
+        if (sensorfile_pread_u64(pvt->cpus[i].fd, &pvt->freqs[i]) != 0)
+            pvt->freqs[i] = 0;
+
+    numnodes = 0;
+    len = 0;
+    if (nz > 0) {
+        numnodes += 1 + pvt->changed;
+        len += nz * sizeof(uint64_t);
+        if (pvt->changed)
+            len += nz * sizeof(struct dmm_power_zone);
+    }
+    if (nc > 0) {
+        numnodes += 2;
+        len += nc * (sizeof(uint64_t) + sizeof(uint32_t));
+    }
+    if (numnodes == 0)
+        return 0;
+
+    if ((data = DMM_DATA_CREATE_RAW(numnodes, len)) == NULL) {
+        dmm_log(DMM_LOG_ERR, "Cannot allocate memory for data");
+        return ENOMEM;
+    }
+    dn = DMM_DATA_NODES(data);
+    if (nz > 0) {
+        DMM_DN_FILL_ADVANCE(dn, POWER_ENERGY, nz * sizeof(uint64_t), pvt->energy);
+        if (pvt->changed)
+            DMM_DN_FILL_ADVANCE(dn, POWER_ZONES, nz * sizeof(struct dmm_power_zone), pvt->zone_ids);
+    }
+    if (nc > 0) {
+        DMM_DN_FILL_ADVANCE(dn, POWER_CPU_FREQ, nc * sizeof(uint64_t), pvt->freqs);
+        DMM_DN_FILL_ADVANCE(dn, POWER_CPU_ID, nc * sizeof(uint32_t), pvt->cpu_ids);
+    }
+    DMM_DN_MKEND(dn);
+    DMM_DATA_SEND(data, pvt->hook);
+    DMM_DATA_UNREF(data);
+    pvt->changed = false;
+
+    return 0;
+}
+
+static int ctor(dmm_node_p node)
+{
+    struct pvt_data *pvt;
+
+    pvt = (struct pvt_data *)DMM_MALLOC(sizeof(*pvt));
+    if (pvt == NULL)
+        return ENOMEM;
+    pvt->hook = NULL;
+    strcpy(pvt->root, DEFAULT_ROOT);
+    pvt->zones = NULL;
+    pvt->num_zones = 0;
+    pvt->energy = NULL;
+    pvt->zone_ids = NULL;
+    pvt->cpus = NULL;
+    pvt->num_cpus = 0;
+    pvt->freqs = NULL;
+    pvt->cpu_ids = NULL;
+    pvt->scanned = false;
+    pvt->changed = true;
+    pvt->warned = false;
+    DMM_NODE_SETPRIVATE(node, pvt);
+    return 0;
+}
+
+static void dtor(dmm_node_p node)
+{
+    struct pvt_data *pvt;
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
+    close_all(pvt);
+    DMM_FREE(pvt);
+}
+
+static int newhook(dmm_hook_p hook)
+{
+    struct pvt_data *pvt;
+
+    if (DMM_HOOK_ISIN(hook))
+        return EINVAL;
+    if (strcmp(HOOKNAME, DMM_HOOK_NAME(hook)) != 0)
+        return EINVAL;
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(DMM_HOOK_NODE(hook));
+    pvt->hook = hook;
+    /* Send zones to the new receiver */
+    pvt->changed = true;
+
+    return 0;
+}
+
+static void rmhook(dmm_hook_p hook)
+{
+    struct pvt_data *pvt;
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(DMM_HOOK_NODE(hook));
+    pvt->hook = NULL;
+}
+
+static int rcvmsg(dmm_node_p node, dmm_msg_p msg)
+{
+    struct pvt_data *pvt;
+    dmm_msg_p resp;
+    int err = 0;
+
+#define CREATE_SEND_EMPTY_RESP()                                    \
+        do {                                                        \
+            resp = DMM_MSG_CREATE_RESP(DMM_NODE_ID(node), msg, 0);  \
+            if (resp != NULL) {                                     \
+                if (err != 0)                                       \
+                    msg->cm_flags |= DMM_MSG_ERR;                   \
+                                                                    \
+                DMM_MSG_SEND_ID(msg->cm_src, resp);                 \
+            } else                                                  \
+                err = (err != 0) ? err : ENOMEM;                    \
+        } while (0)
+
+    if (msg->cm_flags & DMM_MSG_RESP)
+        goto err;
+
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
+    switch (msg->cm_type) {
+    case DMM_MSGTYPE_GENERIC:
+        /* Accept only TIMERTRIGGER messages */
+        if (msg->cm_cmd != DMM_MSG_TIMERTRIGGER) {
+            err = ENOTSUP;
+            break;
+        }
+        // Nowhere to send, so why bother?
+        if (pvt->hook != NULL)
+            err = process_timer_msg(pvt);
+        break;
+
+    case DMM_MSGTYPE_POWER:
+        switch (msg->cm_cmd) {
+        case DMM_MSG_POWER_SETROOT: {
+            struct dmm_msg_power_setroot *sr;
+
+            sr = DMM_MSG_DATA(msg, struct dmm_msg_power_setroot);
+            if (msg->cm_len != sizeof(*sr) ||
+                memchr(sr->root, '\0', sizeof(sr->root)) == NULL || sr->root[0] == '\0') {
+                err = EINVAL;
+            } else {
+                close_all(pvt);
+                strcpy(pvt->root, sr->root);
+                pvt->warned = false;
+            }
+            CREATE_SEND_EMPTY_RESP();
+            break;
+        }
+
+        default:
+            err = ENOTSUP;
+            break;
+        }
+        break;
+
+    default:
+        err = ENOTSUP;
+        break;
+    }
+
+#undef CREATE_SEND_EMPTY_RESP
+
+err:
+    DMM_MSG_FREE(msg);
+    return err;
+}
+
+static struct dmm_type type = {
+    "power",
+    ctor,
+    dtor,
+    NULL,
+    rcvmsg,
+    newhook,
+    rmhook,
+    {},
+};
+
+DMM_MODULE_DECLARE(&type);
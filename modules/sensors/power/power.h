@@ -0,0 +1,37 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+#ifndef MODULES_POWER_POWER_H_
+#define MODULES_POWER_POWER_H_
+
+#include "dmm_types.h"
+
+enum {
+    DMM_MSGTYPE_POWER = 0xba2bfb62
+};
+
+enum {
+    DMM_MSG_POWER_SETROOT = 1,
+};
+
+enum { DMM_POWER_PATHSIZE = 256 };
+enum { DMM_POWER_NAMESIZE = 32 };
+
+/*
+ * Read root/class/powercap/intel-rapl:N and
+ * root/devices/system/cpu/cpuN/cpufreq, root is /sys by default
+ */
+struct dmm_msg_power_setroot {
+    char root[DMM_POWER_PATHSIZE];
+};
+
+/* Element of POWER_ZONES datanode */
+struct dmm_power_zone {
+    /* Zone directory, e.g. intel-rapl:0 */
+    char zone[DMM_POWER_NAMESIZE];
+    /* Contents of its name file, e.g. package-0 */
+    char name[DMM_POWER_NAMESIZE];
+};
+
+#endif /* MODULES_POWER_POWER_H_ */
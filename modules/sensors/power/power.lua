@@ -0,0 +1,24 @@
+-- SPDX-License-Identifier: BSD-2-Clause-Views
+-- Copyright (c) 2013-2023
+--   Research Computing Center Lomonosov Moscow State University
+
+local dmm = require('dmm')
+
+assert(dmm.require_interface('power', 'll'))
+
+local Power = dmm.Module:new_type('power')
+
+--! @brief Set sysfs root
+--! @param root '/sys' by default, e.g. a fixture tree for tests
+function Power:setroot(root)
+  assert(#root < ffi.C.DMM_POWER_PATHSIZE, 'root is too long')
+  local msg, sr = dmm.msg_create {
+    payload_type = 'struct dmm_msg_power_setroot',
+    type = ffi.C.DMM_MSGTYPE_POWER,
+    cmd = ffi.C.DMM_MSG_POWER_SETROOT,
+  }
+  sr.root = root
+  dmm.msg_send(self.nodeid, msg)
+end
+
+return Power
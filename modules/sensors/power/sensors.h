@@ -0,0 +1,22 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+#ifndef MODULES_POWER_SENSORS_H_
+#define MODULES_POWER_SENSORS_H_
+
+enum {
+    /*
+     * uint64_t energy counters of RAPL packages, microjoules,
+     * wraparounds are accounted so values only grow
+     */
+    POWER_ENERGY = 1500,
+    /* Array of struct dmm_power_zone describing POWER_ENERGY elements */
+    POWER_ZONES,
+    /* uint64_t current CPU frequencies, kHz */
+    POWER_CPU_FREQ,
+    /* uint32_t CPU numbers for POWER_CPU_FREQ */
+    POWER_CPU_ID
+};
+
+#endif /* MODULES_POWER_SENSORS_H_ */
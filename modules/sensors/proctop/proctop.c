@@ -0,0 +1,694 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+/*
+ * proctop sends the number of processes and top lists of processes
+ * by CPU time used since the previous tick and by resident set size.
+ *
+ * /proc is opened once, every tick rewinds it and reads root/<pid>/stat
+ * of every process relative to the cached directory descriptor.
+ * Processes are kept in an open-addressed hash table keyed by pid.
+ * Stat descriptors of the first max_cached processes (DEFAULT_CACHED,
+ * see DMM_MSG_PROCTOP_SETCACHED) stay open in it, stat of the others is
+ * opened, read and closed every tick, so descriptors are left to other
+ * modules. Entries of exited processes are swept after the scan.
+ *
+ * A tick costs about 4-5 us per process with a cached descriptor and
+ * about 6 us with open and close, i.e. 80-120 ms for 20000 processes,
+ * see tests/proctop.bench.cc.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "dmm_base.h"
+#include "dmm_log.h"
+#include "dmm_message.h"
+#include "../sensorfile.h"
+#include "proctop.h"
+#include "sensors.h"
+
+#define HOOKNAME "out"
+
+#define DEFAULT_ROOT "/proc"
+#define DEFAULT_TOP 10
+#define DEFAULT_CACHED 256
+
+/* Initial hash table size, power of 2 */
+#define MIN_CAPACITY 1024
+
+/* TASK_COMM_LEN */
+#define COMM_SIZE 16
+
+/* Enough for any /proc/<pid>/stat */
+#define STAT_BUFSIZE 1024
+
+struct proc {
+    /* 0 for empty slot */
+    pid_t pid;
+    /* Cached stat descriptor or -1 */
+    int fd;
+    /* Scan generation the process was last seen in */
+    unsigned gen;
+    /* Clock ticks since boot, tells reused pids apart */
+    uint64_t starttime;
+    /* utime + stime, clock ticks */
+    uint64_t cputime;
+    /* cputime used since the previous scan */
+    uint64_t delta;
+    /* Pages */
+    uint64_t rss;
+    char comm[COMM_SIZE];
+};
+
+struct pvt_data {
+    dmm_hook_p hook;
+    char root[DMM_PROCTOP_PATHSIZE];
+    int rootfd;
+    DIR *dir;
+    /* Hash table with linear probing, capacity is power of 2 */
+    struct proc *procs;
+    size_t capacity;
+    size_t num_procs;
+    unsigned gen;
+    /* Processes seen at the first scan have no CPU delta */
+    bool primed;
+    size_t num_cached;
+    size_t max_cached;
+    /* Top lists, num_top entries each */
+    uint32_t num_top;
+    struct proc **top_cpu;
+    struct proc **top_rss;
+    long clk_tck;
+    uint64_t pagesize;
+};
+
+static inline size_t proc_hash(const struct pvt_data *pvt, pid_t pid)
+{
+    return ((uint32_t)pid * 2654435761u) & (pvt->capacity - 1);
+}
+
+/* Return entry of pid or empty slot where it should be inserted */
+static struct proc *proc_slot(struct pvt_data *pvt, pid_t pid)
+{
+    size_t i;
+
+    for (i = proc_hash(pvt, pid); ; i = (i + 1) & (pvt->capacity - 1))
+        if (pvt->procs[i].pid == pid || pvt->procs[i].pid == 0)
+            return &pvt->procs[i];
+}
+
+/* Double hash table capacity, return 0 or ENOMEM */
+static int grow(struct pvt_data *pvt)
+{
+    struct proc *old, *p;
+    size_t oldcap, i;
+
+    old = pvt->procs;
+    oldcap = pvt->capacity;
+    p = (struct proc *)DMM_MALLOC(2 * oldcap * sizeof(*p));
+    if (p == NULL)
+        return ENOMEM;
+    for (i = 0; i < 2 * oldcap; ++i)
+        p[i].pid = 0;
+    pvt->procs = p;
+    pvt->capacity = 2 * oldcap;
+    for (i = 0; i < oldcap; ++i)
+        if (old[i].pid != 0)
+            *proc_slot(pvt, old[i].pid) = old[i];
+    DMM_FREE(old);
+    return 0;
+}
+
+/* Empty slot i and shift following entries of its cluster back */
+static void proc_remove(struct pvt_data *pvt, size_t i)
+{
+    size_t mask, j, h;
+
+    mask = pvt->capacity - 1;
+    if (pvt->procs[i].fd >= 0) {
+        close(pvt->procs[i].fd);
+        pvt->num_cached--;
+    }
+    pvt->num_procs--;
+    for (j = (i + 1) & mask; pvt->procs[j].pid != 0; j = (j + 1) & mask) {
+        h = proc_hash(pvt, pvt->procs[j].pid);
+        /* Move j to i unless its home slot is cyclically in (i, j] */
+        if (((j - h) & mask) >= ((j - i) & mask)) {
+            pvt->procs[i] = pvt->procs[j];
+            i = j;
+        }
+    }
+    pvt->procs[i].pid = 0;
+}
+
+/* Remove processes not seen at the last scan */
+static void sweep(struct pvt_data *pvt)
+{
+    size_t mask, start, i, n;
+
+    mask = pvt->capacity - 1;
+    /* Start after an empty slot so that no cluster wraps around the start */
+    for (start = 0; pvt->procs[start].pid != 0; ++start)
+        ;
+    for (n = 0, i = start; n < pvt->capacity; ++n, i = (i + 1) & mask)
+        /* Removal may shift a not yet visited entry into i */
+        while (pvt->procs[i].pid != 0 && pvt->procs[i].gen != pvt->gen)
+            proc_remove(pvt, i);
+}
+
+static void close_all(struct pvt_data *pvt)
+{
+    size_t i;
+
+    for (i = 0; i < pvt->capacity; ++i)
+        if (pvt->procs[i].pid != 0 && pvt->procs[i].fd >= 0)
+            close(pvt->procs[i].fd);
+    for (i = 0; i < pvt->capacity; ++i)
+        pvt->procs[i].pid = 0;
+    pvt->num_procs = 0;
+    pvt->num_cached = 0;
+    pvt->primed = false;
+    if (pvt->dir != NULL) {
+        closedir(pvt->dir);
+        pvt->dir = NULL;
+    }
+    if (pvt->rootfd >= 0) {
+        close(pvt->rootfd);
+        pvt->rootfd = -1;
+    }
+}
+
+/* Parse pid from directory name, return 0 if it is not a pid */
+static pid_t parse_pid(const char *s)
+{
+    uint64_t v;
+    const char *end;
+
+    if ((unsigned char)(*s - '0') >= 10)
+        return 0;
+    if ((end = sensorfile_u64(s, &v)) == NULL || *end != '\0' || v > INT32_MAX)
+        return 0;
+    return (pid_t)v;
+}
+
+/*
+ * Read stat file of the process into buf, open it if the descriptor
+ * is not cached. Return number of bytes read or -errno
+ */
+static ssize_t read_stat(struct pvt_data *pvt, struct proc *p, char *buf)
+{
+    char path[32];
+    ssize_t n;
+    int fd;
+
+    if (p->fd >= 0) {
+        if ((n = pread(p->fd, buf, STAT_BUFSIZE - 1, 0)) > 0)
+            return n;
+        /* The process is gone, its pid may already be reused */
+        close(p->fd);
+        p->fd = -1;
+        pvt->num_cached--;
+    }
+    snprintf(path, sizeof(path), "%d/stat", (int)p->pid);
+    if ((fd = openat(pvt->rootfd, path, O_RDONLY | O_CLOEXEC)) < 0)
+        return -errno;
+    if ((n = pread(fd, buf, STAT_BUFSIZE - 1, 0)) <= 0) {
+        n = (n < 0) ? -errno : -ESRCH;
+        close(fd);
+        return n;
+    }
+    if (pvt->num_cached < pvt->max_cached) {
+        p->fd = fd;
+        pvt->num_cached++;
+    } else {
+        close(fd);
+    }
+    return n;
+}
+
+/*
+ * Parse stat of the process, new is true for entries just inserted.
+ * Return false if the contents is malformed
+ */
+static bool parse_stat(struct pvt_data *pvt, struct proc *p, char *buf, bool isnew)
+{
+    const char *s, *e;
+    uint64_t utime, stime, starttime, cputime;
+    int64_t rss;
+    size_t len;
+    int i;
+
+    /* comm may contain blanks and parentheses */
+    if ((s = strchr(buf, '(')) == NULL || (e = strrchr(s, ')')) == NULL)
+        return false;
+    s++;
+    len = (size_t)(e - s);
+    if (len >= COMM_SIZE)
+        len = COMM_SIZE - 1;
+    memcpy(p->comm, s, len);
+    p->comm[len] = '\0';
+
+    /* state ppid pgrp session tty_nr tpgid flags minflt cminflt majflt cmajflt */
+    s = e + 1;
+    for (i = 0; i < 11; ++i)
+        s = sensorfile_skipfield(s);
+    if ((s = sensorfile_u64(s, &utime)) == NULL ||
+        (s = sensorfile_u64(s, &stime)) == NULL)
+        return false;
+    /* cutime cstime priority nice num_threads itrealvalue */
+    for (i = 0; i < 6; ++i)
+        s = sensorfile_skipfield(s);
+    if ((s = sensorfile_u64(s, &starttime)) == NULL)
+        return false;
+    /* vsize */
+    s = sensorfile_skipfield(s);
+    if ((s = sensorfile_i64(s, &rss)) == NULL)
+        return false;
+
+    cputime = utime + stime;
+    if (isnew || starttime != p->starttime)
+        /* Started since the previous scan unless this is the first one */
+        p->delta = pvt->primed ? cputime : 0;
+    else
+        p->delta = (cputime >= p->cputime) ? cputime - p->cputime : 0;
+    p->cputime = cputime;
+    p->starttime = starttime;
+    p->rss = (rss > 0) ? (uint64_t)rss : 0;
+    return true;
+}
+
+static int open_root(struct pvt_data *pvt)
+{
+    int fd;
+
+    if ((pvt->rootfd = open(pvt->root, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+        return errno;
+    /* closedir() closes the descriptor, keep rootfd for openat() */
+    if ((fd = dup(pvt->rootfd)) < 0 || (pvt->dir = fdopendir(fd)) == NULL) {
+        int err = errno;
+        if (fd >= 0)
+            close(fd);
+        close(pvt->rootfd);
+        pvt->rootfd = -1;
+        return err;
+    }
+    return 0;
+}
+
+/* Read stat of every process, return 0 or errno */
+static int scan(struct pvt_data *pvt)
+{
+    char buf[STAT_BUFSIZE];
+    struct dirent *de;
+    struct proc *p;
+    ssize_t n;
+    bool isnew;
+    pid_t pid;
+    int err;
+
+    if (pvt->dir == NULL && (err = open_root(pvt)) != 0)
+        return err;
+    rewinddir(pvt->dir);
+    pvt->gen++;
+    while ((de = readdir(pvt->dir)) != NULL) {
+        if ((pid = parse_pid(de->d_name)) == 0)
+            continue;
+        /* Keep load factor below 1/2 */
+        if (2 * (pvt->num_procs + 1) > pvt->capacity && (err = grow(pvt)) != 0)
+            return err;
+        p = proc_slot(pvt, pid);
+        if ((isnew = (p->pid == 0))) {
+            p->pid = pid;
+            p->fd = -1;
+            p->gen = pvt->gen - 1;
+            pvt->num_procs++;
+        }
+        /* Entries of exited processes are not marked and get swept */
+        if ((n = read_stat(pvt, p, buf)) < 0)
+            continue;
+        buf[n] = '\0';
+        if (parse_stat(pvt, p, buf, isnew))
+            p->gen = pvt->gen;
+    }
+    sweep(pvt);
+    pvt->primed = true;
+    return 0;
+}
+
+/* Insert p into descending list of n elements with capacity num_top */
+static size_t top_insert(struct proc **top, size_t n, uint32_t num_top,
+                         struct proc *p, uint64_t (*key)(const struct proc *))
+{
+    uint64_t k;
+    size_t i;
+
+    k = key(p);
+    if (k == 0 || (n == num_top && k <= key(top[n - 1])))
+        return n;
+    if (n < num_top)
+        n++;
+    for (i = n - 1; i > 0 && key(top[i - 1]) < k; --i)
+        top[i] = top[i - 1];
+    top[i] = p;
+    return n;
+}
+
+static uint64_t cpu_key(const struct proc *p)
+{
+    return p->delta;
+}
+
+static uint64_t rss_key(const struct proc *p)
+{
+    return p->rss;
+}
+
+/* Fill top lists, return their lengths */
+static void select_top(struct pvt_data *pvt, size_t *ncpu, size_t *nrss)
+{
+    size_t i, nc, nr;
+
+    nc = nr = 0;
+    if (pvt->num_top > 0)
+        for (i = 0; i < pvt->capacity; ++i) {
+            if (pvt->procs[i].pid == 0)
+                continue;
+            nc = top_insert(pvt->top_cpu, nc, pvt->num_top, &pvt->procs[i], cpu_key);
+            nr = top_insert(pvt->top_rss, nr, pvt->num_top, &pvt->procs[i], rss_key);
+        }
+    *ncpu = nc;
+    *nrss = nr;
+}
+
+static size_t names_len(struct proc **top, size_t n)
+{
+    size_t i, len;
+
+    for (len = 0, i = 0; i < n; ++i)
+        len += strlen(top[i]->comm) + 1;
+    return len;
+}
+
+static void fill_names(dmm_datanode_p dn, struct proc **top, size_t n)
+{
+    char *s;
+    size_t i, len;
+
+    s = DMM_DN_VECTOR(dn, char);
+    for (i = 0; i < n; ++i) {
+        len = strlen(top[i]->comm) + 1;
+        memcpy(s, top[i]->comm, len);
+        s += len;
+    }
+}
+
+static int process_timer_msg(struct pvt_data *pvt)
+{
+    dmm_data_p data;
+    dmm_datanode_p dn;
+    size_t i, nc, nr, cnames, rnames;
+    uint64_t nprocs;
+    int err;
+
+    if ((err = scan(pvt)) != 0) {
+        char errbuf[128], *errmsg;
+        errmsg = strerror_r(err, errbuf, sizeof(errbuf));
+        dmm_log(DMM_LOG_ERR, "proctop: cannot scan %s: %s", pvt->root, errmsg);
+        return err;
+    }
+    select_top(pvt, &nc, &nr);
+    cnames = names_len(pvt->top_cpu, nc);
+    rnames = names_len(pvt->top_rss, nr);
+
+    data = DMM_DATA_CREATE_RAW(7, sizeof(uint64_t) +
+                                  nc * (sizeof(uint32_t) + sizeof(uint64_t)) + cnames +
+                                  nr * (sizeof(uint32_t) + sizeof(uint64_t)) + rnames);
+    if (data == NULL) {
+        dmm_log(DMM_LOG_ERR, "Cannot allocate memory for data");
+        return ENOMEM;
+    }
+    dn = DMM_DATA_NODES(data);
+    nprocs = pvt->num_procs;
+    DMM_DN_FILL_ADVANCE(dn, PROCTOP_NPROCS, sizeof(nprocs), &nprocs);
+
+    DMM_DN_CREATE(dn, PROCTOP_CPU_PID, nc * sizeof(uint32_t));
+    for (i = 0; i < nc; ++i)
+        DMM_DN_VECTOR(dn, uint32_t)[i] = (uint32_t)pvt->top_cpu[i]->pid;
+    DMM_DN_ADVANCE(dn);
+    DMM_DN_CREATE(dn, PROCTOP_CPU_TIME, nc * sizeof(uint64_t));
+    for (i = 0; i < nc; ++i)
+        DMM_DN_VECTOR(dn, uint64_t)[i] = pvt->top_cpu[i]->delta * 1000000 / (uint64_t)pvt->clk_tck;
+    DMM_DN_ADVANCE(dn);
+    DMM_DN_CREATE(dn, PROCTOP_CPU_NAMES, cnames);
+    fill_names(dn, pvt->top_cpu, nc);
+    DMM_DN_ADVANCE(dn);
+
+    DMM_DN_CREATE(dn, PROCTOP_RSS_PID, nr * sizeof(uint32_t));
+    for (i = 0; i < nr; ++i)
+        DMM_DN_VECTOR(dn, uint32_t)[i] = (uint32_t)pvt->top_rss[i]->pid;
+    DMM_DN_ADVANCE(dn);
+    DMM_DN_CREATE(dn, PROCTOP_RSS_BYTES, nr * sizeof(uint64_t));
+    for (i = 0; i < nr; ++i)
+        DMM_DN_VECTOR(dn, uint64_t)[i] = pvt->top_rss[i]->rss * pvt->pagesize;
+    DMM_DN_ADVANCE(dn);
+    DMM_DN_CREATE(dn, PROCTOP_RSS_NAMES, rnames);
+    fill_names(dn, pvt->top_rss, nr);
+    DMM_DN_ADVANCE(dn);
+
+    DMM_DN_MKEND(dn);
+    DMM_DATA_SEND(data, pvt->hook);
+    DMM_DATA_UNREF(data);
+
+    return 0;
+}
+
+/* Resize top lists, return 0 or ENOMEM */
+static int set_top(struct pvt_data *pvt, uint32_t num)
+{
+    struct proc **cpu = NULL, **rss = NULL;
+
+    if (num > 0) {
+        cpu = (struct proc **)DMM_MALLOC((size_t)num * sizeof(*cpu));
+        rss = (struct proc **)DMM_MALLOC((size_t)num * sizeof(*rss));
+        if (cpu == NULL || rss == NULL) {
+            DMM_FREE(cpu);
+            DMM_FREE(rss);
+            return ENOMEM;
+        }
+    }
+    DMM_FREE(pvt->top_cpu);
+    DMM_FREE(pvt->top_rss);
+    pvt->top_cpu = cpu;
+    pvt->top_rss = rss;
+    pvt->num_top = num;
+    return 0;
+}
+
+/*
+ * Set number of cached stat descriptors and close the ones above it,
+ * return 0 or EINVAL if num is more than half of RLIMIT_NOFILE
+ */
+static int set_cached(struct pvt_data *pvt, uint32_t num)
+{
+    struct rlimit rl;
+    size_t i;
+
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY &&
+        num > rl.rlim_cur / 2)
+        return EINVAL;
+    for (i = 0; i < pvt->capacity && pvt->num_cached > num; ++i)
+        if (pvt->procs[i].pid != 0 && pvt->procs[i].fd >= 0) {
+            close(pvt->procs[i].fd);
+            pvt->procs[i].fd = -1;
+            pvt->num_cached--;
+        }
+    pvt->max_cached = num;
+    return 0;
+}
+
+static int ctor(dmm_node_p node)
+{
+    struct pvt_data *pvt;
+    size_t i;
+
+    pvt = (struct pvt_data *)DMM_MALLOC(sizeof(*pvt));
+    if (pvt == NULL)
+        return ENOMEM;
+    pvt->hook = NULL;
+    strcpy(pvt->root, DEFAULT_ROOT);
+    pvt->rootfd = -1;
+    pvt->dir = NULL;
+    pvt->capacity = MIN_CAPACITY;
+    pvt->procs = (struct proc *)DMM_MALLOC(pvt->capacity * sizeof(*pvt->procs));
+    if (pvt->procs == NULL) {
+        DMM_FREE(pvt);
+        return ENOMEM;
+    }
+    for (i = 0; i < pvt->capacity; ++i)
+        pvt->procs[i].pid = 0;
+    pvt->num_procs = 0;
+    pvt->gen = 0;
+    pvt->primed = false;
+    pvt->num_cached = 0;
+    pvt->max_cached = DEFAULT_CACHED;
+    pvt->top_cpu = NULL;
+    pvt->top_rss = NULL;
+    if (set_top(pvt, DEFAULT_TOP) != 0) {
+        DMM_FREE(pvt->procs);
+        DMM_FREE(pvt);
+        return ENOMEM;
+    }
+    if ((pvt->clk_tck = sysconf(_SC_CLK_TCK)) <= 0)
+        pvt->clk_tck = 100;
+    pvt->pagesize = (uint64_t)sysconf(_SC_PAGESIZE);
+    DMM_NODE_SETPRIVATE(node, pvt);
+    return 0;
+}
+
+static void dtor(dmm_node_p node)
+{
+    struct pvt_data *pvt;
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
+    close_all(pvt);
+    DMM_FREE(pvt->procs);
+    DMM_FREE(pvt->top_cpu);
+    DMM_FREE(pvt->top_rss);
+    DMM_FREE(pvt);
+}
+
+static int newhook(dmm_hook_p hook)
+{
+    struct pvt_data *pvt;
+
+    if (DMM_HOOK_ISIN(hook))
+        return EINVAL;
+    if (strcmp(HOOKNAME, DMM_HOOK_NAME(hook)) != 0)
+        return EINVAL;
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(DMM_HOOK_NODE(hook));
+    pvt->hook = hook;
+
+    return 0;
+}
+
+static void rmhook(dmm_hook_p hook)
+{
+    struct pvt_data *pvt;
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(DMM_HOOK_NODE(hook));
+    pvt->hook = NULL;
+}
+
+static int rcvmsg(dmm_node_p node, dmm_msg_p msg)
+{
+    struct pvt_data *pvt;
+    dmm_msg_p resp;
+    int err = 0;
+
+#define CREATE_SEND_EMPTY_RESP()                                    \
+        do {                                                        \
+            resp = DMM_MSG_CREATE_RESP(DMM_NODE_ID(node), msg, 0);  \
+            if (resp != NULL) {                                     \
+                if (err != 0)                                       \
+                    msg->cm_flags |= DMM_MSG_ERR;                   \
+                                                                    \
+                DMM_MSG_SEND_ID(msg->cm_src, resp);                 \
+            } else                                                  \
+                err = (err != 0) ? err : ENOMEM;                    \
+        } while (0)
+
+    if (msg->cm_flags & DMM_MSG_RESP)
+        goto err;
+
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
+    switch (msg->cm_type) {
+    case DMM_MSGTYPE_GENERIC:
+        /* Accept only TIMERTRIGGER messages */
+        if (msg->cm_cmd != DMM_MSG_TIMERTRIGGER) {
+            err = ENOTSUP;
+            break;
+        }
+        // Nowhere to send, so why bother?
+        if (pvt->hook != NULL)
+            err = process_timer_msg(pvt);
+        break;
+
+    case DMM_MSGTYPE_PROCTOP:
+        switch (msg->cm_cmd) {
+        case DMM_MSG_PROCTOP_SETROOT: {
+            struct dmm_msg_proctop_setroot *sr;
+
+            sr = DMM_MSG_DATA(msg, struct dmm_msg_proctop_setroot);
+            if (msg->cm_len != sizeof(*sr) ||
+                memchr(sr->root, '\0', sizeof(sr->root)) == NULL || sr->root[0] == '\0') {
+                err = EINVAL;
+            } else {
+                close_all(pvt);
+                strcpy(pvt->root, sr->root);
+            }
+            CREATE_SEND_EMPTY_RESP();
+            break;
+        }
+
+        case DMM_MSG_PROCTOP_SETTOP: {
+            struct dmm_msg_proctop_settop *st;
+
+            st = DMM_MSG_DATA(msg, struct dmm_msg_proctop_settop);
+            if (msg->cm_len != sizeof(*st) || st->num > DMM_PROCTOP_MAXTOP)
+                err = EINVAL;
+            else
+                err = set_top(pvt, st->num);
+            CREATE_SEND_EMPTY_RESP();
+            break;
+        }
+
+        case DMM_MSG_PROCTOP_SETCACHED: {
+            struct dmm_msg_proctop_setcached *sc;
+
+            sc = DMM_MSG_DATA(msg, struct dmm_msg_proctop_setcached);
+            if (msg->cm_len != sizeof(*sc))
+                err = EINVAL;
+            else
+                err = set_cached(pvt, sc->num);
+            CREATE_SEND_EMPTY_RESP();
+            break;
+        }
+
+        default:
+            err = ENOTSUP;
+            break;
+        }
+        break;
+
+    default:
+        err = ENOTSUP;
+        break;
+    }
+
+#undef CREATE_SEND_EMPTY_RESP
+
+err:
+    DMM_MSG_FREE(msg);
+    return err;
+}
+
+static struct dmm_type type = {
+    "proctop",
+    ctor,
+    dtor,
+    NULL,
+    rcvmsg,
+    newhook,
+    rmhook,
+    {},
+};
+
+DMM_MODULE_DECLARE(&type);
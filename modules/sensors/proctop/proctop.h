@@ -0,0 +1,46 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+#ifndef MODULES_PROCTOP_PROCTOP_H_
+#define MODULES_PROCTOP_PROCTOP_H_
+
+#include "dmm_types.h"
+
+enum {
+    DMM_MSGTYPE_PROCTOP = 0x16d64a06
+};
+
+enum {
+    DMM_MSG_PROCTOP_SETROOT = 1,
+    DMM_MSG_PROCTOP_SETTOP,
+    DMM_MSG_PROCTOP_SETCACHED,
+};
+
+enum { DMM_PROCTOP_PATHSIZE = 256 };
+
+/* Read root/<pid>/stat, root is /proc by default */
+struct dmm_msg_proctop_setroot {
+    char root[DMM_PROCTOP_PATHSIZE];
+};
+
+enum { DMM_PROCTOP_MAXTOP = 4096 };
+
+/*
+ * Number of processes in top lists, 10 by default, 0 sends PROCTOP_NPROCS only,
+ * more than DMM_PROCTOP_MAXTOP is EINVAL
+ */
+struct dmm_msg_proctop_settop {
+    uint32_t num;
+};
+
+/*
+ * Number of stat descriptors kept open between ticks, 256 by default,
+ * stat of other processes is opened and closed every tick.
+ * More than half of RLIMIT_NOFILE is EINVAL
+ */
+struct dmm_msg_proctop_setcached {
+    uint32_t num;
+};
+
+#endif /* MODULES_PROCTOP_PROCTOP_H_ */
@@ -0,0 +1,48 @@
+-- SPDX-License-Identifier: BSD-2-Clause-Views
+-- Copyright (c) 2013-2023
+--   Research Computing Center Lomonosov Moscow State University
+
+local dmm = require('dmm')
+
+assert(dmm.require_interface('proctop', 'll'))
+
+local Proctop = dmm.Module:new_type('proctop')
+
+--! @brief Set procfs root
+--! @param root '/proc' by default, e.g. a fixture tree for tests
+function Proctop:setroot(root)
+  assert(#root < ffi.C.DMM_PROCTOP_PATHSIZE, 'root is too long')
+  local msg, sr = dmm.msg_create {
+    payload_type = 'struct dmm_msg_proctop_setroot',
+    type = ffi.C.DMM_MSGTYPE_PROCTOP,
+    cmd = ffi.C.DMM_MSG_PROCTOP_SETROOT,
+  }
+  sr.root = root
+  dmm.msg_send(self.nodeid, msg)
+end
+
+--! @brief Set length of top lists
+--! @param num number of processes, 10 by default
+function Proctop:settop(num)
+  local msg, st = dmm.msg_create {
+    payload_type = 'struct dmm_msg_proctop_settop',
+    type = ffi.C.DMM_MSGTYPE_PROCTOP,
+    cmd = ffi.C.DMM_MSG_PROCTOP_SETTOP,
+  }
+  st.num = num
+  dmm.msg_send(self.nodeid, msg)
+end
+
+--! @brief Set number of stat descriptors kept open between ticks
+--! @param num number of descriptors, 256 by default
+function Proctop:setcached(num)
+  local msg, sc = dmm.msg_create {
+    payload_type = 'struct dmm_msg_proctop_setcached',
+    type = ffi.C.DMM_MSGTYPE_PROCTOP,
+    cmd = ffi.C.DMM_MSG_PROCTOP_SETCACHED,
+  }
+  sc.num = num
+  dmm.msg_send(self.nodeid, msg)
+end
+
+return Proctop
@@ -0,0 +1,27 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+#ifndef MODULES_PROCTOP_SENSORS_H_
+#define MODULES_PROCTOP_SENSORS_H_
+
+/*
+ * Top lists are sorted in descending order and hold at most the
+ * configured number of processes, processes with zero value are not
+ * listed. Name datanodes contain NUL-terminated process names
+ * (comm) one after another, in the order of the pid vector.
+ */
+enum {
+    /* Number of processes, uint64_t */
+    PROCTOP_NPROCS = 1800,
+    /* Top by CPU time used since the previous tick */
+    PROCTOP_CPU_PID,        /* uint32_t */
+    PROCTOP_CPU_TIME,       /* uint64_t, microseconds */
+    PROCTOP_CPU_NAMES,      /* char */
+    /* Top by resident set size */
+    PROCTOP_RSS_PID,        /* uint32_t */
+    PROCTOP_RSS_BYTES,      /* uint64_t */
+    PROCTOP_RSS_NAMES       /* char */
+};
+
+#endif /* MODULES_PROCTOP_SENSORS_H_ */
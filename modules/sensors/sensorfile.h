@@ -0,0 +1,258 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+#ifndef MODULES_SENSORS_SENSORFILE_H_
+#define MODULES_SENSORS_SENSORFILE_H_
+
+/*
+ * Reading /proc and sysfs files for sensors.
+ *
+ * File is opened once and reread from the beginning with pread(2)
+ * into a buffer, which is reused and only grows when the file
+ * does not fit. Buffer contents are NUL-terminated and parsed
+ * in place with sensorfile_u64() and friends, which take a pointer
+ * into the buffer and return a pointer past the parsed item,
+ * so no memory is allocated and no stdio is involved.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dmm_memman.h"
+
+#define SENSORFILE_BUFSIZE 4096
+
+struct sensorfile {
+    int     fd;
+    char   *buf;
+    /* Allocated length of buf */
+    size_t  size;
+    /* Length of file contents read by the last sensorfile_read */
+    size_t  len;
+};
+
+#define SENSORFILE_INITIALIZER { -1, NULL, 0, 0 }
+
+static inline void sensorfile_init(struct sensorfile *sf)
+{
+    sf->fd = -1;
+    sf->buf = NULL;
+    sf->size = 0;
+    sf->len = 0;
+}
+
+/* Open path relative to dirfd, return 0 or errno */
+static inline int sensorfile_openat(struct sensorfile *sf, int dirfd, const char *path)
+{
+    int err;
+
+    sensorfile_init(sf);
+    if ((sf->fd = openat(dirfd, path, O_RDONLY | O_CLOEXEC)) < 0) {
+        err = errno;
+        sf->fd = -1;
+        return err;
+    }
+    if ((sf->buf = (char *)DMM_MALLOC(SENSORFILE_BUFSIZE)) == NULL) {
+        close(sf->fd);
+        sf->fd = -1;
+        return ENOMEM;
+    }
+    sf->size = SENSORFILE_BUFSIZE;
+    sf->buf[0] = '\0';
+    return 0;
+}
+
+static inline int sensorfile_open(struct sensorfile *sf, const char *path)
+{
+    return sensorfile_openat(sf, AT_FDCWD, path);
+}
+
+static inline bool sensorfile_isopen(const struct sensorfile *sf)
+{
+    return sf->fd >= 0;
+}
+
+static inline void sensorfile_close(struct sensorfile *sf)
+{
+    if (sf->fd >= 0)
+        close(sf->fd);
+    DMM_FREE(sf->buf);
+    sensorfile_init(sf);
+}
+
+/*
+ * Read the whole file into sf->buf and NUL-terminate it.
+ * Return 0 or errno, on error sf->buf contains empty string
+ */
+static inline int sensorfile_read(struct sensorfile *sf)
+{
+    ssize_t n;
+    char *newbuf;
+    int err;
+
+    sf->len = 0;
+    for (;;) {
+        if (sf->size - sf->len <= 1) {
+            if ((newbuf = (char *)DMM_REALLOC(sf->buf, sf->size * 2)) == NULL) {
+                err = ENOMEM;
+                goto err;
+            }
+            sf->buf = newbuf;
+            sf->size *= 2;
+        }
+        n = pread(sf->fd, sf->buf + sf->len, sf->size - sf->len - 1, (off_t)sf->len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            err = errno;
+            goto err;
+        }
+        if (n == 0)
+            break;
+        sf->len += (size_t)n;
+    }
+    sf->buf[sf->len] = '\0';
+    return 0;
+
+err:
+    sf->len = 0;
+    sf->buf[0] = '\0';
+    return err;
+}
+
+/*
+ * Read a single number from a small file like sysfs attribute,
+ * fd is reread from the beginning without buffer allocation.
+ * Return 0 or errno, EINVAL if the file does not start with a number
+ */
+static inline int sensorfile_pread_u64(int fd, uint64_t *val)
+{
+    char buf[32];
+    uint64_t v = 0;
+    ssize_t n, i;
+
+    while ((n = pread(fd, buf, sizeof(buf), 0)) < 0)
+        if (errno != EINTR)
+            return errno;
+    for (i = 0; i < n && (unsigned char)(buf[i] - '0') < 10; ++i)
+        v = v * 10 + (uint64_t)(buf[i] - '0');
+    if (i == 0)
+        return EINVAL;
+    *val = v;
+    return 0;
+}
+
+/*
+ * Read the first line of a short text file like sysfs label into buf
+ * without the line end, buf is left empty if the file cannot be read
+ */
+static inline void sensorfile_readline(int dirfd, const char *path, char *buf, size_t size)
+{
+    ssize_t n;
+    int fd;
+
+    buf[0] = '\0';
+    if ((fd = openat(dirfd, path, O_RDONLY | O_CLOEXEC)) < 0)
+        return;
+    n = pread(fd, buf, size - 1, 0);
+    close(fd);
+    if (n <= 0)
+        return;
+    buf[n] = '\0';
+    buf[strcspn(buf, "\n")] = '\0';
+}
+
+/* Skip spaces and tabs, but not line ends */
+static inline const char *sensorfile_skipblanks(const char *s)
+{
+    while (*s == ' ' || *s == '\t')
+        s++;
+    return s;
+}
+
+/* Return the beginning of the next line, or the terminating NUL */
+static inline const char *sensorfile_nextline(const char *s)
+{
+    const char *nl;
+
+    if ((nl = strchr(s, '\n')) != NULL)
+        return nl + 1;
+    return s + strlen(s);
+}
+
+/* Skip blanks and one field of non-blank characters */
+static inline const char *sensorfile_skipfield(const char *s)
+{
+    s = sensorfile_skipblanks(s);
+    while (*s != '\0' && *s != ' ' && *s != '\t' && *s != '\n')
+        s++;
+    return s;
+}
+
+/* If s begins with prefix return pointer past it, NULL otherwise */
+static inline const char *sensorfile_match(const char *s, const char *prefix)
+{
+    while (*prefix != '\0') {
+        if (*s != *prefix)
+            return NULL;
+        s++;
+        prefix++;
+    }
+    return s;
+}
+
+/*
+ * Parse decimal unsigned integer after optional blanks.
+ * Return pointer past the number, or NULL if there is no number
+ */
+static inline const char *sensorfile_u64(const char *s, uint64_t *val)
+{
+    const char *start;
+    uint64_t v = 0;
+
+    s = sensorfile_skipblanks(s);
+    for (start = s; (unsigned char)(*s - '0') < 10; s++)
+        v = v * 10 + (uint64_t)(*s - '0');
+    if (s == start)
+        return NULL;
+    *val = v;
+    return s;
+}
+
+/* Same as sensorfile_u64 for optionally negative numbers */
+static inline const char *sensorfile_i64(const char *s, int64_t *val)
+{
+    uint64_t v;
+    bool neg;
+
+    s = sensorfile_skipblanks(s);
+    if ((neg = (*s == '-')))
+        s++;
+    if ((s = sensorfile_u64(s, &v)) == NULL)
+        return NULL;
+    *val = neg ? -(int64_t)v : (int64_t)v;
+    return s;
+}
+
+/*
+ * If name is prefix followed by a decimal number only, like "cpu12"
+ * in a sysfs directory, store the number and return true
+ */
+static inline bool sensorfile_numbered(const char *name, const char *prefix, uint32_t *num)
+{
+    const char *s;
+    uint64_t v;
+
+    if ((s = sensorfile_match(name, prefix)) == NULL ||
+        (s = sensorfile_u64(s, &v)) == NULL || *s != '\0' || v > UINT32_MAX)
+        return false;
+    *num = (uint32_t)v;
+    return true;
+}
+
+#endif /* MODULES_SENSORS_SENSORFILE_H_ */
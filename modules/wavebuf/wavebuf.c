@@ -2,25 +2,195 @@
 // Copyright (c) 2013-2023
 //   Research Computing Center Lomonosov Moscow State University
 
+/*
+ * Wavebuf concatenates received datas and sends them as one data.
+ *
+ * By default buffered datas are sent at wave finish. Output size,
+ * number of buffered datas and buffering time can be limited
+ * with DMM_MSG_WAVEBUF_SET, see wavebuf.h
+ */
+
 #include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 
 #include "dmm_base.h"
 #include "dmm_log.h"
 #include "dmm_message.h"
+#include "dmm_timer.h"
+
+#include "wavebuf.h"
 
 struct datalist {
     dmm_data_p  data;
-    /* Length of datanodes in data without end node. Filled when needed */
+    /* Length of datanodes in data without end node */
     size_t      dnsumlen;
+    /* Length of datanodes already sent in previous outputs */
+    size_t      offset;
     STAILQ_ENTRY(datalist) datas;
 };
 
 struct pvt_data {
     dmm_hook_p  hook;
     STAILQ_HEAD(, datalist) databuf;
+    /* Unused list entries to avoid malloc for every received data */
+    STAILQ_HEAD(, datalist) freelist;
+    /* Length of buffered datanodes not sent yet */
+    size_t      buflen;
+    size_t      bufcount;
+    /* Output data kept between flushes if nobody else references it */
+    dmm_data_p  outdata;
+
+    struct dmm_msg_wavebuf_set limits;
+    dmm_id_t    timer_id;
+    bool        timer_armed;
+    bool        wf_subscribed;
 };
 
+static inline bool latency_limited(struct pvt_data *pvt)
+{
+    return pvt->limits.maxlatency.tv_sec != 0 || pvt->limits.maxlatency.tv_nsec != 0;
+}
+
+/* Maximum length of datanodes in one output without end node */
+static inline size_t chunk_limit(struct pvt_data *pvt)
+{
+    if (pvt->limits.maxbytes == 0)
+        return SIZE_MAX;
+    return pvt->limits.maxbytes - sizeof(struct dmm_datanode);
+}
+
+static void datalist_release(struct pvt_data *pvt, struct datalist *dl)
+{
+    DMM_DATA_UNREF(dl->data);
+    dl->data = NULL;
+    STAILQ_INSERT_HEAD(&pvt->freelist, dl, datas);
+}
+
+static void databuf_drop(struct pvt_data *pvt)
+{
+    struct datalist *dl;
+
+    while ((dl = STAILQ_FIRST(&pvt->databuf)) != NULL) {
+        STAILQ_REMOVE_HEAD(&pvt->databuf, datas);
+        datalist_release(pvt, dl);
+    }
+    pvt->buflen = 0;
+    pvt->bufcount = 0;
+}
+
+/* Get output data with room for at least len bytes of datanodes */
+static dmm_data_p outdata_get(struct pvt_data *pvt, size_t len)
+{
+    if (pvt->outdata != NULL) {
+        if (DMM_DATA_SIZE(pvt->outdata) >= len)
+            return pvt->outdata;
+        if (DMM_DATA_RESIZE(pvt->outdata, 0, len) == 0)
+            return pvt->outdata;
+        DMM_DATA_UNREF(pvt->outdata);
+    }
+    pvt->outdata = DMM_DATA_CREATE_RAW(0, len);
+    return pvt->outdata;
+}
+
+/*
+ * Fill output data from the head of databuf with no more than limit
+ * bytes of datanodes. Datas are split at datanode boundaries, a single
+ * datanode longer than limit is sent alone.
+ * Returns the length of datanodes in output
+ */
+static size_t fill_output(struct pvt_data *pvt, dmm_data_p out, size_t limit)
+{
+    struct datalist *dl;
+    dmm_datanode_p dn, start;
+    size_t len, used;
+    char *dst;
+
+    dst = (char *)DMM_DATA_NODES(out);
+    used = 0;
+    while ((dl = STAILQ_FIRST(&pvt->databuf)) != NULL) {
+        start = (dmm_datanode_p)((char *)DMM_DATA_NODES(dl->data) + dl->offset);
+        len = dl->dnsumlen - dl->offset;
+        if (len <= limit - used) {
+            memcpy(dst + used, start, len);
+            used += len;
+            STAILQ_REMOVE_HEAD(&pvt->databuf, datas);
+            pvt->bufcount--;
+            datalist_release(pvt, dl);
+            continue;
+        }
+
+        /* Data does not fit entirely, take as many datanodes as possible */
+        len = 0;
+        for (dn = start; !DMM_DN_ISEND(dn) && DMM_DN_SIZE(dn) <= limit - used - len; DMM_DN_ADVANCE(dn))
+            len += DMM_DN_SIZE(dn);
+        /* Oversized datanode, send it alone */
+        if (len == 0 && used == 0)
+            len = DMM_DN_SIZE(start);
+        memcpy(dst + used, start, len);
+        used += len;
+        dl->offset += len;
+        break;
+    }
+    DMM_DN_MKEND((dmm_datanode_p)(dst + used));
+    pvt->buflen -= used;
+    return used;
+}
+
+/*
+ * Send buffered datanodes. If all is false only outputs filled
+ * up to the size limit are sent and the rest stays buffered
+ */
+static int flush(struct pvt_data *pvt, bool all)
+{
+    struct datalist *dl;
+    dmm_data_p out;
+    dmm_datanode_p dn;
+    size_t limit, len, used;
+    dmm_size_t cap;
+
+    /*
+     * If hook == NULL we have no way to send buffered data,
+     * so no need to alloc and prepare it
+     */
+    if (pvt->hook == NULL) {
+        databuf_drop(pvt);
+        return 0;
+    }
+
+    limit = chunk_limit(pvt);
+    while (!STAILQ_EMPTY(&pvt->databuf)) {
+        if (!all && pvt->buflen < limit)
+            break;
+
+        len = pvt->buflen < limit ? pvt->buflen : limit;
+        dl = STAILQ_FIRST(&pvt->databuf);
+        dn = (dmm_datanode_p)((char *)DMM_DATA_NODES(dl->data) + dl->offset);
+        if (DMM_DN_SIZE(dn) > len)
+            len = DMM_DN_SIZE(dn);
+        if ((out = outdata_get(pvt, len)) == NULL) {
+            databuf_drop(pvt);
+            return ENOMEM;
+        }
+        used = fill_output(pvt, out, limit);
+        /*
+         * Reused output may be larger than this chunk, send only the used
+         * length and keep the allocation for the next flush
+         */
+        cap = DMM_DATA_FULLSIZE(out);
+        out->da_len = used + sizeof(struct dmm_datanode);
+        DMM_DATA_SEND(out, pvt->hook);
+        if (DMM_DATA_ISSHARED(out)) {
+            DMM_DATA_UNREF(out);
+            pvt->outdata = NULL;
+        } else {
+            out->da_len = cap;
+        }
+    }
+    return 0;
+}
+
 static int ctor(dmm_node_p node)
 {
     struct pvt_data *pvt;
@@ -30,6 +200,14 @@ static int ctor(dmm_node_p node)
 
     pvt->hook = NULL;
     STAILQ_INIT(&pvt->databuf);
+    STAILQ_INIT(&pvt->freelist);
+    pvt->buflen = 0;
+    pvt->bufcount = 0;
+    pvt->outdata = NULL;
+    memset(&pvt->limits, 0, sizeof(pvt->limits));
+    pvt->timer_id = 0;
+    pvt->timer_armed = false;
+    pvt->wf_subscribed = false;
     DMM_NODE_SETPRIVATE(node, pvt);
     return 0;
 }
@@ -37,14 +215,22 @@ static int ctor(dmm_node_p node)
 static void dtor(dmm_node_p node)
 {
     struct datalist *dl;
+    dmm_timer_p timer;
     struct pvt_data *pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
-    while (!STAILQ_EMPTY(&pvt->databuf)) {
-        /* XXX maybe we should send buffered data */
-        dl = STAILQ_FIRST(&pvt->databuf);
-        DMM_DATA_UNREF(dl->data);
-        STAILQ_REMOVE_HEAD(&pvt->databuf, datas);
+
+    /* XXX maybe we should send buffered data */
+    databuf_drop(pvt);
+    while ((dl = STAILQ_FIRST(&pvt->freelist)) != NULL) {
+        STAILQ_REMOVE_HEAD(&pvt->freelist, datas);
         DMM_FREE(dl);
     }
+    if (pvt->outdata != NULL)
+        DMM_DATA_UNREF(pvt->outdata);
+    if (pvt->timer_id != 0 && (timer = dmm_timer_id2ref(pvt->timer_id)) != NULL) {
+        /* See DMM_MSG_TIMERRM processing in dmm_base.c */
+        DMM_TIMER_UNREF(timer);
+        dmm_timer_rm(timer);
+    }
     DMM_FREE(pvt);
 }
 
@@ -65,98 +251,193 @@ static int newhook(dmm_hook_p hook)
 static void rmhook(dmm_hook_p hook)
 {
     struct pvt_data *pvt = (struct pvt_data *)DMM_NODE_PRIVATE(DMM_HOOK_NODE(hook));
-    pvt->hook = NULL;
+    if (DMM_HOOK_ISOUT(hook))
+        pvt->hook = NULL;
+}
+
+/* Make sure buffered data will be flushed at wave finish or by timer */
+static int schedule_flush(dmm_node_p node, struct pvt_data *pvt)
+{
+    dmm_msg_p msg;
+
+    if (latency_limited(pvt) && pvt->timer_id != 0) {
+        struct dmm_msg_timerset *ts;
+
+        if (pvt->timer_armed)
+            return 0;
+        msg = DMM_MSG_CREATE(DMM_NODE_ID(node), DMM_MSG_TIMERSET,
+                             DMM_MSGTYPE_GENERIC, 0, 0, sizeof(*ts));
+        if (msg == NULL)
+            return ENOMEM;
+        ts = DMM_MSG_DATA(msg, struct dmm_msg_timerset);
+        ts->id = pvt->timer_id;
+        ts->next = pvt->limits.maxlatency;
+        ts->interval.tv_sec = 0;
+        ts->interval.tv_nsec = 0;
+        ts->flags = 0;
+        pvt->timer_armed = true;
+        DMM_MSG_SEND_ID(DMM_NODE_ID(node), msg);
+        return 0;
+    }
+
+    if (pvt->wf_subscribed)
+        return 0;
+    msg = DMM_MSG_CREATE(DMM_NODE_ID(node),
+                         DMM_MSG_WAVEFINISHSUBSCRIBE,
+                         DMM_MSGTYPE_GENERIC,
+                         0, 0, 0
+                        );
+    if (msg == NULL)
+        return ENOMEM;
+    pvt->wf_subscribed = true;
+    DMM_MSG_SEND_ID(DMM_NODE_ID(node), msg);
+    return 0;
 }
 
 static int rcvdata(dmm_hook_p hook, dmm_data_p data) {
     struct datalist *dl;
+    dmm_datanode_p dn;
     dmm_node_p node;
     struct pvt_data *pvt;
-
-    dl = (struct datalist *)DMM_MALLOC(sizeof(*dl));
-    if (dl == NULL)
-        goto enomem_err;
-    dl->data = data;
-    dl->dnsumlen = 0;
+    int err;
 
     node = DMM_HOOK_NODE(hook);
     pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
-    if (STAILQ_EMPTY(&pvt->databuf)) {
-        dmm_msg_p msg;
-        msg = DMM_MSG_CREATE(DMM_NODE_ID(node),
-                             DMM_MSG_WAVEFINISHSUBSCRIBE,
-                             DMM_MSGTYPE_GENERIC,
-                             0, 0, 0
-                            );
-        if (msg == NULL)
-            goto enomem_err;
 
-        DMM_MSG_SEND_ID(DMM_NODE_ID(node), msg);
+    for (dn = DMM_DATA_NODES(data); !DMM_DN_ISEND(dn); DMM_DN_ADVANCE(dn))
+        ;
+    if (dn == DMM_DATA_NODES(data)) {
+        DMM_DATA_UNREF(data);
+        return 0;
     }
-    STAILQ_INSERT_TAIL(&pvt->databuf, dl, datas);
-    return 0;
 
-enomem_err:
-    DMM_DATA_UNREF(data);
-    return ENOMEM;
+    if ((dl = STAILQ_FIRST(&pvt->freelist)) != NULL) {
+        STAILQ_REMOVE_HEAD(&pvt->freelist, datas);
+    } else if ((dl = (struct datalist *)DMM_MALLOC(sizeof(*dl))) == NULL) {
+        DMM_DATA_UNREF(data);
+        return ENOMEM;
+    }
+    dl->data = data;
+    dl->dnsumlen = (char *)dn - (char *)DMM_DATA_NODES(data);
+    dl->offset = 0;
+    STAILQ_INSERT_TAIL(&pvt->databuf, dl, datas);
+    pvt->buflen += dl->dnsumlen;
+    pvt->bufcount++;
 
+    if (pvt->limits.maxcount != 0 && pvt->bufcount >= pvt->limits.maxcount)
+        err = flush(pvt, true);
+    else
+        err = flush(pvt, false);
+    if (err == 0 && !STAILQ_EMPTY(&pvt->databuf))
+        err = schedule_flush(node, pvt);
+    return err;
 }
 
 static int rcvmsg(dmm_node_p node, dmm_msg_p msg)
 {
     struct pvt_data *pvt;
-    struct datalist *dl;
-    dmm_datanode_p dn;
-    dmm_data_p data;
-    size_t len;
+    dmm_msg_p resp;
     int err = 0;
 
+#define CREATE_SEND_EMPTY_RESP()                                    \
+        do {                                                        \
+            resp = DMM_MSG_CREATE_RESP(DMM_NODE_ID(node), msg, 0);  \
+            if (resp != NULL) {                                     \
+                if (err != 0)                                       \
+                    msg->cm_flags |= DMM_MSG_ERR;                   \
+                                                                    \
+                DMM_MSG_SEND_ID(msg->cm_src, resp);                 \
+            } else                                                  \
+                err = (err != 0) ? err : ENOMEM;                    \
+        } while (0)
+
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
     if (msg->cm_flags & DMM_MSG_RESP) {
-        if (msg->cm_flags & DMM_MSG_ERR)
+        if (msg->cm_flags & DMM_MSG_ERR) {
             dmm_log(DMM_LOG_ERR, DMM_PRINODE "received error response", DMM_NODEINFO(node));
+            if (msg->cm_type == DMM_MSGTYPE_GENERIC && msg->cm_cmd == DMM_MSG_TIMERSET)
+                pvt->timer_armed = false;
+        } else if (msg->cm_type == DMM_MSGTYPE_GENERIC && msg->cm_cmd == DMM_MSG_TIMERCREATE) {
+            dmm_msg_p tsmsg;
+            struct dmm_msg_timersubscribe *ts;
+
+            pvt->timer_id = DMM_MSG_DATA(msg, struct dmm_msg_timercreate_resp)->id;
+            tsmsg = DMM_MSG_CREATE(DMM_NODE_ID(node), DMM_MSG_TIMERSUBSCRIBE,
+                                   DMM_MSGTYPE_GENERIC, 0, 0, sizeof(*ts));
+            if (tsmsg != NULL) {
+                ts = DMM_MSG_DATA(tsmsg, struct dmm_msg_timersubscribe);
+                ts->id = pvt->timer_id;
+                DMM_MSG_SEND_ID(DMM_NODE_ID(node), tsmsg);
+            } else {
+                err = ENOMEM;
+            }
+        }
         goto out;
     }
-    if (msg->cm_type != DMM_MSGTYPE_GENERIC || msg->cm_cmd != DMM_MSG_WAVEFINISH) {
-        err = ENOTSUP;
-        goto out;
-    }
-    /* Only DMM_MSG_WAVEFINISH generic msg is supported */
-    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(node);
-    len = 0;
-    STAILQ_FOREACH(dl, &pvt->databuf, datas) {
-        for (dn = DMM_DATA_NODES(dl->data); !DMM_DN_ISEND(dn); DMM_DN_ADVANCE(dn))
-            ;
-        dl->dnsumlen = (char *)dn - (char *)DMM_DATA_NODES(dl->data);
-        len += dl->dnsumlen;
-    }
-    data = NULL;
-    /*
-     * If hook == NULL we have no way to send buffered data,
-     * so no need to alloc and prepare it
-     */
-    if (pvt->hook != NULL)
-        data = DMM_DATA_CREATE_RAW(0, len);
-    if (data != NULL)
-        dn = DMM_DATA_NODES(data);
-    else {
-        err = ENOMEM;
-    }
-    while (!STAILQ_EMPTY(&pvt->databuf)) {
-        dl = STAILQ_FIRST(&pvt->databuf);
-        if (data != NULL) {
-            memcpy(dn, DMM_DATA_NODES(dl->data), dl->dnsumlen);
-            dn = (dmm_datanode_p)((char *)dn + dl->dnsumlen);
+
+    switch (msg->cm_type) {
+    case DMM_MSGTYPE_GENERIC:
+        switch (msg->cm_cmd) {
+        case DMM_MSG_WAVEFINISH:
+            pvt->wf_subscribed = false;
+            /* Buffered data is sent by timer if it is set */
+            if (!pvt->timer_armed)
+                err = flush(pvt, true);
+            break;
+
+        case DMM_MSG_TIMERTRIGGER:
+            if (DMM_MSG_DATA(msg, struct dmm_msg_timertrigger)->id != pvt->timer_id)
+                break;
+            pvt->timer_armed = false;
+            err = flush(pvt, true);
+            break;
+
+        default:
+            err = ENOTSUP;
+            break;
         }
-        DMM_DATA_UNREF(dl->data);
-        STAILQ_REMOVE_HEAD(&pvt->databuf, datas);
-        DMM_FREE(dl);
-    }
-    if (data != NULL) {
-        DMM_DN_MKEND(dn);
-        DMM_DATA_SEND(data, pvt->hook);
-        DMM_DATA_UNREF(data);
+        break;
+
+    case DMM_MSGTYPE_WAVEBUF:
+        switch (msg->cm_cmd) {
+        case DMM_MSG_WAVEBUF_SET: {
+            struct dmm_msg_wavebuf_set *s;
+            s = DMM_MSG_DATA(msg, struct dmm_msg_wavebuf_set);
+            if (msg->cm_len != sizeof(*s) ||
+                (s->maxbytes != 0 && s->maxbytes <= sizeof(struct dmm_datanode)) ||
+                s->maxlatency.tv_sec < 0 ||
+                s->maxlatency.tv_nsec < 0 || s->maxlatency.tv_nsec >= 1000000000) {
+                err = EINVAL;
+                CREATE_SEND_EMPTY_RESP();
+                break;
+            }
+            pvt->limits = *s;
+            if (latency_limited(pvt) && pvt->timer_id == 0) {
+                dmm_msg_p tcmsg;
+                tcmsg = DMM_MSG_CREATE(DMM_NODE_ID(node), DMM_MSG_TIMERCREATE,
+                                       DMM_MSGTYPE_GENERIC, 0, 0, 0);
+                if (tcmsg != NULL)
+                    DMM_MSG_SEND_ID(DMM_NODE_ID(node), tcmsg);
+                else
+                    err = ENOMEM;
+            }
+            CREATE_SEND_EMPTY_RESP();
+            break;
+        }
+
+        default:
+            err = ENOTSUP;
+            break;
+        }
+        break;
+
+    default:
+        err = ENOTSUP;
+        break;
     }
 
+#undef CREATE_SEND_EMPTY_RESP
+
 out:
     DMM_MSG_FREE(msg);
     return err;
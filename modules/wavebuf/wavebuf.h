@@ -0,0 +1,39 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+#ifndef MODULES_WAVEBUF_WAVEBUF_H_
+#define MODULES_WAVEBUF_WAVEBUF_H_
+
+#include <time.h>
+
+#include "dmm_types.h"
+
+enum {
+    DMM_MSGTYPE_WAVEBUF = 0xa1ac03d9
+};
+
+enum {
+    DMM_MSG_WAVEBUF_SET = 1,
+};
+
+/*
+ * Flushing parameters, zero value means no limit
+ *   maxbytes - maximum length of output data including terminator
+ *              datanode (e.g. 1472 to fit in one UDP datagram with
+ *              1500 bytes MTU), must leave room for more than the
+ *              terminator. Buffered data are flushed as soon as
+ *              they fill an output, datanodes longer than maxbytes
+ *              are sent alone.
+ *   maxcount - flush when this number of datas is buffered
+ *   maxlatency - flush not later than maxlatency after the first
+ *              data is buffered instead of at wave finish, so datas
+ *              from several waves can be batched together
+ */
+struct dmm_msg_wavebuf_set {
+    uint32_t        maxbytes;
+    uint32_t        maxcount;
+    struct timespec maxlatency;
+};
+
+#endif /* MODULES_WAVEBUF_WAVEBUF_H_ */
@@ -0,0 +1,32 @@
+-- SPDX-License-Identifier: BSD-2-Clause-Views
+-- Copyright (c) 2013-2023
+--   Research Computing Center Lomonosov Moscow State University
+
+local dmm = require('dmm')
+
+assert(dmm.require_interface('wavebuf', 'll'))
+
+local Wavebuf = dmm.Module:new_type('wavebuf')
+
+--! @brief Set flushing limits, omitted or zero limits are disabled
+--! @param limits table with fields
+--!   maxbytes - maximum output data length in bytes, larger than
+--!              the terminating datanode
+--!   maxcount - flush after this number of datas is buffered
+--!   maxlatency - flush not later than this number of seconds
+--!                (may be fractional) instead of at wave finish
+function Wavebuf:set(limits)
+  local msg, s = dmm.msg_create{
+    payload_type = 'struct dmm_msg_wavebuf_set',
+    type = ffi.C.DMM_MSGTYPE_WAVEBUF,
+    cmd = ffi.C.DMM_MSG_WAVEBUF_SET,
+  }
+  local latency = limits.maxlatency or 0
+  s.maxbytes = limits.maxbytes or 0
+  s.maxcount = limits.maxcount or 0
+  s.maxlatency.tv_sec = math.floor(latency)
+  s.maxlatency.tv_nsec = math.floor((latency - math.floor(latency)) * 1e9)
+  dmm.msg_send(self.nodeid, msg)
+end
+
+return Wavebuf
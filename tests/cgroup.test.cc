@@ -0,0 +1,218 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+/*
+ * cgroup on a fixture root created in a temporary directory and set
+ * with DMM_MSG_CGROUP_SETROOT, jobs are added and removed between ticks
+ */
+
+#undef malloc
+#undef calloc
+#undef realloc
+#undef free
+
+#include "../modules/sensors/cgroup/cgroup.c"
+#include "sensortest.h"
+
+#include "CppUTest/CommandLineTestRunner.h"
+
+TEST_GROUP(CgroupFixture)
+{
+    struct sensortest st;
+    struct pvt_data *pvt;
+    char root[PATH_MAX];
+
+    void setup()
+    {
+        sensortest_mkroot(root);
+        sensortest_init(&st, &type, true);
+        pvt = (struct pvt_data *)DMM_NODE_PRIVATE(&st.node);
+    }
+
+    void teardown()
+    {
+        sensortest_fini(&st);
+        sensortest_rmroot(root);
+    }
+
+    void setRoot()
+    {
+        struct dmm_msg_cgroup_setroot sr;
+
+        memset(&sr, 0, sizeof(sr));
+        strcpy(sr.root, root);
+        strcpy(sr.pattern, "job_*");
+        LONGS_EQUAL(0, sensortest_msg(&st, DMM_MSGTYPE_CGROUP, DMM_MSG_CGROUP_SETROOT,
+                                      &sr, sizeof(sr)));
+    }
+
+    /* Job using cpu microseconds, io.stat has two devices */
+    void addJob(const char *name, unsigned cpu)
+    {
+        char path[PATH_MAX], buf[256];
+
+        snprintf(path, sizeof(path), "%s/cpu.stat", name);
+        snprintf(buf, sizeof(buf), "usage_usec %u\nuser_usec %u\nsystem_usec %u\n"
+                                   "nr_periods 0\n", cpu, cpu - cpu / 4, cpu / 4);
+        sensortest_write(root, path, buf);
+        snprintf(path, sizeof(path), "%s/memory.current", name);
+        sensortest_write(root, path, "1048576\n");
+        snprintf(path, sizeof(path), "%s/memory.stat", name);
+        sensortest_write(root, path, "anon 524288\nfile 262144\nkernel 4096\n");
+        snprintf(path, sizeof(path), "%s/io.stat", name);
+        sensortest_write(root, path,
+                         "8:0 rbytes=100 wbytes=200 rios=1 wios=2 dbytes=0 dios=0\n"
+                         "259:0 rbytes=1000 wbytes=2000 rios=10 wios=20 dbytes=0 dios=0\n");
+    }
+
+    void removeJob(const char *name)
+    {
+        char path[PATH_MAX + 32];
+
+        snprintf(path, sizeof(path), "%s/%s", root, name);
+        sensortest_rmroot(path);
+    }
+
+    size_t numJobs()
+    {
+        dmm_datanode_p dn = sensortest_find(&st, CGROUP_JOBID);
+
+        return dn != NULL ? DMM_DN_VECSIZE(dn, uint64_t) : 0;
+    }
+
+    /* Value of sensor id of the job, the order of jobs is the order of readdir */
+    uint64_t value(uint64_t jobid, dmm_sensorid_t id)
+    {
+        dmm_datanode_p ids = sensortest_find(&st, CGROUP_JOBID);
+        dmm_datanode_p dn = sensortest_find(&st, id);
+        size_t i;
+
+        CHECK(ids != NULL && dn != NULL);
+        for (i = 0; i < DMM_DN_VECSIZE(ids, uint64_t); ++i)
+            if (DMM_DN_VECTOR(ids, uint64_t)[i] == jobid)
+                return DMM_DN_VECTOR(dn, uint64_t)[i];
+        FAIL("No such job");
+        return 0;
+    }
+};
+
+TEST(CgroupFixture, ScansJobsMatchingPattern)
+{
+    struct dmm_cgroup_name *names;
+    dmm_datanode_p dn;
+
+    addJob("job_123", 4000);
+    addJob("job_45_step_batch", 800);
+    addJob("other_7", 100);
+    sensortest_write(root, "job_9", "not a directory\n");
+    setRoot();
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    CHECK_EQUAL(2u, numJobs());
+    CHECK_EQUAL(4000u, value(123, CGROUP_CPU_USAGE));
+    CHECK_EQUAL(3000u, value(123, CGROUP_CPU_USER));
+    CHECK_EQUAL(1000u, value(123, CGROUP_CPU_SYSTEM));
+    CHECK_EQUAL(800u, value(45, CGROUP_CPU_USAGE));
+    CHECK_EQUAL(1048576u, value(45, CGROUP_MEMORY_CURRENT));
+    CHECK_EQUAL(524288u, value(45, CGROUP_MEMORY_ANON));
+    CHECK_EQUAL(262144u, value(45, CGROUP_MEMORY_FILE));
+    dn = sensortest_find(&st, CGROUP_NAMES);
+    CHECK(dn != NULL);
+    CHECK_EQUAL(2u, DMM_DN_VECSIZE(dn, struct dmm_cgroup_name));
+    names = DMM_DN_VECTOR(dn, struct dmm_cgroup_name);
+    CHECK(strcmp(names[0].name, "job_123") == 0 || strcmp(names[1].name, "job_123") == 0);
+    CHECK(strcmp(names[0].name, "job_45_step_batch") == 0 ||
+          strcmp(names[1].name, "job_45_step_batch") == 0);
+
+    /* Names are sent only when the set of jobs changes */
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    POINTERS_EQUAL(NULL, sensortest_find(&st, CGROUP_NAMES));
+};
+
+TEST(CgroupFixture, SumsIoStatOverDevices)
+{
+    char path[PATH_MAX + 32];
+
+    addJob("job_1", 100);
+    /* No io controller */
+    addJob("job_2", 100);
+    snprintf(path, sizeof(path), "%s/job_2/io.stat", root);
+    unlink(path);
+    setRoot();
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    CHECK_EQUAL(1100u, value(1, CGROUP_IO_RBYTES));
+    CHECK_EQUAL(2200u, value(1, CGROUP_IO_WBYTES));
+    CHECK_EQUAL(11u, value(1, CGROUP_IO_RIOS));
+    CHECK_EQUAL(22u, value(1, CGROUP_IO_WIOS));
+    CHECK_EQUAL(0u, value(2, CGROUP_IO_RBYTES));
+    CHECK_EQUAL(0u, value(2, CGROUP_IO_WIOS));
+};
+
+TEST(CgroupFixture, FollowsJobsWithInotify)
+{
+    addJob("job_1", 100);
+    setRoot();
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    CHECK_EQUAL(1u, numJobs());
+    CHECK(pvt->wd >= 0);
+
+    addJob("job_2", 200);
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    CHECK_FALSE(pvt->rescan);
+    CHECK_EQUAL(2u, numJobs());
+    CHECK_EQUAL(200u, value(2, CGROUP_CPU_USAGE));
+    CHECK(sensortest_find(&st, CGROUP_NAMES) != NULL);
+
+    removeJob("job_1");
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    CHECK_FALSE(pvt->rescan);
+    CHECK_EQUAL(1u, numJobs());
+    CHECK_EQUAL(200u, value(2, CGROUP_CPU_USAGE));
+    CHECK(sensortest_find(&st, CGROUP_NAMES) != NULL);
+};
+
+TEST(CgroupFixture, RescansWithoutInotify)
+{
+    close(pvt->infd);
+    pvt->infd = -1;
+    addJob("job_1", 100);
+    setRoot();
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    CHECK_EQUAL(1u, numJobs());
+
+    addJob("job_2", 200);
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    CHECK_EQUAL(2u, numJobs());
+    removeJob("job_1");
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    CHECK_EQUAL(1u, numJobs());
+    CHECK_EQUAL(200u, value(2, CGROUP_CPU_USAGE));
+};
+
+TEST(CgroupFixture, RescansAfterReadError)
+{
+    int fd;
+
+    addJob("job_1", 100);
+    setRoot();
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    CHECK_EQUAL(1u, numJobs());
+
+    /* pread() of a directory fails with EISDIR */
+    fd = pvt->jobs[0]->files[FILE_CPU_STAT].fd;
+    CHECK(dup2(pvt->jobs[0]->dirfd, fd) == fd);
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    CHECK_EQUAL(0u, pvt->num_jobs);
+    CHECK(pvt->rescan);
+
+    /* The job is still there and is found again */
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    CHECK_FALSE(pvt->rescan);
+    CHECK_EQUAL(1u, numJobs());
+    CHECK_EQUAL(100u, value(1, CGROUP_CPU_USAGE));
+};
+
+int main(int argc, char** argv)
+{
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
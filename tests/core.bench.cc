@@ -0,0 +1,323 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+/*
+ * Cost of core primitives depending on the size of the structures
+ * they work with. Usage: core.bench.out [max_n]
+ *
+ * For n = 1, 10, 100... up to max_n (10000 by default) one line
+ * is printed per primitive with the mean time of one operation:
+ *   data_create  - dmm_data_create_raw of n 8-byte datanodes and unref
+ *   dn_iterate   - DMM_DN_NEXT pass over the n datanodes
+ *   msg_create   - dmm_msg_create with n bytes of payload and free
+ *   msg_copy     - dmm_msg_copy of the same message and free
+ *   data_send    - dmm_data_send of one datanode to n peers
+ *   event_send   - dmm_event_sendsubscribed to n subscribers
+ *   node_id2ref  - dmm_node_id2ref of the oldest of n nodes and unref
+ *   timer_set    - dmm_timer_set to the latest time with n armed timers
+ * Linear growth of ns_per_op shows an O(n) structure, operations
+ * which are O(1) should stay flat.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+extern "C" {
+#include "dmm_base_internals.h"
+#include "dmm_sockevent.h"
+#include "dmm_timer.h"
+#include "dmm_wave.h"
+}
+
+#include "../dmm_module.c"
+#include "dmm_message.h"
+
+/* Message type of event_send messages, handled by benchnode only */
+#define BENCH_MSGTYPE 0x62656e63
+
+/* Total work per measurement, operations are repeated ~WORK / n times */
+#define WORK        2000000
+#define MIN_ITERS   100
+
+static dmm_id_t controller;
+static dmm_id_t created;
+static int failed;
+static volatile uint64_t sink;
+
+static int bench_newhook(dmm_hook_p hook)
+{
+    (void)hook;
+    return 0;
+}
+
+static int bench_rcvdata(dmm_hook_p hook, dmm_data_p data)
+{
+    (void)hook;
+    sink++;
+    DMM_DATA_UNREF(data);
+    return 0;
+}
+
+/* Responses of NODECREATE and NODECONNECT sent by controller come here */
+static int bench_rcvmsg(dmm_node_p node, dmm_msg_p msg)
+{
+    if (msg->cm_type == DMM_MSGTYPE_GENERIC && msg->cm_cmd == DMM_MSG_STARTUP) {
+        controller = DMM_NODE_ID(node);
+    } else if (msg->cm_flags & DMM_MSG_RESP) {
+        if (msg->cm_flags & DMM_MSG_ERR)
+            failed = 1;
+        else if (msg->cm_cmd == DMM_MSG_NODECREATE)
+            created = msg->cm_src;
+    } else {
+        sink++;
+    }
+    DMM_MSG_FREE(msg);
+    return 0;
+}
+
+static struct dmm_type bench_type = {
+    "benchnode",
+    NULL,
+    NULL,
+    bench_rcvdata,
+    bench_rcvmsg,
+    bench_newhook,
+    NULL,
+    {},
+};
+
+static double now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void report(const char *op, unsigned n, double ns)
+{
+    printf("bench=core op=%s n=%u ns_per_op=%.1f\n", op, n, ns);
+}
+
+/* Mean time of op() in ns, work is the cost of one call in elementary steps */
+template <typename F>
+static double measure(unsigned work, F op)
+{
+    unsigned i, iters;
+    double start;
+
+    iters = WORK / (work > 0 ? work : 1);
+    if (iters < MIN_ITERS)
+        iters = MIN_ITERS;
+    for (i = 0; i < iters / 10; ++i)
+        op();
+    start = now();
+    for (i = 0; i < iters; ++i)
+        op();
+    return (now() - start) / iters;
+}
+
+static dmm_id_t create_node()
+{
+    dmm_msg_p msg;
+
+    msg = DMM_MSG_CREATE(controller, DMM_MSG_NODECREATE, DMM_MSGTYPE_GENERIC, 0, 0,
+                         sizeof(struct dmm_msg_nodecreate));
+    if (msg == NULL)
+        return 0;
+    snprintf(DMM_MSG_DATA(msg, struct dmm_msg_nodecreate)->type, DMM_TYPENAMESIZE,
+             "%s", bench_type.tp_name);
+    created = 0;
+    DMM_MSG_SEND_ID(controller, msg);
+    return failed ? 0 : created;
+}
+
+/* Connect outhook "out" of src to inhook "in" of dst */
+static int connect_nodes(dmm_id_t src, dmm_id_t dst)
+{
+    struct dmm_msg_nodeconnect *conn;
+    dmm_msg_p msg;
+
+    msg = DMM_MSG_CREATE(controller, DMM_MSG_NODECONNECT, DMM_MSGTYPE_GENERIC, 0, 0, sizeof(*conn));
+    if (msg == NULL)
+        return ENOMEM;
+    conn = DMM_MSG_DATA(msg, struct dmm_msg_nodeconnect);
+    snprintf(conn->srchook, sizeof(conn->srchook), "out");
+    snprintf(conn->dstnode, sizeof(conn->dstnode), "[%" PRIuid "]", dst);
+    snprintf(conn->dsthook, sizeof(conn->dsthook), "in");
+    DMM_MSG_SEND_ID(src, msg);
+    return failed ? EINVAL : 0;
+}
+
+/* Data with n datanodes of 8 bytes */
+static dmm_data_p create_data(unsigned n)
+{
+    dmm_data_p data;
+    dmm_datanode_p dn;
+    unsigned i;
+
+    if ((data = DMM_DATA_CREATE(n, sizeof(uint64_t))) == NULL)
+        return NULL;
+    dn = DMM_DATA_NODES(data);
+    for (i = 0; i < n; ++i) {
+        DMM_DN_CREATE(dn, i + 1, sizeof(uint64_t));
+        *DMM_DN_DATA(dn, uint64_t) = i;
+        DMM_DN_ADVANCE(dn);
+    }
+    DMM_DN_MKEND(dn);
+    return data;
+}
+
+static int bench_data(unsigned n)
+{
+    dmm_data_p data;
+
+    report("data_create", n, measure(n, [n]() {
+        dmm_data_p d = DMM_DATA_CREATE(n, sizeof(uint64_t));
+        DMM_DATA_UNREF(d);
+    }));
+
+    if ((data = create_data(n)) == NULL)
+        return ENOMEM;
+    report("dn_iterate", n, measure(n, [data]() {
+        dmm_datanode_p dn;
+        uint64_t sum = 0;
+
+        for (dn = DMM_DATA_NODES(data); !DMM_DN_ISEND(dn); dn = DMM_DN_NEXT(dn))
+            sum += *DMM_DN_DATA(dn, uint64_t);
+        sink = sum;
+    }));
+    DMM_DATA_UNREF(data);
+    return 0;
+}
+
+static int bench_msg(unsigned n)
+{
+    dmm_msg_p msg;
+
+    report("msg_create", n, measure(n / 64, [n]() {
+        dmm_msg_p m = DMM_MSG_CREATE(0, 1, BENCH_MSGTYPE, 0, 0, n);
+        DMM_MSG_FREE(m);
+    }));
+
+    if ((msg = DMM_MSG_CREATE(0, 1, BENCH_MSGTYPE, 0, 0, n)) == NULL)
+        return ENOMEM;
+    memset(DMM_MSG_DATA(msg, char), 0, n);
+    report("msg_copy", n, measure(n / 64, [msg]() {
+        dmm_msg_p m = DMM_MSG_COPY(msg);
+        DMM_MSG_FREE(m);
+    }));
+    DMM_MSG_FREE(msg);
+    return 0;
+}
+
+/*
+ * n nodes are connected to source and subscribed to event,
+ * nodes are added between measurements as n grows
+ */
+static int bench_nodes(unsigned max_n)
+{
+    struct dmm_event event;
+    dmm_node_p src, peer;
+    dmm_hook_p hook;
+    dmm_data_p data;
+    dmm_id_t srcid, id;
+    unsigned n, count;
+    int err;
+
+    if ((srcid = create_node()) == 0)
+        return ENOMEM;
+    src = dmm_node_id2ref(srcid);
+    dmm_event_init(&event);
+    if ((data = create_data(1)) == NULL)
+        return ENOMEM;
+
+    count = 0;
+    for (n = 1; n <= max_n; n *= 10) {
+        for (; count < n; ++count) {
+            if ((id = create_node()) == 0)
+                return ENOMEM;
+            if ((err = connect_nodes(srcid, id)) != 0)
+                return err;
+            peer = dmm_node_id2ref(id);
+            err = dmm_event_subscribe(&event, peer);
+            DMM_NODE_UNREF(peer);
+            if (err != 0)
+                return err;
+        }
+        hook = LIST_FIRST(&src->nd_outhooks);
+
+        report("data_send", n, measure(n, [data, hook]() {
+            DMM_DATA_SEND(data, hook);
+        }));
+        report("event_send", n, measure(n, [&event]() {
+            dmm_msg_p m = DMM_MSG_CREATE(0, 1, BENCH_MSGTYPE, 0, 0, 0);
+            dmm_event_sendsubscribed(&event, m);
+        }));
+        /* Nodes are looked up in a list of all nodes, controller is the oldest */
+        report("node_id2ref", n, measure(n, []() {
+            dmm_node_p node = dmm_node_id2ref(controller);
+            DMM_NODE_UNREF(node);
+        }));
+    }
+
+    DMM_DATA_UNREF(data);
+    DMM_NODE_UNREF(src);
+    return 0;
+}
+
+/* n timers are armed, probe is re-armed after all of them */
+static int bench_timers(unsigned max_n)
+{
+    struct timespec next, interval = {1, 0};
+    struct timespec probe_next = {7200, 0};
+    dmm_timer_p timer, probe;
+    unsigned n, count;
+    int err;
+
+    if ((err = dmm_timer_create(&probe)) != 0)
+        return err;
+    count = 0;
+    for (n = 1; n <= max_n; n *= 10) {
+        for (; count < n; ++count) {
+            if ((err = dmm_timer_create(&timer)) != 0)
+                return err;
+            next = (struct timespec){3600, (long)count};
+            if ((err = dmm_timer_set(timer, &next, &interval, 0)) != 0)
+                return err;
+        }
+        report("timer_set", n, measure(n, [probe, &probe_next, &interval]() {
+            dmm_timer_set(probe, &probe_next, &interval, 0);
+        }));
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned n, max_n;
+    int err;
+
+    max_n = (argc > 1) ? strtoul(argv[1], NULL, 10) : 10000;
+    if (max_n == 0)
+        max_n = 1;
+
+    if (dmm_initialize() != 0)
+        return 1;
+    dmm_type_register(&bench_type);
+    dmm_startup(bench_type.tp_name, -1, 0);
+
+    for (n = 1; n <= max_n; n *= 10)
+        if ((err = bench_data(n)) != 0 || (err = bench_msg(n)) != 0)
+            goto err;
+    if ((err = bench_nodes(max_n)) != 0 || (err = bench_timers(max_n)) != 0)
+        goto err;
+    return 0;
+
+err:
+    fprintf(stderr, "core benchmark failed: %s\n", strerror(err));
+    return 1;
+}
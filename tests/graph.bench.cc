@@ -0,0 +1,270 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+/*
+ * Throughput of whole graphs driven by the dummy load generator.
+ * Usage: graph.bench.out topdir seconds config...
+ *
+ * Every config is a Lua script run by luacontrol in a separate process
+ * with topdir as working directory, see graph.files/bench.lua. It builds
+ * a graph ending in "benchsink" nodes, which count what they receive.
+ * After a warm-up the main loop runs for the given time, then one line
+ * is printed per config: data objects, datanodes and bytes received
+ * by sinks per second, malloc calls per received data object, number
+ * of waves, 99th percentile of wave duration and the share of time
+ * spent in waves (close to 1 means the graph is saturated).
+ */
+
+#include <sys/epoll.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+extern "C" {
+#include "dmm_base_internals.h"
+#include "dmm_sockevent.h"
+#include "dmm_timer.h"
+#include "dmm_wave.h"
+}
+
+#include "../dmm_module.c"
+#include "dmm_message.h"
+
+static const char *bench_modules[] = {
+    "lib/libluacontrol.so",
+    "lib/libdummy.so",
+    "lib/libderivative.so",
+    "lib/libaggregateall.so",
+    "lib/libprepend.so",
+    "lib/libdemux.so",
+    "lib/libwavebuf.so",
+    "lib/libnet_ip.so",
+};
+
+#define NUM_BENCH_MODULES (sizeof(bench_modules) / sizeof(bench_modules[0]))
+
+/*
+ * DMM_MALLOC is malloc, so counting calls here covers the core and
+ * all modules, the binary is linked with --export-dynamic
+ */
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t nmemb, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+
+static uint64_t num_allocs;
+
+extern "C" void *malloc(size_t size)
+{
+    ++num_allocs;
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t nmemb, size_t size)
+{
+    ++num_allocs;
+    return __libc_calloc(nmemb, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    ++num_allocs;
+    return __libc_realloc(ptr, size);
+}
+
+static struct {
+    uint64_t datas;
+    uint64_t datanodes;
+    uint64_t bytes;
+} sink;
+
+static int sink_newhook(dmm_hook_p hook)
+{
+    if (DMM_HOOK_ISOUT(hook))
+        return EINVAL;
+    return 0;
+}
+
+static int sink_rcvdata(dmm_hook_p hook, dmm_data_p data)
+{
+    dmm_datanode_p dn;
+
+    (void)hook;
+    sink.datas++;
+    sink.bytes += DMM_DATA_SIZE(data);
+    for (dn = DMM_DATA_NODES(data); !DMM_DN_ISEND(dn); DMM_DN_ADVANCE(dn))
+        sink.datanodes++;
+    DMM_DATA_UNREF(data);
+    return 0;
+}
+
+static struct dmm_type sink_type = {
+    "benchsink",
+    NULL,
+    NULL,
+    sink_rcvdata,
+    NULL,
+    sink_newhook,
+    NULL,
+    {},
+};
+
+static double now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+ * One iteration of dmm_main_loop, put wave duration in ns to durations.
+ * Configs must have at least one timer, otherwise this waits forever
+ */
+static int run_wave(std::vector<double> &durations)
+{
+    struct timespec now_rt, next;
+    struct epoll_event ev;
+    int timeout_ms, ret, err;
+    double start;
+
+    clock_gettime(CLOCK_REALTIME, &now_rt);
+    if ((err = dmm_timers_next(&next)) == 0) {
+        timeout_ms = (next.tv_sec - now_rt.tv_sec) * 1000 +
+                     (next.tv_nsec - now_rt.tv_nsec) / 1000000;
+        if (timeout_ms < 0)
+            timeout_ms = 0;
+    } else if (err == ENOENT) {
+        timeout_ms = -1;
+    } else {
+        return err;
+    }
+    if ((ret = epoll_wait(dmm_epollfd, &ev, 1, timeout_ms)) < 0)
+        return errno == EINTR ? 0 : errno;
+
+    start = now();
+    if ((err = dmm_wave_start()) != 0)
+        return err;
+    if (ret > 0 && (err = dmm_sockevent_process(&ev)) != 0)
+        return err;
+    if ((err = dmm_timers_trigger(ret == 0)) != 0)
+        return err;
+    if ((err = dmm_wave_finish()) != 0)
+        return err;
+    durations.push_back(now() - start);
+    return 0;
+}
+
+/* Run the main loop for ns nanoseconds */
+static int run_for(double ns, std::vector<double> &durations)
+{
+    double finish;
+    int err;
+
+    for (finish = now() + ns; now() < finish; )
+        if ((err = run_wave(durations)) != 0)
+            return err;
+    return 0;
+}
+
+static int bench_config(const char *topdir, double seconds, const char *config)
+{
+    std::vector<double> durations;
+    const char *name;
+    double start, elapsed, busy, p99;
+    uint64_t allocs;
+    size_t i;
+    int fd, err;
+
+    if ((fd = open(config, O_RDONLY | O_CLOEXEC)) < 0) {
+        perror(config);
+        return 1;
+    }
+    if (chdir(topdir) != 0) {
+        perror(topdir);
+        return 1;
+    }
+    if (dmm_initialize() != 0)
+        return 1;
+    dmm_type_register(&sink_type);
+    for (i = 0; i < NUM_BENCH_MODULES; ++i)
+        if (dmm_module_load(bench_modules[i]) != 0)
+            return 1;
+    dmm_startup("luacontrol", fd, 0);
+    close(fd);
+
+    durations.reserve(1 << 20);
+    if ((err = run_for(seconds * 0.2e9, durations)) != 0)
+        goto err;
+    durations.clear();
+    memset(&sink, 0, sizeof(sink));
+    allocs = num_allocs;
+    start = now();
+    if ((err = run_for(seconds * 1e9, durations)) != 0)
+        goto err;
+    elapsed = (now() - start) / 1e9;
+    allocs = num_allocs - allocs;
+
+    busy = 0;
+    for (i = 0; i < durations.size(); ++i)
+        busy += durations[i];
+    p99 = 0;
+    if (!durations.empty()) {
+        std::vector<double>::iterator nth = durations.begin() + durations.size() * 99 / 100;
+        std::nth_element(durations.begin(), nth, durations.end());
+        p99 = *nth;
+    }
+    name = strrchr(config, '/') != NULL ? strrchr(config, '/') + 1 : config;
+    printf("bench=graph config=%s seconds=%.2f msgs_per_s=%.0f datanodes_per_s=%.0f "
+           "bytes_per_s=%.0f allocs_per_msg=%.2f waves=%zu wave_p99_ns=%.0f busy=%.2f\n",
+           name, elapsed, sink.datas / elapsed, sink.datanodes / elapsed,
+           sink.bytes / elapsed, sink.datas > 0 ? (double)allocs / sink.datas : 0.0,
+           durations.size(), p99, busy / 1e9 / elapsed);
+    return 0;
+
+err:
+    fprintf(stderr, "%s: main loop failed: %s\n", config, strerror(err));
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    double seconds;
+    pid_t pid;
+    int i, status, failed;
+
+    if (argc < 4) {
+        fprintf(stderr, "Usage: %s topdir seconds config...\n", argv[0]);
+        return 1;
+    }
+    seconds = atof(argv[2]);
+    if (seconds <= 0)
+        seconds = 1;
+
+    /* Graphs cannot be torn down, so every config runs in its own process */
+    failed = 0;
+    for (i = 3; i < argc; ++i) {
+        fflush(stdout);
+        if ((pid = fork()) < 0) {
+            perror("fork");
+            return 1;
+        }
+        if (pid == 0) {
+            status = bench_config(argv[1], seconds, argv[i]);
+            fflush(stdout);
+            _exit(status);
+        }
+        if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "%s: benchmark failed\n", argv[i]);
+            failed = 1;
+        }
+    }
+    return failed;
+}
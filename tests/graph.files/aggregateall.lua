@@ -0,0 +1,18 @@
+-- SPDX-License-Identifier: BSD-2-Clause-Views
+-- Copyright (c) 2013-2023
+--   Research Computing Center Lomonosov Moscow State University
+
+-- 4 x dummy -> aggregateall -> sink, aggregates are sent every tick
+
+local bench = assert(loadfile('tests/graph.files/bench.lua'))()
+local Aggregateall = assert(dmm.require_interface('aggregateall'))
+
+local aggregateall = Aggregateall:new()
+local sink = bench.Sink:new()
+
+aggregateall:set(1000, 1031, 'uint64_t', 2000)
+for i = 1, 4 do
+  bench.generator({seed = i, objects = 25}):connect('out', aggregateall, 'in')
+end
+aggregateall:connect('out', sink, 'in')
+aggregateall:timer_subscribe(bench.timer)
@@ -0,0 +1,54 @@
+-- SPDX-License-Identifier: BSD-2-Clause-Views
+-- Copyright (c) 2013-2023
+--   Research Computing Center Lomonosov Moscow State University
+
+-- Common part of graph benchmark configs, see graph.bench.cc.
+-- Configs are run with TOPDIR as working directory and load it with
+-- local bench = assert(loadfile('tests/graph.files/bench.lua'))()
+-- (dofile would not let control messages wait for responses)
+
+package.path = package.path .. ';./lib/?.lua'
+package.cpath = package.cpath .. ';./lib/lib?.so;'
+dmm = require('dmm')
+ffi = require('ffi')
+dmm.ll_ipath = dmm.ll_ipath .. ';lib/?.i'
+dmm.hl_ipath = dmm.hl_ipath .. ';lib/?.lua'
+
+local bench = {}
+
+local Dummy = assert(dmm.require_interface('dummy'))
+
+bench.Sink = dmm.Module:new_type('benchsink')
+
+-- All generators and periodic nodes are triggered every millisecond
+bench.timer = dmm.Timer:new()
+bench.timer:setperiodic(0, 1000000)
+
+-- Default load of one generator: 32 vectors of 16 uint64_t counters,
+-- 100 data objects per tick, enough to keep the loop busy most of the time
+bench.load = {
+  first = 1000,
+  sensors = 32,
+  len = 16,
+  type = 'uint64_t',
+  pattern = 'counter',
+  objects = 100,
+}
+
+--! @brief Create a generator subscribed to bench.timer
+--! @param params overrides of bench.load fields
+function bench.generator(params)
+  local p = {}
+  for k, v in pairs(bench.load) do
+    p[k] = v
+  end
+  for k, v in pairs(params or {}) do
+    p[k] = v
+  end
+  local gen = Dummy:new()
+  gen:set(p)
+  gen:timer_subscribe(bench.timer)
+  return gen
+end
+
+return bench
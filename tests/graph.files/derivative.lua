@@ -0,0 +1,16 @@
+-- SPDX-License-Identifier: BSD-2-Clause-Views
+-- Copyright (c) 2013-2023
+--   Research Computing Center Lomonosov Moscow State University
+
+-- dummy -> derivative -> sink
+
+local bench = assert(loadfile('tests/graph.files/bench.lua'))()
+local Derivative = assert(dmm.require_interface('derivative'))
+
+local gen = bench.generator()
+local derivative = Derivative:new()
+local sink = bench.Sink:new()
+
+derivative:set(1000, 1031, 'uint64_t', true, 2000)
+gen:connect('out', derivative, 'in')
+derivative:connect('out', sink, 'in')
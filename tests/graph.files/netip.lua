@@ -0,0 +1,33 @@
+-- SPDX-License-Identifier: BSD-2-Clause-Views
+-- Copyright (c) 2013-2023
+--   Research Computing Center Lomonosov Moscow State University
+
+-- dummy -> wavebuf -> net/ip/send -> loopback UDP -> net/ip/recv -> sink
+
+local bench = assert(loadfile('tests/graph.files/bench.lua'))()
+local Wavebuf = assert(dmm.require_interface('wavebuf'))
+
+-- net_ip.lua takes only socket constants from luaposix, which is
+-- not required for benchmarks otherwise
+if not pcall(require, 'posix.sys.socket') then
+  package.loaded['posix.sys.socket'] = {AF_INET = 2, AF_INET6 = 10, SOCK_DGRAM = 2}
+end
+local Net_ip = assert(dmm.require_interface('net/ip'))
+
+local ADDR = '127.0.0.1:34571'
+
+local recv = Net_ip.Recv:new()
+local sink = bench.Sink:new()
+recv:createsock(Net_ip.AF_INET, Net_ip.SOCK_DGRAM, 0)
+recv:bind(ADDR)
+recv:connect('out', sink, 'in')
+
+local send = Net_ip.Send:new()
+send:createsock(Net_ip.AF_INET, Net_ip.SOCK_DGRAM, 0)
+send:connect(ADDR)
+
+-- Fill UDP datagrams of 64 KiB at most
+local wavebuf = Wavebuf:new()
+wavebuf:set{maxbytes = 65000}
+bench.generator({objects = 4}):connect('out', wavebuf, 'in')
+wavebuf:connect('out', send, 'in')
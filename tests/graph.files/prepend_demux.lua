@@ -0,0 +1,38 @@
+-- SPDX-License-Identifier: BSD-2-Clause-Views
+-- Copyright (c) 2013-2023
+--   Research Computing Center Lomonosov Moscow State University
+
+-- 2 x (dummy -> prepend) -> demux -> sink, routed by the prepended key
+
+local bench = assert(loadfile('tests/graph.files/bench.lua'))()
+local Demux = assert(dmm.require_interface('demux'))
+assert(dmm.require_interface('prepend'))
+
+local KEY_ID = 999
+
+local function prepend_set(node, key)
+  local msg, set = dmm.msg_create {
+    len = ffi.sizeof('struct dmm_msg_prepend_set') + ffi.sizeof('uint32_t'),
+    payload_type = 'struct dmm_msg_prepend_set',
+    type = ffi.C.DMM_MSGTYPE_PREPEND,
+    cmd = ffi.C.DMM_MSG_PREPEND_SET,
+  }
+  set.dn.dn_sensor = KEY_ID
+  set.dn.dn_len = ffi.sizeof('uint32_t')
+  ffi.cast('uint32_t *', set.dn.dn_data)[0] = key
+  dmm.msg_send(node.nodeid, msg)
+end
+
+local demux = Demux:new()
+local sink = bench.Sink:new()
+
+demux:set(KEY_ID)
+demux:setkeytype('uint', false)
+for key = 1, 2 do
+  local prepend = dmm.Module:new('prepend')
+  prepend_set(prepend, key)
+  bench.generator():connect('out', prepend, 'in')
+  prepend:connect('out', demux, 'in')
+  demux:addkey(key, 'out' .. key)
+  demux:connect('out' .. key, sink, 'in')
+end
@@ -0,0 +1,107 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+/*
+ * ibcounters on the fixture tree ibcounters.files:
+ * mlx5_0 with ports 1, 2 and 10, mlx5_1 with port 1,
+ * only some counter files are present
+ */
+
+#undef malloc
+#undef calloc
+#undef realloc
+#undef free
+
+#include "../modules/sensors/ibcounters/ibcounters.c"
+#include "sensortest.h"
+
+#include "CppUTest/CommandLineTestRunner.h"
+
+TEST_GROUP(IbcountersFixture)
+{
+    struct sensortest st;
+    struct pvt_data *pvt;
+
+    void setup()
+    {
+        sensortest_init(&st, &type, true);
+        pvt = (struct pvt_data *)DMM_NODE_PRIVATE(&st.node);
+        strcpy(pvt->root, "ibcounters.files");
+    }
+
+    void teardown()
+    {
+        sensortest_fini(&st);
+    }
+
+    void checkVector(dmm_sensorid_t id, uint64_t p0, uint64_t p1, uint64_t p2, uint64_t p3)
+    {
+        dmm_datanode_p dn = sensortest_find(&st, id);
+
+        CHECK(dn != NULL);
+        CHECK_EQUAL(4 * sizeof(uint64_t), DMM_DN_LEN(dn));
+        CHECK_EQUAL(p0, DMM_DN_VECTOR(dn, uint64_t)[0]);
+        CHECK_EQUAL(p1, DMM_DN_VECTOR(dn, uint64_t)[1]);
+        CHECK_EQUAL(p2, DMM_DN_VECTOR(dn, uint64_t)[2]);
+        CHECK_EQUAL(p3, DMM_DN_VECTOR(dn, uint64_t)[3]);
+    }
+};
+
+TEST(IbcountersFixture, SortsPortsByDeviceAndNumber)
+{
+    struct dmm_ibcounters_port *ports;
+    dmm_datanode_p dn;
+
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    dn = sensortest_find(&st, IB_PORTS);
+    CHECK(dn != NULL);
+    CHECK_EQUAL(4u, DMM_DN_VECSIZE(dn, struct dmm_ibcounters_port));
+    ports = DMM_DN_VECTOR(dn, struct dmm_ibcounters_port);
+    STRCMP_EQUAL("mlx5_0", ports[0].dev);
+    CHECK_EQUAL(1u, ports[0].port);
+    STRCMP_EQUAL("mlx5_0", ports[1].dev);
+    CHECK_EQUAL(2u, ports[1].port);
+    STRCMP_EQUAL("mlx5_0", ports[2].dev);
+    CHECK_EQUAL(10u, ports[2].port);
+    STRCMP_EQUAL("mlx5_1", ports[3].dev);
+    CHECK_EQUAL(1u, ports[3].port);
+};
+
+TEST(IbcountersFixture, SendsVectorPerCounter)
+{
+    dmm_datanode_p dn;
+    int n;
+
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    /* All counters and IB_PORTS, missing files are zeroes */
+    n = 0;
+    for (dn = DMM_DATA_NODES(st.data); !DMM_DN_ISEND(dn); DMM_DN_ADVANCE(dn))
+        n++;
+    LONGS_EQUAL(NUM_COUNTERS + 1, n);
+    checkVector(IB_PORT_XMIT_DATA, 1000, 2000, 3000, 4000);
+    checkVector(IB_PORT_RCV_DATA, 1001, 2001, 3001, 4001);
+    checkVector(IB_SYMBOL_ERROR, 0, 0, 0, 3);
+    checkVector(IB_VL15_DROPPED, 7, 0, 0, 0);
+    checkVector(IB_PORT_XMIT_WAIT, 0, 0, 0, 0);
+};
+
+TEST(IbcountersFixture, SendsPortsOnlyWhenChanged)
+{
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    POINTERS_EQUAL(NULL, sensortest_find(&st, IB_PORTS));
+    checkVector(IB_PORT_XMIT_DATA, 1000, 2000, 3000, 4000);
+};
+
+TEST(IbcountersFixture, SendsNothingWithoutPorts)
+{
+    strcpy(pvt->root, "ibcounters.files/mlx5_0/ports");
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    POINTERS_EQUAL(NULL, st.data);
+};
+
+int main(int argc, char** argv)
+{
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
@@ -0,0 +1,130 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+/*
+ * interrupts on fixture copies of /proc/interrupts and /proc/softirqs
+ * created in a temporary directory and rewritten between ticks
+ */
+
+#undef malloc
+#undef calloc
+#undef realloc
+#undef free
+
+#include "../modules/sensors/interrupts/interrupts.c"
+#include "sensortest.h"
+
+#include "CppUTest/CommandLineTestRunner.h"
+
+/* Sensor id of the selected IRQ vector */
+#define IRQ_MLX5 5000
+
+static const char softirqs[] =
+    "                    CPU0       CPU1\n"
+    "          HI:          1          2\n"
+    "       TIMER:         10         20\n"
+    "      NET_TX:          0          0\n"
+    "      NET_RX:          5          6\n"
+    "       BLOCK:          0          0\n"
+    "    IRQ_POLL:          0          0\n"
+    "     TASKLET:          0          0\n"
+    "       SCHED:          7          8\n"
+    "     HRTIMER:          0          0\n"
+    "         RCU:          3          4\n";
+
+TEST_GROUP(InterruptsFixture)
+{
+    struct sensortest st;
+    struct pvt_data *pvt;
+    char root[PATH_MAX];
+
+    void setup()
+    {
+        struct dmm_interrupts_irq irq;
+        char path[PATH_MAX + 32];
+
+        sensortest_mkroot(root);
+        sensortest_write(root, "interrupts", "");
+        sensortest_write(root, "softirqs", softirqs);
+        sensortest_init(&st, &type, true);
+        pvt = (struct pvt_data *)DMM_NODE_PRIVATE(&st.node);
+        sensorfile_close(&pvt->intr_sf);
+        sensorfile_close(&pvt->soft_sf);
+        snprintf(path, sizeof(path), "%s/interrupts", root);
+        LONGS_EQUAL(0, sensorfile_open(&pvt->intr_sf, path));
+        snprintf(path, sizeof(path), "%s/softirqs", root);
+        LONGS_EQUAL(0, sensorfile_open(&pvt->soft_sf, path));
+
+        irq.id = IRQ_MLX5;
+        strcpy(irq.pattern, "*mlx5_comp*");
+        LONGS_EQUAL(0, set_irqs(pvt, &irq, 1));
+    }
+
+    void teardown()
+    {
+        sensortest_fini(&st);
+        sensortest_rmroot(root);
+    }
+
+    /* Files are rewritten in place and reread through the same descriptors */
+    void setInterrupts(const char *contents)
+    {
+        sensortest_write(root, "interrupts", contents);
+    }
+
+    void checkVector(dmm_sensorid_t id, uint64_t v0, uint64_t v1)
+    {
+        dmm_datanode_p dn = sensortest_find(&st, id);
+
+        CHECK(dn != NULL);
+        CHECK_EQUAL(2 * sizeof(uint64_t), DMM_DN_LEN(dn));
+        CHECK_EQUAL(v0, DMM_DN_VECTOR(dn, uint64_t)[0]);
+        CHECK_EQUAL(v1, DMM_DN_VECTOR(dn, uint64_t)[1]);
+    }
+};
+
+TEST(InterruptsFixture, SumsRowsPerCpu)
+{
+    setInterrupts("           CPU0       CPU1\n"
+                  "  0:         10          0   IO-APIC   2-edge      timer\n"
+                  " 24:        100        200   IR-PCI-MSI 524288-edge      mlx5_comp0@pci:0000:01:00.0\n"
+                  " 25:       1000       2000   IR-PCI-MSI 524289-edge      mlx5_comp1@pci:0000:01:00.0\n"
+                  "LOC:          5          6   Local timer interrupts\n"
+                  "ERR:          0\n"
+                  "MIS:          0\n");
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    checkVector(INTR_CPU_TOTAL, 1115, 2206);
+    checkVector(IRQ_MLX5, 1100, 2200);
+    checkVector(SOFTIRQ_TIMER, 10, 20);
+    checkVector(SOFTIRQ_RCU, 3, 4);
+};
+
+TEST(InterruptsFixture, MatchesRowAgainWhenIrqIsReassigned)
+{
+    setInterrupts("           CPU0       CPU1\n"
+                  " 24:        100        200   IR-PCI-MSI 524288-edge      mlx5_comp0@pci:0000:01:00.0\n"
+                  " 25:       1000       2000   IR-PCI-MSI 524289-edge      mlx5_comp1@pci:0000:01:00.0\n");
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    checkVector(IRQ_MLX5, 1100, 2200);
+
+    /* The same labels, IRQ 24 now belongs to another device */
+    setInterrupts("           CPU0       CPU1\n"
+                  " 24:          1          2   IR-PCI-MSI 1048576-edge      nvme0q1\n"
+                  " 25:       1010       2020   IR-PCI-MSI 524289-edge      mlx5_comp1@pci:0000:01:00.0\n");
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    checkVector(IRQ_MLX5, 1010, 2020);
+    checkVector(INTR_CPU_TOTAL, 1011, 2022);
+
+    /* And back */
+    setInterrupts("           CPU0       CPU1\n"
+                  " 24:          3          4   IR-PCI-MSI 524288-edge      mlx5_comp0@pci:0000:01:00.0\n"
+                  " 25:       1010       2020   IR-PCI-MSI 524289-edge      mlx5_comp1@pci:0000:01:00.0\n");
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    checkVector(IRQ_MLX5, 1013, 2024);
+};
+
+int main(int argc, char** argv)
+{
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
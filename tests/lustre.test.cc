@@ -0,0 +1,101 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+/*
+ * lustre on the fixture tree lustre.files with stats captured
+ * from clients: llite of Lustre 2.12 (scratch) and 2.15 (home, with
+ * usecs and sumsq fields), osc of an active and an idle OST
+ */
+
+#undef malloc
+#undef calloc
+#undef realloc
+#undef free
+
+#include "../modules/sensors/lustre/lustre.c"
+#include "sensortest.h"
+
+#include "CppUTest/CommandLineTestRunner.h"
+
+TEST_GROUP(LustreFixture)
+{
+    struct sensortest st;
+    struct pvt_data *pvt;
+
+    void setup()
+    {
+        sensortest_init(&st, &type, true);
+        pvt = (struct pvt_data *)DMM_NODE_PRIVATE(&st.node);
+        strcpy(pvt->root, "lustre.files");
+    }
+
+    void teardown()
+    {
+        sensortest_fini(&st);
+    }
+
+    void checkVector(dmm_sensorid_t id, uint64_t v0, uint64_t v1)
+    {
+        dmm_datanode_p dn = sensortest_find(&st, id);
+
+        CHECK(dn != NULL);
+        CHECK_EQUAL(2 * sizeof(uint64_t), DMM_DN_LEN(dn));
+        CHECK_EQUAL(v0, DMM_DN_VECTOR(dn, uint64_t)[0]);
+        CHECK_EQUAL(v1, DMM_DN_VECTOR(dn, uint64_t)[1]);
+    }
+
+    void checkNames(dmm_sensorid_t id, const char *n0, const char *n1)
+    {
+        dmm_datanode_p dn = sensortest_find(&st, id);
+
+        CHECK(dn != NULL);
+        CHECK_EQUAL(2u, DMM_DN_VECSIZE(dn, struct dmm_lustre_name));
+        STRCMP_EQUAL(n0, DMM_DN_VECTOR(dn, struct dmm_lustre_name)[0].name);
+        STRCMP_EQUAL(n1, DMM_DN_VECTOR(dn, struct dmm_lustre_name)[1].name);
+    }
+};
+
+TEST(LustreFixture, SendsMountsSortedByName)
+{
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    checkNames(LUSTRE_MOUNTS, "home-ffff9a1c3b6e9000", "scratch-ffff9a1c3b6e8000");
+};
+
+TEST(LustreFixture, ParsesLliteStats)
+{
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    checkVector(LUSTRE_READ_BYTES, 9437184, 2654813184);
+    checkVector(LUSTRE_WRITE_BYTES, 3146240, 1009768448);
+    checkVector(LUSTRE_READ_OPS, 35, 1214);
+    checkVector(LUSTRE_WRITE_OPS, 12, 482);
+    /* open, close, getattr, unlink, mkdir; the same and more for 2.12 */
+    checkVector(LUSTRE_META_OPS, 80 + 80 + 150 + 3 + 1,
+                1530 + 1529 + 10 + 3 + 2400 + 8 + 5 + 1 + 2 + 7 + 120);
+};
+
+TEST(LustreFixture, ParsesOscStats)
+{
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    /* osc/num_refs has no stats and is skipped */
+    checkNames(LUSTRE_OSCS, "scratch-OST0000-osc-ffff9a1c3b6e8000",
+               "scratch-OST0001-osc-ffff9a1c3b6e8000");
+    checkVector(LUSTRE_OSC_READ_BYTES, 402653184, 0);
+    checkVector(LUSTRE_OSC_WRITE_BYTES, 201326592, 0);
+    checkVector(LUSTRE_OSC_READ_OPS, 120, 0);
+    checkVector(LUSTRE_OSC_WRITE_OPS, 60, 0);
+};
+
+TEST(LustreFixture, SendsNamesOnlyWhenChanged)
+{
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    POINTERS_EQUAL(NULL, sensortest_find(&st, LUSTRE_MOUNTS));
+    POINTERS_EQUAL(NULL, sensortest_find(&st, LUSTRE_OSCS));
+    checkVector(LUSTRE_READ_OPS, 35, 1214);
+};
+
+int main(int argc, char** argv)
+{
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
@@ -0,0 +1,182 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+/*
+ * numa on a fixture tree of two nodes created in a temporary directory,
+ * meminfo gets an extra line between ticks so the layout is resolved again
+ */
+
+#undef malloc
+#undef calloc
+#undef realloc
+#undef free
+
+#include "../modules/sensors/numa/numa.c"
+#include "sensortest.h"
+
+#include "CppUTest/CommandLineTestRunner.h"
+
+static const char meminfo0[] =
+    "Node 0 MemTotal:       16318480 kB\n"
+    "Node 0 MemFree:         8159240 kB\n"
+    "Node 0 MemUsed:         8159240 kB\n"
+    "Node 0 Active:          4000000 kB\n"
+    "Node 0 Inactive:        2000000 kB\n"
+    "Node 0 FilePages:       3000000 kB\n"
+    "Node 0 AnonPages:       1000000 kB\n"
+    "Node 0 Shmem:             10000 kB\n"
+    "Node 0 HugePages_Total:     16\n"
+    "Node 0 HugePages_Free:       8\n";
+
+static const char meminfo1[] =
+    "Node 1 MemTotal:       16777216 kB\n"
+    "Node 1 MemFree:         1048576 kB\n"
+    "Node 1 MemUsed:        15728640 kB\n"
+    "Node 1 Active:         12000000 kB\n"
+    "Node 1 Inactive:        3000000 kB\n"
+    "Node 1 FilePages:       5000000 kB\n"
+    "Node 1 AnonPages:       9000000 kB\n"
+    "Node 1 Shmem:             20000 kB\n"
+    "Node 1 HugePages_Total:     32\n"
+    "Node 1 HugePages_Free:       4\n";
+
+/* meminfo1 of a newer kernel with a line inserted after MemFree */
+static const char meminfo1_added[] =
+    "Node 1 MemTotal:       16777216 kB\n"
+    "Node 1 MemFree:         2097152 kB\n"
+    "Node 1 MemAvailable:    4194304 kB\n"
+    "Node 1 MemUsed:        14680064 kB\n"
+    "Node 1 Active:         12000000 kB\n"
+    "Node 1 Inactive:        3000000 kB\n"
+    "Node 1 FilePages:       5000000 kB\n"
+    "Node 1 AnonPages:       9000000 kB\n"
+    "Node 1 Shmem:             20000 kB\n"
+    "Node 1 HugePages_Total:     32\n"
+    "Node 1 HugePages_Free:       4\n";
+
+static const char numastat0[] =
+    "numa_hit 1000\n"
+    "numa_miss 10\n"
+    "numa_foreign 20\n"
+    "interleave_hit 30\n"
+    "local_node 990\n"
+    "other_node 10\n";
+
+static const char numastat1[] =
+    "numa_hit 2000\n"
+    "numa_miss 20\n"
+    "numa_foreign 10\n"
+    "interleave_hit 31\n"
+    "local_node 1980\n"
+    "other_node 20\n";
+
+TEST_GROUP(NumaFixture)
+{
+    struct sensortest st;
+    struct pvt_data *pvt;
+    char root[PATH_MAX];
+
+    void setup()
+    {
+        sensortest_mkroot(root);
+        /* Directory order must not matter, nodeX is not a node */
+        sensortest_write(root, "devices/system/node/node1/meminfo", meminfo1);
+        sensortest_write(root, "devices/system/node/node1/numastat", numastat1);
+        sensortest_write(root, "devices/system/node/node0/meminfo", meminfo0);
+        sensortest_write(root, "devices/system/node/node0/numastat", numastat0);
+        sensortest_write(root, "devices/system/node/nodeX/meminfo", meminfo0);
+        sensortest_write(root, "devices/system/node/possible", "0-1\n");
+        sensortest_init(&st, &type, true);
+        pvt = (struct pvt_data *)DMM_NODE_PRIVATE(&st.node);
+        strcpy(pvt->root, root);
+    }
+
+    void teardown()
+    {
+        sensortest_fini(&st);
+        sensortest_rmroot(root);
+    }
+
+    void checkVector(dmm_sensorid_t id, uint64_t v0, uint64_t v1)
+    {
+        dmm_datanode_p dn = sensortest_find(&st, id);
+
+        CHECK(dn != NULL);
+        CHECK_EQUAL(2 * sizeof(uint64_t), DMM_DN_LEN(dn));
+        CHECK_EQUAL(v0, DMM_DN_VECTOR(dn, uint64_t)[0]);
+        CHECK_EQUAL(v1, DMM_DN_VECTOR(dn, uint64_t)[1]);
+    }
+
+    void checkMemory(uint64_t memfree, uint64_t memused)
+    {
+        checkVector(NUMA_MEMTOTAL, 16318480 * 1024ull, 16777216 * 1024ull);
+        checkVector(NUMA_MEMFREE, 8159240 * 1024ull, memfree * 1024);
+        checkVector(NUMA_MEMUSED, 8159240 * 1024ull, memused * 1024);
+        checkVector(NUMA_SHMEM, 10000 * 1024ull, 20000 * 1024ull);
+        checkVector(NUMA_NUMA_HIT, 1000, 2000);
+        checkVector(NUMA_OTHER_NODE, 10, 20);
+    }
+};
+
+TEST(NumaFixture, SendsVectorsPerNode)
+{
+    dmm_datanode_p dn;
+
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    dn = sensortest_find(&st, NUMA_NODE_ID);
+    CHECK(dn != NULL);
+    CHECK_EQUAL(2u, DMM_DN_VECSIZE(dn, uint32_t));
+    CHECK_EQUAL(0u, DMM_DN_VECTOR(dn, uint32_t)[0]);
+    CHECK_EQUAL(1u, DMM_DN_VECTOR(dn, uint32_t)[1]);
+    checkMemory(1048576, 15728640);
+    checkVector(NUMA_ACTIVE, 4000000 * 1024ull, 12000000 * 1024ull);
+    checkVector(NUMA_LOCAL_NODE, 990, 1980);
+    /* Not selected by default */
+    POINTERS_EQUAL(NULL, sensortest_find(&st, NUMA_HUGEPAGES_TOTAL));
+};
+
+TEST(NumaFixture, SendsSelectedFieldsPresentInFiles)
+{
+    dmm_datanode_p dn;
+    int n;
+
+    memset(pvt->selected, 0, sizeof(pvt->selected));
+    select_field(pvt, NUMA_HUGEPAGES_TOTAL);
+    select_field(pvt, NUMA_MEMAVAILABLE);
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    /* HugePages_Total is in pages, MemAvailable is missing */
+    checkVector(NUMA_HUGEPAGES_TOTAL, 16, 32);
+    n = 0;
+    for (dn = DMM_DATA_NODES(st.data); !DMM_DN_ISEND(dn); DMM_DN_ADVANCE(dn))
+        n++;
+    LONGS_EQUAL(2, n);
+};
+
+TEST(NumaFixture, ResolvesLayoutAgainWhenLineIsAdded)
+{
+    char buf[1024];
+
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    checkMemory(1048576, 15728640);
+
+    /* Only node 1 has the new line, the layout is resolved for every file */
+    sensortest_write(root, "devices/system/node/node1/meminfo", meminfo1_added);
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    checkMemory(2097152, 14680064);
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    checkMemory(2097152, 14680064);
+
+    /* And a line appended at the end */
+    snprintf(buf, sizeof(buf), "%sNode 0 MemAvailable:       1024 kB\n", meminfo0);
+    sensortest_write(root, "devices/system/node/node0/meminfo", buf);
+    select_field(pvt, NUMA_MEMAVAILABLE);
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    checkMemory(2097152, 14680064);
+    checkVector(NUMA_MEMAVAILABLE, 1024 * 1024, 4194304 * 1024ull);
+};
+
+int main(int argc, char** argv)
+{
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
@@ -0,0 +1,144 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+/*
+ * power on a fixture tree created in a temporary directory,
+ * energy counters are rewritten between ticks
+ */
+
+#undef malloc
+#undef calloc
+#undef realloc
+#undef free
+
+#include "../modules/sensors/power/power.c"
+#include "sensortest.h"
+
+#include "CppUTest/CommandLineTestRunner.h"
+
+TEST_GROUP(PowerFixture)
+{
+    struct sensortest st;
+    struct pvt_data *pvt;
+    char root[PATH_MAX];
+
+    void setup()
+    {
+        sensortest_mkroot(root);
+        sensortest_init(&st, &type, true);
+        pvt = (struct pvt_data *)DMM_NODE_PRIVATE(&st.node);
+        strcpy(pvt->root, root);
+    }
+
+    void teardown()
+    {
+        sensortest_fini(&st);
+        sensortest_rmroot(root);
+    }
+
+    void addZone(const char *zone, const char *name, const char *max, const char *energy)
+    {
+        char path[PATH_MAX];
+
+        snprintf(path, sizeof(path), "class/powercap/%s/name", zone);
+        sensortest_write(root, path, name);
+        snprintf(path, sizeof(path), "class/powercap/%s/max_energy_range_uj", zone);
+        sensortest_write(root, path, max);
+        setEnergy(zone, energy);
+    }
+
+    void setEnergy(const char *zone, const char *energy)
+    {
+        char path[PATH_MAX];
+
+        snprintf(path, sizeof(path), "class/powercap/%s/energy_uj", zone);
+        sensortest_write(root, path, energy);
+    }
+
+    void checkEnergy(uint64_t e0, uint64_t e1)
+    {
+        dmm_datanode_p dn;
+
+        LONGS_EQUAL(0, process_timer_msg(pvt));
+        dn = sensortest_find(&st, POWER_ENERGY);
+        CHECK(dn != NULL);
+        CHECK_EQUAL(2u, DMM_DN_VECSIZE(dn, uint64_t));
+        CHECK_EQUAL(e0, DMM_DN_VECTOR(dn, uint64_t)[0]);
+        CHECK_EQUAL(e1, DMM_DN_VECTOR(dn, uint64_t)[1]);
+    }
+};
+
+TEST(PowerFixture, SendsPackageZones)
+{
+    struct dmm_power_zone *zones;
+    dmm_datanode_p dn;
+
+    addZone("intel-rapl:1", "package-1\n", "1000\n", "100\n");
+    addZone("intel-rapl:0", "package-0\n", "1000\n", "900\n");
+    /* Subzones are not packages */
+    addZone("intel-rapl:0:0", "core\n", "1000\n", "10\n");
+    checkEnergy(900, 100);
+    dn = sensortest_find(&st, POWER_ZONES);
+    CHECK(dn != NULL);
+    CHECK_EQUAL(2u, DMM_DN_VECSIZE(dn, struct dmm_power_zone));
+    zones = DMM_DN_VECTOR(dn, struct dmm_power_zone);
+    STRCMP_EQUAL("intel-rapl:0", zones[0].zone);
+    STRCMP_EQUAL("package-0", zones[0].name);
+    STRCMP_EQUAL("intel-rapl:1", zones[1].zone);
+    STRCMP_EQUAL("package-1", zones[1].name);
+};
+
+TEST(PowerFixture, AccumulatesEnergyPastWraparound)
+{
+    addZone("intel-rapl:0", "package-0\n", "1000\n", "900\n");
+    addZone("intel-rapl:1", "package-1\n", "1000\n", "100\n");
+    checkEnergy(900, 100);
+    setEnergy("intel-rapl:0", "950\n");
+    setEnergy("intel-rapl:1", "300\n");
+    checkEnergy(950, 300);
+    /* Counter of package 0 wraps at max_energy_range_uj */
+    setEnergy("intel-rapl:0", "50\n");
+    checkEnergy(1050, 300);
+    setEnergy("intel-rapl:0", "70\n");
+    setEnergy("intel-rapl:1", "20\n");
+    checkEnergy(1070, 1020);
+};
+
+TEST(PowerFixture, SendsFrequenciesOfCpusWithCpufreq)
+{
+    dmm_datanode_p dn;
+
+    sensortest_write(root, "devices/system/cpu/cpu10/cpufreq/scaling_cur_freq", "1200000\n");
+    sensortest_write(root, "devices/system/cpu/cpu2/cpufreq/scaling_cur_freq", "3400000\n");
+    sensortest_write(root, "devices/system/cpu/cpu3/online", "0\n");
+    sensortest_write(root, "devices/system/cpu/cpufreq/boost", "1\n");
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    POINTERS_EQUAL(NULL, sensortest_find(&st, POWER_ENERGY));
+    dn = sensortest_find(&st, POWER_CPU_ID);
+    CHECK(dn != NULL);
+    CHECK_EQUAL(2u, DMM_DN_VECSIZE(dn, uint32_t));
+    CHECK_EQUAL(2u, DMM_DN_VECTOR(dn, uint32_t)[0]);
+    CHECK_EQUAL(10u, DMM_DN_VECTOR(dn, uint32_t)[1]);
+    dn = sensortest_find(&st, POWER_CPU_FREQ);
+    CHECK(dn != NULL);
+    CHECK_EQUAL(3400000u, DMM_DN_VECTOR(dn, uint64_t)[0]);
+    CHECK_EQUAL(1200000u, DMM_DN_VECTOR(dn, uint64_t)[1]);
+};
+
+TEST(PowerFixture, ScansAgainWhileNothingIsFound)
+{
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    POINTERS_EQUAL(NULL, st.data);
+    CHECK_FALSE(pvt->scanned);
+    addZone("intel-rapl:0", "package-0\n", "1000\n", "5\n");
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    CHECK(pvt->scanned);
+    CHECK(sensortest_find(&st, POWER_ZONES) != NULL);
+    CHECK_EQUAL(5u, DMM_DN_VECTOR(sensortest_find(&st, POWER_ENERGY), uint64_t)[0]);
+};
+
+int main(int argc, char** argv)
+{
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
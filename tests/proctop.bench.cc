@@ -0,0 +1,116 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+/*
+ * Cost of a proctop tick: scan of root/<pid>/stat and selection of top
+ * lists. Usage: proctop.bench.out [num_procs [num_ticks [root]]]
+ * Without root a fixture of num_procs fake processes is created in /tmp,
+ * with root (e.g. /proc) num_procs is ignored.
+ */
+
+#include <sys/stat.h>
+#include <time.h>
+
+#include "../modules/sensors/proctop/proctop.c"
+
+static double now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void make_fixture(const char *root, unsigned num_procs)
+{
+    char path[DMM_PROCTOP_PATHSIZE + 32];
+    unsigned i;
+    FILE *f;
+
+    for (i = 1; i <= num_procs; ++i) {
+        snprintf(path, sizeof(path), "%s/%u", root, i);
+        if (mkdir(path, 0755) != 0) {
+            perror(path);
+            exit(1);
+        }
+        snprintf(path, sizeof(path), "%s/%u/stat", root, i);
+        if ((f = fopen(path, "w")) == NULL) {
+            perror(path);
+            exit(1);
+        }
+        fprintf(f, "%u (proc%u) S 1 %u %u 0 -1 4194560 1000 0 0 0 %u %u 0 0 "
+                   "20 0 1 0 %u 100000000 %u 18446744073709551615 1 1 0 0 0 0 0\n",
+                i, i, i, i, i % 1000, i % 100, i, i % 5000);
+        fclose(f);
+    }
+}
+
+static void remove_fixture(const char *root, unsigned num_procs)
+{
+    char path[DMM_PROCTOP_PATHSIZE + 32];
+    unsigned i;
+
+    for (i = 1; i <= num_procs; ++i) {
+        snprintf(path, sizeof(path), "%s/%u/stat", root, i);
+        unlink(path);
+        snprintf(path, sizeof(path), "%s/%u", root, i);
+        rmdir(path);
+    }
+    rmdir(root);
+}
+
+int main(int argc, char **argv)
+{
+    char fixture[] = "/tmp/proctopbenchXXXXXX";
+    unsigned num_procs, num_ticks, i;
+    struct pvt_data *pvt;
+    struct dmm_node node;
+    size_t nc, nr;
+    double start, elapsed;
+
+    num_procs = (argc > 1) ? (unsigned)atoi(argv[1]) : 20000;
+    num_ticks = (argc > 2) ? (unsigned)atoi(argv[2]) : 50;
+    if (num_ticks == 0)
+        num_ticks = 1;
+
+    memset(&node, 0, sizeof(node));
+    if (ctor(&node) != 0) {
+        fprintf(stderr, "ctor failed\n");
+        return 1;
+    }
+    pvt = (struct pvt_data *)DMM_NODE_PRIVATE(&node);
+    if (argc > 3) {
+        snprintf(pvt->root, sizeof(pvt->root), "%s", argv[3]);
+    } else {
+        if (mkdtemp(fixture) == NULL) {
+            perror(fixture);
+            return 1;
+        }
+        make_fixture(fixture, num_procs);
+        strcpy(pvt->root, fixture);
+    }
+
+    /* The first scan fills the table and opens descriptors */
+    if (scan(pvt) != 0) {
+        fprintf(stderr, "cannot scan %s\n", pvt->root);
+        return 1;
+    }
+    start = now();
+    for (i = 0; i < num_ticks; ++i) {
+        scan(pvt);
+        select_top(pvt, &nc, &nr);
+    }
+    elapsed = now() - start;
+
+    printf("bench=proctop root=%s procs=%zu cached_fds=%zu ticks=%u "
+           "ns_per_tick=%.0f ns_per_proc=%.1f\n",
+           argc > 3 ? pvt->root : "fixture", pvt->num_procs, pvt->num_cached,
+           num_ticks, elapsed / num_ticks,
+           pvt->num_procs > 0 ? elapsed / num_ticks / pvt->num_procs : 0.0);
+
+    dtor(&node);
+    if (argc <= 3)
+        remove_fixture(fixture, num_procs);
+    return 0;
+}
@@ -0,0 +1,226 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+/*
+ * proctop on a fixture root created in a temporary directory,
+ * root/<pid>/stat files are rewritten and removed between ticks
+ */
+
+#undef malloc
+#undef calloc
+#undef realloc
+#undef free
+
+#include "../modules/sensors/proctop/proctop.c"
+#include "sensortest.h"
+
+#include "CppUTest/CommandLineTestRunner.h"
+
+TEST_GROUP(ProctopFixture)
+{
+    struct sensortest st;
+    struct pvt_data *pvt;
+    char root[PATH_MAX];
+
+    void setup()
+    {
+        sensortest_mkroot(root);
+        sensortest_init(&st, &type, true);
+        pvt = (struct pvt_data *)DMM_NODE_PRIVATE(&st.node);
+        strcpy(pvt->root, root);
+    }
+
+    void teardown()
+    {
+        sensortest_fini(&st);
+        sensortest_rmroot(root);
+    }
+
+    void setProc(unsigned pid, const char *comm, unsigned cputime,
+                 unsigned starttime, unsigned rss)
+    {
+        char path[32], stat[256];
+
+        snprintf(path, sizeof(path), "%u/stat", pid);
+        /* utime and stime are the 14th and 15th fields, starttime 22nd, rss 24th */
+        snprintf(stat, sizeof(stat),
+                 "%u (%s) S 1 %u %u 0 -1 4194560 1000 0 0 0 %u %u 0 0 "
+                 "20 0 1 0 %u 100000000 %u 18446744073709551615 1 1 0 0 0 0 0\n",
+                 pid, comm, pid, pid, cputime - cputime / 2, cputime / 2, starttime, rss);
+        sensortest_write(root, path, stat);
+    }
+
+    void removeProc(unsigned pid)
+    {
+        char path[PATH_MAX + 32];
+
+        snprintf(path, sizeof(path), "%s/%u/stat", root, pid);
+        unlink(path);
+        snprintf(path, sizeof(path), "%s/%u", root, pid);
+        rmdir(path);
+    }
+
+    uint64_t usecs(uint64_t ticks)
+    {
+        return ticks * 1000000 / (uint64_t)pvt->clk_tck;
+    }
+
+    void checkPids(dmm_sensorid_t id, size_t n, const uint32_t *pids)
+    {
+        dmm_datanode_p dn = sensortest_find(&st, id);
+        size_t i;
+
+        CHECK(dn != NULL);
+        CHECK_EQUAL(n, DMM_DN_VECSIZE(dn, uint32_t));
+        for (i = 0; i < n; ++i)
+            CHECK_EQUAL(pids[i], DMM_DN_VECTOR(dn, uint32_t)[i]);
+    }
+
+    uint64_t value(dmm_sensorid_t id, size_t i)
+    {
+        dmm_datanode_p dn = sensortest_find(&st, id);
+
+        CHECK(dn != NULL);
+        CHECK(i < DMM_DN_VECSIZE(dn, uint64_t));
+        return DMM_DN_VECTOR(dn, uint64_t)[i];
+    }
+
+    /* Every process in the table is found from its home slot */
+    void checkTable(size_t num_procs)
+    {
+        size_t i, n;
+
+        for (n = 0, i = 0; i < pvt->capacity; ++i)
+            if (pvt->procs[i].pid != 0) {
+                POINTERS_EQUAL(&pvt->procs[i], proc_slot(pvt, pvt->procs[i].pid));
+                n++;
+            }
+        CHECK_EQUAL(num_procs, n);
+        CHECK_EQUAL(num_procs, pvt->num_procs);
+    }
+};
+
+TEST(ProctopFixture, SortsTopListsByCpuDeltaAndRss)
+{
+    static const uint32_t cpu[] = {30, 10, 20};
+    static const uint32_t rss[] = {20, 30, 10};
+    dmm_datanode_p dn;
+
+    setProc(10, "ten", 100, 1, 300);
+    setProc(20, "twenty", 1000, 2, 500);
+    setProc(30, "thirty", 10, 3, 400);
+    setProc(40, "idle", 5, 4, 0);
+    /* Not a process */
+    sensortest_write(root, "self/stat", "garbage\n");
+    /* The first tick has no CPU deltas */
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    CHECK_EQUAL(4u, value(PROCTOP_NPROCS, 0));
+    checkPids(PROCTOP_CPU_PID, 0, NULL);
+    checkPids(PROCTOP_RSS_PID, 3, rss);
+
+    setProc(10, "ten", 150, 1, 300);
+    setProc(20, "twenty", 1020, 2, 500);
+    setProc(30, "thirty", 110, 3, 400);
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    /* Processes with zero value are not listed */
+    checkPids(PROCTOP_CPU_PID, 3, cpu);
+    CHECK_EQUAL(usecs(100), value(PROCTOP_CPU_TIME, 0));
+    CHECK_EQUAL(usecs(50), value(PROCTOP_CPU_TIME, 1));
+    CHECK_EQUAL(usecs(20), value(PROCTOP_CPU_TIME, 2));
+    CHECK_EQUAL(500 * pvt->pagesize, value(PROCTOP_RSS_BYTES, 0));
+    dn = sensortest_find(&st, PROCTOP_CPU_NAMES);
+    CHECK(dn != NULL);
+    CHECK_EQUAL(sizeof("thirty") + sizeof("ten") + sizeof("twenty"), DMM_DN_LEN(dn));
+    MEMCMP_EQUAL("thirty\0ten\0twenty", DMM_DN_VECTOR(dn, char), DMM_DN_LEN(dn));
+};
+
+TEST(ProctopFixture, KeepsTopListLength)
+{
+    static const uint32_t cpu[] = {20, 10};
+
+    LONGS_EQUAL(0, set_top(pvt, 2));
+    setProc(10, "ten", 100, 1, 300);
+    setProc(20, "twenty", 1000, 2, 500);
+    setProc(30, "thirty", 10, 3, 400);
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    setProc(10, "ten", 120, 1, 300);
+    setProc(20, "twenty", 1100, 2, 500);
+    setProc(30, "thirty", 15, 3, 400);
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    checkPids(PROCTOP_CPU_PID, 2, cpu);
+    CHECK_EQUAL(500 * pvt->pagesize, value(PROCTOP_RSS_BYTES, 0));
+    CHECK_EQUAL(400 * pvt->pagesize, value(PROCTOP_RSS_BYTES, 1));
+
+    LONGS_EQUAL(0, set_top(pvt, 0));
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    checkPids(PROCTOP_CPU_PID, 0, NULL);
+    checkPids(PROCTOP_RSS_PID, 0, NULL);
+    CHECK_EQUAL(3u, value(PROCTOP_NPROCS, 0));
+};
+
+TEST(ProctopFixture, TellsReusedPidByStarttime)
+{
+    static const uint32_t cpu[] = {10};
+
+    setProc(10, "old", 1000, 100, 1);
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    /* Another process with the same pid, all its CPU time is new */
+    setProc(10, "new", 30, 200, 1);
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    checkPids(PROCTOP_CPU_PID, 1, cpu);
+    CHECK_EQUAL(usecs(30), value(PROCTOP_CPU_TIME, 0));
+    MEMCMP_EQUAL("new", DMM_DN_VECTOR(sensortest_find(&st, PROCTOP_CPU_NAMES), char), 4);
+    setProc(10, "new", 35, 200, 1);
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    CHECK_EQUAL(usecs(5), value(PROCTOP_CPU_TIME, 0));
+};
+
+TEST(ProctopFixture, SweepsExitedProcesses)
+{
+    unsigned pid;
+
+    /* Enough processes to grow the table and make long clusters */
+    for (pid = 1; pid <= 1500; ++pid)
+        setProc(pid, "p", pid, pid, 1);
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    CHECK_EQUAL(4096u, pvt->capacity);
+    checkTable(1500);
+
+    for (pid = 1; pid <= 1500; ++pid)
+        if (pid % 3 != 0)
+            removeProc(pid);
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    CHECK_EQUAL(500u, value(PROCTOP_NPROCS, 0));
+    checkTable(500);
+    for (pid = 1; pid <= 1500; ++pid)
+        CHECK_EQUAL(pid % 3 == 0 ? (pid_t)pid : 0, proc_slot(pvt, pid)->pid);
+};
+
+TEST(ProctopFixture, CachesAtMostMaxCachedDescriptors)
+{
+    unsigned pid;
+
+    LONGS_EQUAL(0, set_cached(pvt, 2));
+    for (pid = 1; pid <= 5; ++pid)
+        setProc(pid, "p", 10 * pid, pid, pid);
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    CHECK_EQUAL(2u, pvt->num_cached);
+
+    /* Processes past the cap are read every tick as well */
+    for (pid = 1; pid <= 5; ++pid)
+        setProc(pid, "p", 10 * pid + pid, pid, pid);
+    LONGS_EQUAL(0, process_timer_msg(pvt));
+    CHECK_EQUAL(2u, pvt->num_cached);
+    CHECK_EQUAL(usecs(5), value(PROCTOP_CPU_TIME, 0));
+    CHECK_EQUAL(usecs(1), value(PROCTOP_CPU_TIME, 4));
+
+    LONGS_EQUAL(0, set_cached(pvt, 1));
+    CHECK_EQUAL(1u, pvt->num_cached);
+    LONGS_EQUAL(EINVAL, set_cached(pvt, UINT32_MAX));
+};
+
+int main(int argc, char** argv)
+{
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
@@ -0,0 +1,177 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../modules/sensors/sensorfile.h"
+
+#include "CppUTest/CommandLineTestRunner.h"
+
+TEST_GROUP(SensorfileParse)
+{
+};
+
+TEST(SensorfileParse, ParsesUnsignedAfterBlanks)
+{
+    const char *s = " \t18446744073709551615 7";
+    uint64_t val;
+
+    s = sensorfile_u64(s, &val);
+    CHECK(s != NULL);
+    CHECK_EQUAL(UINT64_MAX, val);
+    s = sensorfile_u64(s, &val);
+    CHECK(s != NULL);
+    CHECK_EQUAL(7u, val);
+    CHECK_EQUAL('\0', *s);
+};
+
+TEST(SensorfileParse, DoesNotParseAcrossLineEnd)
+{
+    uint64_t val = 42;
+
+    POINTERS_EQUAL(NULL, sensorfile_u64(" \n5", &val));
+    POINTERS_EQUAL(NULL, sensorfile_u64("", &val));
+    CHECK_EQUAL(42u, val);
+};
+
+TEST(SensorfileParse, ParsesNegative)
+{
+    int64_t val;
+
+    CHECK(sensorfile_i64(" -12", &val) != NULL);
+    CHECK_EQUAL(-12, val);
+    POINTERS_EQUAL(NULL, sensorfile_i64("-x", &val));
+};
+
+TEST(SensorfileParse, MatchesPrefixAndSkipsLines)
+{
+    const char *buf = "cpu0 1 2\ncpu1 3 4";
+    const char *s;
+
+    s = sensorfile_match(buf, "cpu");
+    POINTERS_EQUAL(buf + 3, s);
+    POINTERS_EQUAL(NULL, sensorfile_match(buf, "cpu1"));
+    POINTERS_EQUAL(buf + 4, sensorfile_skipfield(buf));
+    s = sensorfile_nextline(buf);
+    STRCMP_EQUAL("cpu1 3 4", s);
+    s = sensorfile_nextline(s);
+    CHECK_EQUAL('\0', *s);
+};
+
+TEST(SensorfileParse, ParsesNumberedNames)
+{
+    uint32_t num = 0;
+
+    CHECK(sensorfile_numbered("cpu12", "cpu", &num));
+    CHECK_EQUAL(12u, num);
+    CHECK_FALSE(sensorfile_numbered("cpufreq", "cpu", &num));
+    CHECK_FALSE(sensorfile_numbered("cpu1a", "cpu", &num));
+    CHECK_FALSE(sensorfile_numbered("cpu", "cpu", &num));
+    CHECK_FALSE(sensorfile_numbered("cpu4294967296", "cpu", &num));
+    CHECK_EQUAL(12u, num);
+};
+
+TEST_GROUP(SensorfileRead)
+{
+    char path[32];
+    struct sensorfile sf;
+
+    void setup()
+    {
+        int fd;
+
+        strcpy(path, "/tmp/sensorfileXXXXXX");
+        fd = mkstemp(path);
+        CHECK(fd >= 0);
+        close(fd);
+        sensorfile_init(&sf);
+    }
+
+    void teardown()
+    {
+        sensorfile_close(&sf);
+        unlink(path);
+    }
+
+    void write_file(const char *contents, size_t len)
+    {
+        FILE *f = fopen(path, "w");
+        CHECK(f != NULL);
+        CHECK_EQUAL(len, fwrite(contents, 1, len, f));
+        fclose(f);
+    }
+};
+
+TEST(SensorfileRead, RereadsFromBeginning)
+{
+    write_file("1 2\n", 4);
+    CHECK_EQUAL(0, sensorfile_open(&sf, path));
+    CHECK_EQUAL(0, sensorfile_read(&sf));
+    STRCMP_EQUAL("1 2\n", sf.buf);
+    write_file("3\n", 2);
+    CHECK_EQUAL(0, sensorfile_read(&sf));
+    CHECK_EQUAL(2u, sf.len);
+    STRCMP_EQUAL("3\n", sf.buf);
+};
+
+TEST(SensorfileRead, GrowsBufferForLargeFile)
+{
+    size_t len = 3 * SENSORFILE_BUFSIZE + 5;
+    char *contents = (char *)malloc(len);
+
+    memset(contents, 'a', len);
+    write_file(contents, len);
+    CHECK_EQUAL(0, sensorfile_open(&sf, path));
+    CHECK_EQUAL(0, sensorfile_read(&sf));
+    CHECK_EQUAL(len, sf.len);
+    CHECK(sf.size > len);
+    CHECK_EQUAL('\0', sf.buf[len]);
+    free(contents);
+};
+
+TEST(SensorfileRead, ReportsMissingFile)
+{
+    CHECK_EQUAL(ENOENT, sensorfile_open(&sf, "/nonexistent/sensorfile"));
+    CHECK_FALSE(sensorfile_isopen(&sf));
+};
+
+TEST(SensorfileRead, ReadsFirstLine)
+{
+    char buf[8];
+
+    write_file("label\nnext\n", 11);
+    sensorfile_readline(AT_FDCWD, path, buf, sizeof(buf));
+    STRCMP_EQUAL("label", buf);
+    /* Truncated to the buffer */
+    write_file("long label\n", 11);
+    sensorfile_readline(AT_FDCWD, path, buf, sizeof(buf));
+    STRCMP_EQUAL("long la", buf);
+    sensorfile_readline(AT_FDCWD, "/nonexistent/sensorfile", buf, sizeof(buf));
+    STRCMP_EQUAL("", buf);
+};
+
+TEST(SensorfileRead, PreadsSingleValue)
+{
+    uint64_t val = 0;
+    int fd;
+
+    write_file("12345\n", 6);
+    fd = open(path, O_RDONLY);
+    CHECK(fd >= 0);
+    CHECK_EQUAL(0, sensorfile_pread_u64(fd, &val));
+    CHECK_EQUAL(12345u, val);
+    write_file("7\n", 2);
+    CHECK_EQUAL(0, sensorfile_pread_u64(fd, &val));
+    CHECK_EQUAL(7u, val);
+    write_file("N/A\n", 4);
+    CHECK_EQUAL(EINVAL, sensorfile_pread_u64(fd, &val));
+    CHECK_EQUAL(7u, val);
+    close(fd);
+};
+
+int main(int argc, char** argv)
+{
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
@@ -0,0 +1,164 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+// Copyright (c) 2013-2023
+//   Research Computing Center Lomonosov Moscow State University
+
+/*
+ * Helpers for tests of sensor modules. The module source is included
+ * into the test before this header, its node is run without the core
+ * graph: the out hook has a single peer which keeps the last data sent.
+ * Fixture trees may be created in a temporary directory.
+ *
+ * Data is allocated by core objects and freed by the module and the test,
+ * so tests undefine CppUTest malloc macros before including the module.
+ */
+
+#ifndef TESTS_SENSORTEST_H_
+#define TESTS_SENSORTEST_H_
+
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "dmm_base.h"
+#include "dmm_message.h"
+
+struct sensortest {
+    struct dmm_node node;
+    struct dmm_hook out;
+    struct dmm_hook in;
+    struct dmm_hookpeer *peer;
+    /* Last data received from out, with reference */
+    dmm_data_p data;
+};
+
+static struct sensortest *sensortest_current;
+
+static int sensortest_rcvdata(dmm_hook_p hook, dmm_data_p data)
+{
+    (void)hook;
+    if (sensortest_current->data != NULL)
+        DMM_DATA_UNREF(sensortest_current->data);
+    sensortest_current->data = data;
+    return 0;
+}
+
+/* Create node of type, connect its hook "out" if connect is true */
+static inline void sensortest_init(struct sensortest *st, struct dmm_type *type, bool connect)
+{
+    memset(st, 0, sizeof(*st));
+    sensortest_current = st;
+    st->node.nd_id = 1;
+    st->node.nd_type = type;
+    st->node.nd_refs = 1;
+    LIST_INIT(&st->node.nd_inhooks);
+    LIST_INIT(&st->node.nd_outhooks);
+    LIST_INIT(&st->node.nd_events);
+    if (type->ctor(&st->node) != 0)
+        abort();
+    if (!connect)
+        return;
+
+    strcpy(st->out.hk_name, "out");
+    st->out.hk_flags = DMM_HOOK_OUT;
+    st->out.hk_node = &st->node;
+    st->out.hk_refs = 1;
+    LIST_INIT(&st->out.hk_peers);
+    strcpy(st->in.hk_name, "in");
+    st->in.hk_flags = DMM_HOOK_IN;
+    st->in.hk_node = &st->node;
+    st->in.hk_rcvdata = sensortest_rcvdata;
+    st->in.hk_refs = 1;
+    LIST_INIT(&st->in.hk_peers);
+    if ((st->peer = (struct dmm_hookpeer *)malloc(sizeof(*st->peer))) == NULL)
+        abort();
+    st->peer->hp_peer = &st->in;
+    st->peer->hp_nmask = 0;
+    LIST_INSERT_HEAD(&st->out.hk_peers, st->peer, hp_peerlist);
+    if (type->newhook(&st->out) != 0)
+        abort();
+}
+
+static inline void sensortest_fini(struct sensortest *st)
+{
+    if (st->peer != NULL) {
+        st->node.nd_type->rmhook(&st->out);
+        free(st->peer);
+    }
+    st->node.nd_type->dtor(&st->node);
+    if (st->data != NULL)
+        DMM_DATA_UNREF(st->data);
+    sensortest_current = NULL;
+}
+
+/*
+ * Pass message cmd of type with len bytes of payload to the node,
+ * return rcvmsg() result. The response goes to node 0 and is dropped
+ */
+static inline int sensortest_msg(struct sensortest *st, uint32_t type, uint32_t cmd,
+                                 const void *payload, dmm_size_t len)
+{
+    dmm_msg_p msg;
+
+    if ((msg = DMM_MSG_CREATE(0, cmd, type, 0, 0, len)) == NULL)
+        abort();
+    memcpy(DMM_MSG_DATA(msg, char), payload, len);
+    return st->node.nd_type->rcvmsg(&st->node, msg);
+}
+
+/* Datanode of sensor id in the last data or NULL */
+static inline dmm_datanode_p sensortest_find(struct sensortest *st, dmm_sensorid_t id)
+{
+    dmm_datanode_p dn;
+
+    if (st->data == NULL)
+        return NULL;
+    for (dn = DMM_DATA_NODES(st->data); !DMM_DN_ISEND(dn); DMM_DN_ADVANCE(dn))
+        if (dn->dn_sensor == id)
+            return dn;
+    return NULL;
+}
+
+/* Create a temporary directory for a fixture tree in root (PATH_MAX bytes) */
+static inline void sensortest_mkroot(char *root)
+{
+    strcpy(root, "/tmp/sensortestXXXXXX");
+    if (mkdtemp(root) == NULL)
+        abort();
+}
+
+/* Write contents to root/path creating missing directories */
+static inline void sensortest_write(const char *root, const char *path, const char *contents)
+{
+    char full[PATH_MAX];
+    char *p;
+    FILE *f;
+
+    snprintf(full, sizeof(full), "%s/%s", root, path);
+    for (p = full + strlen(root) + 1; (p = strchr(p, '/')) != NULL; ++p) {
+        *p = '\0';
+        mkdir(full, 0755);
+        *p = '/';
+    }
+    if ((f = fopen(full, "w")) == NULL)
+        abort();
+    fputs(contents, f);
+    fclose(f);
+}
+
+static int sensortest_rmentry(const char *path, const struct stat *sb, int flag, struct FTW *ftw)
+{
+    (void)sb;
+    (void)flag;
+    (void)ftw;
+    return remove(path);
+}
+
+static inline void sensortest_rmroot(const char *root)
+{
+    nftw(root, sensortest_rmentry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+#endif /* TESTS_SENSORTEST_H_ */